@@ -43,6 +43,10 @@ namespace fc
 
   // 根据 code 参数来把对应的助记符写入到 buf 中，同时返回该指令的长度
   uint8_t disassemble(nes_code code, char buf[]);
+  // opcode 的寻址模式（nes_6502_addressing_mode）
+  uint8_t addressing_mode(uint8_t opcode);
+  // 寻址模式的简称，如 "abx"
+  const char* addressing_mode_name(uint8_t mode);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include <cstdlib>
+#include "nes_cpu.h"
+
+#ifndef NES_ALU_H
+#define NES_ALU_H
+
+namespace fc
+{
+  // 预先计算的 ALU 结果与标记，让 ALU 指令不再按数据分支
+  /*
+    二进制模式下 A - v - !c 与 A + ~v + c 的结果及 C/V/Z/N 完全相同，
+    因此 SBC 查 adc[c][A][~v]，CMP/CPX/CPY 查 adc[1][r][~v] 并只取 C/Z/N，
+    一张 128K 项的表覆盖了加减与比较。
+  */
+  struct nes_alu_tables {
+    // 每个值对应的 Z/N 标记
+    uint8_t zn[256];
+    // A + v + c 的结果（低 8 位）与 C/V/Z/N 标记（高 8 位），以 [c][A][v] 为下标
+    uint16_t adc[2][256][256];
+
+    nes_alu_tables();
+  };
+
+  // 在静态初始化时生成，main 之前不要执行 CPU
+  extern const nes_alu_tables nes_alu;
+
+  // 以下在 p 中更新对应的标记，其余标记不变
+  // 按 r 设置 Z/N
+  inline uint8_t nes_alu_zn(uint8_t p, uint8_t r) {
+    return (p & ~(SFC_FLAG_Z | SFC_FLAG_N)) | nes_alu.zn[r];
+  }
+  // 带进位加法，返回结果
+  inline uint8_t nes_alu_adc(uint8_t& p, uint8_t a, uint8_t v) {
+    const uint16_t e = nes_alu.adc[p & SFC_FLAG_C][a][v];
+    p = (p & ~(SFC_FLAG_C | SFC_FLAG_V | SFC_FLAG_Z | SFC_FLAG_N)) | e >> 8;
+    return (uint8_t)e;
+  }
+  // 带借位减法，返回结果
+  inline uint8_t nes_alu_sbc(uint8_t& p, uint8_t a, uint8_t v) {
+    return nes_alu_adc(p, a, ~v);
+  }
+  // 比较 r 与 v
+  inline void nes_alu_cmp(uint8_t& p, uint8_t r, uint8_t v) {
+    const uint8_t flags = nes_alu.adc[1][r][(uint8_t)~v] >> 8;
+    p = (p & ~(SFC_FLAG_C | SFC_FLAG_Z | SFC_FLAG_N)) | (flags & (SFC_FLAG_C | SFC_FLAG_Z | SFC_FLAG_N));
+  }
+  // 移位与循环移位，移出的位进入 CF，返回结果
+  inline uint8_t nes_alu_asl(uint8_t& p, uint8_t v) {
+    const uint8_t r = v << 1;
+    p = (p & ~(SFC_FLAG_C | SFC_FLAG_Z | SFC_FLAG_N)) | v >> 7 | nes_alu.zn[r];
+    return r;
+  }
+  inline uint8_t nes_alu_lsr(uint8_t& p, uint8_t v) {
+    const uint8_t r = v >> 1;
+    p = (p & ~(SFC_FLAG_C | SFC_FLAG_Z | SFC_FLAG_N)) | (v & 1) | nes_alu.zn[r];
+    return r;
+  }
+  inline uint8_t nes_alu_rol(uint8_t& p, uint8_t v) {
+    const uint8_t r = v << 1 | (p & SFC_FLAG_C);
+    p = (p & ~(SFC_FLAG_C | SFC_FLAG_Z | SFC_FLAG_N)) | v >> 7 | nes_alu.zn[r];
+    return r;
+  }
+  inline uint8_t nes_alu_ror(uint8_t& p, uint8_t v) {
+    const uint8_t r = v >> 1 | (p & SFC_FLAG_C) << 7;
+    p = (p & ~(SFC_FLAG_C | SFC_FLAG_Z | SFC_FLAG_N)) | (v & 1) | nes_alu.zn[r];
+    return r;
+  }
+}
+
+#endif
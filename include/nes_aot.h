@@ -0,0 +1,211 @@
+#include <cstdlib>
+#include <string>
+
+#ifndef NES_AOT_H
+#define NES_AOT_H
+
+// 预编译模块接口的版本，接口或生成代码的约定有不兼容的改动时加 1
+#define SFC_AOT_ABI_VERSION 3
+// 预编译模块导出的入口函数名
+#define SFC_AOT_ENTRY "sfc_aot_entry"
+// 块缓存索引文件的格式版本
+#define SFC_BLOCK_CACHE_VERSION 1
+
+// NROM 的 PRG-ROM 预先翻译成 C++ 后编译成的共享库（由 tools/aot.cpp 生成）
+/*
+  每个基本块是一个函数，执行时直接读写 CPU 的寄存器与周期计数，
+  与解释器的约定相同：
+    - 指令开始时先计入基础周期，跨页与分支的额外周期在指令结束时计入
+    - 每条指令之后检查周期是否到达 stop，到达时写回下一条指令的地址并返回
+    - 只访问页表中的普通内存，I/O 与观察点所在的页通过 read/write 回到内存池，
+      PRG-ROM 的页只读，写入同样交给内存池
+  块结束时 pc 为下一条要执行的指令，由 nes_cpu 查表继续执行下一个块，
+  查不到的地址（间接跳转的目标、RAM 中的代码、未翻译的指令）交给解释器。
+  生成的代码只依赖本文件，不依赖模拟器的其它头文件。
+*/
+extern "C" {
+  // 与 fc::nes_registers 的布局相同
+  struct sfc_aot_registers {
+    uint16_t pc;
+    uint8_t p, a, x, y, sp;
+    uint8_t unused;
+  };
+
+  // 块执行时需要的全部状态
+  struct sfc_aot_context {
+    sfc_aot_registers* regs;
+    // CPU 周期计数与本批次的结束周期，stop 可能在访问 I/O 时被提前
+    uint64_t* cycle;
+    const uint64_t* stop;
+    // 每 256 字节一页的页表，为 NULL 的页调用 read/write
+    uint8_t* const* pages;
+    // 栈所在的 $0100-$01FF
+    uint8_t* stack;
+    // 传给 read/write 的内存池
+    void* memory;
+    uint8_t (*read)(void* memory, uint16_t addr);
+    void (*write)(void* memory, uint16_t addr, uint8_t data);
+    // BNE 从 next 向回跳转到 head 之后调用，让 CPU 与解释器一样尝试整块执行循环惯用法
+    void* cpu;
+    void (*loop)(void* cpu, uint16_t head, uint16_t next);
+  };
+
+  // 一个基本块
+  typedef void (*sfc_aot_block)(sfc_aot_context* c);
+
+  // 块的入口地址、翻译的字节数与函数
+  struct sfc_aot_entry_point {
+    uint16_t pc;
+    uint16_t length;
+    sfc_aot_block block;
+  };
+
+  // 模块的描述
+  struct sfc_aot_module {
+    // 等于 SFC_AOT_ABI_VERSION
+    uint32_t abi_version;
+    // 翻译时 PRG-ROM 的 nes_hash64，加载时用来确认是同一个 ROM
+    uint64_t prg_hash;
+    // PRG-ROM 的字节数（16K 或 32K）
+    uint32_t prg_size;
+    // 块的数量与列表
+    uint32_t count;
+    const sfc_aot_entry_point* blocks;
+  };
+
+  // 模块的入口
+  const sfc_aot_module* sfc_aot_entry();
+}
+
+// 以下供生成的代码使用，cyc 为块内缓存的周期数，调用内存池前后与 *c->cycle 同步
+static inline uint8_t sfc_aot_read(sfc_aot_context* c, uint64_t& cyc, uint16_t addr) {
+  const uint8_t* page = c->pages[addr >> 8];
+  if (page) return page[addr & 0xff];
+  *c->cycle = cyc;
+  const uint8_t data = c->read(c->memory, addr);
+  cyc = *c->cycle;
+  return data;
+}
+
+static inline void sfc_aot_write(sfc_aot_context* c, uint64_t& cyc, uint16_t addr, uint8_t data) {
+  uint8_t* page = c->pages[addr >> 8];
+  // PRG-ROM 的页只用于读取，写入交给内存池忽略
+  if (page && addr < 0x8000) {
+    page[addr & 0xff] = data;
+    return;
+  }
+  *c->cycle = cyc;
+  c->write(c->memory, addr, data);
+  cyc = *c->cycle;
+}
+
+// 按 data 设置 Z 与 N
+static inline void sfc_aot_zn(sfc_aot_registers* r, uint8_t data) {
+  r->p = (r->p & 0x7d) | (data & 0x80) | (data? 0: 0x02);
+}
+
+// 写回 PC 与周期后离开块
+#define SFC_AOT_EXIT(next) do { r->pc = (next); *c->cycle = cyc; return; } while (0)
+// 非最后一条指令之后：到达批次的结束周期时离开块
+#define SFC_AOT_CHECK(next) if (cyc >= *c->stop) SFC_AOT_EXIT(next)
+// 向回跳转的 BNE 成立后离开块，由 CPU 决定是否整块执行剩余的迭代
+#define SFC_AOT_LOOP(head, next) do { r->pc = (head); *c->cycle = cyc; c->loop(c->cpu, (head), (next)); return; } while (0)
+
+namespace fc
+{
+  // 模拟器的构建标识，由编译时间、编译器版本与各个格式版本散列而来，可用 -DSFC_BUILD_ID=... 指定
+  uint64_t nes_build_id();
+
+  // 块缓存索引文件的文件头
+  struct nes_block_cache_header {
+    // "SFCBLK1"
+    char magic[8];
+    // 等于 SFC_BLOCK_CACHE_VERSION
+    uint32_t version;
+    // 记录数
+    uint32_t count;
+    // 写入时的 nes_build_id()
+    uint64_t build_id;
+    // PRG-ROM 的 nes_hash64 与字节数
+    uint64_t prg_hash;
+    uint32_t prg_size;
+    uint32_t reserved;
+  };
+
+  // 块缓存索引中的一条记录，按 pc 升序排列
+  struct nes_block_record {
+    // 块的入口地址与翻译的字节数
+    uint16_t pc;
+    uint16_t length;
+    // 在模块块列表中的下标
+    uint32_t index;
+    // 这些字节的 nes_hash64
+    uint64_t hash;
+  };
+
+  // 加载预编译模块，并按 PC 建立块的查找表
+  /*
+    块缓存目录中每个 ROM 有两个文件，文件名为 <PRG 哈希>-<构建标识>：
+      .so  预编译模块
+      .blk 块索引：nes_block_cache_header 之后是 nes_block_record 数组
+    从缓存加载时只检查文件头，索引以 mmap 只读映射，查找表起初为空；
+    某个地址第一次要执行块时才核对记录、模块与 PRG-ROM 中这段字节的哈希，
+    一致才填入查找表，否则该地址以后一直交给解释器。
+  */
+  class nes_aot
+  {
+  private:
+    // dlopen 的句柄
+    void* handle;
+    // 模块的描述
+    const sfc_aot_module* module;
+    // $8000-$FFFF 每个地址上的块，没有则为 NULL
+    sfc_aot_block* table;
+    // 块的数量
+    uint32_t count;
+    // 模块对应的 PRG-ROM
+    const uint8_t* prg;
+    size_t prg_size;
+    // 从缓存加载时映射的索引文件及其长度
+    const uint8_t* index_map;
+    size_t index_size;
+    // 每个地址是否有尚未核对的记录，不是从缓存加载时为 NULL
+    bool* pending;
+    // 已核对的块数与核对失败的块数
+    uint32_t validated;
+    uint32_t rejected;
+
+    // 打开模块并检查接口版本与 PRG-ROM
+    bool open_module(const char* path, const char** error);
+    // 第一次执行 pc 处的块之前核对索引中的记录
+    bool validate_block(uint16_t pc);
+
+  public:
+    nes_aot(): handle(NULL), module(NULL), table(NULL), count(0), prg(NULL), prg_size(0),
+      index_map(NULL), index_size(0), pending(NULL), validated(0), rejected(0) {}
+    ~nes_aot() { unload(); }
+    // 加载 path，模块的 PRG-ROM 哈希须与 prg 的一致，失败时 error 指向原因
+    bool load(const char* path, const uint8_t* prg, size_t prg_size, const char** error = NULL);
+    // 从块缓存目录 dir 加载该 PRG-ROM 的模块与索引，没有或已失效时返回 false
+    bool load_cache(const char* dir, const uint8_t* prg, size_t prg_size, const char** error = NULL);
+    // 把已加载模块的块索引写入 dir，模块本身须已放在 cache_path(dir, ..., ".so")
+    bool save_cache(const char* dir);
+    // 块缓存目录中该 PRG-ROM 的文件路径，ext 为 ".so" 或 ".blk"
+    static std::string cache_path(const char* dir, const uint8_t* prg, size_t prg_size, const char* ext);
+    // 卸载
+    void unload();
+    // 是否已加载
+    bool loaded() { return table != NULL; }
+    // 块的查找表，以 pc - $8000 为下标
+    const sfc_aot_block* get_table() { return table; }
+    // 查找表中 pc 处没有块时调用：有尚未核对的记录则核对，通过后填入查找表并返回 true
+    bool validate(uint16_t pc) { return pending && pending[pc & 0x7fff] && validate_block(pc); }
+    // 块的数量
+    uint32_t get_count() { return count; }
+    // 从缓存加载后已核对的块数与核对失败的块数
+    uint32_t get_validated() { return validated; }
+    uint32_t get_rejected() { return rejected; }
+  };
+}
+
+#endif
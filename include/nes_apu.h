@@ -0,0 +1,262 @@
+#include <cstdlib>
+#include "./nes_scheduler.h"
+#include "./nes_blip.h"
+
+#ifndef NES_APU_H
+#define NES_APU_H
+
+// CPU 的时钟频率（NTSC）
+#define SFC_CPU_CLOCK_RATE 1789773.0
+// 默认的输出采样率
+#define SFC_APU_SAMPLE_RATE 48000
+
+namespace fc
+{
+  class nes_memory_pool;
+
+  // 包络单元，方波与噪声共用
+  struct nes_apu_envelope
+  {
+    // 下一次 1/4 帧时钟时重新开始
+    bool start;
+    // 循环（同时也是长度计数器的暂停位）
+    bool loop;
+    // 使用固定音量
+    bool constant;
+    // 固定音量或分频器的周期
+    uint8_t volume;
+    // 分频器
+    uint8_t divider;
+    // 衰减计数，15-0
+    uint8_t decay;
+
+    // 1/4 帧时钟
+    void clock();
+    // 当前音量
+    uint8_t output() { return constant? volume: decay; }
+  };
+
+  // 方波声道
+  struct nes_apu_pulse
+  {
+    nes_apu_envelope envelope;
+    // 占空比，0-3
+    uint8_t duty;
+    // 序列器位置，0-7
+    uint8_t position;
+    // 扫描单元
+    bool sweep_enabled;
+    bool sweep_negate;
+    bool sweep_reload;
+    uint8_t sweep_period;
+    uint8_t sweep_shift;
+    uint8_t sweep_divider;
+    // 1 号方波的扫描单元以反码做减法
+    bool ones_complement;
+    // 计时器周期，11 位
+    uint16_t timer;
+    // 长度计数器
+    uint8_t length;
+    // 计时器下一次到期的 CPU 周期
+    uint64_t next_clock;
+
+    // 扫描单元的目标周期
+    int sweep_target();
+    // 是否被计时器周期或扫描目标静音
+    bool muted() { return timer < 8 || sweep_target() > 0x7ff; }
+    // 计时器到期的间隔（CPU 周期）
+    uint64_t period() { return (timer + 1) * 2; }
+    // 当前输出，0-15
+    uint8_t output();
+  };
+
+  // 三角波声道
+  struct nes_apu_triangle
+  {
+    // 控制位（同时也是长度计数器的暂停位）
+    bool control;
+    // 线性计数器
+    bool linear_reload;
+    uint8_t linear_reload_value;
+    uint8_t linear;
+    // 序列器位置，0-31
+    uint8_t position;
+    // 计时器周期，11 位
+    uint16_t timer;
+    // 长度计数器
+    uint8_t length;
+    // 计时器下一次到期的 CPU 周期
+    uint64_t next_clock;
+
+    // 序列器是否前进（周期过小的超声波直接保持不动）
+    bool active() { return length && linear && timer >= 2; }
+    // 当前输出，0-15
+    uint8_t output();
+  };
+
+  // 噪声声道
+  struct nes_apu_noise
+  {
+    nes_apu_envelope envelope;
+    // 短周期模式
+    bool mode;
+    // 周期的序号，0-15
+    uint8_t period_index;
+    // 15 位线性反馈移位寄存器
+    uint16_t shift;
+    // 长度计数器
+    uint8_t length;
+    // 计时器下一次到期的 CPU 周期
+    uint64_t next_clock;
+
+    // 当前输出，0-15
+    uint8_t output() { return (shift & 1) || !length? 0: envelope.output(); }
+  };
+
+  // 增量调制（DMC）声道
+  struct nes_apu_dmc
+  {
+    bool irq_enabled;
+    bool loop;
+    // 速率的序号，0-15
+    uint8_t rate_index;
+    // 输出电平，0-127
+    uint8_t level;
+    // 采样的起始地址与长度
+    uint16_t sample_addr;
+    uint16_t sample_length;
+    // 下一个要读取的地址与剩余字节数
+    uint16_t addr;
+    uint16_t bytes_remaining;
+    // 输出单元
+    uint8_t shift;
+    uint8_t bits;
+    bool silence;
+    // 采样缓冲
+    uint8_t buffer;
+    bool buffer_full;
+    // 计时器下一次到期的 CPU 周期
+    uint64_t next_clock;
+  };
+
+  // 音频处理器，与 PPU 一样按需追赶 CPU 的周期
+  /*
+    帧计数器：
+      - 4 步模式在第 7457/14913/22371/29829 周期各产生一次 1/4 帧时钟，
+        第 2、4 步同时产生 1/2 帧时钟，第 4 步在未禁止时置位帧中断
+      - 5 步模式的第 4 步在第 37281 周期，不产生帧中断
+    声道不逐周期产生采样：
+      - 追赶时每个声道从自己计时器的下一次到期跳到下一次到期，
+        静音的声道直接按周期数算出序列器位置
+      - 寄存器写入与帧计数器时钟都发生在追赶到的周期上
+      - 混音后的振幅只在变化时作为带时间戳的增量送入带限阶跃缓冲，
+        每帧结束时整块生成输出采样
+    混音按非线性公式预先算成两张表，因此增量精确反映了声道之间的相互影响。
+  */
+  class nes_apu
+  {
+  friend struct nes_machine;
+  private:
+    // $4000-$4017 最近一次写入的值
+    uint8_t regs[0x18];
+    // 已同步到的 CPU 周期
+    uint64_t synced_cycle;
+    // 帧计数器当前序列开始的 CPU 周期
+    uint64_t sequence_start;
+    // 帧计数器下一步的序号，0-3
+    uint8_t step;
+    // 是否为 5 步模式
+    bool five_step;
+    // 是否禁止帧中断
+    bool irq_inhibit;
+    // 帧中断标记
+    bool frame_irq;
+    // DMC 中断标记
+    bool dmc_irq;
+    // 事件时间线
+    nes_scheduler* scheduler;
+    // DMC 读取采样用的内存
+    nes_memory_pool* memory;
+
+    nes_apu_pulse pulse[2];
+    nes_apu_triangle triangle;
+    nes_apu_noise noise;
+    nes_apu_dmc dmc;
+    // DMC 读取的字节总数
+    uint64_t dmc_fetches;
+
+    // 各声道当前的输出：方波 1、方波 2、三角波、噪声、DMC
+    uint8_t outputs[5];
+    // 混音后的振幅
+    int32_t amplitude;
+    // 是否生成采样
+    bool output_enabled;
+    // 本帧音频开始的 CPU 周期
+    uint64_t frame_start;
+    // 带限阶跃缓冲，在 machine 之外按需分配，从未生成采样时为 NULL
+    nes_blip_buffer* blip = NULL;
+    // 输出采样率
+    uint32_t sample_rate;
+
+    // 帧计数器第 step 步相对序列开始的周期
+    uint64_t step_cycle(uint8_t step);
+    // 处理帧计数器的一步
+    void run_step();
+    // 1/4 帧时钟（包络、线性计数器）
+    void clock_quarter();
+    // 1/2 帧时钟（长度计数器、扫描单元）
+    void clock_half();
+    // 按当前状态在时间线上重新预定帧中断事件
+    void reschedule();
+    // 按当前状态在时间线上重新预定 DMC 中断事件
+    void reschedule_dmc();
+
+    // 把所有声道推进到 CPU 的第 cycle 个周期
+    void run_channels(uint64_t cycle);
+    void run_pulse(int i, uint64_t cycle);
+    void run_triangle(uint64_t cycle);
+    void run_noise(uint64_t cycle);
+    void run_dmc(uint64_t cycle);
+    // DMC 的采样缓冲为空时读取下一个字节
+    void fetch_dmc();
+    // 重新开始 DMC 采样
+    void restart_dmc();
+    // 在第 cycle 个周期把声道 channel 的输出设为 value
+    void set_output(int channel, uint8_t value, uint64_t cycle);
+    // 状态改变后在第 cycle 个周期刷新所有声道的输出
+    void refresh_outputs(uint64_t cycle);
+
+  public:
+    ~nes_apu() { delete blip; }
+    // 恢复上电状态，并绑定事件时间线与 DMC 读取采样用的内存，采样输出默认关闭
+    void init(nes_scheduler* scheduler, nes_memory_pool* memory);
+    // 设置输出采样率，清空未读取的采样
+    void set_sample_rate(uint32_t rate);
+    // 追赶到 CPU 的第 cpu_cycle 个周期
+    void catch_up(uint64_t cpu_cycle);
+    // 读取寄存器（$4015）
+    uint8_t read_register(uint16_t addr);
+    // 写入寄存器（$4000-$4013, $4015, $4017）
+    void write_register(uint16_t addr, uint8_t data);
+    // 下一次帧中断的 CPU 周期，不会产生时返回 UINT64_MAX
+    uint64_t next_event_cycle();
+    // 帧中断或 DMC 中断是否有效
+    bool irq() { return frame_irq || dmc_irq; }
+    // 开启或关闭采样输出，关闭时声道照常运行但不生成采样，第一次开启时分配缓冲
+    void set_output(bool enabled);
+    // 追赶到第 cpu_cycle 个周期并结束一帧音频，返回可读取的采样数
+    uint32_t end_frame(uint64_t cpu_cycle);
+    // 读取最多 max 个采样，返回实际读取的个数
+    uint32_t read_samples(int16_t* out, uint32_t max) { return blip? blip->read_samples(out, max): 0; }
+    // 可读取的采样数
+    uint32_t samples_avail() { return blip? blip->samples_avail(): 0; }
+    // 输出采样率
+    uint32_t get_sample_rate() { return sample_rate; }
+    // DMC 读取的字节总数
+    uint64_t get_dmc_fetches() { return dmc_fetches; }
+    // 在 machine 之外分配的字节数
+    size_t allocated_bytes() { return blip? sizeof(nes_blip_buffer): 0; }
+  };
+}
+
+#endif
@@ -0,0 +1,57 @@
+#include <cstdlib>
+
+#ifndef NES_BLIP_H
+#define NES_BLIP_H
+
+// 每个阶跃的带限核长度（采样）
+#define SFC_BLIP_TAPS 16
+// 一个采样内的相位数
+#define SFC_BLIP_PHASES 64
+// 核的定点精度，每个相位的各抽头之和为 1 << SFC_BLIP_KERNEL_BITS
+#define SFC_BLIP_KERNEL_BITS 14
+// 缓冲区能容纳的采样数
+#define SFC_BLIP_CAPACITY 8192
+
+namespace fc
+{
+  // 带限阶跃缓冲，把 CPU 时钟域中的振幅变化直接重采样到输出采样率
+  /*
+    声道只在输出振幅变化时调用 add_delta(time, delta)，而不是每个周期计算一个采样：
+      - time 为本帧开始后的 CPU 周期，按定点比例换算成输出采样的位置与相位
+      - 把对应相位的窗口化 sinc 核（带限阶跃的导数）乘以 delta 累加到缓冲区
+      - 读取时对缓冲区积分得到振幅，同时用漏积分去掉直流分量
+    核的累加在 x86 上用 SSE2 一次处理 8 个抽头。
+  */
+  class nes_blip_buffer
+  {
+  private:
+    // 采样位置的定点换算系数：每个时钟对应的采样数 * 2^32
+    uint64_t factor;
+    // 本帧开始处的采样位置（定点，整数部分相对 avail）
+    uint64_t offset;
+    // 已经完成、可以读取的采样数
+    uint32_t avail;
+    // 积分器状态
+    int32_t integrator;
+    // 各相位的核
+    int16_t kernel[SFC_BLIP_PHASES][SFC_BLIP_TAPS];
+    // 振幅变化的导数，末尾留出一个核的长度
+    int32_t buf[SFC_BLIP_CAPACITY + SFC_BLIP_TAPS];
+
+  public:
+    // 设置时钟频率与采样率，并清空缓冲
+    void init(double clock_rate, double sample_rate);
+    // 清空缓冲
+    void clear();
+    // 在本帧第 time 个时钟处加入振幅变化 delta（|delta| < 32768）
+    void add_delta(uint32_t time, int32_t delta);
+    // 结束长度为 time 个时钟的一帧，其中的采样变为可读
+    void end_frame(uint32_t time);
+    // 可读的采样数
+    uint32_t samples_avail() { return avail; }
+    // 读取最多 max 个采样，返回实际读取的个数
+    uint32_t read_samples(int16_t* out, uint32_t max);
+  };
+}
+
+#endif
@@ -0,0 +1,174 @@
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "./nes_pipeline.h"
+#include "./nes_palette.h"
+
+#ifndef NES_CAPTURE_H
+#define NES_CAPTURE_H
+
+// 流式写文件的默认缓冲区大小
+#define SFC_STREAM_CHUNK (4 * 1024 * 1024)
+// 缓冲区与直接 IO 的对齐
+#define SFC_STREAM_ALIGN 4096
+
+namespace fc
+{
+  // 顺序写文件，两块对齐的大缓冲轮流填充与落盘
+  /*
+    生产者把数据拷进当前缓冲，写满后交给 IO 线程并换到另一块继续填充，
+    只有在上一块尚未写完时才需要等待。
+    整块的写入大小与偏移都是 SFC_STREAM_ALIGN 的倍数，因此可以使用 O_DIRECT 绕过页缓存；
+    文件系统不支持时退回普通写入，并在每块写完后用 posix_fadvise 丢弃其页缓存。
+    写入出错（磁盘已满、EIO 等）时记录 errno 并停止写入，之后追加的数据被丢弃，
+    由 get_error 与 close 的返回值报告。
+  */
+  class nes_stream_writer
+  {
+  private:
+    int fd = -1;
+    // 是否以 O_DIRECT 打开
+    bool direct = false;
+    // 每块缓冲的大小
+    size_t chunk = 0;
+    // 两块缓冲，current 为正在填充的一块
+    uint8_t* buffers[2] = { NULL, NULL };
+    int current = 0;
+    // 当前缓冲已填充的字节数
+    size_t fill = 0;
+    // 已交给 IO 线程的字节数（即下一块的文件偏移）
+    uint64_t submitted = 0;
+
+    // 交给 IO 线程的缓冲，NULL 表示空闲
+    uint8_t* pending = NULL;
+    uint64_t pending_offset = 0;
+    bool stopping = false;
+    std::mutex lock;
+    std::condition_variable cond;
+    std::thread io;
+
+    // 生产者等待 IO 线程的时间与 IO 线程写入的时间（纳秒）
+    uint64_t wait_ns = 0;
+    uint64_t write_ns = 0;
+    // 第一次写入失败的 errno，0 表示没有出错，由 lock 保护
+    int error = 0;
+
+    // IO 线程主循环
+    void run();
+    // 把当前缓冲交给 IO 线程
+    void submit();
+    // 等待 IO 线程空闲
+    void wait_idle();
+    // 记录 e（非 0 时），只保留第一次的错误
+    void set_error(int e);
+
+  public:
+    ~nes_stream_writer() { close(); }
+    // 创建文件，chunk 会向上取整到 SFC_STREAM_ALIGN 的倍数，返回是否成功
+    bool open(const char* path, size_t chunk = SFC_STREAM_CHUNK);
+    // 追加数据
+    void write(const void* data, size_t size);
+    // 把已追加的数据全部落盘，此后可以用 write_at 修改已写入的内容
+    void flush();
+    // 在 offset 处覆盖写入（用于回填文件头），需先 flush
+    void write_at(uint64_t offset, const void* data, size_t size);
+    // 落盘并关闭文件，返回全部数据是否都已写入
+    bool close();
+    // 第一次写入失败的 errno，0 表示没有出错，关闭后保留到下一次 open
+    int get_error();
+    bool failed() { return get_error() != 0; }
+    // 已追加的总字节数
+    uint64_t size() { return submitted + fill; }
+    // 是否使用了 O_DIRECT
+    bool is_direct() { return direct; }
+    // 生产者因 IO 未完成而等待的时间（纳秒）
+    uint64_t get_wait_ns() { return wait_ns; }
+    // IO 线程写入所用的时间（纳秒）
+    uint64_t get_write_ns() { return write_ns; }
+  };
+
+  // 把画面写成 YUV4MPEG2（.y4m）文件，色度为居中采样的 4:2:0
+  class nes_y4m_writer
+  {
+  private:
+    nes_stream_writer stream;
+    nes_color_converter converter;
+    nes_video_target target;
+    // 一帧 YUV 的缓冲
+    uint8_t* frame = NULL;
+    size_t frame_size = 0;
+    uint64_t frames = 0;
+
+  public:
+    ~nes_y4m_writer() { close(); }
+    // 创建文件并写入文件头，scale 为 1-3 的整数放大倍数
+    bool open(const char* path, int scale = 1);
+    // 追加一帧
+    void write_frame(const uint8_t* pixels, const uint8_t* emphasis);
+    // 关闭文件，返回全部数据是否都已写入
+    bool close();
+    uint64_t get_frames() { return frames; }
+    nes_stream_writer& get_stream() { return stream; }
+  };
+
+  // 把 16 位单声道采样写成 WAV 文件，关闭时回填文件头中的长度
+  class nes_wav_writer
+  {
+  private:
+    nes_stream_writer stream;
+    uint32_t sample_rate = 0;
+    uint64_t samples = 0;
+
+    // 按当前长度生成 44 字节的文件头
+    void make_header(uint8_t* header);
+
+  public:
+    ~nes_wav_writer() { close(); }
+    bool open(const char* path, uint32_t sample_rate);
+    // 追加采样
+    void write_samples(const int16_t* data, uint32_t count);
+    // 回填文件头并关闭文件，返回全部数据是否都已写入
+    bool close();
+    uint64_t get_samples() { return samples; }
+    nes_stream_writer& get_stream() { return stream; }
+  };
+
+  // 把流水线的画面与音频录制到文件
+  /*
+    画面与音频各占流水线的一个阶段，颜色转换与写文件都在消费线程中进行，
+    模拟线程只负责把数据拷进队列。
+  */
+  class nes_av_capture
+  {
+  private:
+    nes_y4m_writer video;
+    nes_wav_writer audio;
+    bool has_video = false;
+    bool has_audio = false;
+
+    static void on_frame(void* ctx, const nes_video_frame& frame);
+    static void on_audio(void* ctx, const nes_audio_block& block);
+
+  public:
+    // 打开输出文件，路径为 NULL 的一路不录制，返回是否成功
+    bool open(const char* video_path, const char* audio_path,
+              uint32_t sample_rate, int scale = 1);
+    // 在流水线上添加录制阶段，需在 pipeline.start 之前调用
+    /*
+      默认队列满时阻塞而不丢帧，磁盘跟不上时模拟会被拖慢，
+      只在意实时性时可以改用 SFC_BP_DROP。
+    */
+    void attach(nes_av_pipeline& pipeline, uint32_t capacity = 64,
+                sfc_backpressure policy = SFC_BP_BLOCK);
+    // 关闭文件，需在 pipeline.stop 之后调用，返回全部数据是否都已写入
+    bool close();
+    // 第一次写入失败的 errno，0 表示没有出错
+    int get_error();
+    // 输出写入的数据量、IO 等待与写入错误
+    void print_stats(FILE* fp);
+  };
+}
+
+#endif
@@ -0,0 +1,18 @@
+#include <cstdlib>
+
+#ifndef NES_CLOCK_H
+#define NES_CLOCK_H
+
+namespace fc
+{
+  // CPU 的周期计数，内存池借助它让 I/O 设备追赶到当前周期
+  struct nes_clock
+  {
+    // 上电以来经过的 CPU 周期数
+    uint64_t cycle;
+    // 当前批次执行到的周期，设备的事件提前时会被调小以截断批次
+    uint64_t stop;
+  };
+}
+
+#endif
@@ -1,13 +1,21 @@
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include "nes_memory_pool.h"
+#include "nes_clock.h"
+#include "nes_aot.h"
 
 #ifndef NES_CPU_H
 #define NES_CPU_H
 
 #define OP_BUF_LEN 24
 
+// 插桩组合的数量
+#define SFC_TRACE_MODES 16
+
 namespace fc
 {
+  class nes_debugger;
 
   // 状态寄存器标记
   enum sfc_status_index {
@@ -35,27 +43,92 @@ namespace fc
       SFC_FLAG_N = SFC_FLAG_S,// 又叫(Negative Flag)
   };
 
+  // 解释器的插桩，可以任意组合
+  enum sfc_trace_flag {
+      SFC_TRACE_LOG      = 1 << 0,  // 每条指令前输出一行反汇编与寄存器
+      SFC_TRACE_PROFILE  = 1 << 1,  // 按指令地址统计执行次数与周期数
+      SFC_TRACE_COVERAGE = 1 << 2,  // 统计条件分支的覆盖率
+      SFC_TRACE_BREAK    = 1 << 3,  // 每条指令前检查 PC 断点
+  };
+
+  // 整块执行的循环惯用法
+  enum sfc_idiom_kind {
+      SFC_IDIOM_CLEAR,   // 以 0 填充
+      SFC_IDIOM_MEMSET,  // 以非 0 的值填充
+      SFC_IDIOM_MEMCPY,  // 逐字节复制
+      SFC_IDIOM_COUNT,
+  };
+
+  // 循环惯用法的统计
+  struct nes_idiom_stats {
+    // 整块执行的次数
+    uint64_t loops[SFC_IDIOM_COUNT];
+    // 因此不再逐条解释的指令数
+    uint64_t instructions[SFC_IDIOM_COUNT];
+  };
+
+  // 预编译块的统计
+  struct nes_aot_stats {
+    // 执行的块数
+    uint64_t blocks;
+    // 查不到块而交给解释器的指令数
+    uint64_t interpreted;
+  };
+
+  // CPU 寄存器
+  struct nes_registers {
+    // 指令计数器 PC
+    uint16_t program_counter;
+    // 状态寄存器
+    uint8_t status;
+    // 累加寄存器
+    uint8_t accumulator;
+    // X 变址寄存器
+    uint8_t x_index;
+    // Y 变址寄存器
+    uint8_t y_index;
+    // 栈指针
+    uint8_t stack_pointer;
+    // 对齐用
+    uint8_t unused;
+  };
+
   class nes_cpu
   {
+  friend struct nes_machine;
   private:
+    // 以下几项每条指令都会访问，放在最前面，同在 nes_machine 的第一个缓存行中
+    nes_registers registers;
+
+    // CPU 周期计数
+    nes_clock clock;
     nes_memory_pool* memory;
+    // 预编译块，为 NULL 时只用解释器
+    nes_aot* aot;
+    // 当前指令的寻址是否跨页
+    bool page_crossed;
+    // IRQ 线的电平，由 simulator 在批次边界上更新
+    bool irq_line;
+    // 当前启用的插桩，sfc_trace_flag 的组合
+    uint8_t trace_mode;
+    // 是否整块执行循环惯用法
+    bool idioms;
 
-    struct {
-      // 指令计数器 PC
-      uint16_t program_counter;
-      // 状态寄存器
-      uint8_t status;
-      // 累加寄存器
-      uint8_t accumulator;
-      // X 变址寄存器
-      uint8_t x_index;
-      // Y 变址寄存器
-      uint8_t y_index;
-      // 栈指针
-      uint8_t stack_pointer;
-      // 对齐用
-      uint8_t unused;
-    } registers;
+    // 指令日志的输出
+    FILE* trace_file;
+    // 每个指令地址的执行次数与周期数，各 65536 项
+    uint64_t* profile_hits;
+    uint64_t* profile_cycles;
+    // 分支覆盖率计数表
+    uint8_t* coverage;
+    // 计数表长度减 1（长度为 2 的幂）
+    uint32_t coverage_mask;
+    // 断点
+    nes_debugger* debugger;
+    // 循环惯用法的统计
+    nes_idiom_stats idiom_stats;
+    // 预编译块的统计
+    nes_aot_stats aot_stats;
 
     // 根据操作数来判断如何为 ZF 和 SF 置位
     void check_zf_and_sf(uint8_t);
@@ -63,6 +136,32 @@ namespace fc
     void stack_push(uint8_t);
     // 将栈顶元素出栈
     uint8_t stack_pop();
+    // 分支成立时跳转，并计入额外的周期
+    void branch_to(uint16_t);
+    // 以 Mode 中的插桩连续执行指令，每种组合各实例化一次
+    template <int Mode> void run_traced(uint64_t until);
+    // 各个实例，以插桩组合为下标
+    static void (nes_cpu::*const runners[SFC_TRACE_MODES])(uint64_t);
+    // 打开或关闭一种插桩
+    void set_trace_bit(int flag, bool on) { trace_mode = on? trace_mode | flag: trace_mode & ~flag; }
+    // 向 trace_file 输出当前指令的一行日志
+    void trace_line();
+    // 进入中断：压入 PC 与状态寄存器，置位 IF 并从 vector 读取新的 PC
+    void interrupt(uint16_t vector, uint8_t pushed_flags);
+    // 清除 IF 时若 IRQ 线有效，让 CPU 提前回到批次边界响应
+    void check_irq_unmasked();
+    // BNE 刚从 next 向回跳转到 head，若 [head, next) 是填充或复制循环则整块执行剩余的迭代
+    /*
+      识别的循环体（X/Y 须与步进的寄存器一致）：
+        [LDA abs,X | LDA abs,Y | LDA (zp),Y]  STA abs,X | STA abs,Y | STA (zp),Y  INX | DEX | INY | DEY  BNE head
+      只在循环位于 PRG-ROM、没有插桩、写入的页都是没有观察点的 RAM/SRAM 时进行，
+      最多执行到不越过 clock.stop 的整数次迭代，寄存器、标记与周期数与逐条解释完全一致。
+    */
+    void run_idiom(uint16_t head, uint16_t next);
+    // 优先执行预编译块，查不到时逐条解释
+    void run_aot(uint64_t until);
+    // 预编译块中向回跳转的 BNE 成立后调用
+    static void aot_loop(void* cpu, uint16_t head, uint16_t next);
 
     // 未知寻址模式
     uint16_t address_unk();
@@ -186,6 +285,10 @@ namespace fc
     void operate_tsx(uint16_t);
     // TXS 指令（将 X 寄存器中的值送入 SP 寄存器）
     void operate_txs(uint16_t);
+    // BRK 指令（软件中断，压入 PC+1 与带 BF 的状态寄存器）
+    void operate_brk(uint16_t);
+    // CLI 指令（清空 IF）
+    void operate_cli(uint16_t);
     // RTI 指令（从中断返回，影响 P/R/BF）
     void operate_rti(uint16_t);
     // LSRA 指令（对 A 寄存器进行逻辑右移，影响 S/Z/CF）
@@ -237,12 +340,67 @@ namespace fc
     void init(nes_memory_pool* mp);
     // 执行当前 PC 指向的指令
     void execute();
-    // 按地址反汇编一条指令，内部调用 output_registers_and_flags 并输出读取的字节
-    void disassemble_op(uint16_t addr, char buf[]);
+    // 连续执行指令，直到周期数达到 until，停在断点上时提前返回
+    /*
+      按当前启用的插桩选择对应的实例，选择只在每个批次开始时进行一次，
+      因此插桩可以在批次之间任意切换；没有插桩时循环中只有 execute。
+    */
+    void run(uint64_t until);
+    // 响应 NMI
+    void nmi();
+    // 响应 IRQ，IF 置位时忽略
+    void irq();
+    // 设置 IRQ 线的电平
+    void set_irq_line(bool level) { irq_line = level; }
+    // 把指令日志输出到 out，为 NULL 时关闭
+    void set_trace_log(FILE* out);
+    // 设置按指令地址统计的执行次数与周期数（各 65536 项，由调用者清零），为 NULL 时关闭
+    void set_profile(uint64_t* hits, uint64_t* cycles);
+    // 设置分支覆盖率计数表，size 须为 2 的幂，map 为 NULL 时关闭
+    /*
+      每执行一条条件分支，按 (bank, 指令地址, 是否成立) 散列后把对应的计数加 1（溢出回绕），
+      供模糊测试器作为边覆盖率使用。
+    */
+    void set_coverage(uint8_t* map, uint32_t size);
+    // 设置检查 PC 断点的调试器，为 NULL 时关闭
+    void set_breakpoints(nes_debugger* d);
+    // 当前启用的插桩
+    int get_trace_mode() { return trace_mode; }
+    // 开启或关闭循环惯用法的整块执行（默认开启）
+    void set_idioms(bool enabled) { idioms = enabled; }
+    // 循环惯用法的统计
+    const nes_idiom_stats& get_idiom_stats() { return idiom_stats; }
+    // 清零循环惯用法的统计
+    void clear_idiom_stats() { memset(&idiom_stats, 0, sizeof(idiom_stats)); }
+    // 设置预编译块（见 nes_aot），为 NULL 时关闭
+    /*
+      只在没有插桩、也没有观察点时使用，否则照常逐条解释。
+    */
+    void set_aot(nes_aot* a) { aot = a; }
+    // 预编译块的统计
+    const nes_aot_stats& get_aot_stats() { return aot_stats; }
+    // 清零预编译块的统计
+    void clear_aot_stats() { memset(&aot_stats, 0, sizeof(aot_stats)); }
+    // opcode 的基础周期数
+    static uint8_t base_cycles(uint8_t opcode);
+    // opcode 在 ABX/ABY/INY 寻址跨页时是否多 1 个周期
+    static bool page_penalty(uint8_t opcode);
+    // execute 是否实现了该 opcode（STP 与几条不稳定的非法指令没有实现）
+    static bool implemented(uint8_t opcode);
+    // 按地址反汇编一条指令，读取的字节写入 bytes，返回指令长度，不产生副作用
+    uint8_t disassemble_op(uint16_t addr, char buf[], uint8_t bytes[3]);
+    // 反汇编一条指令，并输出寄存器的值与读取的字节
+    void output_op(uint16_t addr, char buf[]);
     // 输出当前寄存器的值和状态寄存器的标记
     void output_registers_and_flags();
     // 获取当前 PC 寄存器中的值
     uint16_t get_pc() { return registers.program_counter; }
+    // 获取全部寄存器
+    const nes_registers& get_registers() { return registers; }
+    // 获取上电以来经过的 CPU 周期数
+    uint64_t get_cycle() { return clock.cycle; }
+    // 获取周期计数，供调度器截断批次
+    nes_clock& get_clock() { return clock; }
   };
 }
 
@@ -0,0 +1,158 @@
+#include <cstdlib>
+#include <vector>
+#include "./nes_cpu.h"
+#include "./nes_clock.h"
+
+#ifndef NES_DEBUGGER_H
+#define NES_DEBUGGER_H
+
+// 条件表达式求值栈的深度
+#define SFC_CONDITION_STACK 16
+
+namespace fc
+{
+  class nes_memory_pool;
+
+  // 观察点关注的访问类型
+  enum sfc_watch_kind {
+      SFC_WATCH_READ  = 1 << 0,  // 读取
+      SFC_WATCH_WRITE = 1 << 1,  // 写入
+  };
+
+  // 停下的原因
+  enum sfc_break_reason {
+      SFC_BREAK_NONE = 0,  // 没有停下
+      SFC_BREAK_PC,        // PC 断点
+      SFC_BREAK_READ,      // 读观察点
+      SFC_BREAK_WRITE,     // 写观察点
+  };
+
+  // 条件求值时可见的状态
+  struct nes_debug_context {
+    const nes_registers* registers;
+    uint64_t cycle;
+    // 观察点命中的地址与读出/写入的值，断点时为 0
+    uint16_t addr;
+    uint8_t value;
+    // 用于 [addr] 读取内存，不产生副作用
+    nes_memory_pool* memory;
+  };
+
+  // 编译为字节码的条件表达式
+  /*
+    语法与 C 相同的优先级：|| && == != < <= > >= | ^ & + - 以及一元的 ! ~ -，可以用括号，
+    [expr] 读取内存（I/O 区域读为 0），数字可写作 0x40、$40 或十进制。
+    标识符不区分大小写：A X Y SP P PC CYCLE ADDR VALUE，以及标记位 C Z I D V N（值为 0/1）。
+    例：A==0x40 && X>3、[$0300]!=0 && PC>=$C000
+  */
+  class nes_condition
+  {
+  private:
+    std::vector<uint8_t> code;
+
+  public:
+    // 编译表达式，失败时返回 false 并把原因写入 error
+    bool compile(const char* expr, const char** error = NULL);
+    // 求值，没有编译任何表达式时为真
+    bool eval(const nes_debug_context& ctx) const;
+    // 是否为空（总是成立）
+    bool empty() const { return code.empty(); }
+  };
+
+  // 停下时的信息
+  struct nes_break_info {
+    // sfc_break_reason
+    int reason;
+    // 命中的断点或观察点编号
+    int id;
+    // 停下时的 PC：断点为即将执行的指令，观察点为访问内存的指令执行完之后
+    uint16_t pc;
+    // 观察点访问的地址与值
+    uint16_t addr;
+    uint8_t value;
+    // 停下时的 CPU 周期
+    uint64_t cycle;
+  };
+
+  // 断点与观察点
+  /*
+    simulator 只在每个批次开始前检查一次是否有断点，
+    有断点时 nes_cpu::run 选用带 SFC_TRACE_BREAK 的实例，每条指令前查一次 64K 位的 PC 位图。
+    观察点只把被观察的 256 字节页从内存池的页表中移除，让这些页的访问走慢速路径，
+    其余页的访问不受影响。有观察点时栈操作（PHA、JSR、中断等）也经过页表，栈页上的观察点同样命中。
+  */
+  class nes_debugger
+  {
+  private:
+    struct point {
+      int id;
+      // 0 为 PC 断点，否则为 sfc_watch_kind 的组合
+      int kinds;
+      // 断点的 PC，或观察的起始地址（主内存的镜像已归一化到 $0000-$07FF）
+      uint16_t addr;
+      // 观察的字节数
+      uint16_t length;
+      nes_condition condition;
+    };
+
+    std::vector<point> points;
+    // 有断点的 PC 位图，第一次添加断点时才分配
+    std::vector<uint64_t> pc_bits;
+    // 有观察点的页
+    uint32_t watch_pages[8];
+    // 断点数与观察点数
+    int breakpoint_count;
+    int watchpoint_count;
+    int next_id;
+    // 为 false 时暂停所有断点与观察点（提前运行的推测帧）
+    bool enabled;
+    // 最近一次停下的信息
+    nes_break_info hit;
+    // 从断点处继续时跳过该周期上的 PC 检查，避免原地再次停下
+    uint64_t resume_cycle;
+
+    nes_memory_pool* memory;
+    const nes_registers* registers;
+    nes_clock* clock;
+
+    // 根据观察点重新标记被观察的页，并让内存池刷新页表
+    void refresh_watch_pages();
+    // 记录停下的信息并截断 CPU 的批次
+    void stop(int reason, int id, uint16_t addr, uint8_t value);
+
+  public:
+    // 绑定内存池与 CPU，并把自己挂到内存池的慢速路径上
+    void init(nes_memory_pool* memory, nes_cpu* cpu);
+    // 添加 PC 断点，返回编号，条件编译失败时返回 -1
+    int add_breakpoint(uint16_t pc, const char* condition = NULL, const char** error = NULL);
+    // 添加观察 [addr, addr+length) 的观察点，kinds 为 sfc_watch_kind 的组合
+    int add_watchpoint(uint16_t addr, uint16_t length, int kinds,
+                       const char* condition = NULL, const char** error = NULL);
+    // 删除断点或观察点
+    bool remove(int id);
+    // 删除全部
+    void clear();
+    // 暂停或恢复
+    void set_enabled(bool e) { enabled = e; }
+    // 是否需要逐条指令检查 PC
+    bool has_breakpoints() { return enabled && breakpoint_count; }
+    // 页 page 是否有观察点
+    bool watching(uint8_t page) { return watch_pages[page >> 5] >> (page & 31) & 1; }
+
+    // 在执行 PC 处的指令之前调用，返回是否应停下
+    bool check_pc();
+    // 在被观察页上的访问时由内存池调用
+    void check_access(uint16_t addr, uint8_t value, int kind);
+    // CPU 停下后由 simulator 调用，补全停下的信息
+    void settle();
+
+    // 自上次 clear_hit 以来是否停下过
+    bool has_hit() { return hit.reason != SFC_BREAK_NONE; }
+    // 最近一次停下的信息
+    const nes_break_info& get_hit() { return hit; }
+    // 清除停下的信息，之后从该处继续
+    void clear_hit() { hit.reason = SFC_BREAK_NONE; }
+  };
+}
+
+#endif
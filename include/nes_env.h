@@ -0,0 +1,91 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef NES_ENV_H
+#define NES_ENV_H
+
+// 接口的版本，接口有不兼容的改动时加 1
+#define SFC_ENV_ABI_VERSION 1
+// 主内存的字节数
+#define SFC_ENV_RAM_BYTES (2 * 1024)
+// 一帧画面的字节数，256x240，每个像素为 6 位颜色索引（见 nes_palette.h）
+#define SFC_ENV_FRAME_BYTES (256 * 240)
+
+// 供强化学习等宿主程序嵌入的 C 接口，以共享库的形式提供
+/*
+  本文件是合法的 C 头文件，只使用 C 的类型与调用约定，可以从 C、ctypes/cffi 等任意语言直接调用。
+  编译：g++ -O2 -shared -fPIC -o libsfcenv.so $(ls *.cpp | grep -v main.cpp) -lpthread -ldl
+  典型的用法：
+    1. sfc_rom_load 从内存中的 .nes 镜像解析 ROM，同一个 ROM 由任意多个实例只读共享
+    2. 每个环境 sfc_env_create 一个实例，运行到起点后 sfc_env_save 保存快照
+    3. 每一步 sfc_env_step（或对一组实例 sfc_env_step_many）以动作运行若干帧，
+       之后从 RAM 与画面中读出观察与奖励，回合结束时 sfc_env_reset 回到快照
+  实例总是以无画面模式运行（见 simulator::set_headless），不生成声音，
+  创建时带 SFC_ENV_RENDER 的实例只在每一步的最后一帧输出画面。
+  读写观察的函数都直接写入调用者提供的缓冲区，或返回实例内部的只读指针，不做额外的分配与复制。
+  不同实例可以在不同线程中同时使用，同一实例同时只能在一个线程中使用。
+*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+  // 解析后的 ROM
+  typedef struct sfc_rom sfc_rom;
+  // 一个模拟器实例
+  typedef struct sfc_env sfc_env;
+
+  // sfc_env_create 的选项
+  enum sfc_env_flag {
+    SFC_ENV_RENDER = 1 << 0,  // 每一步的最后一帧输出画面，读取画面观察时须设置
+  };
+
+  // 编译时的 SFC_ENV_ABI_VERSION，宿主程序可以用来确认加载的库与头文件一致
+  uint32_t sfc_env_abi_version(void);
+
+  // 从内存中的 .nes 镜像解析 ROM，镜像会被复制，不合法或不支持的 mapper 返回 NULL
+  sfc_rom* sfc_rom_load(const void* data, size_t size);
+  // 释放 ROM，使用它的实例须先全部销毁
+  void sfc_rom_free(sfc_rom* rom);
+
+  // 创建使用 rom 的实例，处于上电状态，flags 为 sfc_env_flag 的组合
+  sfc_env* sfc_env_create(sfc_rom* rom, uint32_t flags);
+  void sfc_env_destroy(sfc_env* env);
+
+  // 运行 frames 帧，第 i 帧以 actions[i] 为按键：低 8 位为 1P，高 8 位为 2P，
+  // 每一位的含义同 fc::sfc_button_flag（A、B、Select、Start、上、下、左、右）。
+  // actions 为 NULL 时保持之前的按键
+  void sfc_env_step(sfc_env* env, const uint16_t* actions, uint32_t frames);
+  // 对 count 个实例各运行 frames 帧，由内部的线程池并行执行
+  /*
+    第 k 个实例使用 actions + k * frames 处的 frames 个动作（actions 为 NULL 时保持之前的按键）。
+    运行完毕后，ram 不为 NULL 时第 k 个实例的主内存写入 ram + k * SFC_ENV_RAM_BYTES，
+    frames_out 不为 NULL 时画面写入 frames_out + k * SFC_ENV_FRAME_BYTES。
+    envs 中不能有重复的实例。返回时全部实例都已运行完毕。
+  */
+  void sfc_env_step_many(sfc_env* const* envs, uint32_t count, const uint16_t* actions, uint32_t frames,
+    uint8_t* ram, uint8_t* frames_out);
+  // 设置 sfc_env_step_many 使用的线程数（包括调用者所在的线程），0 表示使用全部处理器
+  void sfc_env_set_threads(uint32_t threads);
+
+  // 复制 2KB 主内存到 out（SFC_ENV_RAM_BYTES 字节）
+  void sfc_env_read_ram(sfc_env* env, uint8_t* out);
+  // 复制最近输出的画面到 out（SFC_ENV_FRAME_BYTES 字节），从未输出时为全 0
+  void sfc_env_read_frame(sfc_env* env, uint8_t* out);
+  // 主内存与画面在实例内部的只读指针，实例运行时内容随之改变，销毁之前一直有效
+  const uint8_t* sfc_env_ram(sfc_env* env);
+  const uint8_t* sfc_env_frame(sfc_env* env);
+  // 无副作用地读取 CPU 地址空间中的一个字节，$2000-$5FFF 的 I/O 区域返回 0
+  uint8_t sfc_env_peek(sfc_env* env, uint16_t addr);
+  // 已运行的帧数
+  uint64_t sfc_env_frame_count(sfc_env* env);
+
+  // 快照的字节数，创建后不变
+  size_t sfc_env_snapshot_size(sfc_env* env);
+  // 保存快照到 buf
+  void sfc_env_save(sfc_env* env, void* buf);
+  // 恢复到 sfc_env_save 保存的快照，快照只能恢复到保存它的同一个实例
+  void sfc_env_reset(sfc_env* env, const void* snapshot);
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+#include <cstdio>
+#include <cstdlib>
+
+#ifndef NES_HASH_H
+#define NES_HASH_H
+
+// 每个条带的字节数
+#define SFC_HASH_STRIPE 64
+// 密钥的字节数
+#define SFC_HASH_SECRET_SIZE 192
+
+namespace fc
+{
+  // 64 位哈希的累加内核，同一组接口有标量、SSE2、AVX2 三种实现
+  /*
+    结构与 XXH3 的长输入路径相同（但不保证与其输出一致）：
+      - 8 个 64 位累加器，每 64 字节为一个条带
+      - 每个 64 位字与密钥异或后高低 32 位相乘累加到本通道，原值累加到相邻通道
+      - 每 16 个条带用密钥末尾搅乱一次累加器
+    乘法只需 32x32->64，因此可以用 pmuludq 一次处理 2/4 个通道。
+  */
+  struct nes_hash_kernels {
+    // 实现的名称
+    const char* name;
+    // 把 stripes 个条带累加进 acc，第 i 个条带使用密钥的第 8*i 字节起的 64 字节
+    void (*accumulate)(uint64_t* acc, const uint8_t* data, size_t stripes, const uint8_t* secret);
+    // 搅乱累加器
+    void (*scramble)(uint64_t* acc, const uint8_t* secret);
+  };
+
+  // 标量实现，同时也是其它实现逐位比对的基准
+  const nes_hash_kernels& nes_hash_kernels_scalar();
+  // 根据 CPU 支持的指令集返回最快的实现
+  const nes_hash_kernels& nes_hash_kernels_best();
+  // 列出所有在当前 CPU 上可用的实现，返回数量
+  int nes_hash_kernels_available(const nes_hash_kernels* list[], int max);
+
+  // 计算 size 字节的 64 位哈希，kernels 为 NULL 时使用最快的实现
+  uint64_t nes_hash64(const void* data, size_t size, uint64_t seed = 0,
+                      const nes_hash_kernels* kernels = NULL);
+
+  // 一帧结束时模拟器状态的摘要
+  struct nes_state_digest
+  {
+    // 帧序号
+    uint64_t frame;
+    // CPU 周期数
+    uint64_t cycle;
+    // CPU 寄存器
+    uint64_t cpu;
+    // 2KB 主内存
+    uint64_t ram;
+    // 8KB SRAM
+    uint64_t sram;
+    // 画面（颜色索引与色彩强调位）
+    uint64_t video;
+
+    // 除帧序号外所有字段是否一致
+    bool same_state(const nes_state_digest& other) const;
+    // 把各字段合成一个哈希，video 为 false 时不含画面（用于比较无画面模式的运行）
+    uint64_t checksum(bool video = false) const;
+  };
+
+  // 逐帧状态摘要的二进制日志
+  /*
+    文件头为 8 字节的 "SFCHASH1"，之后每帧（或每若干条指令，见 simulator::set_hash_log）
+    一条 48 字节的小端序记录，依次为 nes_state_digest 的 6 个字段。
+  */
+  class nes_hash_log
+  {
+  private:
+    FILE* fp = NULL;
+
+  public:
+    ~nes_hash_log() { close(); }
+    // 创建日志用于写入
+    bool create(const char* path);
+    // 打开日志用于读取，检查文件头
+    bool open(const char* path);
+    // 追加一条记录
+    void append(const nes_state_digest& digest);
+    // 读取下一条记录，没有时返回 false
+    bool next(nes_state_digest& digest);
+    void close();
+  };
+}
+
+#endif
@@ -0,0 +1,49 @@
+#include <cstdlib>
+
+#ifndef NES_JOYPAD_H
+#define NES_JOYPAD_H
+
+namespace fc
+{
+  // 手柄按键在掩码中的位
+  enum sfc_button_flag {
+      SFC_BUTTON_A      = 1 << 0,
+      SFC_BUTTON_B      = 1 << 1,
+      SFC_BUTTON_SELECT = 1 << 2,
+      SFC_BUTTON_START  = 1 << 3,
+      SFC_BUTTON_UP     = 1 << 4,
+      SFC_BUTTON_DOWN   = 1 << 5,
+      SFC_BUTTON_LEFT   = 1 << 6,
+      SFC_BUTTON_RIGHT  = 1 << 7,
+  };
+
+  // 两个标准手柄，$4016/$4017
+  /*
+    写 $4016 的第 0 位为 1 时持续把按键状态装入移位寄存器，
+    变为 0 后每次读取 $4016/$4017 依次移出 A、B、Select、Start、上、下、左、右，
+    8 次之后一直返回 1。
+  */
+  class nes_joypad
+  {
+  private:
+    // 当前按下的按键
+    uint8_t buttons[2];
+    // 移位寄存器
+    uint8_t shift[2];
+    // 是否处于装载状态
+    bool strobe;
+
+  public:
+    void init();
+    // 设置手柄 port（0/1）的按键掩码
+    void set_buttons(int port, uint8_t mask) { buttons[port] = mask; if (strobe) shift[port] = mask; }
+    // 获取手柄 port 的按键掩码
+    uint8_t get_buttons(int port) { return buttons[port]; }
+    // 写入 $4016
+    void write(uint8_t data);
+    // 读取 $4016（port 0）或 $4017（port 1）
+    uint8_t read(int port);
+  };
+}
+
+#endif
@@ -0,0 +1,102 @@
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+#include "./nes_cpu.h"
+#include "./nes_memory_pool.h"
+#include "./nes_ppu.h"
+#include "./nes_apu.h"
+#include "./nes_scheduler.h"
+#include "./nes_joypad.h"
+
+#ifndef NES_MACHINE_H
+#define NES_MACHINE_H
+
+// 缓存行的字节数
+#define SFC_CACHE_LINE 64
+
+namespace fc
+{
+  // 一个模拟器实例的全部可变状态，放在一块按缓存行对齐的连续内存中
+  /*
+    按访问频率从高到低排列：
+      - CPU 寄存器、周期计数与内存池指针（nes_cpu 的前几项，第一个缓存行）
+      - 页表、零页与栈、其余主内存（nes_memory_pool 的前几项）
+      - 慢速路径与设备的状态
+    不是每个实例都用到的大块内存在 machine 之外按需分配：
+      - SRAM：ROM 声明了 SRAM 或第一次写入 $6000-$7FFF 时
+      - 卡带上的 CHR-RAM 与四屏幕名称表：按 ROM 在 init 时
+      - PPU 的画面与 APU 的重采样缓冲：第一次输出像素或采样时
+    内部的指针（页表、各设备之间的绑定）都指向本实例，
+    因此快照以整块的一次 memcpy 为主，只能恢复到生成它的同一个实例。
+  */
+  struct alignas(SFC_CACHE_LINE) nes_machine
+  {
+    nes_cpu cpu;
+    nes_memory_pool memory_pool;
+    nes_scheduler scheduler;
+    nes_joypad joypad;
+    nes_apu apu;
+    nes_ppu ppu;
+
+    // 快照的字节数：machine 整块、8KB SRAM（未分配时为 0）、卡带上的显存
+    /*
+      画面与音频缓冲是输出而不是状态，不在快照中。
+    */
+    size_t snapshot_size() { return sizeof(nes_machine) + 8 * 1024 + ppu.cart_vram_size; }
+    // 保存快照到 buf
+    void save(void* buf);
+    // 从 save 生成的快照恢复
+    /*
+      以下内容仍属于本实例，不会被快照中的值替换：
+        - machine 之外的缓冲区（SRAM、画面与音频缓冲）
+        - 宿主程序设置的工具状态：预编译块、指令日志、性能统计与覆盖率计数表、断点与观察点、
+          循环惯用法的开关，以及惯用法与预编译块的统计
+      因此保存快照之后更改这些设置（例如卸载预编译块）再恢复，仍使用当前的设置。
+    */
+    void restore(const void* buf);
+    // 在 machine 之外分配的字节数
+    size_t allocated_bytes() { return memory_pool.allocated_bytes() + ppu.allocated_bytes() + apu.allocated_bytes(); }
+
+  private:
+    // restore 时保持不变的字段
+    struct host_fields;
+  };
+
+  // nes_machine 的池分配器
+  /*
+    按块向系统申请按缓存行对齐的内存，每块容纳 per_chunk 个实例，
+    释放的实例放回空闲链表，之后优先重复使用，块在池析构时才归还。
+    同时存在大量实例时，它们在内存中紧密相邻，不会因为各自分配而散落在堆中。
+    create/destroy 可以在多个线程中调用。
+  */
+  class nes_machine_pool
+  {
+  private:
+    std::mutex lock;
+    // 已申请的块
+    std::vector<void*> chunks;
+    // 空闲的实例，链表指针存放在实例内存的开头
+    void* free_list;
+    // 每块的实例数
+    size_t per_chunk;
+    // 正在使用的实例数
+    size_t in_use;
+
+  public:
+    explicit nes_machine_pool(size_t per_chunk = 16);
+    // 池中的实例须已全部归还
+    ~nes_machine_pool();
+    // 取得一个构造好的实例
+    nes_machine* create();
+    // 析构并归还实例
+    void destroy(nes_machine* machine);
+    // 正在使用的实例数
+    size_t size() { return in_use; }
+    // 向系统申请的字节数
+    size_t reserved() { return chunks.size() * per_chunk * sizeof(nes_machine); }
+    // simulator 默认使用的池，进程退出时不析构，也不检查是否还有实例没有归还
+    static nes_machine_pool& shared();
+  };
+}
+
+#endif
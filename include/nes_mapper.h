@@ -13,7 +13,10 @@ namespace fc
   class nes_mapper
   {
   public:
+    virtual ~nes_mapper() {}
     virtual void reset(nes_rom_info* info, uint8_t** banks) = 0;
+    // 按编号创建 mapper，由调用者 delete，不支持的编号返回 NULL
+    static nes_mapper* create(uint8_t number);
   };
 }
 
@@ -2,39 +2,108 @@
 #include <cstdlib>
 #include "./nes_rom.h"
 #include "./nes_mapper.h"
+#include "./nes_ppu.h"
+#include "./nes_apu.h"
+#include "./nes_joypad.h"
+#include "./nes_clock.h"
 
 #ifndef NES_MEMORY_POOL_H
 #define NES_MEMORY_POOL_H
 
+// OAM DMA 使 CPU 暂停的周期数，在奇数周期开始时再多 1 个
+#define SFC_OAM_DMA_CYCLES 513
+// DMC 读取一个采样字节使 CPU 暂停的周期数
+#define SFC_DMC_DMA_CYCLES 4
+
 namespace fc
 {
+  class nes_debugger;
+
   // 用于处理模拟器的内存的读写动作
   /*
     内存布局：
     Bank0 [$0000, $2000) 系统主内存，从 $0800 开始
-    Bank1 [$2000, $4000) PPU 寄存器
-    Bank2 [$4000, $6000) pAPU寄存器以及扩展区域
-    Bank3 [$6000, $8000) SRAM区
-    剩下的全是程序代码区 PRG-ROM
+    Bank1 [$2000, $4000) PPU 寄存器，访问前先让 PPU 追赶到当前周期
+    Bank2 [$4000, $6000) pAPU寄存器、手柄以及扩展区域，访问 APU 前同样先追赶
+    Bank3 [$6000, $8000) SRAM区，ROM 声明了 SRAM 或第一次写入时才分配，之前读为 0
+    剩下的全是程序代码区 PRG-ROM，只读，写入被忽略，因此多个实例可以共享同一份 ROM
+    普通内存按 256 字节一页记录在页表中直接访问，
+    I/O 区域与有观察点的页在页表中为 NULL，走按 bank 分派的慢速路径。
   */
   class nes_memory_pool
   {
   friend class nes_cpu;
+  friend struct nes_machine;
   private:
+    // 按访问频率从高到低排列：页表、主内存（零页与栈在最前）、慢速路径用到的指针
+    // 每 256 字节一页在宿主内存中的指针，为 NULL 的页走慢速路径
+    alignas(64) uint8_t* pages[256] = {0};
     // 小霸王的 2k 主要内存
-    uint8_t main_memory[2 * 1024] = {0};
-    // 工作,存档用内存 SRAM
-    uint8_t sram_memory[8 * 1024] = {0};
+    alignas(64) uint8_t main_memory[2 * 1024] = {0};
+    // CPU 的周期计数，由 nes_cpu::init 绑定
+    nes_clock* clock = NULL;
+    // 图形处理器
+    nes_ppu* ppu = NULL;
+    // 音频处理器
+    nes_apu* apu = NULL;
+    // 手柄
+    nes_joypad* joypad = NULL;
+    // 观察点，为 NULL 时慢速路径不检查
+    nes_debugger* debugger = NULL;
+    // 是否有任何一页设有观察点
+    bool watched = false;
     // 方便 Mapper 的 banks，每 8KB 一个，因此 64 KB 一共有 8 个
     uint8_t* banks[8] = {0};
+    // PRG-ROM 的开始处，用于求出 bank 编号
+    const uint8_t* prg_rom = NULL;
+    // 工作,存档用内存 SRAM，在 machine 之外按需分配，未分配时为 NULL
+    uint8_t* sram_memory = NULL;
+    // 未分配 SRAM 时 get_sram_memory 返回的全 0 内容
+    static const uint8_t empty_sram[8 * 1024];
+
+    // 分配 SRAM 并清零，不更新页表
+    void allocate_sram();
+
+    // 取得 $xx00-$xxFF 这一页在宿主内存中的连续指针，I/O 区域返回 NULL
+    uint8_t* page_pointer(uint8_t page);
+    // 慢速路径：按 bank 分派，并检查观察点
+    uint8_t read_slow(uint16_t addr);
+    void write_slow(uint16_t addr, uint8_t data);
+    // 按 bank 分派的读写，I/O 区域在这里让设备追赶
+    uint8_t read_bank(uint16_t addr);
+    void write_bank(uint16_t addr, uint8_t data);
+    // 写入 $4014：把一整页复制到 PPU 的精灵属性表，并让 CPU 暂停
+    void oam_dma(uint8_t page);
 
   public:
-    // 绑定 simulator 实例
-    void init(nes_rom_info* rom_info, nes_mapper* mapper);
+    ~nes_memory_pool();
+    // 绑定 simulator 实例，ROM 声明了 SRAM 时分配 SRAM
+    void init(nes_rom_info* rom_info, nes_mapper* mapper, nes_ppu* ppu, nes_apu* apu, nes_joypad* joypad);
     // 读取内存
     uint8_t read(uint16_t addr);
     // 写入内存
     void write(uint16_t addr, uint8_t data);
+    // 读取内存但不产生副作用，I/O 区域读为 0
+    uint8_t peek(uint16_t addr) {
+      const uint8_t* page = page_pointer(addr >> 8);
+      return page? page[addr & 0xff]: 0;
+    }
+    // 绑定观察点
+    void set_debugger(nes_debugger* d) { debugger = d; }
+    // 按 bank 与观察点重新生成页表
+    void refresh_pages();
+    // addr 所在的 8KB PRG-ROM bank 编号，不在 PRG-ROM 中时返回 0xff
+    uint8_t bank_number(uint16_t addr) {
+      return addr & 0x8000? (banks[addr >> 13] - prg_rom) >> 13: 0xff;
+    }
+    // 获取 2KB 主内存
+    uint8_t* get_main_memory() { return main_memory; }
+    // 获取 8KB SRAM，未分配时为全 0
+    const uint8_t* get_sram_memory() { return sram_memory? sram_memory: empty_sram; }
+    // 在 machine 之外分配的字节数
+    size_t allocated_bytes() { return sram_memory? 8 * 1024: 0; }
+    // DMA 占用总线，让 CPU 暂停 cycles 个周期
+    void stall(uint32_t cycles) { clock->cycle += cycles; }
   };
 }
 
@@ -0,0 +1,41 @@
+#include <cstdlib>
+#include <vector>
+
+#ifndef NES_MOVIE_H
+#define NES_MOVIE_H
+
+namespace fc
+{
+  // 输入录像：每帧两个手柄的按键掩码（见 sfc_button_flag）
+  /*
+    自有格式为 8 字节的 "SFCMOVI1"、8 字节小端序的帧数，之后每帧 2 字节（手柄 1、手柄 2）。
+    也可以导入 FCEUX 的文本格式 .fm2，其中的复位命令不被支持，只统计次数。
+  */
+  class nes_movie
+  {
+  private:
+    // 低字节为手柄 1，高字节为手柄 2
+    std::vector<uint16_t> frames;
+    // 导入时忽略的复位命令数
+    uint32_t ignored_resets = 0;
+
+  public:
+    void clear() { frames.clear(); ignored_resets = 0; }
+    // 追加一帧
+    void append(uint8_t port0, uint8_t port1) { frames.push_back(port0 | (port1 << 8)); }
+    // 帧数
+    uint64_t size() const { return frames.size(); }
+    // 第 frame 帧手柄 port 的按键掩码
+    uint8_t get(uint64_t frame, int port) const { return frames[frame] >> (port * 8); }
+    // 导入时忽略的复位命令数
+    uint32_t get_ignored_resets() const { return ignored_resets; }
+    // 导入 .fm2，返回是否成功（不支持二进制形式的 .fm2）
+    bool load_fm2(const char* path);
+    // 读取自有格式
+    bool load(const char* path);
+    // 保存为自有格式
+    bool save(const char* path) const;
+  };
+}
+
+#endif
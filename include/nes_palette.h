@@ -0,0 +1,94 @@
+#include <cstdlib>
+
+#ifndef NES_PALETTE_H
+#define NES_PALETTE_H
+
+// 输出画面支持的最大整数放大倍数
+#define SFC_PALETTE_MAX_SCALE 3
+
+namespace fc
+{
+  // 输出的像素格式
+  enum sfc_pixel_format {
+      SFC_PIXEL_RGBA8888,  // 每像素 4 字节，内存中依次为 R G B A
+      SFC_PIXEL_RGB565,    // 每像素一个 16 位整数
+      SFC_PIXEL_YUV420,    // BT.601 有限范围的 Y/U/V 三个平面，色度宽高各减半
+  };
+
+  // 颜色查找表，按色彩强调位（PPUMASK 的高 3 位）分成 8 组，每组 64 种颜色
+  struct nes_color_tables {
+    uint8_t r[8][64];
+    uint8_t g[8][64];
+    uint8_t b[8][64];
+    // RGB565 的低字节与高字节
+    uint8_t rgb565_lo[8][64];
+    uint8_t rgb565_hi[8][64];
+    uint8_t y[8][64];
+    uint8_t u[8][64];
+    uint8_t v[8][64];
+  };
+
+  // 把一条扫描线的 6 位颜色索引转换为目标格式的内核，同一组接口有标量、SSE4.1、AVX2 三种实现
+  /*
+    查表按 64 项拆成 4 段 16 字节，用字节重排指令查各段再按索引的第 4、5 位选择，
+    一次处理 16（SSE4.1）或 32（AVX2）个像素。
+    scale 为 1-3，每个像素在水平方向重复 scale 次，垂直方向的重复由调用者复制整行。
+  */
+  struct nes_color_kernels {
+    // 实现的名称
+    const char* name;
+    // 256 个索引转换为 RGBA8888，输出 256*scale 个像素
+    void (*line_rgba)(const uint8_t* r, const uint8_t* g, const uint8_t* b,
+                      const uint8_t* src, int scale, uint8_t* out);
+    // 256 个索引转换为 RGB565，输出 256*scale 个像素
+    void (*line_rgb565)(const uint8_t* lo, const uint8_t* hi,
+                        const uint8_t* src, int scale, uint16_t* out);
+    // 256 个索引转换为亮度，输出 256*scale 个采样
+    void (*line_luma)(const uint8_t* y, const uint8_t* src, int scale, uint8_t* out);
+    // 由放大后画面中相邻两行对应的源扫描线 src0/src1 求出一行色度，输出 128*scale 个采样
+    //  - 每个色度采样为 2x2 个亮度采样先水平、再垂直取平均（向上舍入）
+    void (*line_chroma)(const uint8_t* u0, const uint8_t* v0, const uint8_t* src0,
+                        const uint8_t* u1, const uint8_t* v1, const uint8_t* src1,
+                        int scale, uint8_t* out_u, uint8_t* out_v);
+  };
+
+  // 标量实现，同时也是其它实现逐位比对的基准
+  const nes_color_kernels& nes_color_kernels_scalar();
+  // 根据 CPU 支持的指令集返回最快的实现
+  const nes_color_kernels& nes_color_kernels_best();
+  // 列出所有在当前 CPU 上可用的实现，返回数量
+  int nes_color_kernels_available(const nes_color_kernels* list[], int max);
+
+  // 调用者提供的输出缓冲区
+  struct nes_video_target {
+    sfc_pixel_format format;
+    // 整数放大倍数，1-3
+    int scale;
+    // RGBA8888/RGB565 只用 planes[0]，YUV420 依次为 Y/U/V 平面
+    uint8_t* planes[3];
+    // 各平面每行的字节数
+    size_t pitch[3];
+  };
+
+  // 把 PPU 输出的颜色索引与色彩强调位转换为宿主可以直接显示或编码的画面
+  class nes_color_converter
+  {
+  private:
+    // 查找表
+    nes_color_tables tables;
+    // 使用的转换内核
+    const nes_color_kernels* kernels;
+
+  public:
+    // 生成查找表，rgb 为 64 种颜色的 RGB 三元组，为 NULL 时使用内置的调色板
+    //  - 强调位使未被强调的两个分量衰减到约 81.6%
+    //  - kernels 为 NULL 时使用最快的实现
+    void init(const uint8_t* rgb = NULL, const nes_color_kernels* kernels = NULL);
+    // 转换一帧画面，pixels 为 240*256 个 6 位颜色索引，emphasis 为每条扫描线的强调位
+    void convert(const uint8_t* pixels, const uint8_t* emphasis, const nes_video_target& target);
+    // 获取查找表
+    const nes_color_tables& get_tables() { return tables; }
+  };
+}
+
+#endif
@@ -0,0 +1,129 @@
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include "./nes_spsc_queue.h"
+
+#ifndef NES_PIPELINE_H
+#define NES_PIPELINE_H
+
+// 每个音频块最多的采样数
+#define SFC_AUDIO_BLOCK_MAX 2048
+// 流水线最多的消费阶段数
+#define SFC_PIPELINE_MAX_STAGES 8
+
+namespace fc
+{
+  // 一帧画面
+  struct nes_video_frame
+  {
+    // 帧序号
+    uint64_t frame;
+    // 入队时的时间（纳秒）
+    uint64_t timestamp;
+    // 6 位颜色索引
+    uint8_t pixels[240 * 256];
+    // 每条扫描线的色彩强调位
+    uint8_t emphasis[240];
+  };
+
+  // 一块音频采样
+  struct nes_audio_block
+  {
+    // 第一个采样的序号
+    uint64_t first_sample;
+    // 入队时的时间（纳秒）
+    uint64_t timestamp;
+    // 采样率
+    uint32_t sample_rate;
+    // 采样数
+    uint32_t count;
+    // 16 位单声道采样
+    int16_t samples[SFC_AUDIO_BLOCK_MAX];
+  };
+
+  // 处理一帧画面的回调，在消费线程中执行
+  typedef void (*nes_frame_consumer)(void* ctx, const nes_video_frame& frame);
+  // 处理一块音频的回调，在消费线程中执行
+  typedef void (*nes_audio_consumer)(void* ctx, const nes_audio_block& block);
+
+  // 每个消费阶段的统计，由消费线程写入
+  struct nes_stage_stats
+  {
+    // 已处理的项数
+    std::atomic<uint64_t> items;
+    // 从入队到被取出的等待时间之和与最大值（纳秒）
+    std::atomic<uint64_t> wait_total;
+    std::atomic<uint64_t> wait_max;
+    // 回调处理时间之和与最大值（纳秒）
+    std::atomic<uint64_t> work_total;
+    std::atomic<uint64_t> work_max;
+  };
+
+  // 模拟线程与输出线程之间的流水线
+  /*
+    模拟线程把完成的画面与音频块拷贝进每个阶段各自的 SPSC 队列后立即返回，
+    每个阶段有一个消费线程调用回调去编码、计算哈希或写文件。
+    所有槽位在 start 时分配，此后 push_frame/push_audio 不会再分配内存；
+    队列满时按各阶段的 sfc_backpressure 处理。
+  */
+  class nes_av_pipeline
+  {
+  private:
+    // 一个消费阶段
+    struct stage {
+      // 名称，用于统计输出
+      const char* name;
+      // 是否为画面阶段，否则为音频阶段
+      bool video;
+      // 队列容量与满时策略
+      uint32_t capacity;
+      sfc_backpressure policy;
+      // 队列
+      nes_spsc_queue<nes_video_frame> frames;
+      nes_spsc_queue<nes_audio_block> audio;
+      // 回调及其参数
+      nes_frame_consumer on_frame;
+      nes_audio_consumer on_audio;
+      void* ctx;
+      // 消费线程
+      std::thread worker;
+      // 统计
+      nes_stage_stats stats;
+    };
+
+    stage stages[SFC_PIPELINE_MAX_STAGES];
+    int stage_count = 0;
+    // 消费线程是否继续等待新数据
+    std::atomic<bool> running;
+    // 是否已经启动
+    bool started = false;
+
+    // 消费线程主循环
+    void consume(stage* s);
+
+  public:
+    nes_av_pipeline() { running.store(false); }
+    ~nes_av_pipeline() { stop(); }
+
+    // 添加画面阶段，返回阶段编号，需在 start 之前调用
+    int add_frame_stage(const char* name, nes_frame_consumer fn, void* ctx,
+                        uint32_t capacity, sfc_backpressure policy);
+    // 添加音频阶段，返回阶段编号，需在 start 之前调用
+    int add_audio_stage(const char* name, nes_audio_consumer fn, void* ctx,
+                        uint32_t capacity, sfc_backpressure policy);
+    // 分配所有槽位并启动消费线程
+    void start();
+    // 处理完已入队的数据后停止消费线程并释放槽位
+    void stop();
+    // 把一帧画面送入所有画面阶段
+    void push_frame(uint64_t frame, const uint8_t* pixels, const uint8_t* emphasis);
+    // 把一块音频送入所有音频阶段，超过 SFC_AUDIO_BLOCK_MAX 的部分会被拆分
+    void push_audio(uint64_t first_sample, uint32_t sample_rate,
+                    const int16_t* samples, uint32_t count);
+    // 输出各阶段的处理数、丢弃数与延迟
+    void print_stats(FILE* fp);
+  };
+}
+
+#endif
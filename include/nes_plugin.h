@@ -0,0 +1,54 @@
+#include <cstdlib>
+
+#ifndef NES_PLUGIN_H
+#define NES_PLUGIN_H
+
+// 插件接口的版本，接口有不兼容的改动时加 1
+#define SFC_PLUGIN_ABI_VERSION 1
+// 插件导出的入口函数名
+#define SFC_PLUGIN_ENTRY "sfc_plugin_entry"
+
+// 以共享库形式加载的模拟器构建，供比较两个构建（或同一构建的两种配置）的工具使用
+/*
+  只使用 C 的类型与调用约定，不同编译选项、不同版本的构建之间可以互相加载比较。
+  编译：g++ -O2 -shared -fPIC -o fc.so $(ls *.cpp | grep -v main.cpp) -lpthread
+*/
+extern "C" {
+  // CPU 寄存器与周期
+  struct sfc_plugin_cpu {
+    uint64_t cycle;
+    uint16_t pc;
+    uint8_t a, x, y, p, sp;
+  };
+
+  struct sfc_plugin_api {
+    // 等于 SFC_PLUGIN_ABI_VERSION
+    uint32_t abi_version;
+    // 构建的说明（编译器、日期等）
+    const char* build;
+    // 创建实例，config 为逗号分隔的选项：headless、interval=N
+    void* (*create)(const char* config);
+    void (*destroy)(void* instance);
+    // 加载 ROM，成功返回 0
+    int (*load_rom)(void* instance, const char* path);
+    // 运行一帧
+    void (*run_frame)(void* instance);
+    // 单步执行 count 条指令
+    void (*step)(void* instance, uint64_t count);
+    // 快照
+    size_t (*snapshot_size)(void* instance);
+    void (*save_state)(void* instance, void* buf);
+    void (*load_state)(void* instance, const void* buf);
+    // 状态摘要：帧序号、周期、CPU、主内存、SRAM、画面
+    void (*digest)(void* instance, uint64_t out[6]);
+    // 读取寄存器
+    void (*get_cpu)(void* instance, sfc_plugin_cpu* out);
+    // 无副作用地读取内存，$2000-$5FFF 的 I/O 区域返回 0
+    uint8_t (*peek)(void* instance, uint16_t addr);
+  };
+
+  // 插件的入口
+  const sfc_plugin_api* sfc_plugin_entry();
+}
+
+#endif
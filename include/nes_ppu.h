@@ -0,0 +1,184 @@
+#include <cstdlib>
+#include "./nes_rom.h"
+#include "./nes_ppu_render.h"
+#include "./nes_scheduler.h"
+
+#ifndef NES_PPU_H
+#define NES_PPU_H
+
+// 每条扫描线的 PPU 周期数
+#define SFC_PPU_DOTS_PER_LINE 341
+// 每帧的扫描线数（NTSC）
+#define SFC_PPU_LINES_PER_FRAME 262
+// 开始 VBlank 的扫描线
+#define SFC_PPU_VBLANK_LINE 241
+// 预渲染扫描线
+#define SFC_PPU_PRERENDER_LINE 261
+
+namespace fc
+{
+  // PPUCTRL($2000) 的各个位
+  enum sfc_ppu_ctrl_flag {
+      SFC_CTRL_INC32   = 1 << 2,  // $2007 访问后地址加 32，否则加 1
+      SFC_CTRL_SPR_TBL = 1 << 3,  // 8x8 精灵使用 $1000 的图案表
+      SFC_CTRL_BG_TBL  = 1 << 4,  // 背景使用 $1000 的图案表
+      SFC_CTRL_SPR_16  = 1 << 5,  // 8x16 精灵
+      SFC_CTRL_NMI     = 1 << 7,  // VBlank 时产生 NMI
+  };
+
+  // PPUSTATUS($2002) 的各个位
+  enum sfc_ppu_status_flag {
+      SFC_STATUS_OVERFLOW = 1 << 5,  // 精灵溢出
+      SFC_STATUS_SPR0HIT  = 1 << 6,  // 0 号精灵命中
+      SFC_STATUS_VBLANK   = 1 << 7,  // 处于 VBlank
+  };
+
+  // PPU 的画面输出，第一次输出像素时才分配
+  struct nes_ppu_output
+  {
+    // 输出画面，每个像素为 6 位颜色索引
+    uint8_t framebuffer[240 * 256];
+    // 每条扫描线的色彩强调位（PPUMASK 的高 3 位）
+    uint8_t emphasis[240];
+  };
+
+  // 图形处理器，按需追赶（catch-up）CPU 的周期
+  /*
+    PPU 不随每条指令单步执行，而是记录自己已同步到的 PPU 周期，
+    只在 CPU 访问 $2000-$3FFF 或时间线上预定的 VBlank 事件到期时才向前推进。
+    推进以扫描线内的关键点为粒度：
+      - 第 1 周期：渲染整条可见扫描线，并算出 0 号精灵命中的位置
+      - 命中周期：设置 0 号精灵命中标记
+      - 第 256/257 周期：垂直滚动自增、复制水平滚动
+      - 预渲染线第 304 周期：复制垂直滚动
+  */
+  class nes_ppu
+  {
+  friend struct nes_machine;
+  private:
+    // PPUCTRL
+    uint8_t ctrl;
+    // PPUMASK
+    uint8_t mask;
+    // PPUSTATUS
+    uint8_t status;
+    // OAMADDR
+    uint8_t oam_addr;
+    // 当前 VRAM 地址（loopy v）
+    uint16_t vram_addr;
+    // 临时 VRAM 地址（loopy t）
+    uint16_t temp_addr;
+    // 精细 X 滚动
+    uint8_t fine_x;
+    // $2005/$2006 的写入次序
+    uint8_t write_toggle;
+    // $2007 的读缓冲
+    uint8_t read_buffer;
+    // 最近一次写入寄存器的值，读取只写寄存器时返回
+    uint8_t open_bus;
+    // 是否需要向 CPU 发出 NMI
+    bool nmi_pending;
+    // 是否输出像素，关闭时只维护 0 号精灵命中与精灵溢出等时序可见的状态
+    bool output_enabled;
+
+    // 已同步到的 PPU 周期（CPU 周期的 3 倍）
+    uint64_t dot_clock;
+    // 当前扫描线，0-261
+    uint16_t scanline;
+    // 当前扫描线内已经过的周期，0-340
+    uint16_t dot;
+    // 当前帧 0 号精灵命中的周期，没有则为 0
+    uint16_t hit_dot;
+    // 已完成的帧数
+    uint64_t frame_count;
+
+    // 精灵属性表
+    uint8_t oam[256];
+    // 调色板
+    uint8_t palette[32];
+    // 主机上的 2KB 名称表
+    uint8_t nametables[2 * 1024];
+    // 卡带上的显存，在 machine 之外按 ROM 分配：没有 CHR-ROM 时的 8KB CHR-RAM，四屏幕时另加 2KB 名称表
+    uint8_t* cart_vram = NULL;
+    // cart_vram 的字节数
+    uint32_t cart_vram_size = 0;
+    // 图案表（CHR-ROM 或 CHR-RAM）
+    uint8_t* pattern;
+    // 是否可以写入图案表
+    bool pattern_writable;
+    // $2000-$2FFF 的四个名称表按镜像方式的映射
+    uint8_t* nametable_banks[4];
+
+    // 画面输出，在 machine 之外按需分配，从未输出像素时为 NULL
+    nes_ppu_output* output = NULL;
+    // 没有画面输出时 get_framebuffer/get_emphasis 返回的全 0 内容
+    static const nes_ppu_output blank;
+    // 使用的合成内核
+    const nes_ppu_kernels* kernels;
+    // 事件时间线
+    nes_scheduler* scheduler;
+
+    // 读取 PPU 地址空间
+    uint8_t vram_read(uint16_t addr);
+    // 写入 PPU 地址空间
+    void vram_write(uint16_t addr, uint8_t data);
+    // 背景或精灵是否开启
+    bool rendering() { return mask & (SFC_MASK_BG | SFC_MASK_SPR); }
+    // 当前扫描线的长度（奇数帧开启渲染时预渲染线少 1 个周期）
+    uint16_t line_length();
+    // 当前扫描线内下一个需要处理的周期
+    uint16_t next_dot();
+    // 处理到达 dot 时发生的事件
+    void run_dot();
+    // 抓取当前扫描线第 skip 个起的 count 个背景 tile
+    void fetch_bg_tiles(int skip, int count, uint8_t* plane0, uint8_t* plane1, uint8_t* attr);
+    // 抓取精灵 s 第 row 行的两个位平面，处理翻转
+    void fetch_sprite_row(const uint8_t* s, int row, uint8_t& plane0, uint8_t& plane1);
+    // 渲染当前扫描线
+    void render_line();
+    // 不输出像素，只求出 0 号精灵命中与精灵溢出
+    void render_line_timing();
+    // 求出对当前扫描线可见的精灵，line 不为 NULL 时叠加到精灵行缓冲中
+    //  - 返回 0 号精灵在本扫描线上的行号，不在本扫描线上时返回 -1
+    int evaluate_sprites(uint8_t* line);
+    // 垂直滚动自增
+    void increment_y();
+    // 距离到达 (line, pos) 还需的 PPU 周期
+    uint64_t dots_until(uint16_t line, uint16_t pos);
+    // 按当前状态在时间线上重新预定 VBlank 事件
+    void reschedule();
+    // 产生 NMI，并让 CPU 尽快回到批次边界
+    void raise_nmi();
+
+  public:
+    ~nes_ppu();
+    // 根据 rom 信息初始化图案表与名称表镜像，并绑定事件时间线，像素输出默认关闭
+    void init(nes_rom_info* rom_info, nes_scheduler* scheduler);
+    // 追赶到 CPU 的第 cpu_cycle 个周期
+    void catch_up(uint64_t cpu_cycle);
+    // 读取寄存器，addr 为 0-7
+    uint8_t read_register(uint8_t addr);
+    // 写入寄存器，addr 为 0-7
+    void write_register(uint8_t addr, uint8_t data);
+    // OAM DMA：把 256 字节从 OAMADDR 开始写入精灵属性表，效果等同于连续写 256 次 $2004
+    void write_oam(const uint8_t* data);
+    // 下一次 VBlank 开始时的 CPU 周期
+    uint64_t next_vblank_cycle();
+    // 下一帧开始时的 CPU 周期
+    uint64_t next_frame_cycle();
+    // 取走待处理的 NMI，返回之前是否存在
+    bool take_nmi() { const bool n = nmi_pending; nmi_pending = false; return n; }
+    // 已完成的帧数
+    uint64_t get_frame_count() { return frame_count; }
+    // 开启或关闭像素输出，第一次开启时分配画面
+    void set_output(bool enabled);
+    // 获取画面
+    const uint8_t* get_framebuffer() { return (output? output: &blank)->framebuffer; }
+    // 获取每条扫描线的色彩强调位
+    const uint8_t* get_emphasis() { return (output? output: &blank)->emphasis; }
+    // 在 machine 之外分配的字节数
+    size_t allocated_bytes() { return cart_vram_size + (output? sizeof(nes_ppu_output): 0); }
+  };
+}
+
+#endif
@@ -0,0 +1,58 @@
+#include <cstdlib>
+
+#ifndef NES_PPU_RENDER_H
+#define NES_PPU_RENDER_H
+
+// 一条扫描线需要抓取的背景 tile 数（256 像素 + 精细滚动多出的一个 tile）
+#define SFC_BG_TILES_PER_LINE 33
+// 精灵行缓冲的长度，末尾多留 8 字节以便 x=255 的精灵整块写入
+#define SFC_SPRITE_LINE_LEN (256 + 8)
+
+namespace fc
+{
+  // PPUMASK 中与合成相关的位
+  enum sfc_ppu_mask_flag {
+      SFC_MASK_GRAY    = 1 << 0,  // 灰度模式
+      SFC_MASK_BG_L8   = 1 << 1,  // 显示最左侧 8 像素的背景
+      SFC_MASK_SPR_L8  = 1 << 2,  // 显示最左侧 8 像素的精灵
+      SFC_MASK_BG      = 1 << 3,  // 显示背景
+      SFC_MASK_SPR     = 1 << 4,  // 显示精灵
+  };
+
+  // 精灵行缓冲中每个像素的附加位（低 5 位为调色板地址 0x10-0x1F）
+  enum sfc_sprite_pixel_flag {
+      SFC_SPR_BEHIND   = 1 << 5,  // 优先级低于背景
+      SFC_SPR_ZERO     = 1 << 6,  // 来自 0 号精灵
+  };
+
+  // 背景/精灵合成内核，同一组接口有标量、SSE4.1、AVX2 三种实现
+  struct nes_ppu_kernels {
+    // 实现的名称
+    const char* name;
+    // 把 count 个 tile 的两个位平面解码为 8*count 个像素（调色板地址，透明为 0）
+    //  - attr 为每个 tile 的调色板选择，背景为 0-3，精灵为 4-7
+    void (*decode_tiles)(const uint8_t* plane0, const uint8_t* plane1,
+                         const uint8_t* attr, int count, uint8_t* out);
+    // 解码一整条扫描线的 33 个背景 tile，并按精细滚动 fine_x 截取 256 像素
+    void (*render_bg)(const uint8_t* plane0, const uint8_t* plane1,
+                      const uint8_t* attr, uint8_t fine_x, uint8_t* out);
+    // 把一个精灵的 8 像素叠加到精灵行缓冲中，已有不透明像素的位置不会被覆盖
+    //  - flags 为 0-3 的调色板选择再或上 sfc_sprite_pixel_flag
+    //  - 调用者需按 OAM 顺序（优先级从高到低）依次叠加，水平翻转由调用者处理
+    void (*overlay_sprite)(uint8_t* line, uint8_t plane0, uint8_t plane1,
+                           uint8_t flags, uint8_t x);
+    // 按优先级合成背景与精灵并查调色板，输出 256 个 6 位颜色索引
+    //  - 返回 0 号精灵命中的 x 坐标，没有命中则返回 -1
+    int (*compose)(const uint8_t* bg, const uint8_t* spr,
+                   const uint8_t* palette, uint8_t mask, uint8_t* out);
+  };
+
+  // 标量实现，同时也是其它实现逐位比对的基准
+  const nes_ppu_kernels& nes_ppu_kernels_scalar();
+  // 根据 CPU 支持的指令集返回最快的实现
+  const nes_ppu_kernels& nes_ppu_kernels_best();
+  // 列出所有在当前 CPU 上可用的实现，返回数量
+  int nes_ppu_kernels_available(const nes_ppu_kernels* list[], int max);
+}
+
+#endif
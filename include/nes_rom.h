@@ -64,13 +64,26 @@ namespace fc
   {
   private:
     FILE* fp;
+    // load_memory 时文件头之后的内容及其长度
+    const uint8_t* source;
+    size_t source_size;
     nes_header_info_buffer buffer;
     nes_rom_info info;
 
   public:
+    nes_rom_handler(): fp(NULL), source(NULL), source_size(0) { info.prg_rom_ptr = info.chr_rom_ptr = NULL; }
     // 加载一个文件内容到 buffer 中
     void load_image(const char* path);
-    // 解析 buffer 中的内容为 nes_header_info，同时申请内存空间
+    // 从内存中的镜像加载文件头，之后同样调用 parse_to_info
+    /*
+      不是合法的镜像或长度不足以容纳文件头声明的 PRG/CHR-ROM 时返回 false，
+      data 只需在 parse_to_info 返回前有效，其内容会被复制。
+    */
+    bool load_memory(const uint8_t* data, size_t size);
+    // 解析 buffer 中的内容为 nes_header_info，同时申请内存空间，读完后关闭文件
+    /*
+      之后镜像只被读取，多个 simulator 可以通过 load_rom(nes_rom_handler*) 共享同一份。
+    */
     void parse_to_info();
     // 返回内部的 nes_header_info
     nes_rom_info* get_info();
@@ -0,0 +1,73 @@
+#include <cstdlib>
+#include "./nes_clock.h"
+
+#ifndef NES_SCHEDULER_H
+#define NES_SCHEDULER_H
+
+// 事件堆的容量，包含被替换后尚未弹出的过期项
+#define SFC_EVENT_HEAP_SIZE 32
+
+namespace fc
+{
+  // 时间线上的事件种类，每种同一时刻只有一个有效的预定
+  enum sfc_event_type {
+      SFC_EVENT_VBLANK = 0,     // PPU 进入 VBlank（开启 NMI 时才预定）
+      SFC_EVENT_APU_FRAME_IRQ,  // APU 帧计数器中断
+      SFC_EVENT_DMC,            // DMC 取样/中断
+      SFC_EVENT_MAPPER_IRQ,     // 预留给带 IRQ 计数器的 mapper
+      SFC_EVENT_COUNT,
+  };
+
+  // 时间线上的一项
+  struct nes_event {
+    // 到期的 CPU 周期
+    uint64_t cycle;
+    // 事件种类
+    uint8_t type;
+  };
+
+  // 以最小堆保存未来事件的时间线
+  /*
+    CPU 以批次执行，批次的终点为最早的事件；批次边界上弹出所有到期事件，
+    由 simulator 分派给对应的设备追赶，再统一检查 NMI/IRQ。
+    重新预定时不在堆中查找旧项，而是记录每种事件当前有效的周期，
+    弹出时丢弃与之不符的过期项（惰性删除）。
+  */
+  class nes_scheduler
+  {
+  private:
+    // 最小堆
+    nes_event heap[SFC_EVENT_HEAP_SIZE];
+    // 堆中的项数
+    int size;
+    // 每种事件当前有效的到期周期，没有预定时为 UINT64_MAX
+    uint64_t due[SFC_EVENT_COUNT];
+    // CPU 的周期计数，用来截断当前批次
+    nes_clock* clock;
+
+    // 向堆中加入一项
+    void push(uint64_t cycle, uint8_t type);
+    // 移除堆顶
+    void pop();
+    // 堆满时丢弃所有过期项，按 due 重建
+    void rebuild();
+    // 堆顶是否为过期项
+    bool stale_top();
+
+  public:
+    // 清空时间线并绑定 CPU 的周期计数
+    void init(nes_clock* clock);
+    // 预定（或改期）type 事件在 cycle 到期，早于当前批次终点时截断批次
+    void schedule(uint8_t type, uint64_t cycle);
+    // 取消 type 事件
+    void cancel(uint8_t type);
+    // 最早的有效事件的周期，没有时返回 UINT64_MAX
+    uint64_t next_cycle();
+    // 弹出一个在 now 之前到期的事件，返回其种类，没有则返回 -1
+    int pop_due(uint64_t now);
+    // 让 CPU 在当前指令结束后回到批次边界（例如 NMI 被立即触发时）
+    void poll_now() { if (clock->stop > clock->cycle) clock->stop = clock->cycle; }
+  };
+}
+
+#endif
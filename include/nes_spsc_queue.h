@@ -0,0 +1,128 @@
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+
+#ifndef NES_SPSC_QUEUE_H
+#define NES_SPSC_QUEUE_H
+
+namespace fc
+{
+  // 队列满时生产者的处理方式
+  enum sfc_backpressure {
+      SFC_BP_DROP = 0,  // 丢弃新的一项
+      SFC_BP_BLOCK,     // 等待消费者腾出空间
+      SFC_BP_LATEST,    // 只保留最新的一项，未被读走的旧项被覆盖
+  };
+
+  // 单生产者/单消费者的无锁队列，槽位在 init 时一次性分配
+  /*
+    读写都分为 begin/end 两步，生产者直接在槽位中填写数据，消费者直接在槽位中读取，
+    不发生额外的拷贝：
+      - DROP/BLOCK：容量为 2 的幂的环形队列，head 只由消费者推进，tail 只由生产者推进
+      - LATEST：三缓冲，生产者写 back，写完后与 middle 交换并打上新数据标记，
+        消费者发现标记后把自己的 front 与 middle 交换，因此永远拿到最新的一项
+  */
+  template <typename T>
+  class nes_spsc_queue
+  {
+  private:
+    // 三缓冲中表示 middle 为新数据的标记
+    static const uint32_t FRESH = 0x80000000u;
+
+    T* slots = NULL;
+    uint32_t capacity = 0;
+    sfc_backpressure policy = SFC_BP_DROP;
+
+    // 消费者下一次读取的位置
+    alignas(64) std::atomic<uint32_t> head;
+    // 生产者下一次写入的位置
+    alignas(64) std::atomic<uint32_t> tail;
+    // 三缓冲的 middle 槽位及新数据标记
+    alignas(64) std::atomic<uint32_t> middle;
+    // 三缓冲中生产者与消费者各自持有的槽位
+    uint32_t back = 0;
+    uint32_t front = 0;
+    // 被丢弃（或被覆盖）的项数
+    std::atomic<uint64_t> dropped;
+    // 关闭后阻塞中的生产者立即返回
+    std::atomic<bool> closed;
+
+  public:
+    // 分配 capacity 个槽位（向上取整为 2 的幂，LATEST 固定为 3 个）
+    void init(uint32_t capacity, sfc_backpressure policy) {
+      this->policy = policy;
+      if (policy == SFC_BP_LATEST) {
+        capacity = 3;
+      } else {
+        uint32_t n = 2;
+        while (n < capacity) n <<= 1;
+        capacity = n;
+      }
+      this->capacity = capacity;
+      slots = new T[capacity];
+      head.store(0);
+      tail.store(0);
+      back = 0;
+      middle.store(1);
+      front = 2;
+      dropped.store(0);
+      closed.store(false);
+    }
+
+    // 释放槽位
+    void destroy() {
+      delete[] slots;
+      slots = NULL;
+    }
+
+    // 生产者取得一个可写的槽位，DROP 策略下队列已满时返回 NULL
+    T* begin_write() {
+      if (policy == SFC_BP_LATEST) return slots + back;
+      const uint32_t t = tail.load(std::memory_order_relaxed);
+      while (t - head.load(std::memory_order_acquire) == capacity) {
+        if (policy == SFC_BP_DROP || closed.load(std::memory_order_relaxed)) {
+          dropped.fetch_add(1, std::memory_order_relaxed);
+          return NULL;
+        }
+        std::this_thread::yield();
+      }
+      return slots + (t & (capacity - 1));
+    }
+
+    // 生产者发布 begin_write 取得的槽位
+    void end_write() {
+      if (policy == SFC_BP_LATEST) {
+        const uint32_t prev = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+        if (prev & FRESH) dropped.fetch_add(1, std::memory_order_relaxed);
+        back = prev & ~FRESH;
+        return;
+      }
+      tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // 消费者取得最早（LATEST 为最新）的一项，队列为空时返回 NULL
+    T* begin_read() {
+      if (policy == SFC_BP_LATEST) {
+        if (!(middle.load(std::memory_order_acquire) & FRESH)) return NULL;
+        front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+        return slots + front;
+      }
+      const uint32_t h = head.load(std::memory_order_relaxed);
+      if (h == tail.load(std::memory_order_acquire)) return NULL;
+      return slots + (h & (capacity - 1));
+    }
+
+    // 消费者归还 begin_read 取得的槽位
+    void end_read() {
+      if (policy == SFC_BP_LATEST) return;
+      head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // 让阻塞中的生产者放弃等待
+    void close() { closed.store(true); }
+    // 被丢弃的项数
+    uint64_t get_dropped() { return dropped.load(std::memory_order_relaxed); }
+  };
+}
+
+#endif
@@ -0,0 +1,61 @@
+#include <cstdlib>
+#include <vector>
+
+#ifndef NES_WORKLOAD_H
+#define NES_WORKLOAD_H
+
+// 程序入口（nes_cpu::init 固定从 $C000 开始执行）
+#define SFC_WORKLOAD_ENTRY 0xC000
+// 程序结束后停留的地址，该处为 JMP 到自身的死循环
+#define SFC_WORKLOAD_HALT_PC 0xFFF0
+// 结束前写入完成标记的地址与值，可以用写入监视点精确停在结束的那一刻
+#define SFC_WORKLOAD_DONE_ADDR 0x07FF
+#define SFC_WORKLOAD_DONE_VALUE 0xA5
+
+namespace fc
+{
+  // 合成负载的种类
+  enum sfc_workload_kind {
+      SFC_WORKLOAD_MEMSET,     // STA abs,X / INX / BNE 逐页填充内存
+      SFC_WORKLOAD_MEMCPY,     // LDA abs,X / STA abs,X 逐页复制内存
+      SFC_WORKLOAD_ADC,        // 32 位多字节 ADC/SBC 运算
+      SFC_WORKLOAD_BRANCHY,    // 由 LFSR 驱动、CMP/BNE 分派的 8 状态状态机
+      SFC_WORKLOAD_RECURSION,  // 深层 JSR 递归
+      SFC_WORKLOAD_TABLE_WALK, // (zp),Y 遍历 PRG 中的数据表
+      SFC_WORKLOAD_SMC,        // 执行复制到 RAM 中并不断改写自身的代码
+      SFC_WORKLOAD_COUNT,
+  };
+
+  // 合成负载的参数
+  struct nes_workload_params {
+    // sfc_workload_kind
+    int kind;
+    // 外层循环次数，1-65535
+    uint16_t iterations;
+    // 每次外层循环的规模，含义随种类而定，0 表示使用默认值：
+    //  - memset：填充的页数 1-5（$0200 起）
+    //  - memcpy：复制的页数 1-2（$0200 起复制到 $0400 起）
+    //  - adc / branchy / smc：内层循环次数 1-255
+    //  - recursion：递归深度 1-80
+    //  - table_walk：遍历的页数 1-16（$D000 起）
+    uint16_t size;
+  };
+
+  // 种类的名称，例如 "memset"
+  const char* nes_workload_name(int kind);
+  // 根据名称查找种类，找不到时返回 -1
+  int nes_workload_find(const char* name);
+  // 把 size 为 0 或超出范围的参数修正为实际使用的值
+  nes_workload_params nes_workload_normalize(const nes_workload_params& params);
+  // 生成 NROM-256 的 iNES 镜像（16 字节文件头 + 32KB PRG + 8KB CHR）
+  /*
+    程序从 $C000 开始，执行 iterations 次外层循环后向 $07FF 写入 $A5，
+    然后停在 $FFF0 的死循环中。NMI 与 IRQ 向量指向一条 RTI，且程序全程屏蔽 IRQ、
+    不开启 PPU 的 NMI，因此同样的参数总是得到同样的指令流与周期数。
+  */
+  std::vector<uint8_t> nes_workload_build(const nes_workload_params& params);
+  // 生成镜像并写入 path，返回是否成功
+  bool nes_workload_write(const nes_workload_params& params, const char* path);
+}
+
+#endif
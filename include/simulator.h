@@ -2,16 +2,49 @@
 #include <cstdlib>
 #include "./nes_rom.h"
 #include "./nes_cpu.h"
-#include "./nes_nrom_mapper.h"
+#include "./nes_mapper.h"
 #include "./nes_memory_pool.h"
+#include "./nes_ppu.h"
+#include "./nes_apu.h"
+#include "./nes_scheduler.h"
+#include "./nes_pipeline.h"
+#include "./nes_hash.h"
+#include "./nes_joypad.h"
+#include "./nes_movie.h"
+#include "./nes_debugger.h"
+#include "./nes_aot.h"
+#include "./nes_machine.h"
 
 #ifndef SIMULATOR_H
 #define SIMULATOR_H
 
 namespace fc
 {
-  static nes_mapper* mappers[] = {
-    new nes_nrom_mapper()
+  // 帧率统计，输出像素的帧与跳过像素输出的帧分开计时
+  struct nes_frame_stats
+  {
+    // 输出了像素的帧数
+    uint64_t rendered_frames;
+    // 跳过像素输出的帧数
+    uint64_t skipped_frames;
+    // 输出像素的帧所用的时间（秒）
+    double rendered_seconds;
+    // 跳过像素输出的帧所用的时间（秒）
+    double skipped_seconds;
+    // 单次 run_frame 用时的最大值（秒），包括提前运行的帧
+    double max_seconds;
+    // 提前运行时保存与恢复快照所用的时间（秒）
+    double snapshot_seconds;
+
+    // 输出像素的帧的帧率
+    double rendered_fps() { return rendered_seconds > 0? rendered_frames / rendered_seconds: 0; }
+    // 跳过像素输出的帧的帧率
+    double skipped_fps() { return skipped_seconds > 0? skipped_frames / skipped_seconds: 0; }
+    // 每个显示帧的平均主机用时（毫秒）
+    double ms_per_frame() {
+      const uint64_t frames = rendered_frames + skipped_frames;
+      return frames? (rendered_seconds + skipped_seconds) * 1000 / frames: 0;
+    }
   };
 
   // 模拟器主体
@@ -20,25 +53,196 @@ namespace fc
   private:
     // 当前加载的 rom 信息
     nes_rom_info* rom_info;
-    // 用来处理 rom 镜像
-    nes_rom_handler rom_handler;
+    // 用来处理 rom 镜像，共享时属于调用者
+    nes_rom_handler* rom_handler;
+    // rom_handler 是否由本实例创建并释放
+    bool owns_rom;
+    // 当前 ROM 的 mapper
+    nes_mapper* mapper;
+    // 分配 machine 的池
+    nes_machine_pool* pool;
+    // 全部可变状态所在的连续内存，以下各设备都是其中的成员
+    nes_machine* machine;
     // 用来读写内存
-    nes_memory_pool memory_pool;
+    nes_memory_pool& memory_pool;
     // 用来解释和执行指令
-    nes_cpu cpu;
+    nes_cpu& cpu;
+    // 用来生成画面
+    nes_ppu& ppu;
+    // 用来生成声音
+    nes_apu& apu;
+    // 未来事件的时间线
+    nes_scheduler& scheduler;
+    // 手柄
+    nes_joypad& joypad;
+    // 断点与观察点
+    nes_debugger debugger;
+    // 预编译块
+    nes_aot aot;
+
+    // 是否为无画面模式
+    bool headless;
+    // 无画面模式下每隔多少帧完整渲染一帧，0 表示从不
+    uint32_t render_interval;
+    // 是否要求下一帧完整渲染
+    bool render_requested;
+    // 上一次 run_frame 停在断点或观察点上，这一帧还没运行完
+    bool frame_pending;
+    // 当前帧是否完整渲染
+    bool frame_render;
+    // 帧率统计
+    nes_frame_stats frame_stats;
+    // 输出流水线，为 NULL 时不输出
+    nes_av_pipeline* pipeline;
+    // 每帧结束时读出的音频采样，第一次有采样时分配
+    int16_t* audio_samples;
+    // 已输出的音频采样数
+    uint64_t audio_position;
+    // 逐帧状态摘要的日志，为 NULL 时不记录
+    nes_hash_log* hash_log;
+    // 不为 0 时改为每执行这么多条指令记录一条摘要，hash_countdown 为距下一条记录的指令数
+    uint64_t hash_interval;
+    uint64_t hash_countdown;
+    // 正在回放的输入录像，为 NULL 时不回放
+    const nes_movie* movie;
+    // 下一帧对应录像中的序号
+    uint64_t movie_frame;
+    // 提前运行的帧数，0 表示不提前运行
+    uint32_t run_ahead_frames;
+    // 提前运行用的快照，之后紧跟显示帧的画面与色彩强调位
+    uint8_t* run_ahead_buffer;
+
+    // 让 PPU 与 APU 追赶到 CPU 当前的周期
+    void sync_devices();
+    // 把到期的事件分派给对应的设备
+    void dispatch_event(int type);
+    // 在批次边界上检查并响应 NMI/IRQ
+    void service_interrupts();
+    // 逐条执行到 until，按指令数记录状态摘要
+    void run_hashed(uint64_t until);
+    // 按指令数记录状态摘要时，每执行完一条指令调用一次
+    void count_hashed_instruction() {
+      if (--hash_countdown) return;
+      hash_countdown = hash_interval;
+      hash_log->append(digest());
+    }
+    // 运行一帧，render/audio 决定是否输出像素与声音，停在断点或观察点上时返回 false
+    bool emulate_frame(bool render, bool audio);
+    // 提前运行时显示帧的画面
+    uint8_t* presented_pixels() { return run_ahead_buffer + snapshot_size(); }
+    // 按 rom_handler 中已解析的 ROM 初始化各设备
+    void attach_rom();
 
   public:
-    // Constructor，初始化一些状态
-    simulator();
+    // Constructor，初始化一些状态，从 pool（为 NULL 时为 nes_machine_pool::shared()）取得 machine
+    explicit simulator(nes_machine_pool* pool = NULL);
+    ~simulator();
     // 根据路径加载 rom 到 rom_info 中
     void load_rom(const char* path);
+    // 使用已解析的 ROM（parse_to_info 之后），不复制也不接管
+    /*
+      ROM 镜像只被读取，任意多个实例可以共享同一个 rom，
+      rom 须在这些实例 free_rom 或析构之后才能 unload_image。
+    */
+    void load_rom(nes_rom_handler* rom);
     // 释放当前加载的 rom_info
     void free_rom();
     // 获取内存池对象
     nes_memory_pool& get_memory_pool() { return memory_pool; }
     // 获取 cpu 对象
     nes_cpu& get_cpu() { return cpu; }
-    // 输出当前寄存器的值
+    // 获取 ppu 对象
+    nes_ppu& get_ppu() { return ppu; }
+    // 获取 apu 对象
+    nes_apu& get_apu() { return apu; }
+    // 获取手柄对象
+    nes_joypad& get_joypad() { return joypad; }
+    // 获取调试器，断点与观察点命中时 run_until/run_frame/step 提前返回
+    nes_debugger& get_debugger() { return debugger; }
+    // 上一次运行是否停在断点或观察点上
+    bool stopped() { return debugger.has_hit(); }
+    // 运行到 CPU 的第 cycle 个周期
+    /*
+      CPU 以批次为单位连续执行，批次的终点为 cycle 与时间线上最早的事件中较早者，
+      设备只在 CPU 访问其寄存器或其事件到期时才追赶，从而避免逐条指令同步。
+      中断只在批次边界上检查，而不是每条指令检查一次。
+    */
+    void run_until(uint64_t cycle);
+    // 运行到下一帧开始
+    /*
+      停在断点或观察点上时提前返回，再次调用时从停下的地方继续运行这一帧，
+      不会再次读取录像中的输入。提前运行的推测帧中断点与观察点不生效。
+    */
+    void run_frame();
+    // 开启或关闭无画面模式
+    /*
+      无画面模式下 PPU 跳过像素输出、APU 不生成采样，但 VBlank、0 号精灵命中与精灵溢出照常维护，
+      因此对游戏程序而言时序不变；每隔 interval 帧（为 0 则从不）仍完整渲染一帧。
+    */
+    void set_headless(bool enabled, uint32_t interval = 0);
+    // 要求下一帧完整渲染（无画面模式下按需截图用）
+    void request_render() { render_requested = true; }
+    // 设置提前运行（run-ahead）的帧数，0 表示关闭
+    /*
+      每个显示帧先以当前输入运行一帧真实帧（保留声音、不输出像素）并保存快照，
+      再沿用同一输入静音运行 frames 帧，把最后一帧的画面作为显示帧，然后恢复快照。
+      画面因此领先真实状态 frames 帧，抵消游戏自身读取输入到画出结果之间的延迟；
+      状态摘要、音频与录像回放都只按真实帧推进，与不提前运行时一致。
+      主机每个显示帧需模拟 frames + 1 帧，至少要有 frames + 1 倍实时的速度。
+    */
+    void set_run_ahead(uint32_t frames);
+    // 提前运行的帧数
+    uint32_t get_run_ahead() { return run_ahead_frames; }
+    // 最近一个显示帧的画面，提前运行时为领先的那一帧，否则即 PPU 的画面
+    const uint8_t* get_framebuffer() { return run_ahead_frames? presented_pixels(): ppu.get_framebuffer(); }
+    // 最近一个显示帧每条扫描线的色彩强调位
+    const uint8_t* get_emphasis() { return run_ahead_frames? presented_pixels() + 240 * 256: ppu.get_emphasis(); }
+    // 获取帧率统计，提前运行时每帧的用时包括提前运行的帧与快照
+    nes_frame_stats& get_frame_stats() { return frame_stats; }
+    // 绑定输出流水线，每个完整渲染的帧结束后送入其中，音频每帧整块送入
+    void set_pipeline(nes_av_pipeline* p) { pipeline = p; }
+    // 计算当前状态的摘要：CPU 寄存器与周期、主内存、SRAM、画面
+    /*
+      画面只在完整渲染的帧结束后才是最新的，
+      比较无画面模式与完整渲染的两份日志时应只看其余字段。
+    */
+    nes_state_digest digest();
+    // 绑定状态摘要日志，每帧结束后追加一条记录
+    /*
+      instructions 不为 0 时改为每执行 instructions 条指令（跨帧连续计数，包括 step）追加一条，
+      用于把分歧定位到帧内。此时 CPU 逐条执行，速度远低于正常运行；提前运行的推测帧不记录。
+    */
+    void set_hash_log(nes_hash_log* log, uint64_t instructions = 0) {
+      hash_log = log;
+      hash_interval = instructions;
+      hash_countdown = instructions;
+    }
+    // 回放输入录像，之后每帧开始前按录像设置两个手柄的按键
+    void play_movie(const nes_movie* m) { movie = m; movie_frame = 0; }
+    // 录像是否已经回放完
+    bool movie_finished() { return !movie || movie_frame >= movie->size(); }
+    // 单步执行 count 条指令，每条指令后分派到期事件并响应中断，期间不生成声音
+    void step(uint64_t count = 1);
+    // 快照需要的字节数，加载 ROM 之后不变
+    size_t snapshot_size();
+    // 把 CPU、内存、PPU、APU 与时间线的状态（即整个 nes_machine 与 SRAM、卡带显存）保存到 buf
+    /*
+      各设备之间以及指向 ROM 镜像的指针原样保存，
+      因此快照只能恢复到生成它的同一个实例，且期间不能重新加载 ROM。
+    */
+    void save_state(void* buf);
+    // 从 save_state 生成的快照恢复
+    void load_state(const void* buf);
+    // 加载为当前 ROM 预编译的共享库（见 nes_aot.h），失败时 error 指向原因
+    bool load_aot(const char* path, const char** error = NULL);
+    // 从块缓存目录加载当前 ROM 的预编译块（见 nes_aot），缓存中没有或已失效时返回 false
+    bool load_aot_cache(const char* dir, const char** error = NULL);
+    // 获取预编译块
+    nes_aot& get_aot() { return aot; }
+    // 卸载预编译块，回到逐条解释
+    void unload_aot() { cpu.set_aot(NULL); aot.unload(); }
+    // 本实例占用的字节数：simulator、machine 与它们按需分配的缓冲区，不含 ROM 镜像与预编译块
+    size_t instance_bytes();
   };
 }
 
@@ -19,7 +19,7 @@ int main(int argc, char const *argv[])
       char buf[OP_BUF_LEN] = {0};
       printf("\nInst-%d\n", idx);
 
-      fc.get_cpu().disassemble_op(fc.get_cpu().get_pc(), buf);
+      fc.get_cpu().output_op(fc.get_cpu().get_pc(), buf);
       printf("STR : %s\n", buf+6);
 
       fc.get_cpu().execute();
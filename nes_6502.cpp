@@ -287,6 +287,18 @@ namespace fc
     { 'I', 'S', 'B', SFC_AM_ABX },
   };
 
+  uint8_t addressing_mode(uint8_t opcode) {
+    return nes_opname_data[opcode].mode;
+  }
+
+  const char* addressing_mode_name(uint8_t mode) {
+    static const char* names[] = {
+      "unk", "acc", "imp", "imm", "abs", "abx", "aby",
+      "zpg", "zpx", "zpy", "inx", "iny", "ind", "rel",
+    };
+    return mode <= SFC_AM_REL? names[mode]: "unk";
+  }
+
   uint8_t disassemble(nes_code code, char buf[]) {
     uint8_t length = 0;
     const nes_opname opname = nes_opname_data[code.op];
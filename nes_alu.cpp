@@ -0,0 +1,25 @@
+#include "include/nes_alu.h"
+
+namespace fc
+{
+  nes_alu_tables::nes_alu_tables() {
+    for (int r=0; r<256; r++) {
+      zn[r] = (r? 0: SFC_FLAG_Z) | (r & SFC_FLAG_N);
+    }
+    for (int c=0; c<2; c++) {
+      for (int a=0; a<256; a++) {
+        for (int v=0; v<256; v++) {
+          const int sum = a + v + c;
+          const uint8_t r = (uint8_t)sum;
+          uint8_t flags = zn[r];
+          if (sum > 0xff) flags |= SFC_FLAG_C;
+          // 两个操作数同号而结果与之异号
+          if (~(a ^ v) & (a ^ r) & 0x80) flags |= SFC_FLAG_V;
+          adc[c][a][v] = r | flags << 8;
+        }
+      }
+    }
+  }
+
+  const nes_alu_tables nes_alu;
+}
@@ -0,0 +1,202 @@
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include "include/nes_aot.h"
+#include "include/nes_hash.h"
+
+namespace fc
+{
+  static const char BLOCK_CACHE_MAGIC[8] = "SFCBLK1";
+
+  uint64_t nes_build_id() {
+#ifdef SFC_BUILD_ID
+    static const char build[] = SFC_BUILD_ID;
+#elif defined(__VERSION__)
+    static const char build[] = __DATE__ " " __TIME__ " " __VERSION__;
+#else
+    static const char build[] = __DATE__ " " __TIME__;
+#endif
+    const uint64_t versions = (uint64_t)SFC_AOT_ABI_VERSION << 32 | SFC_BLOCK_CACHE_VERSION;
+    return nes_hash64(build, sizeof(build) - 1, versions);
+  }
+
+  // PRG-ROM 中从 pc 开始 length 字节的哈希（16K 时 $C000-$FFFF 是镜像）
+  static uint64_t block_hash(const uint8_t* prg, size_t prg_size, uint16_t pc, uint16_t length) {
+    std::vector<uint8_t> bytes(length);
+    for (uint32_t i=0; i<length; i++) bytes[i] = prg[(pc + i - 0x8000) % prg_size];
+    return nes_hash64(bytes.data(), bytes.size());
+  }
+
+  bool nes_aot::open_module(const char* path, const char** error) {
+    const char* reason = NULL;
+    handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+      reason = dlerror();
+    } else {
+      const sfc_aot_module* (*entry)() = (const sfc_aot_module* (*)())dlsym(handle, SFC_AOT_ENTRY);
+      module = entry? entry(): NULL;
+      if (!module) reason = "没有 " SFC_AOT_ENTRY;
+      else if (module->abi_version != SFC_AOT_ABI_VERSION) reason = "接口版本不符";
+      else if (module->prg_size != prg_size || module->prg_hash != nes_hash64(prg, prg_size)) reason = "不是为该 ROM 生成的模块";
+    }
+    if (reason) {
+      if (error) *error = reason;
+      return false;
+    }
+    table = new sfc_aot_block[0x8000];
+    memset(table, 0, sizeof(sfc_aot_block) * 0x8000);
+    count = module->count;
+    return true;
+  }
+
+  bool nes_aot::load(const char* path, const uint8_t* prg, size_t prg_size, const char** error) {
+    unload();
+    this->prg = prg;
+    this->prg_size = prg_size;
+    if (!open_module(path, error)) {
+      unload();
+      return false;
+    }
+    for (uint32_t i=0; i<module->count; i++) {
+      const sfc_aot_entry_point& e = module->blocks[i];
+      if (e.pc & 0x8000) table[e.pc & 0x7fff] = e.block;
+    }
+    return true;
+  }
+
+  std::string nes_aot::cache_path(const char* dir, const uint8_t* prg, size_t prg_size, const char* ext) {
+    char name[64];
+    snprintf(name, sizeof(name), "/%016llx-%016llx%s", (unsigned long long)nes_hash64(prg, prg_size),
+      (unsigned long long)nes_build_id(), ext);
+    return std::string(dir) + name;
+  }
+
+  bool nes_aot::load_cache(const char* dir, const uint8_t* prg, size_t prg_size, const char** error) {
+    unload();
+    this->prg = prg;
+    this->prg_size = prg_size;
+    const char* reason = NULL;
+    const std::string index_path = cache_path(dir, prg, prg_size, ".blk");
+    const int fd = open(index_path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(nes_block_cache_header)) {
+      reason = "缓存中没有该 ROM";
+    } else {
+      void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED) {
+        index_map = (const uint8_t*)map;
+        index_size = st.st_size;
+      }
+    }
+    if (fd >= 0) close(fd);
+
+    if (!reason && !index_map) reason = "无法映射块索引";
+    if (!reason) {
+      // 文件名已经包含了哈希与构建标识，这里只防止文件被截断或内容与文件名不符
+      const nes_block_cache_header* header = (const nes_block_cache_header*)index_map;
+      if (memcmp(header->magic, BLOCK_CACHE_MAGIC, sizeof(header->magic)) || header->version != SFC_BLOCK_CACHE_VERSION) reason = "块索引的格式版本不符";
+      else if (header->build_id != nes_build_id()) reason = "块索引来自其它构建";
+      else if (header->prg_size != prg_size || header->prg_hash != nes_hash64(prg, prg_size)) reason = "块索引不是为该 ROM 生成的";
+      else if (index_size != sizeof(nes_block_cache_header) + header->count * sizeof(nes_block_record)) reason = "块索引的长度不符";
+    }
+    if (!reason) open_module(cache_path(dir, prg, prg_size, ".so").c_str(), &reason);
+    if (reason) {
+      if (error) *error = reason;
+      unload();
+      return false;
+    }
+
+    pending = new bool[0x8000];
+    memset(pending, 0, sizeof(bool) * 0x8000);
+    const nes_block_cache_header* header = (const nes_block_cache_header*)index_map;
+    const nes_block_record* records = (const nes_block_record*)(header + 1);
+    for (uint32_t i=0; i<header->count; i++) {
+      if (records[i].pc & 0x8000) pending[records[i].pc & 0x7fff] = true;
+    }
+    return true;
+  }
+
+  bool nes_aot::validate_block(uint16_t pc) {
+    pending[pc & 0x7fff] = false;
+    const nes_block_cache_header* header = (const nes_block_cache_header*)index_map;
+    const nes_block_record* begin = (const nes_block_record*)(header + 1);
+    const nes_block_record* end = begin + header->count;
+    nes_block_record key;
+    key.pc = pc;
+    const nes_block_record* r = std::lower_bound(begin, end, key,
+      [](const nes_block_record& a, const nes_block_record& b) { return a.pc < b.pc; });
+    const bool ok = r != end && r->pc == pc && r->index < module->count
+      && module->blocks[r->index].pc == pc && module->blocks[r->index].length == r->length
+      && block_hash(prg, prg_size, pc, r->length) == r->hash;
+    if (!ok) {
+      ++rejected;
+      return false;
+    }
+    table[pc & 0x7fff] = module->blocks[r->index].block;
+    ++validated;
+    return true;
+  }
+
+  bool nes_aot::save_cache(const char* dir) {
+    if (!module) return false;
+    std::vector<nes_block_record> records;
+    for (uint32_t i=0; i<module->count; i++) {
+      const sfc_aot_entry_point& e = module->blocks[i];
+      if (!(e.pc & 0x8000)) continue;
+      nes_block_record r;
+      r.pc = e.pc;
+      r.length = e.length;
+      r.index = i;
+      r.hash = block_hash(prg, prg_size, e.pc, e.length);
+      records.push_back(r);
+    }
+    std::sort(records.begin(), records.end(),
+      [](const nes_block_record& a, const nes_block_record& b) { return a.pc < b.pc; });
+
+    nes_block_cache_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BLOCK_CACHE_MAGIC, sizeof(header.magic));
+    header.version = SFC_BLOCK_CACHE_VERSION;
+    header.count = records.size();
+    header.build_id = nes_build_id();
+    header.prg_hash = nes_hash64(prg, prg_size);
+    header.prg_size = prg_size;
+
+    // 先写到临时文件再改名，并发的任务不会读到写了一半的索引
+    const std::string path = cache_path(dir, prg, prg_size, ".blk");
+    const std::string temp = path + ".tmp";
+    FILE* fp = fopen(temp.c_str(), "wb");
+    if (!fp) return false;
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    if (!records.empty()) ok = ok && fwrite(records.data(), sizeof(nes_block_record), records.size(), fp) == records.size();
+    ok = fclose(fp) == 0 && ok;
+    if (ok) ok = rename(temp.c_str(), path.c_str()) == 0;
+    if (!ok) remove(temp.c_str());
+    return ok;
+  }
+
+  void nes_aot::unload() {
+    delete[] table;
+    table = NULL;
+    delete[] pending;
+    pending = NULL;
+    count = 0;
+    validated = rejected = 0;
+    module = NULL;
+    if (index_map) {
+      munmap((void*)index_map, index_size);
+      index_map = NULL;
+      index_size = 0;
+    }
+    if (handle) {
+      dlclose(handle);
+      handle = NULL;
+    }
+  }
+}
@@ -0,0 +1,503 @@
+#include <cstring>
+#include <cstdint>
+#include "include/nes_apu.h"
+#include "include/nes_memory_pool.h"
+
+namespace fc
+{
+  // 两种模式下帧计数器各步的周期，最后一项为序列的长度
+  static const uint16_t nes_frame_steps[2][5] = {
+    { 7457, 14913, 22371, 29829, 29830 },
+    { 7457, 14913, 22371, 37281, 37282 },
+  };
+
+  // 长度计数器的装载值
+  static const uint8_t nes_length_table[32] = {
+    10, 254, 20,  2, 40,  4, 80,  6, 160,  8, 60, 10, 14, 12, 26, 14,
+    12,  16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30,
+  };
+
+  // 方波的四种占空比
+  static const uint8_t nes_duty_table[4][8] = {
+    { 0, 1, 0, 0, 0, 0, 0, 0 },
+    { 0, 1, 1, 0, 0, 0, 0, 0 },
+    { 0, 1, 1, 1, 1, 0, 0, 0 },
+    { 1, 0, 0, 1, 1, 1, 1, 1 },
+  };
+
+  // 三角波的序列
+  static const uint8_t nes_triangle_table[32] = {
+    15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+  };
+
+  // 噪声的周期（CPU 周期，NTSC）
+  static const uint16_t nes_noise_periods[16] = {
+    4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068,
+  };
+
+  // DMC 的周期（CPU 周期，NTSC）
+  static const uint16_t nes_dmc_periods[16] = {
+    428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54,
+  };
+
+  // 混音后满幅对应的振幅，给带限阶跃的过冲留出余量
+  static const double MIX_SCALE = 24000.0;
+
+  // 非线性混音表：方波之和 0-30，三角波*3 + 噪声*2 + DMC 0-202
+  static int32_t nes_pulse_mix[31];
+  static int32_t nes_tnd_mix[203];
+
+  // 只在第一次调用时计算，返回值无意义
+  /*
+    由 init 中的函数内静态变量调用，C++11 保证只执行一次，
+    多个线程同时创建实例时不会同时写表，之后的实例也不再重写正在被其他实例读取的表。
+  */
+  static bool init_mix_tables() {
+    nes_pulse_mix[0] = 0;
+    for (int i=1; i<31; i++) {
+      nes_pulse_mix[i] = (int32_t)(95.52 / (8128.0 / i + 100) * MIX_SCALE);
+    }
+    nes_tnd_mix[0] = 0;
+    for (int i=1; i<203; i++) {
+      nes_tnd_mix[i] = (int32_t)(163.67 / (24329.0 / i + 100) * MIX_SCALE);
+    }
+    return true;
+  }
+
+  void nes_apu_envelope::clock() {
+    if (start) {
+      start = false;
+      decay = 15;
+      divider = volume;
+    } else if (divider) {
+      --divider;
+    } else {
+      divider = volume;
+      if (decay) --decay;
+      else if (loop) decay = 15;
+    }
+  }
+
+  int nes_apu_pulse::sweep_target() {
+    const int change = timer >> sweep_shift;
+    if (!sweep_negate) return timer + change;
+    return timer - change - (ones_complement? 1: 0);
+  }
+
+  uint8_t nes_apu_pulse::output() {
+    if (!length || muted() || !nes_duty_table[duty][position]) return 0;
+    return envelope.output();
+  }
+
+  uint8_t nes_apu_triangle::output() {
+    return nes_triangle_table[position];
+  }
+
+  void nes_apu::init(nes_scheduler* scheduler, nes_memory_pool* memory) {
+    this->scheduler = scheduler;
+    this->memory = memory;
+    static const bool mix_tables_ready = init_mix_tables();
+    (void)mix_tables_ready;
+    memset(regs, 0, sizeof(regs));
+    synced_cycle = 0;
+    sequence_start = 0;
+    step = 0;
+    five_step = false;
+    irq_inhibit = false;
+    frame_irq = false;
+    dmc_irq = false;
+
+    memset(pulse, 0, sizeof(pulse));
+    memset(&triangle, 0, sizeof(triangle));
+    memset(&noise, 0, sizeof(noise));
+    memset(&dmc, 0, sizeof(dmc));
+    pulse[0].ones_complement = true;
+    pulse[0].next_clock = pulse[0].period();
+    pulse[1].next_clock = pulse[1].period();
+    triangle.next_clock = 1;
+    noise.shift = 1;
+    noise.next_clock = nes_noise_periods[0];
+    dmc.bits = 8;
+    dmc.silence = true;
+    dmc.sample_addr = dmc.addr = 0xc000;
+    dmc.sample_length = 1;
+    dmc.next_clock = nes_dmc_periods[0];
+    dmc_fetches = 0;
+
+    memset(outputs, 0, sizeof(outputs));
+    outputs[2] = triangle.output();
+    amplitude = nes_tnd_mix[3 * outputs[2]];
+    output_enabled = false;
+    frame_start = 0;
+    set_sample_rate(SFC_APU_SAMPLE_RATE);
+    reschedule();
+  }
+
+  void nes_apu::set_sample_rate(uint32_t rate) {
+    sample_rate = rate;
+    if (blip) blip->init(SFC_CPU_CLOCK_RATE, rate);
+  }
+
+  void nes_apu::set_output(bool enabled) {
+    if (enabled && !blip) {
+      blip = new nes_blip_buffer();
+      blip->init(SFC_CPU_CLOCK_RATE, sample_rate);
+    }
+    output_enabled = enabled;
+  }
+
+  uint64_t nes_apu::step_cycle(uint8_t step) {
+    return sequence_start + nes_frame_steps[five_step][step];
+  }
+
+  void nes_apu::run_step() {
+    clock_quarter();
+    if (step & 1) clock_half();
+    refresh_outputs(synced_cycle);
+    if (step == 3) {
+      if (!five_step && !irq_inhibit) frame_irq = true;
+      sequence_start += nes_frame_steps[five_step][4];
+      step = 0;
+    } else {
+      ++step;
+    }
+  }
+
+  void nes_apu::clock_quarter() {
+    pulse[0].envelope.clock();
+    pulse[1].envelope.clock();
+    noise.envelope.clock();
+
+    if (triangle.linear_reload) {
+      triangle.linear = triangle.linear_reload_value;
+    } else if (triangle.linear) {
+      --triangle.linear;
+    }
+    if (!triangle.control) triangle.linear_reload = false;
+  }
+
+  void nes_apu::clock_half() {
+    for (int i=0; i<2; i++) {
+      nes_apu_pulse& p = pulse[i];
+      if (p.length && !p.envelope.loop) --p.length;
+      if (!p.sweep_divider && p.sweep_enabled && p.sweep_shift && !p.muted()) {
+        p.timer = (uint16_t)p.sweep_target();
+      }
+      if (!p.sweep_divider || p.sweep_reload) {
+        p.sweep_divider = p.sweep_period;
+        p.sweep_reload = false;
+      } else {
+        --p.sweep_divider;
+      }
+    }
+    if (triangle.length && !triangle.control) --triangle.length;
+    if (noise.length && !noise.envelope.loop) --noise.length;
+  }
+
+  void nes_apu::set_output(int channel, uint8_t value, uint64_t cycle) {
+    if (outputs[channel] == value) return;
+    outputs[channel] = value;
+    const int32_t amp
+      = nes_pulse_mix[outputs[0] + outputs[1]]
+      + nes_tnd_mix[3 * outputs[2] + 2 * outputs[3] + outputs[4]];
+    if (output_enabled) blip->add_delta((uint32_t)(cycle - frame_start), amp - amplitude);
+    amplitude = amp;
+  }
+
+  void nes_apu::refresh_outputs(uint64_t cycle) {
+    set_output(0, pulse[0].output(), cycle);
+    set_output(1, pulse[1].output(), cycle);
+    set_output(2, triangle.output(), cycle);
+    set_output(3, noise.output(), cycle);
+    set_output(4, dmc.level, cycle);
+  }
+
+  void nes_apu::run_pulse(int i, uint64_t cycle) {
+    nes_apu_pulse& p = pulse[i];
+    if (p.next_clock > cycle) return;
+    const uint64_t period = p.period();
+    if (!p.length || p.muted() || !p.envelope.output()) {
+      // 静音时只需算出序列器的位置
+      const uint64_t n = (cycle - p.next_clock) / period + 1;
+      p.position = (uint8_t)((p.position + n) & 7);
+      p.next_clock += n * period;
+      return;
+    }
+    while (p.next_clock <= cycle) {
+      p.position = (p.position + 1) & 7;
+      set_output(i, p.output(), p.next_clock);
+      p.next_clock += period;
+    }
+  }
+
+  void nes_apu::run_triangle(uint64_t cycle) {
+    nes_apu_triangle& t = triangle;
+    if (t.next_clock > cycle) return;
+    const uint64_t period = t.timer + 1;
+    if (!t.active()) {
+      // 序列器停止时输出保持不变
+      t.next_clock += ((cycle - t.next_clock) / period + 1) * period;
+      return;
+    }
+    while (t.next_clock <= cycle) {
+      t.position = (t.position + 1) & 31;
+      set_output(2, t.output(), t.next_clock);
+      t.next_clock += period;
+    }
+  }
+
+  void nes_apu::run_noise(uint64_t cycle) {
+    nes_apu_noise& n = noise;
+    if (n.next_clock > cycle) return;
+    const uint64_t period = nes_noise_periods[n.period_index];
+    if (!n.length || !n.envelope.output()) {
+      n.next_clock += ((cycle - n.next_clock) / period + 1) * period;
+      return;
+    }
+    const int tap = n.mode? 6: 1;
+    while (n.next_clock <= cycle) {
+      const uint16_t feedback = (n.shift ^ (n.shift >> tap)) & 1;
+      n.shift = (n.shift >> 1) | (feedback << 14);
+      set_output(3, n.output(), n.next_clock);
+      n.next_clock += period;
+    }
+  }
+
+  void nes_apu::run_dmc(uint64_t cycle) {
+    nes_apu_dmc& d = dmc;
+    if (d.next_clock > cycle) return;
+    const uint64_t period = nes_dmc_periods[d.rate_index];
+    if (d.silence && !d.buffer_full) {
+      // 没有采样可播放时只需算出输出单元的位数
+      const uint64_t n = (cycle - d.next_clock) / period + 1;
+      d.bits = (uint8_t)(((d.bits - 1 + 8 - n % 8) & 7) + 1);
+      d.next_clock += n * period;
+      return;
+    }
+    while (d.next_clock <= cycle) {
+      if (!d.silence) {
+        if (d.shift & 1) {
+          if (d.level <= 125) d.level += 2;
+        } else if (d.level >= 2) {
+          d.level -= 2;
+        }
+        set_output(4, d.level, d.next_clock);
+      }
+      d.shift >>= 1;
+      if (!--d.bits) {
+        d.bits = 8;
+        d.silence = !d.buffer_full;
+        if (d.buffer_full) {
+          d.shift = d.buffer;
+          d.buffer_full = false;
+          fetch_dmc();
+        }
+      }
+      d.next_clock += period;
+    }
+  }
+
+  void nes_apu::fetch_dmc() {
+    nes_apu_dmc& d = dmc;
+    if (d.buffer_full || !d.bytes_remaining) return;
+    d.buffer = memory->read(d.addr);
+    d.buffer_full = true;
+    memory->stall(SFC_DMC_DMA_CYCLES);
+    d.addr = d.addr == 0xffff? 0x8000: d.addr + 1;
+    ++dmc_fetches;
+    if (--d.bytes_remaining) return;
+    if (d.loop) {
+      restart_dmc();
+    } else if (d.irq_enabled) {
+      dmc_irq = true;
+      // 让 CPU 尽快回到批次边界响应中断
+      scheduler->poll_now();
+    }
+  }
+
+  void nes_apu::restart_dmc() {
+    dmc.addr = dmc.sample_addr;
+    dmc.bytes_remaining = dmc.sample_length;
+  }
+
+  void nes_apu::run_channels(uint64_t cycle) {
+    run_pulse(0, cycle);
+    run_pulse(1, cycle);
+    run_triangle(cycle);
+    run_noise(cycle);
+    run_dmc(cycle);
+  }
+
+  void nes_apu::catch_up(uint64_t cpu_cycle) {
+    if (cpu_cycle <= synced_cycle) return;
+    const uint64_t fetches = dmc_fetches;
+    bool stepped = false;
+    while (step_cycle(step) <= cpu_cycle) {
+      synced_cycle = step_cycle(step);
+      run_channels(synced_cycle);
+      run_step();
+      stepped = true;
+    }
+    run_channels(cpu_cycle);
+    synced_cycle = cpu_cycle;
+    if (stepped) reschedule();
+    if (fetches != dmc_fetches) reschedule_dmc();
+  }
+
+  void nes_apu::reschedule() {
+    const uint64_t next = next_event_cycle();
+    if (next == UINT64_MAX) {
+      scheduler->cancel(SFC_EVENT_APU_FRAME_IRQ);
+    } else {
+      scheduler->schedule(SFC_EVENT_APU_FRAME_IRQ, next);
+    }
+  }
+
+  void nes_apu::reschedule_dmc() {
+    const nes_apu_dmc& d = dmc;
+    if (!d.irq_enabled || d.loop || !d.bytes_remaining || !d.buffer_full) {
+      scheduler->cancel(SFC_EVENT_DMC);
+      return;
+    }
+    // 缓冲中的字节在输出单元的位数用完时被取走，随后立即读取下一个字节，
+    // 之后每 8 个周期读取一个，最后一个字节读取时产生中断
+    const uint64_t period = nes_dmc_periods[d.rate_index];
+    const uint64_t first = d.next_clock + (d.bits - 1) * period;
+    scheduler->schedule(SFC_EVENT_DMC, first + (d.bytes_remaining - 1) * 8 * period);
+  }
+
+  uint8_t nes_apu::read_register(uint16_t addr) {
+    if (addr != 0x4015) return 0;
+    uint8_t data = 0;
+    if (pulse[0].length) data |= 0x01;
+    if (pulse[1].length) data |= 0x02;
+    if (triangle.length) data |= 0x04;
+    if (noise.length) data |= 0x08;
+    if (dmc.bytes_remaining) data |= 0x10;
+    if (frame_irq) data |= 0x40;
+    if (dmc_irq) data |= 0x80;
+    // 读取会清除帧中断标记
+    frame_irq = false;
+    return data;
+  }
+
+  void nes_apu::write_register(uint16_t addr, uint8_t data) {
+    regs[addr - 0x4000] = data;
+    // 声道未开启时不装载长度计数器
+    const bool enabled = regs[0x15] & (1 << ((addr - 0x4000) >> 2));
+
+    switch (addr) {
+    case 0x4000: case 0x4004: {
+      nes_apu_pulse& p = pulse[(addr >> 2) & 1];
+      p.duty = data >> 6;
+      p.envelope.loop = data & 0x20;
+      p.envelope.constant = data & 0x10;
+      p.envelope.volume = data & 0x0f;
+      break;
+    }
+    case 0x4001: case 0x4005: {
+      nes_apu_pulse& p = pulse[(addr >> 2) & 1];
+      p.sweep_enabled = data & 0x80;
+      p.sweep_period = (data >> 4) & 7;
+      p.sweep_negate = data & 0x08;
+      p.sweep_shift = data & 7;
+      p.sweep_reload = true;
+      break;
+    }
+    case 0x4002: case 0x4006: {
+      nes_apu_pulse& p = pulse[(addr >> 2) & 1];
+      p.timer = (p.timer & 0x700) | data;
+      break;
+    }
+    case 0x4003: case 0x4007: {
+      nes_apu_pulse& p = pulse[(addr >> 2) & 1];
+      p.timer = (p.timer & 0xff) | ((data & 7) << 8);
+      if (enabled) p.length = nes_length_table[data >> 3];
+      p.position = 0;
+      p.envelope.start = true;
+      break;
+    }
+    case 0x4008:
+      triangle.control = data & 0x80;
+      triangle.linear_reload_value = data & 0x7f;
+      break;
+    case 0x400a:
+      triangle.timer = (triangle.timer & 0x700) | data;
+      break;
+    case 0x400b:
+      triangle.timer = (triangle.timer & 0xff) | ((data & 7) << 8);
+      if (enabled) triangle.length = nes_length_table[data >> 3];
+      triangle.linear_reload = true;
+      break;
+    case 0x400c:
+      noise.envelope.loop = data & 0x20;
+      noise.envelope.constant = data & 0x10;
+      noise.envelope.volume = data & 0x0f;
+      break;
+    case 0x400e:
+      noise.mode = data & 0x80;
+      noise.period_index = data & 0x0f;
+      break;
+    case 0x400f:
+      if (enabled) noise.length = nes_length_table[data >> 3];
+      noise.envelope.start = true;
+      break;
+    case 0x4010:
+      dmc.irq_enabled = data & 0x80;
+      if (!dmc.irq_enabled) dmc_irq = false;
+      dmc.loop = data & 0x40;
+      dmc.rate_index = data & 0x0f;
+      break;
+    case 0x4011:
+      dmc.level = data & 0x7f;
+      break;
+    case 0x4012:
+      dmc.sample_addr = 0xc000 | (data << 6);
+      break;
+    case 0x4013:
+      dmc.sample_length = (data << 4) + 1;
+      break;
+    case 0x4015:
+      if (!(data & 0x01)) pulse[0].length = 0;
+      if (!(data & 0x02)) pulse[1].length = 0;
+      if (!(data & 0x04)) triangle.length = 0;
+      if (!(data & 0x08)) noise.length = 0;
+      dmc_irq = false;
+      if (!(data & 0x10)) {
+        dmc.bytes_remaining = 0;
+      } else if (!dmc.bytes_remaining) {
+        restart_dmc();
+        fetch_dmc();
+      }
+      break;
+    case 0x4017:
+      five_step = data & 0x80;
+      irq_inhibit = data & 0x40;
+      if (irq_inhibit) frame_irq = false;
+      // 重新开始帧序列，5 步模式会立即产生一次 1/4 与 1/2 帧时钟
+      sequence_start = synced_cycle;
+      step = 0;
+      if (five_step) {
+        clock_quarter();
+        clock_half();
+      }
+      reschedule();
+      break;
+    }
+    refresh_outputs(synced_cycle);
+    reschedule_dmc();
+  }
+
+  uint64_t nes_apu::next_event_cycle() {
+    if (five_step || irq_inhibit) return UINT64_MAX;
+    return step_cycle(3);
+  }
+
+  uint32_t nes_apu::end_frame(uint64_t cpu_cycle) {
+    catch_up(cpu_cycle);
+    if (output_enabled) blip->end_frame((uint32_t)(synced_cycle - frame_start));
+    frame_start = synced_cycle;
+    return samples_avail();
+  }
+}
@@ -0,0 +1,106 @@
+#include <cmath>
+#include <cstring>
+#include <cassert>
+#include "include/nes_blip.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace fc
+{
+  // 高通（去直流）滤波的强度，截止频率约为 采样率 / (2π * 2^SHIFT)
+  static const int BASS_SHIFT = 9;
+
+  void nes_blip_buffer::init(double clock_rate, double sample_rate) {
+    factor = (uint64_t)(sample_rate / clock_rate * 4294967296.0 + 0.5);
+
+    // 生成各相位的 Blackman 窗 sinc 核，截止频率略低于奈奎斯特频率
+    const double cutoff = 0.9;
+    const double center = SFC_BLIP_TAPS / 2.0;
+    for (int p=0; p<SFC_BLIP_PHASES; p++) {
+      double taps[SFC_BLIP_TAPS];
+      double sum = 0;
+      for (int k=0; k<SFC_BLIP_TAPS; k++) {
+        const double x = k + 0.5 - center - (double)p / SFC_BLIP_PHASES;
+        const double w = (x + center) / SFC_BLIP_TAPS;
+        const double window
+          = 0.42 - 0.5 * cos(2 * M_PI * w) + 0.08 * cos(4 * M_PI * w);
+        const double t = M_PI * x * cutoff;
+        taps[k] = (fabs(t) < 1e-9? 1.0: sin(t) / t) * window;
+        sum += taps[k];
+      }
+      // 归一化，并把舍入误差补到最大的抽头上，保证阶跃的终值准确
+      int total = 0;
+      int peak = 0;
+      for (int k=0; k<SFC_BLIP_TAPS; k++) {
+        kernel[p][k] = (int16_t)lround(taps[k] / sum * (1 << SFC_BLIP_KERNEL_BITS));
+        total += kernel[p][k];
+        if (kernel[p][k] > kernel[p][peak]) peak = k;
+      }
+      kernel[p][peak] += (1 << SFC_BLIP_KERNEL_BITS) - total;
+    }
+    clear();
+  }
+
+  void nes_blip_buffer::clear() {
+    offset = 0;
+    avail = 0;
+    integrator = 0;
+    memset(buf, 0, sizeof(buf));
+  }
+
+  void nes_blip_buffer::add_delta(uint32_t time, int32_t delta) {
+    const uint64_t pos = offset + time * factor;
+    const uint32_t index = avail + (uint32_t)(pos >> 32);
+    const uint32_t phase = (uint32_t)(pos >> (32 - 6)) & (SFC_BLIP_PHASES - 1);
+    assert(index < SFC_BLIP_CAPACITY && "音频缓冲区溢出");
+    const int16_t* k = kernel[phase];
+    int32_t* out = buf + index;
+
+#if defined(__SSE2__)
+    // 16 位乘法的高低两半交错展开为 32 位乘积，一次累加 8 个抽头
+    const __m128i d = _mm_set1_epi16((int16_t)delta);
+    for (int i=0; i<SFC_BLIP_TAPS; i += 8) {
+      const __m128i kv = _mm_loadu_si128((const __m128i*)(k + i));
+      const __m128i lo = _mm_mullo_epi16(kv, d);
+      const __m128i hi = _mm_mulhi_epi16(kv, d);
+      __m128i* o = (__m128i*)(out + i);
+      _mm_storeu_si128(o, _mm_add_epi32(_mm_loadu_si128(o), _mm_unpacklo_epi16(lo, hi)));
+      _mm_storeu_si128(o + 1, _mm_add_epi32(_mm_loadu_si128(o + 1), _mm_unpackhi_epi16(lo, hi)));
+    }
+#else
+    for (int i=0; i<SFC_BLIP_TAPS; i++) out[i] += k[i] * delta;
+#endif
+  }
+
+  void nes_blip_buffer::end_frame(uint32_t time) {
+    const uint64_t pos = offset + time * factor;
+    avail += (uint32_t)(pos >> 32);
+    offset = pos & 0xffffffffu;
+    assert(avail <= SFC_BLIP_CAPACITY && "音频缓冲区溢出");
+  }
+
+  uint32_t nes_blip_buffer::read_samples(int16_t* out, uint32_t max) {
+    const uint32_t count = avail < max? avail: max;
+    int32_t sum = integrator;
+    for (uint32_t i=0; i<count; i++) {
+      sum += buf[i];
+      int32_t s = sum >> SFC_BLIP_KERNEL_BITS;
+      if (s > 32767) s = 32767;
+      if (s < -32768) s = -32768;
+      out[i] = (int16_t)s;
+      // 漏积分：每个采样衰减一点，去掉直流分量
+      // s 可能为负，用乘法而不是左移
+      sum -= s * (1 << (SFC_BLIP_KERNEL_BITS - BASS_SHIFT));
+    }
+    integrator = sum;
+
+    // 把尚未完成的采样移到开头
+    const uint32_t remain = avail - count + SFC_BLIP_TAPS;
+    memmove(buf, buf + count, remain * sizeof(int32_t));
+    memset(buf + remain, 0, count * sizeof(int32_t));
+    avail -= count;
+    return count;
+  }
+}
@@ -0,0 +1,326 @@
+#include <cstring>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include "include/nes_capture.h"
+
+namespace fc
+{
+  // 单调时钟的纳秒数
+  static inline uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // 写满 size 字节，成功时返回 0，否则返回 errno（被信号打断时重试）
+  static int write_fully(int fd, const uint8_t* data, size_t size, uint64_t offset) {
+    while (size) {
+      const ssize_t n = pwrite(fd, data, size, offset);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) return errno;
+      // 没有写入任何字节时 pwrite 不设置 errno，按磁盘已满处理
+      if (n == 0) return ENOSPC;
+      data += n;
+      size -= n;
+      offset += n;
+    }
+    return 0;
+  }
+
+  // ---------------------------------------------------------------- nes_stream_writer
+
+  bool nes_stream_writer::open(const char* path, size_t chunk) {
+    close();
+    this->chunk = (chunk + SFC_STREAM_ALIGN - 1) / SFC_STREAM_ALIGN * SFC_STREAM_ALIGN;
+    direct = false;
+#ifdef O_DIRECT
+    fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    direct = fd >= 0;
+#endif
+    // 不支持 O_DIRECT 的文件系统（如 tmpfs）退回普通写入
+    if (fd < 0) fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    for (int i=0; i<2; i++) {
+      void* p = NULL;
+      if (posix_memalign(&p, SFC_STREAM_ALIGN, this->chunk)) p = NULL;
+      assert(p && "无法分配写缓冲");
+      buffers[i] = (uint8_t*)p;
+    }
+    current = 0;
+    fill = 0;
+    submitted = 0;
+    pending = NULL;
+    stopping = false;
+    error = 0;
+    wait_ns = write_ns = 0;
+    io = std::thread(&nes_stream_writer::run, this);
+    return true;
+  }
+
+  void nes_stream_writer::run() {
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+      cond.wait(guard, [this] { return pending || stopping; });
+      if (!pending) return;
+      uint8_t* data = pending;
+      const uint64_t offset = pending_offset;
+      const int previous = error;
+      guard.unlock();
+
+      const uint64_t start = now_ns();
+      const int result = previous? previous: write_fully(fd, data, chunk, offset);
+#ifdef POSIX_FADV_DONTNEED
+      // 录制的数据不会再读，不让它挤占页缓存
+      if (!direct && !result) posix_fadvise(fd, offset, chunk, POSIX_FADV_DONTNEED);
+#endif
+      write_ns += now_ns() - start;
+
+      guard.lock();
+      if (!error) error = result;
+      pending = NULL;
+      cond.notify_all();
+    }
+  }
+
+  void nes_stream_writer::wait_idle() {
+    std::unique_lock<std::mutex> guard(lock);
+    if (!pending) return;
+    const uint64_t start = now_ns();
+    cond.wait(guard, [this] { return !pending; });
+    wait_ns += now_ns() - start;
+  }
+
+  void nes_stream_writer::submit() {
+    wait_idle();
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      pending = buffers[current];
+      pending_offset = submitted;
+      cond.notify_all();
+    }
+    submitted += fill;
+    current ^= 1;
+    fill = 0;
+  }
+
+  void nes_stream_writer::write(const void* data, size_t size) {
+    // 出错后不再写入，只丢弃数据
+    if (failed()) return;
+    const uint8_t* p = (const uint8_t*)data;
+    while (size) {
+      const size_t n = size < chunk - fill? size: chunk - fill;
+      memcpy(buffers[current] + fill, p, n);
+      fill += n;
+      p += n;
+      size -= n;
+      if (fill == chunk) submit();
+    }
+  }
+
+  void nes_stream_writer::flush() {
+    if (fd < 0) return;
+    wait_idle();
+    if (!fill || failed()) return;
+#ifdef O_DIRECT
+    // 末尾不足一块的数据无法对齐，关闭 O_DIRECT 后写入
+    if (direct) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+      direct = false;
+    }
+#endif
+    const int result = write_fully(fd, buffers[current], fill, submitted);
+    submitted += fill;
+    fill = 0;
+    set_error(result);
+  }
+
+  void nes_stream_writer::write_at(uint64_t offset, const void* data, size_t size) {
+    if (failed()) return;
+    assert(!fill && !pending && offset + size <= submitted && "需先 flush");
+#ifdef O_DIRECT
+    if (direct) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+      direct = false;
+    }
+#endif
+    set_error(write_fully(fd, (const uint8_t*)data, size, offset));
+  }
+
+  int nes_stream_writer::get_error() {
+    std::lock_guard<std::mutex> guard(lock);
+    return error;
+  }
+
+  void nes_stream_writer::set_error(int e) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!error) error = e;
+  }
+
+  bool nes_stream_writer::close() {
+    if (fd < 0) return !get_error();
+    flush();
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stopping = true;
+      cond.notify_all();
+    }
+    io.join();
+    if (::close(fd)) set_error(errno);
+    fd = -1;
+    for (int i=0; i<2; i++) {
+      free(buffers[i]);
+      buffers[i] = NULL;
+    }
+    return !get_error();
+  }
+
+  // ---------------------------------------------------------------- nes_y4m_writer
+
+  bool nes_y4m_writer::open(const char* path, int scale) {
+    close();
+    if (!stream.open(path)) return false;
+    converter.init();
+
+    const size_t w = 256 * scale, h = 240 * scale;
+    frame_size = w * h * 3 / 2;
+    frame = (uint8_t*)malloc(frame_size);
+    target.format = SFC_PIXEL_YUV420;
+    target.scale = scale;
+    target.planes[0] = frame;
+    target.planes[1] = frame + w * h;
+    target.planes[2] = frame + w * h + w * h / 4;
+    target.pitch[0] = w;
+    target.pitch[1] = target.pitch[2] = w / 2;
+    frames = 0;
+
+    // NTSC 的帧率为 39375000/655171 ≈ 60.0988
+    char header[128];
+    const int n = snprintf(header, sizeof(header),
+      "YUV4MPEG2 W%d H%d F39375000:655171 Ip A1:1 C420jpeg\n", (int)w, (int)h);
+    stream.write(header, n);
+    return true;
+  }
+
+  void nes_y4m_writer::write_frame(const uint8_t* pixels, const uint8_t* emphasis) {
+    converter.convert(pixels, emphasis, target);
+    stream.write("FRAME\n", 6);
+    stream.write(frame, frame_size);
+    ++frames;
+  }
+
+  bool nes_y4m_writer::close() {
+    const bool ok = stream.close();
+    free(frame);
+    frame = NULL;
+    return ok;
+  }
+
+  // ---------------------------------------------------------------- nes_wav_writer
+
+  static inline void put_le(uint8_t* p, uint32_t v, int bytes) {
+    for (int i=0; i<bytes; i++) p[i] = (v >> (i * 8)) & 0xff;
+  }
+
+  void nes_wav_writer::make_header(uint8_t* header) {
+    const uint32_t data_size = (uint32_t)(samples * 2);
+    memcpy(header, "RIFF", 4);
+    put_le(header + 4, 36 + data_size, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_le(header + 16, 16, 4);              // fmt 块长度
+    put_le(header + 20, 1, 2);               // PCM
+    put_le(header + 22, 1, 2);               // 单声道
+    put_le(header + 24, sample_rate, 4);
+    put_le(header + 28, sample_rate * 2, 4); // 每秒字节数
+    put_le(header + 32, 2, 2);               // 每个采样的字节数
+    put_le(header + 34, 16, 2);              // 位深
+    memcpy(header + 36, "data", 4);
+    put_le(header + 40, data_size, 4);
+  }
+
+  bool nes_wav_writer::open(const char* path, uint32_t sample_rate) {
+    close();
+    if (!stream.open(path)) return false;
+    this->sample_rate = sample_rate;
+    samples = 0;
+    uint8_t header[44];
+    make_header(header);
+    stream.write(header, sizeof(header));
+    return true;
+  }
+
+  void nes_wav_writer::write_samples(const int16_t* data, uint32_t count) {
+    // WAV 为小端序，与 x86/ARM 的内存布局一致
+    stream.write(data, count * sizeof(int16_t));
+    samples += count;
+  }
+
+  bool nes_wav_writer::close() {
+    if (!sample_rate) return !stream.get_error();
+    stream.flush();
+    uint8_t header[44];
+    make_header(header);
+    stream.write_at(0, header, sizeof(header));
+    sample_rate = 0;
+    return stream.close();
+  }
+
+  // ---------------------------------------------------------------- nes_av_capture
+
+  bool nes_av_capture::open(
+    const char* video_path, const char* audio_path, uint32_t sample_rate, int scale
+  ) {
+    has_video = video_path && video.open(video_path, scale);
+    has_audio = audio_path && audio.open(audio_path, sample_rate);
+    return (!video_path || has_video) && (!audio_path || has_audio);
+  }
+
+  void nes_av_capture::on_frame(void* ctx, const nes_video_frame& frame) {
+    ((nes_av_capture*)ctx)->video.write_frame(frame.pixels, frame.emphasis);
+  }
+
+  void nes_av_capture::on_audio(void* ctx, const nes_audio_block& block) {
+    ((nes_av_capture*)ctx)->audio.write_samples(block.samples, block.count);
+  }
+
+  void nes_av_capture::attach(nes_av_pipeline& pipeline, uint32_t capacity, sfc_backpressure policy) {
+    if (has_video) pipeline.add_frame_stage("y4m", on_frame, this, capacity, policy);
+    // 音频块很小，多留一些槽位
+    if (has_audio) pipeline.add_audio_stage("wav", on_audio, this, capacity * 4, policy);
+  }
+
+  bool nes_av_capture::close() {
+    bool ok = true;
+    if (has_video) ok = video.close() && ok;
+    if (has_audio) ok = audio.close() && ok;
+    has_video = has_audio = false;
+    return ok;
+  }
+
+  int nes_av_capture::get_error() {
+    const int e = video.get_stream().get_error();
+    return e? e: audio.get_stream().get_error();
+  }
+
+  void nes_av_capture::print_stats(FILE* fp) {
+    if (has_video) {
+      nes_stream_writer& s = video.get_stream();
+      fprintf(fp, "y4m: %llu frames, %.1f MB, direct=%d, producer wait %.1f ms, write %.1f ms\n",
+        (unsigned long long)video.get_frames(), s.size() / 1048576.0, s.is_direct(),
+        s.get_wait_ns() / 1e6, s.get_write_ns() / 1e6);
+      if (s.get_error()) fprintf(fp, "y4m: write failed, recording stopped: %s\n", strerror(s.get_error()));
+    }
+    if (has_audio) {
+      nes_stream_writer& s = audio.get_stream();
+      fprintf(fp, "wav: %llu samples, %.1f MB, direct=%d, producer wait %.1f ms, write %.1f ms\n",
+        (unsigned long long)audio.get_samples(), s.size() / 1048576.0, s.is_direct(),
+        s.get_wait_ns() / 1e6, s.get_write_ns() / 1e6);
+      if (s.get_error()) fprintf(fp, "wav: write failed, recording stopped: %s\n", strerror(s.get_error()));
+    }
+  }
+}
@@ -1,9 +1,12 @@
 #include <cassert>
 #include <cstring>
 #include "include/nes_cpu.h"
+#include "include/nes_alu.h"
 #include "include/nes_6502.h"
 #include "include/nes_utils.h"
 #include "include/nes_memory_pool.h"
+#include "include/nes_debugger.h"
+#include <cstddef>
 
 // 用来简化 case 的排列
 #define OP(n, a, o)\
@@ -15,8 +18,91 @@ case 0x##n:\
 
 namespace fc
 {
+  // 每条指令的基础周期数，opcode 为下标
+  static const uint8_t nes_cycle_table[256] = {
+  /*0 1 2 3 4 5 6 7 8 9 A B C D E F */
+    7,6,2,8,3,3,5,5,3,2,2,2,4,4,6,6, // 0
+    2,5,2,8,4,4,6,6,2,4,2,7,4,4,7,7, // 1
+    6,6,2,8,3,3,5,5,4,2,2,2,4,4,6,6, // 2
+    2,5,2,8,4,4,6,6,2,4,2,7,4,4,7,7, // 3
+    6,6,2,8,3,3,5,5,3,2,2,2,3,4,6,6, // 4
+    2,5,2,8,4,4,6,6,2,4,2,7,4,4,7,7, // 5
+    6,6,2,8,3,3,5,5,4,2,2,2,5,4,6,6, // 6
+    2,5,2,8,4,4,6,6,2,4,2,7,4,4,7,7, // 7
+    2,6,2,6,3,3,3,3,2,2,2,2,4,4,4,4, // 8
+    2,6,2,6,4,4,4,4,2,5,2,5,5,5,5,5, // 9
+    2,6,2,6,3,3,3,3,2,2,2,2,4,4,4,4, // A
+    2,5,2,5,4,4,4,4,2,4,2,4,4,4,4,4, // B
+    2,6,2,8,3,3,5,5,2,2,2,2,4,4,6,6, // C
+    2,5,2,8,4,4,6,6,2,4,2,7,4,4,7,7, // D
+    2,6,2,8,3,3,5,5,2,2,2,2,4,4,6,6, // E
+    2,5,2,8,4,4,6,6,2,4,2,7,4,4,7,7, // F
+  };
+
+  // 读取类指令在 ABX/ABY/INY 寻址跨页时多出 1 个周期，写入与读改写指令已计入基础周期
+  static const uint8_t nes_page_penalty[256] = {
+  /*0 1 2 3 4 5 6 7 8 9 A B C D E F */
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, // 0
+    0,1,0,0,0,0,0,0,0,1,0,0,1,1,0,0, // 1
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, // 2
+    0,1,0,0,0,0,0,0,0,1,0,0,1,1,0,0, // 3
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, // 4
+    0,1,0,0,0,0,0,0,0,1,0,0,1,1,0,0, // 5
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, // 6
+    0,1,0,0,0,0,0,0,0,1,0,0,1,1,0,0, // 7
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, // 8
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, // 9
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, // A
+    0,1,0,1,0,0,0,0,0,1,0,0,1,1,1,1, // B
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, // C
+    0,1,0,0,0,0,0,0,0,1,0,0,1,1,0,0, // D
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, // E
+    0,1,0,0,0,0,0,0,0,1,0,0,1,1,0,0, // F
+  };
+
+  // 预编译块直接把寄存器当作 sfc_aot_registers 访问
+  static_assert(sizeof(nes_registers) == sizeof(sfc_aot_registers), "寄存器布局不一致");
+  static_assert(offsetof(nes_registers, status) == offsetof(sfc_aot_registers, p), "寄存器布局不一致");
+  static_assert(offsetof(nes_registers, stack_pointer) == offsetof(sfc_aot_registers, sp), "寄存器布局不一致");
+
+  uint8_t nes_cpu::base_cycles(uint8_t opcode) {
+    return nes_cycle_table[opcode];
+  }
+
+  bool nes_cpu::page_penalty(uint8_t opcode) {
+    return nes_page_penalty[opcode];
+  }
+
+  bool nes_cpu::implemented(uint8_t opcode) {
+    // 与 execute 中的 case 保持一致
+    static const uint8_t missing[] = {
+      0x02, 0x0B, 0x12, 0x22, 0x2B, 0x32, 0x42, 0x4B, 0x52, 0x62, 0x6B, 0x72, 0x82, 0x89, 0x8B,
+      0x92, 0x93, 0x9B, 0x9C, 0x9E, 0x9F, 0xAB, 0xB2, 0xBB, 0xC2, 0xCB, 0xD2, 0xE2, 0xF2,
+    };
+    for (size_t i=0; i<sizeof(missing); i++) {
+      if (missing[i] == opcode) return false;
+    }
+    return true;
+  }
+
   void nes_cpu::init(nes_memory_pool* mp) {
     this->memory = mp;
+    // 让内存池在访问 I/O 寄存器时能得知当前的 CPU 周期
+    memory->clock = &clock;
+    clock.cycle = 0;
+    clock.stop = 0;
+    page_crossed = false;
+    trace_mode = 0;
+    trace_file = NULL;
+    profile_hits = NULL;
+    profile_cycles = NULL;
+    coverage = NULL;
+    coverage_mask = 0;
+    debugger = NULL;
+    idioms = true;
+    clear_idiom_stats();
+    aot = NULL;
+    clear_aot_stats();
     const uint8_t pcl = memory->read(RESET_VECTOR);
     const uint8_t pch = memory->read(RESET_VECTOR + 1);
     registers.program_counter = (uint16_t)pcl | ((uint16_t)pch << 8);
@@ -30,9 +116,136 @@ namespace fc
     registers.program_counter = 0xc000;
   }
 
+  template <int Mode>
+  void nes_cpu::run_traced(uint64_t until) {
+    clock.stop = until;
+    while (clock.cycle < clock.stop) {
+      // Mode 是编译期常量，未选中的插桩在实例化时整段消去
+      if ((Mode & SFC_TRACE_BREAK) && debugger->check_pc()) return;
+      if (Mode & SFC_TRACE_LOG) trace_line();
+      const uint16_t pc = registers.program_counter;
+      const uint64_t start = clock.cycle;
+      const uint8_t opcode = (Mode & SFC_TRACE_COVERAGE)? memory->read(pc): 0;
+
+      execute();
+
+      if (Mode & SFC_TRACE_PROFILE) {
+        ++profile_hits[pc];
+        profile_cycles[pc] += clock.cycle - start;
+      }
+      // 条件分支的 opcode 为 xxx10000，不成立时 PC 恰好前进 2
+      if ((Mode & SFC_TRACE_COVERAGE) && (opcode & 0x1f) == 0x10) {
+        const bool taken = registers.program_counter != (uint16_t)(pc + 2);
+        // 以 (bank, 分支指令地址, 是否成立) 为键，散列到覆盖率计数表中
+        uint32_t key = ((uint32_t)memory->bank_number(pc) << 17) | ((uint32_t)pc << 1) | taken;
+        key = (key ^ (key >> 15)) * 0x2c1b3c6du;
+        key ^= key >> 12;
+        ++coverage[key & coverage_mask];
+      }
+    }
+  }
+
+  // 每种插桩组合各实例化一次，以 trace_mode 为下标
+  void (nes_cpu::*const nes_cpu::runners[SFC_TRACE_MODES])(uint64_t) = {
+    &nes_cpu::run_traced<0>,  &nes_cpu::run_traced<1>,  &nes_cpu::run_traced<2>,  &nes_cpu::run_traced<3>,
+    &nes_cpu::run_traced<4>,  &nes_cpu::run_traced<5>,  &nes_cpu::run_traced<6>,  &nes_cpu::run_traced<7>,
+    &nes_cpu::run_traced<8>,  &nes_cpu::run_traced<9>,  &nes_cpu::run_traced<10>, &nes_cpu::run_traced<11>,
+    &nes_cpu::run_traced<12>, &nes_cpu::run_traced<13>, &nes_cpu::run_traced<14>, &nes_cpu::run_traced<15>,
+  };
+
+  static uint8_t aot_read(void* memory, uint16_t addr) {
+    return ((nes_memory_pool*)memory)->read(addr);
+  }
+
+  static void aot_write(void* memory, uint16_t addr, uint8_t data) {
+    ((nes_memory_pool*)memory)->write(addr, data);
+  }
+
+  void nes_cpu::aot_loop(void* cpu, uint16_t head, uint16_t next) {
+    nes_cpu* self = (nes_cpu*)cpu;
+    if (self->idioms) self->run_idiom(head, next);
+  }
+
+  void nes_cpu::run_aot(uint64_t until) {
+    clock.stop = until;
+    sfc_aot_context context;
+    context.regs = (sfc_aot_registers*)&registers;
+    context.cycle = &clock.cycle;
+    context.stop = &clock.stop;
+    context.pages = memory->pages;
+    context.stack = memory->main_memory + 0x100;
+    context.memory = memory;
+    context.read = aot_read;
+    context.write = aot_write;
+    context.cpu = this;
+    context.loop = aot_loop;
+    const sfc_aot_block* table = aot->get_table();
+    while (clock.cycle < clock.stop) {
+      const uint16_t pc = registers.program_counter;
+      const sfc_aot_block block = (pc & 0x8000)? table[pc & 0x7fff]: NULL;
+      if (block) {
+        block(&context);
+        ++aot_stats.blocks;
+      } else if ((pc & 0x8000) && aot->validate(pc)) {
+        // 从缓存加载的块第一次执行前核对，通过后重新查表
+        continue;
+      } else {
+        execute();
+        ++aot_stats.interpreted;
+      }
+    }
+  }
+
+  void nes_cpu::run(uint64_t until) {
+    // 块内不逐条检查插桩与观察点，有任何一个时照常解释
+    if (aot && !trace_mode && !memory->watched) run_aot(until);
+    else (this->*runners[trace_mode])(until);
+  }
+
+  void nes_cpu::set_trace_log(FILE* out) {
+    trace_file = out;
+    set_trace_bit(SFC_TRACE_LOG, out != NULL);
+  }
+
+  void nes_cpu::set_profile(uint64_t* hits, uint64_t* cycles) {
+    profile_hits = hits;
+    profile_cycles = cycles;
+    set_trace_bit(SFC_TRACE_PROFILE, hits && cycles);
+  }
+
+  void nes_cpu::set_coverage(uint8_t* map, uint32_t size) {
+    coverage = map;
+    coverage_mask = size - 1;
+    set_trace_bit(SFC_TRACE_COVERAGE, map != NULL);
+  }
+
+  void nes_cpu::set_breakpoints(nes_debugger* d) {
+    debugger = d;
+    set_trace_bit(SFC_TRACE_BREAK, d != NULL);
+  }
+
+  void nes_cpu::trace_line() {
+    char buf[OP_BUF_LEN];
+    uint8_t bytes[3];
+    const uint16_t pc = registers.program_counter;
+    const uint8_t length = disassemble_op(pc, buf, bytes);
+    buf[OP_BUF_LEN - 2] = 0;
+    // 指令的字节，不足 3 个时以空格补齐
+    char hex[9] = "        ";
+    for (uint8_t i=0; i<length; i++) btoh(hex + i * 3, bytes[i]);
+    // 与 nestest.log 相近的格式
+    fprintf(trace_file, "%04X  %s  %-16s A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%llu\n",
+      pc, hex, buf + 6, registers.accumulator, registers.x_index, registers.y_index,
+      registers.status, registers.stack_pointer, (unsigned long long)clock.cycle);
+  }
+
   void nes_cpu::execute() {
     const uint8_t opcode = memory->read(registers.program_counter++);
+    // 先计入基础周期，使指令中的 I/O 访问看到的是接近指令结束时的周期
+    clock.cycle += nes_cycle_table[opcode];
+    page_crossed = false;
     switch (opcode) {
+      OP(00, imp, brk)
       OP(01, inx, ora)
       OP(03, inx, slo)
       OP(04, zpg, nop)
@@ -111,6 +324,7 @@ namespace fc
       OP(55, zpx, eor)
       OP(56, zpx, lsr)
       OP(57, zpx, sre)
+      OP(58, imp, cli)
       OP(59, aby, eor)
       OP(5A, imp, nop)
       OP(5B, aby, sre)
@@ -260,31 +474,180 @@ namespace fc
       OP(FF, abx, isb)
       default: assert(! "尚未实现的指令");
     }
+    if (page_crossed) clock.cycle += nes_page_penalty[opcode];
   }
 
-  void nes_cpu::check_zf_and_sf(uint8_t data) {
-    if (! data) {
-      registers.status |= SFC_FLAG_Z;
-    } else {
-      registers.status &= ~SFC_FLAG_Z;
+  void nes_cpu::interrupt(uint16_t vector, uint8_t pushed_flags) {
+    stack_push(uint8_t(registers.program_counter >> 8));
+    stack_push(uint8_t(registers.program_counter));
+    stack_push(registers.status | pushed_flags);
+    registers.status |= SFC_FLAG_I;
+    const uint8_t pcl = memory->read(vector);
+    const uint8_t pch = memory->read(vector + 1);
+    registers.program_counter = (uint16_t)pcl | ((uint16_t)pch << 8);
+  }
+
+  void nes_cpu::nmi() {
+    // 硬件中断压入的状态寄存器 BF 为 0
+    interrupt(NMI_VECTOR, SFC_FLAG_R);
+    clock.cycle += 7;
+  }
+
+  void nes_cpu::irq() {
+    if (registers.status & SFC_FLAG_I) return;
+    interrupt(IRQBRK_VECTOR, SFC_FLAG_R);
+    clock.cycle += 7;
+  }
+
+  void nes_cpu::check_irq_unmasked() {
+    if (irq_line && !(registers.status & SFC_FLAG_I)) clock.stop = clock.cycle;
+  }
+
+  void nes_cpu::branch_to(uint16_t address) {
+    // 分支成立多 1 个周期，跨页再多 1 个
+    clock.cycle += ((registers.program_counter ^ address) & 0xff00)? 2: 1;
+    registers.program_counter = address;
+  }
+
+  // addr 所在页在宿主内存中的指针，writable 时只接受 RAM 与 SRAM
+  static uint8_t* idiom_page(uint8_t* const pages[256], uint16_t addr, bool writable) {
+    const uint8_t page = addr >> 8;
+    if (writable && (page >> 5) != 0 && (page >> 5) != 3) return NULL;
+    return pages[page];
+  }
+
+  void nes_cpu::run_idiom(uint16_t head, uint16_t next) {
+    // 循环体最长为 LDA abs,X / STA abs,X / INX 共 7 字节，加上 BNE 共 9 字节
+    const uint16_t length = next - head;
+    if (head < 0x8000 || length > 9) return;
+    uint8_t body[9];
+    for (uint16_t i=0; i<length; i++) {
+      const uint8_t* page = memory->pages[(head + i) >> 8];
+      if (!page) return;
+      body[i] = page[(head + i) & 0xff];
     }
 
-    if (data & (uint8_t)0x80) {
-      registers.status |= SFC_FLAG_S;
-    } else {
-      registers.status &= ~SFC_FLAG_S;
+    // 解码：可选的读取、写入、步进
+    uint8_t pos = 0;
+    const uint8_t load = (body[0] == 0xBD || body[0] == 0xB9 || body[0] == 0xB1)? body[0]: 0;
+    const uint8_t* load_operand = body + 1;
+    if (load) pos = load == 0xB1? 2: 3;
+    const uint8_t store = body[pos];
+    if (store != 0x9D && store != 0x99 && store != 0x91) return;
+    const uint8_t* store_operand = body + pos + 1;
+    pos += store == 0x91? 2: 3;
+    const uint8_t step = body[pos];
+    if (step != 0xE8 && step != 0xCA && step != 0xC8 && step != 0x88) return;
+    if (pos + 3 != length) return;
+    const bool use_x = step == 0xE8 || step == 0xCA;
+    if (use_x != (store == 0x9D) || (load && use_x != (load == 0xBD))) return;
+    const int dir = (step == 0xE8 || step == 0xC8)? 1: -1;
+
+    // 求出读写的基地址，(zp),Y 的指针从零页读取
+    uint8_t* const zero_page = memory->pages[0];
+    if (!zero_page && (load == 0xB1 || store == 0x91)) return;
+    uint16_t src = 0, dst;
+    if (load == 0xB1) src = zero_page[load_operand[0]] | zero_page[(uint8_t)(load_operand[0] + 1)] << 8;
+    else if (load) src = load_operand[0] | load_operand[1] << 8;
+    if (store == 0x91) dst = zero_page[store_operand[0]] | zero_page[(uint8_t)(store_operand[0] + 1)] << 8;
+    else dst = store_operand[0] | store_operand[1] << 8;
+
+    // 剩余的迭代次数，BNE 刚成立，因此步进的寄存器不为 0
+    uint8_t& index = use_x? registers.x_index: registers.y_index;
+    const uint8_t first = index;
+    const int remaining = dir > 0? 256 - first: first;
+    // 涉及的地址范围 [low, high]
+    const uint32_t low = dir > 0? first: 1;
+    const uint32_t high = dir > 0? 255: first;
+    if (dst + high > 0xffff || (load && src + high > 0xffff)) return;
+    for (uint32_t a=((dst + low) & 0xff00); a<=dst + high; a+=0x100) {
+      if (!idiom_page(memory->pages, a, true)) return;
+      // 写入零页时可能改写 (zp),Y 的指针
+      if ((load == 0xB1 || store == 0x91) && a < 0x2000 && (a & 0x0700) == 0) return;
+    }
+    for (uint32_t a=((src + low) & 0xff00); load && a<=src + high; a+=0x100) {
+      if (!idiom_page(memory->pages, a, false)) return;
+    }
+
+    // 逐次迭代计算周期数，只执行整个落在本批次内的迭代
+    const uint8_t load_cycles = load? (load == 0xB1? 5: 4): 0;
+    const uint8_t store_cycles = store == 0x91? 6: 5;
+    const uint8_t taken_cycles = ((next ^ head) & 0xff00)? 4: 3;
+    uint64_t cycles = 0;
+    int count = 0;
+    uint8_t r = first;
+    while (count < remaining) {
+      uint32_t c = load_cycles + store_cycles + 2 + (count + 1 == remaining? 2: taken_cycles);
+      if (load && (src & 0xff) + r > 0xff) c += 1;
+      if (clock.cycle + cycles + c > clock.stop) break;
+      cycles += c;
+      count++;
+      r += dir;
+    }
+    if (!count) return;
+
+    // 按迭代的顺序分段执行，每段不跨页
+    int done = 0;
+    uint16_t last = 0;
+    while (done < count) {
+      // 本段第一个迭代的下标
+      const uint16_t i = first + done * dir;
+      int len = count - done;
+      const uint16_t d = dst + i;
+      const uint16_t s = src + i;
+      const int d_room = dir > 0? 0x100 - (d & 0xff): (d & 0xff) + 1;
+      const int s_room = dir > 0? 0x100 - (s & 0xff): (s & 0xff) + 1;
+      if (len > d_room) len = d_room;
+      if (load && len > s_room) len = s_room;
+      // 本段在宿主内存中的起点（地址最低处）
+      const uint16_t d_low = dir > 0? d: d - len + 1;
+      const uint16_t s_low = dir > 0? s: s - len + 1;
+      uint8_t* dp = memory->pages[d_low >> 8] + (d_low & 0xff);
+      if (!load) {
+        memset(dp, registers.accumulator, len);
+      } else {
+        const uint8_t* sp = memory->pages[s_low >> 8] + (s_low & 0xff);
+        if ((uintptr_t)sp + len <= (uintptr_t)dp || (uintptr_t)dp + len <= (uintptr_t)sp) {
+          memcpy(dp, sp, len);
+        } else if (dir > 0) {
+          for (int k=0; k<len; k++) dp[k] = sp[k];
+        } else {
+          for (int k=len-1; k>=0; k--) dp[k] = sp[k];
+        }
+        last = dir > 0? s_low + len - 1: s_low;
+      }
+      done += len;
     }
+
+    // 最后一次迭代读取的值留在 A 中，标记由最后一次步进决定
+    if (load) registers.accumulator = memory->pages[last >> 8][last & 0xff];
+    index = r;
+    check_zf_and_sf(index);
+    registers.program_counter = count == remaining? next: head;
+    clock.cycle += cycles;
+    const int kind = load? SFC_IDIOM_MEMCPY: registers.accumulator? SFC_IDIOM_MEMSET: SFC_IDIOM_CLEAR;
+    idiom_stats.loops[kind]++;
+    idiom_stats.instructions[kind] += (uint64_t)count * (load? 4: 3);
   }
 
+  void nes_cpu::check_zf_and_sf(uint8_t data) {
+    registers.status = nes_alu_zn(registers.status, data);
+  }
+
+  // 有观察点时经过页表，栈页上的观察点才能命中
   void nes_cpu::stack_push(uint8_t data) {
-    (memory->main_memory + 0x100)[registers.stack_pointer--] = data;
+    const uint16_t address = 0x100 | registers.stack_pointer--;
+    if (memory->watched) memory->write(address, data);
+    else memory->main_memory[address] = data;
   }
 
   uint8_t nes_cpu::stack_pop() {
-    return (memory->main_memory + 0x100)[++registers.stack_pointer];
+    const uint16_t address = 0x100 | ++registers.stack_pointer;
+    if (memory->watched) return memory->read(address);
+    return memory->main_memory[address];
   }
 
-  void nes_cpu::disassemble_op(uint16_t addr, char buf[]) {
+  uint8_t nes_cpu::disassemble_op(uint16_t addr, char buf[], uint8_t bytes[3]) {
     memset(buf, ' ', OP_BUF_LEN);
     buf[OP_BUF_LEN - 2] = ';';
     buf[OP_BUF_LEN - 1] = 0;
@@ -294,11 +657,15 @@ namespace fc
     btoh(buf+3, (uint8_t)(addr & (uint8_t)0xFF));
 
     nes_code code;
+    code.op = bytes[0] = memory->peek(addr);
+    code.a1 = bytes[1] = memory->peek(addr + 1);
+    code.a2 = bytes[2] = memory->peek(addr + 2);
+    return disassemble(code, buf+6);
+  }
+
+  void nes_cpu::output_op(uint16_t addr, char buf[]) {
     uint8_t bytes[3];
-    code.op = bytes[0] = memory->read(addr);
-    code.a1 = bytes[1] = memory->read(addr + 1);
-    code.a2 = bytes[2] = memory->read(addr + 2);
-    const uint8_t length = disassemble(code, buf+6);
+    const uint8_t length = disassemble_op(addr, buf, bytes);
 
     // 输出内部寄存器的值
     output_registers_and_flags();
@@ -357,12 +724,16 @@ namespace fc
 
   uint16_t nes_cpu::address_abx() {
     const uint16_t base = address_abs();
-    return base + registers.x_index;
+    const uint16_t address = base + registers.x_index;
+    page_crossed = (base ^ address) & 0xff00;
+    return address;
   }
 
   uint16_t nes_cpu::address_aby() {
     const uint16_t base = address_abs();
-    return base + registers.y_index;
+    const uint16_t address = base + registers.y_index;
+    page_crossed = (base ^ address) & 0xff00;
+    return address;
   }
 
   uint16_t nes_cpu::address_zpg() {
@@ -395,7 +766,9 @@ namespace fc
     // 自增同上
     const uint8_t address1 = memory->read(++base);
     const uint16_t address = (uint16_t)address0 | (uint16_t)address1<<8;
-    return address + registers.y_index;
+    const uint16_t result = address + registers.y_index;
+    page_crossed = (address ^ result) & 0xff00;
+    return result;
   }
 
   uint16_t nes_cpu::address_ind() {
@@ -444,7 +817,7 @@ namespace fc
 
   void nes_cpu::operate_bcs(uint16_t address) {
     if (registers.status & SFC_FLAG_C) {
-      registers.program_counter = address;
+      branch_to(address);
     }
   }
 
@@ -454,25 +827,27 @@ namespace fc
 
   void nes_cpu::operate_bcc(uint16_t address) {
     if (! (registers.status & SFC_FLAG_C)) {
-      registers.program_counter = address;
+      branch_to(address);
     }
   }
 
   void nes_cpu::operate_lda(uint16_t address) {
     registers.accumulator = memory->read(address);
-    printf("Get data %X from %X\n", registers.accumulator, address);
     check_zf_and_sf(registers.accumulator);
   }
 
   void nes_cpu::operate_beq(uint16_t address) {
     if (registers.status & SFC_FLAG_Z) {
-      registers.program_counter = address;
+      branch_to(address);
     }
   }
 
   void nes_cpu::operate_bne(uint16_t address) {
     if (! (registers.status & SFC_FLAG_Z)) {
-      registers.program_counter = address;
+      const uint16_t next = registers.program_counter;
+      branch_to(address);
+      // 插桩需要看到每一条指令，因此只在没有插桩时尝试
+      if (idioms && address < next && !trace_mode) run_idiom(address, next);
     }
   }
 
@@ -505,19 +880,19 @@ namespace fc
 
   void nes_cpu::operate_bvs(uint16_t address) {
     if (registers.status & SFC_FLAG_V) {
-      registers.program_counter = address;
+      branch_to(address);
     }
   }
 
   void nes_cpu::operate_bvc(uint16_t address) {
     if (! (registers.status & SFC_FLAG_V)) {
-      registers.program_counter = address;
+      branch_to(address);
     }
   }
 
   void nes_cpu::operate_bpl(uint16_t address) {
     if (! (registers.status & SFC_FLAG_S)) {
-      registers.program_counter = address;
+      branch_to(address);
     }
   }
 
@@ -552,17 +927,7 @@ namespace fc
   }
 
   void nes_cpu::operate_cmp(uint16_t address) {
-    uint16_t result
-      = (uint16_t)registers.accumulator
-      - (uint16_t)memory->read(address);
-
-    if (result < 0x100) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-
-    check_zf_and_sf((uint8_t)result);
+    nes_alu_cmp(registers.status, registers.accumulator, memory->read(address));
   }
 
   void nes_cpu::operate_cld(uint16_t) {
@@ -576,11 +941,12 @@ namespace fc
   void nes_cpu::operate_plp(uint16_t) {
     registers.status = stack_pop();
     registers.status &= ~SFC_FLAG_B;
+    check_irq_unmasked();
   }
 
   void nes_cpu::operate_bmi(uint16_t address) {
     if (registers.status & SFC_FLAG_S) {
-      registers.program_counter = address;
+      branch_to(address);
     }
   }
 
@@ -602,30 +968,7 @@ namespace fc
 
   void nes_cpu::operate_adc(uint16_t address) {
     const uint8_t data = memory->read(address);
-    const uint16_t result16
-      = (uint16_t)registers.accumulator
-      + (uint16_t)data
-      + (registers.status & SFC_FLAG_C? 1: 0);
-    const uint8_t result8 = (uint8_t)result16;
-
-    // 如果有进位那么置 CF，否则清空
-    if (result16 >> 8) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-    // 如果两个操作数同号而结果与之异号，那么置 VF，否则清空
-    if (
-      !((registers.accumulator ^ data) & 0x80)
-      &&
-      ((registers.accumulator ^ result8) & 0x80)
-    ) {
-      registers.status |= SFC_FLAG_V;
-    } else {
-      registers.status &= ~SFC_FLAG_V;
-    }
-    registers.accumulator = result8;
-    check_zf_and_sf(result8);
+    registers.accumulator = nes_alu_adc(registers.status, registers.accumulator, data);
   }
 
   void nes_cpu::operate_ldy(uint16_t address) {
@@ -635,59 +978,16 @@ namespace fc
   }
 
   void nes_cpu::operate_cpy(uint16_t address) {
-    const uint16_t result
-      = (uint16_t)registers.y_index
-      - (uint16_t)memory->read(address);
-
-    if (result < 0x100) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-
-    check_zf_and_sf((uint8_t)result);
+    nes_alu_cmp(registers.status, registers.y_index, memory->read(address));
   }
 
   void nes_cpu::operate_cpx(uint16_t address) {
-    const uint16_t result
-      = (uint16_t)registers.x_index
-      - (uint16_t)memory->read(address);
-
-    if (result < 0x100) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-
-    check_zf_and_sf((uint8_t)result);
+    nes_alu_cmp(registers.status, registers.x_index, memory->read(address));
   }
 
   void nes_cpu::operate_sbc(uint16_t address) {
     const uint8_t data = memory->read(address);
-    const uint16_t result16
-      = (uint16_t)registers.accumulator
-      - (uint16_t)data
-      - (registers.status & SFC_FLAG_C? 0: 1);
-    const uint8_t result8 = (uint8_t)result16;
-
-    // 如果有进位那么置 CF，否则清空
-    if (! (result16 >> 8)) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-    // 如果两个操作数异号且结果与被减数异号，那么置 VF，否则清空
-    if (
-      ((registers.accumulator ^ data) & 0x80)
-      &&
-      ((registers.accumulator ^ result8) & 0x80)
-    ) {
-      registers.status |= SFC_FLAG_V;
-    } else {
-      registers.status &= ~SFC_FLAG_V;
-    }
-    registers.accumulator = result8;
-    check_zf_and_sf(result8);
+    registers.accumulator = nes_alu_sbc(registers.status, registers.accumulator, data);
   }
 
   void nes_cpu::operate_iny(uint16_t) {
@@ -739,6 +1039,17 @@ namespace fc
     registers.stack_pointer = registers.x_index;
   }
 
+  void nes_cpu::operate_brk(uint16_t) {
+    // BRK 后有一个填充字节，返回地址为 PC+1
+    ++registers.program_counter;
+    interrupt(IRQBRK_VECTOR, SFC_FLAG_B | SFC_FLAG_R);
+  }
+
+  void nes_cpu::operate_cli(uint16_t) {
+    registers.status &= ~SFC_FLAG_I;
+    check_irq_unmasked();
+  }
+
   void nes_cpu::operate_rti(uint16_t) {
     registers.status = stack_pop();
     registers.status |= SFC_FLAG_R;
@@ -749,76 +1060,28 @@ namespace fc
     registers.program_counter
       = (uint16_t)pcl
       | (uint16_t)pch << 8;
+    check_irq_unmasked();
   }
 
   void nes_cpu::operate_lsra(uint16_t) {
-    uint8_t data = registers.accumulator;
-
-    // 把最低位送入到 CF 中
-    if (data & 1) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-
-    data >>= 1;
-    registers.accumulator = data;
-    check_zf_and_sf(data);
+    registers.accumulator = nes_alu_lsr(registers.status, registers.accumulator);
   }
 
   void nes_cpu::operate_lsr(uint16_t address) {
-    uint8_t data = memory->read(address);
-
-    // 把最低位送入到 CF 中
-    if (data & 1) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-
-    data >>= 1;
+    const uint8_t data = nes_alu_lsr(registers.status, memory->read(address));
     memory->write(address, data);
-    check_zf_and_sf(data);
   }
 
   void nes_cpu::operate_asla(uint16_t) {
-    uint8_t data = registers.accumulator;
-
-    if (data & 0x80) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-
-    data <<= 1;
-    registers.accumulator = data;
-    check_zf_and_sf(data);
+    registers.accumulator = nes_alu_asl(registers.status, registers.accumulator);
   }
 
   void nes_cpu::operate_rora(uint16_t) {
-    uint16_t data = registers.accumulator;
-    data |= uint16_t(registers.status & SFC_FLAG_C) << 8;
-    if (data & 1) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-    data >>= 1;
-    registers.accumulator = (uint8_t)data;
-    check_zf_and_sf(registers.accumulator);
+    registers.accumulator = nes_alu_ror(registers.status, registers.accumulator);
   }
 
   void nes_cpu::operate_rola(uint16_t) {
-    uint16_t data = registers.accumulator;
-    data <<= 1;
-    data |= (registers.status & SFC_FLAG_C);
-    if (data & (uint16_t)0x0100) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-    registers.accumulator = (uint8_t)data;
-    check_zf_and_sf(registers.accumulator);
+    registers.accumulator = nes_alu_rol(registers.status, registers.accumulator);
   }
 
   void nes_cpu::operate_sty(uint16_t address) {
@@ -826,44 +1089,19 @@ namespace fc
   }
 
   void nes_cpu::operate_asl(uint16_t address) {
-    uint8_t data = memory->read(address);
-
-    if (data & 0x80) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-
-    data <<= 1;
+    const uint8_t data = nes_alu_asl(registers.status, memory->read(address));
     memory->write(address, data);
-    check_zf_and_sf(data);
   }
 
   void nes_cpu::operate_ror(uint16_t address) {
-    uint16_t data = memory->read(address);
-    data |= uint16_t(registers.status & SFC_FLAG_C) << 8;
-    if (data & 1) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-    data >>= 1;
-    memory->write(address, (uint8_t)data);
-    check_zf_and_sf((uint8_t)data);
+    const uint8_t data = nes_alu_ror(registers.status, memory->read(address));
+    memory->write(address, data);
   }
 
   void nes_cpu::operate_rol(uint16_t address) {
-    uint16_t data = memory->read(address);
-    data <<= 1;
-    data |= (registers.status & SFC_FLAG_C);
-    if (data & (uint16_t)0x0100) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-    registers.accumulator = (uint8_t)data;
-    memory->write(address, (uint8_t)data);
-    check_zf_and_sf((uint8_t)data);
+    const uint8_t data = nes_alu_rol(registers.status, memory->read(address));
+    registers.accumulator = data;
+    memory->write(address, data);
   }
 
   void nes_cpu::operate_inc(uint16_t address) {
@@ -898,122 +1136,48 @@ namespace fc
     uint8_t data = memory->read(address);
     --data;
     memory->write(address, data);
-
     // CMP
-    const uint16_t result16
-      = (uint16_t)registers.accumulator
-      - (uint16_t)data;
-    if (! (result16 & (uint16_t)0x8000)) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-    check_zf_and_sf((uint8_t)result16);
+    nes_alu_cmp(registers.status, registers.accumulator, data);
   }
 
   void nes_cpu::operate_isb(uint16_t address) {
     uint8_t data = memory->read(address);
     ++data;
     memory->write(address, data);
-
-    const uint16_t result16
-      = (uint16_t)registers.accumulator
-      - (uint16_t)data
-      - (registers.status & SFC_FLAG_C? 0: 1);
-    if (! (result16 >> 8)) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-    const uint8_t result8 = (uint8_t)result16;
-    if (
-      ((registers.accumulator ^ data) & 0x80)
-      &&
-      ((registers.accumulator ^ result8) & 0x80)
-    ) {
-      registers.status |= SFC_FLAG_V;
-    } else {
-      registers.status &= ~SFC_FLAG_V;
-    }
-    registers.accumulator = result8;
-    check_zf_and_sf(result8);
+    // SBC
+    registers.accumulator = nes_alu_sbc(registers.status, registers.accumulator, data);
   }
 
   void nes_cpu::operate_slo(uint16_t address) {
-    uint8_t data = memory->read(address);
-    if (data & (uint8_t)0x80) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-    data <<= 1;
+    const uint8_t data = nes_alu_asl(registers.status, memory->read(address));
     memory->write(address, data);
-
+    // ORA
     registers.accumulator |= data;
     check_zf_and_sf(registers.accumulator);
   }
 
   void nes_cpu::operate_rla(uint16_t address) {
-    puts("Wahahahaha");
-    uint16_t result16 = memory->read(address);
-    result16 <<= 1;
-    result16 |= registers.status & SFC_FLAG_C;
-    if (result16 & (uint16_t)0x100) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-    const uint8_t result8 = (uint8_t)result16;
-    memory->write(address, result8);
-
-    registers.accumulator &= result8;
+    const uint8_t data = nes_alu_rol(registers.status, memory->read(address));
+    memory->write(address, data);
+    // AND
+    registers.accumulator &= data;
     check_zf_and_sf(registers.accumulator);
   }
 
   void nes_cpu::operate_sre(uint16_t address) {
-    uint8_t data = memory->read(address);
-    if (data & 1) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-    data >>= 1;
+    const uint8_t data = nes_alu_lsr(registers.status, memory->read(address));
     memory->write(address, data);
-
+    // EOR
     registers.accumulator ^= data;
     check_zf_and_sf(registers.accumulator);
   }
 
   void nes_cpu::operate_rra(uint16_t address) {
-    uint16_t result16 = memory->read(address);
-    result16 |= (registers.status & SFC_FLAG_C) << 8;
-    uint8_t tmp_cp = result16 & 1;
-    result16 >>= 1;
-    uint8_t result8 = (uint8_t)result16;
-    memory->write(address, result8);
-
-    const uint8_t src = result8;
-    result16
-      = (uint16_t)registers.accumulator
-      + (uint16_t)src
-      + tmp_cp;
-    if (result16 >> 8) {
-      registers.status |= SFC_FLAG_C;
-    } else {
-      registers.status &= ~SFC_FLAG_C;
-    }
-    result8 = (uint8_t)result16;
-    if (
-      !((registers.accumulator ^ src) & 0x80)
-      &&
-      ((registers.accumulator ^ result8) & 0x80)
-    ) {
-      registers.status |= SFC_FLAG_V;
-    } else {
-      registers.status &= ~SFC_FLAG_V;
-    }
-    registers.accumulator = result8;
-    check_zf_and_sf(result8);
+    // 移出的位作为 ADC 的进位
+    const uint8_t data = nes_alu_ror(registers.status, memory->read(address));
+    memory->write(address, data);
+    // ADC
+    registers.accumulator = nes_alu_adc(registers.status, registers.accumulator, data);
   }
 
 }
\ No newline at end of file
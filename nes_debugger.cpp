@@ -0,0 +1,407 @@
+#include <cctype>
+#include <cstring>
+#include "include/nes_debugger.h"
+#include "include/nes_memory_pool.h"
+
+namespace fc
+{
+  // 条件表达式的字节码，除 PUSH 带 4 字节立即数、REG 带 1 字节寄存器编号外均无操作数
+  enum sfc_condition_op {
+      SFC_OP_PUSH, SFC_OP_REG, SFC_OP_PEEK,
+      SFC_OP_NOT, SFC_OP_NEG, SFC_OP_INV,
+      SFC_OP_ADD, SFC_OP_SUB, SFC_OP_AND, SFC_OP_OR, SFC_OP_XOR,
+      SFC_OP_EQ, SFC_OP_NE, SFC_OP_LT, SFC_OP_LE, SFC_OP_GT, SFC_OP_GE,
+      SFC_OP_LAND, SFC_OP_LOR,
+  };
+
+  // REG 的寄存器编号
+  enum sfc_condition_reg {
+      SFC_REG_A, SFC_REG_X, SFC_REG_Y, SFC_REG_SP, SFC_REG_P, SFC_REG_PC,
+      SFC_REG_CYCLE, SFC_REG_ADDR, SFC_REG_VALUE,
+      SFC_REG_C, SFC_REG_Z, SFC_REG_I, SFC_REG_D, SFC_REG_V, SFC_REG_N,
+  };
+
+  static const struct { const char* name; uint8_t reg; } nes_condition_names[] = {
+    { "a", SFC_REG_A }, { "x", SFC_REG_X }, { "y", SFC_REG_Y },
+    { "sp", SFC_REG_SP }, { "s", SFC_REG_SP }, { "p", SFC_REG_P }, { "pc", SFC_REG_PC },
+    { "cycle", SFC_REG_CYCLE }, { "addr", SFC_REG_ADDR }, { "value", SFC_REG_VALUE },
+    { "c", SFC_REG_C }, { "z", SFC_REG_Z }, { "i", SFC_REG_I },
+    { "d", SFC_REG_D }, { "v", SFC_REG_V }, { "n", SFC_REG_N },
+  };
+
+  // 递归下降的表达式编译器
+  struct nes_condition_parser {
+    const char* p;
+    std::vector<uint8_t>& code;
+    const char* error;
+    // 编译期模拟的栈深度
+    int depth;
+    int max_depth;
+
+    nes_condition_parser(const char* expr, std::vector<uint8_t>& out)
+      : p(expr), code(out), error(NULL), depth(0), max_depth(0) {}
+
+    void skip() { while (isspace((unsigned char)*p)) ++p; }
+
+    bool accept(const char* token) {
+      skip();
+      const size_t n = strlen(token);
+      if (strncmp(p, token, n)) return false;
+      p += n;
+      return true;
+    }
+
+    void emit(uint8_t op, int delta) {
+      code.push_back(op);
+      depth += delta;
+      if (depth > max_depth) max_depth = depth;
+    }
+
+    void emit_push(uint32_t value) {
+      emit(SFC_OP_PUSH, 1);
+      for (int i=0; i<4; i++) code.push_back(value >> (i * 8));
+    }
+
+    bool fail(const char* message) {
+      if (!error) error = message;
+      return false;
+    }
+
+    bool primary() {
+      skip();
+      if (accept("(")) {
+        if (!logical_or()) return false;
+        return accept(")") || fail("缺少 )");
+      }
+      if (accept("[")) {
+        if (!logical_or()) return false;
+        emit(SFC_OP_PEEK, 0);
+        return accept("]") || fail("缺少 ]");
+      }
+      if (*p == '$' || isdigit((unsigned char)*p)) {
+        // $ 与 0x 开头为十六进制，其余为十进制（前导 0 不表示八进制）
+        const bool hex = *p == '$' || (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'));
+        const char* digits = *p == '$'? p + 1: hex? p + 2: p;
+        char* end;
+        const uint32_t value = strtoul(digits, &end, hex? 16: 10);
+        if (end == digits || !isxdigit((unsigned char)*digits)) return fail("无效的数字");
+        p = end;
+        emit_push(value);
+        return true;
+      }
+      if (isalpha((unsigned char)*p)) {
+        char name[8];
+        size_t n = 0;
+        while (isalnum((unsigned char)p[n])) {
+          if (n < sizeof(name) - 1) name[n] = tolower((unsigned char)p[n]);
+          ++n;
+        }
+        name[n < sizeof(name)? n: sizeof(name) - 1] = 0;
+        for (size_t i=0; i<sizeof(nes_condition_names)/sizeof(nes_condition_names[0]); i++) {
+          if (n < sizeof(name) && !strcmp(name, nes_condition_names[i].name)) {
+            p += n;
+            emit(SFC_OP_REG, 1);
+            code.push_back(nes_condition_names[i].reg);
+            return true;
+          }
+        }
+        return fail("未知的标识符");
+      }
+      return fail("缺少操作数");
+    }
+
+    bool unary() {
+      skip();
+      if (*p == '!' && p[1] != '=') { ++p; if (!unary()) return false; emit(SFC_OP_NOT, 0); return true; }
+      if (accept("-")) { if (!unary()) return false; emit(SFC_OP_NEG, 0); return true; }
+      if (accept("~")) { if (!unary()) return false; emit(SFC_OP_INV, 0); return true; }
+      return primary();
+    }
+
+    bool additive() {
+      if (!unary()) return false;
+      for (;;) {
+        if (accept("+")) { if (!unary()) return false; emit(SFC_OP_ADD, -1); }
+        else if (accept("-")) { if (!unary()) return false; emit(SFC_OP_SUB, -1); }
+        else return true;
+      }
+    }
+
+    bool bit_and() {
+      if (!additive()) return false;
+      for (;;) {
+        skip();
+        if (*p != '&' || p[1] == '&') return true;
+        ++p;
+        if (!additive()) return false;
+        emit(SFC_OP_AND, -1);
+      }
+    }
+
+    bool bit_xor() {
+      if (!bit_and()) return false;
+      while (accept("^")) {
+        if (!bit_and()) return false;
+        emit(SFC_OP_XOR, -1);
+      }
+      return true;
+    }
+
+    bool bit_or() {
+      if (!bit_xor()) return false;
+      for (;;) {
+        skip();
+        if (*p != '|' || p[1] == '|') return true;
+        ++p;
+        if (!bit_xor()) return false;
+        emit(SFC_OP_OR, -1);
+      }
+    }
+
+    bool comparison() {
+      if (!bit_or()) return false;
+      // 长的运算符先匹配
+      static const struct { const char* token; uint8_t op; } ops[] = {
+        { "==", SFC_OP_EQ }, { "!=", SFC_OP_NE }, { "<=", SFC_OP_LE },
+        { ">=", SFC_OP_GE }, { "<", SFC_OP_LT }, { ">", SFC_OP_GT },
+      };
+      for (size_t i=0; i<sizeof(ops)/sizeof(ops[0]); i++) {
+        if (accept(ops[i].token)) {
+          if (!bit_or()) return false;
+          emit(ops[i].op, -1);
+          return true;
+        }
+      }
+      return true;
+    }
+
+    bool logical_and() {
+      if (!comparison()) return false;
+      while (accept("&&")) {
+        if (!comparison()) return false;
+        emit(SFC_OP_LAND, -1);
+      }
+      return true;
+    }
+
+    bool logical_or() {
+      if (!logical_and()) return false;
+      while (accept("||")) {
+        if (!logical_and()) return false;
+        emit(SFC_OP_LOR, -1);
+      }
+      return true;
+    }
+  };
+
+  bool nes_condition::compile(const char* expr, const char** error) {
+    code.clear();
+    if (!expr) return true;
+    nes_condition_parser parser(expr, code);
+    parser.skip();
+    bool ok = !*parser.p || parser.logical_or();
+    parser.skip();
+    if (ok && *parser.p) ok = parser.fail("表达式末尾有多余的字符");
+    if (ok && parser.max_depth > SFC_CONDITION_STACK) ok = parser.fail("表达式嵌套过深");
+    if (!ok) {
+      code.clear();
+      if (error) *error = parser.error;
+    }
+    return ok;
+  }
+
+  bool nes_condition::eval(const nes_debug_context& ctx) const {
+    if (code.empty()) return true;
+    int32_t stack[SFC_CONDITION_STACK];
+    int top = -1;
+    const nes_registers& r = *ctx.registers;
+    for (size_t i=0; i<code.size(); i++) {
+      int32_t b;
+      switch (code[i]) {
+      case SFC_OP_PUSH:
+        stack[++top] = code[i + 1] | (code[i + 2] << 8) | (code[i + 3] << 16) | ((uint32_t)code[i + 4] << 24);
+        i += 4;
+        continue;
+      case SFC_OP_REG:
+        switch (code[++i]) {
+        case SFC_REG_A: b = r.accumulator; break;
+        case SFC_REG_X: b = r.x_index; break;
+        case SFC_REG_Y: b = r.y_index; break;
+        case SFC_REG_SP: b = r.stack_pointer; break;
+        case SFC_REG_P: b = r.status; break;
+        case SFC_REG_PC: b = r.program_counter; break;
+        case SFC_REG_CYCLE: b = (int32_t)ctx.cycle; break;
+        case SFC_REG_ADDR: b = ctx.addr; break;
+        case SFC_REG_VALUE: b = ctx.value; break;
+        case SFC_REG_C: b = r.status >> SFC_INDEX_C & 1; break;
+        case SFC_REG_Z: b = r.status >> SFC_INDEX_Z & 1; break;
+        case SFC_REG_I: b = r.status >> SFC_INDEX_I & 1; break;
+        case SFC_REG_D: b = r.status >> SFC_INDEX_D & 1; break;
+        case SFC_REG_V: b = r.status >> SFC_INDEX_V & 1; break;
+        default: b = r.status >> SFC_INDEX_N & 1; break;
+        }
+        stack[++top] = b;
+        continue;
+      case SFC_OP_PEEK: stack[top] = ctx.memory->peek((uint16_t)stack[top]); continue;
+      case SFC_OP_NOT: stack[top] = !stack[top]; continue;
+      case SFC_OP_NEG: stack[top] = -stack[top]; continue;
+      case SFC_OP_INV: stack[top] = ~stack[top]; continue;
+      }
+      b = stack[top--];
+      int32_t& a = stack[top];
+      switch (code[i]) {
+      case SFC_OP_ADD: a = a + b; break;
+      case SFC_OP_SUB: a = a - b; break;
+      case SFC_OP_AND: a = a & b; break;
+      case SFC_OP_OR: a = a | b; break;
+      case SFC_OP_XOR: a = a ^ b; break;
+      case SFC_OP_EQ: a = a == b; break;
+      case SFC_OP_NE: a = a != b; break;
+      case SFC_OP_LT: a = a < b; break;
+      case SFC_OP_LE: a = a <= b; break;
+      case SFC_OP_GT: a = a > b; break;
+      case SFC_OP_GE: a = a >= b; break;
+      case SFC_OP_LAND: a = a && b; break;
+      case SFC_OP_LOR: a = a || b; break;
+      }
+    }
+    return stack[0] != 0;
+  }
+
+  // 主内存的镜像归一化到 $0000-$07FF
+  static uint16_t canonical_address(uint16_t addr) {
+    return addr < 0x2000? addr & 0x07ff: addr;
+  }
+
+  void nes_debugger::init(nes_memory_pool* memory, nes_cpu* cpu) {
+    this->memory = memory;
+    registers = &cpu->get_registers();
+    clock = &cpu->get_clock();
+    enabled = true;
+    next_id = 1;
+    resume_cycle = UINT64_MAX;
+    clear();
+    memory->set_debugger(this);
+  }
+
+  int nes_debugger::add_breakpoint(uint16_t pc, const char* condition, const char** error) {
+    point bp;
+    if (!bp.condition.compile(condition, error)) return -1;
+    bp.id = next_id++;
+    bp.kinds = 0;
+    bp.addr = pc;
+    bp.length = 1;
+    points.push_back(bp);
+    if (pc_bits.empty()) pc_bits.resize(0x10000 / 64);
+    pc_bits[pc >> 6] |= (uint64_t)1 << (pc & 63);
+    ++breakpoint_count;
+    return bp.id;
+  }
+
+  int nes_debugger::add_watchpoint(uint16_t addr, uint16_t length, int kinds,
+                                   const char* condition, const char** error) {
+    point wp;
+    if (!length || !(kinds & (SFC_WATCH_READ | SFC_WATCH_WRITE))) return -1;
+    if (!wp.condition.compile(condition, error)) return -1;
+    wp.id = next_id++;
+    wp.kinds = kinds & (SFC_WATCH_READ | SFC_WATCH_WRITE);
+    wp.addr = canonical_address(addr);
+    // 主内存范围不跨过镜像
+    wp.length = wp.addr < 0x0800 && wp.addr + length > 0x0800? 0x0800 - wp.addr: length;
+    points.push_back(wp);
+    ++watchpoint_count;
+    refresh_watch_pages();
+    return wp.id;
+  }
+
+  bool nes_debugger::remove(int id) {
+    for (size_t i=0; i<points.size(); i++) {
+      if (points[i].id != id) continue;
+      const point removed = points[i];
+      points.erase(points.begin() + i);
+      if (removed.kinds) {
+        --watchpoint_count;
+        refresh_watch_pages();
+        return true;
+      }
+      --breakpoint_count;
+      // 同一 PC 上没有其它断点时才清除位图
+      bool shared = false;
+      for (size_t k=0; k<points.size(); k++) {
+        shared = shared || (!points[k].kinds && points[k].addr == removed.addr);
+      }
+      if (!shared) pc_bits[removed.addr >> 6] &= ~((uint64_t)1 << (removed.addr & 63));
+      return true;
+    }
+    return false;
+  }
+
+  void nes_debugger::clear() {
+    points.clear();
+    pc_bits.clear();
+    breakpoint_count = 0;
+    watchpoint_count = 0;
+    hit.reason = SFC_BREAK_NONE;
+    refresh_watch_pages();
+  }
+
+  void nes_debugger::refresh_watch_pages() {
+    memset(watch_pages, 0, sizeof(watch_pages));
+    for (size_t i=0; i<points.size(); i++) {
+      const point& wp = points[i];
+      if (!wp.kinds) continue;
+      const uint32_t last = wp.addr + wp.length - 1;
+      for (uint32_t page = wp.addr >> 8; page <= (last > 0xffff? 0xff: last >> 8); page++) {
+        // 主内存的页在 $0000-$1FFF 中的 4 个镜像都要观察
+        for (uint32_t mirror = 0; mirror < (page < 0x08? 0x20: 1); mirror += 0x08) {
+          const uint32_t p = page + mirror;
+          watch_pages[p >> 5] |= 1u << (p & 31);
+        }
+      }
+    }
+    memory->refresh_pages();
+  }
+
+  void nes_debugger::stop(int reason, int id, uint16_t addr, uint8_t value) {
+    hit.reason = reason;
+    hit.id = id;
+    hit.pc = registers->program_counter;
+    hit.addr = addr;
+    hit.value = value;
+    hit.cycle = clock->cycle;
+    if (reason == SFC_BREAK_PC) resume_cycle = clock->cycle;
+    clock->stop = clock->cycle;
+  }
+
+  void nes_debugger::settle() {
+    // 观察点在指令执行中途命中，等指令执行完再记录 PC
+    if (hit.reason == SFC_BREAK_READ || hit.reason == SFC_BREAK_WRITE) hit.pc = registers->program_counter;
+  }
+
+  bool nes_debugger::check_pc() {
+    const uint16_t pc = registers->program_counter;
+    if (!(pc_bits[pc >> 6] >> (pc & 63) & 1)) return false;
+    if (clock->cycle == resume_cycle) return false;
+    const nes_debug_context ctx = { registers, clock->cycle, 0, 0, memory };
+    for (size_t i=0; i<points.size(); i++) {
+      const point& bp = points[i];
+      if (bp.kinds || bp.addr != pc || !bp.condition.eval(ctx)) continue;
+      stop(SFC_BREAK_PC, bp.id, 0, 0);
+      return true;
+    }
+    return false;
+  }
+
+  void nes_debugger::check_access(uint16_t addr, uint8_t value, int kind) {
+    if (!enabled || has_hit()) return;
+    const uint16_t canonical = canonical_address(addr);
+    const nes_debug_context ctx = { registers, clock->cycle, addr, value, memory };
+    for (size_t i=0; i<points.size(); i++) {
+      const point& wp = points[i];
+      if (!(wp.kinds & kind) || (uint16_t)(canonical - wp.addr) >= wp.length) continue;
+      if (!wp.condition.eval(ctx)) continue;
+      stop(kind == SFC_WATCH_READ? SFC_BREAK_READ: SFC_BREAK_WRITE, wp.id, addr, value);
+      return;
+    }
+  }
+}
@@ -0,0 +1,246 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "include/nes_env.h"
+#include "include/simulator.h"
+
+struct sfc_rom
+{
+  fc::nes_rom_handler handler;
+};
+
+struct sfc_env
+{
+  fc::simulator fc;
+  uint32_t flags;
+};
+
+namespace fc
+{
+  // sfc_env_step_many 的一批任务
+  struct nes_env_batch
+  {
+    sfc_env* const* envs;
+    uint32_t count;
+    const uint16_t* actions;
+    uint32_t frames;
+    uint8_t* ram;
+    uint8_t* frames_out;
+    // 下一个要运行的实例
+    std::atomic<uint32_t> next;
+  };
+
+  static void env_step(sfc_env* env, const uint16_t* actions, uint32_t frames) {
+    nes_joypad& joypad = env->fc.get_joypad();
+    for (uint32_t i=0; i<frames; i++) {
+      if (actions) {
+        joypad.set_buttons(0, actions[i] & 0xff);
+        joypad.set_buttons(1, actions[i] >> 8);
+      }
+      if ((env->flags & SFC_ENV_RENDER) && i + 1 == frames) env->fc.request_render();
+      env->fc.run_frame();
+    }
+  }
+
+  // 不断领取并运行批次中的下一个实例，直到全部领取完
+  static void drain(nes_env_batch& b) {
+    uint32_t k;
+    while ((k = b.next.fetch_add(1)) < b.count) {
+      sfc_env* env = b.envs[k];
+      env_step(env, b.actions? b.actions + (size_t)k * b.frames: NULL, b.frames);
+      if (b.ram) memcpy(b.ram + (size_t)k * SFC_ENV_RAM_BYTES, env->fc.get_memory_pool().get_main_memory(), SFC_ENV_RAM_BYTES);
+      if (b.frames_out) memcpy(b.frames_out + (size_t)k * SFC_ENV_FRAME_BYTES, env->fc.get_framebuffer(), SFC_ENV_FRAME_BYTES);
+    }
+  }
+
+  // sfc_env_step_many 的线程池
+  /*
+    工作线程在两次批次之间等待条件变量，调用者所在的线程也参与运行，
+    各线程以原子计数逐个领取实例，先完成的线程自动多领，实例之间的用时不同也不会互相等待。
+  */
+  class nes_env_workers
+  {
+  private:
+    // 同一时间只执行一个批次
+    std::mutex batch_lock;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::vector<std::thread> threads;
+    // 当前批次与它的序号，序号改变时工作线程开始运行
+    nes_env_batch* batch = NULL;
+    uint64_t generation = 0;
+    // 还在运行当前批次的工作线程数
+    size_t busy = 0;
+    bool stopping = false;
+
+    // 工作线程主循环，seen 为创建线程时的批次序号
+    void run(uint64_t seen) {
+      std::unique_lock<std::mutex> guard(lock);
+      for (;;) {
+        wake.wait(guard, [&] { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+        nes_env_batch* b = batch;
+        guard.unlock();
+        drain(*b);
+        guard.lock();
+        if (--busy == 0) done.notify_all();
+      }
+    }
+
+    void stop() {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        wake.notify_all();
+      }
+      for (size_t i=0; i<threads.size(); i++) threads[i].join();
+      threads.clear();
+      stopping = false;
+    }
+
+  public:
+    nes_env_workers() { resize(0); }
+    ~nes_env_workers() { stop(); }
+
+    // 共 total 个线程（包括调用者），0 表示使用全部处理器
+    void resize(uint32_t total) {
+      std::lock_guard<std::mutex> guard(batch_lock);
+      if (!total) total = std::thread::hardware_concurrency();
+      if (!total) total = 1;
+      stop();
+      for (uint32_t i=1; i<total; i++) threads.push_back(std::thread(&nes_env_workers::run, this, generation));
+    }
+
+    void execute(nes_env_batch& b) {
+      std::lock_guard<std::mutex> serial(batch_lock);
+      if (threads.empty() || b.count <= 1) {
+        drain(b);
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        batch = &b;
+        busy = threads.size();
+        ++generation;
+        wake.notify_all();
+      }
+      drain(b);
+      std::unique_lock<std::mutex> guard(lock);
+      done.wait(guard, [this] { return busy == 0; });
+      batch = NULL;
+    }
+
+    static nes_env_workers& shared() {
+      static nes_env_workers workers;
+      return workers;
+    }
+  };
+}
+
+extern "C" {
+  uint32_t sfc_env_abi_version(void) {
+    return SFC_ENV_ABI_VERSION;
+  }
+
+  sfc_rom* sfc_rom_load(const void* data, size_t size) {
+    sfc_rom* rom = new sfc_rom();
+    if (!rom->handler.load_memory((const uint8_t*)data, size)) {
+      delete rom;
+      return NULL;
+    }
+    rom->handler.parse_to_info();
+    // 目前只支持 16K/32K PRG-ROM 的 NROM
+    const fc::nes_rom_info* info = rom->handler.get_info();
+    fc::nes_mapper* mapper = fc::nes_mapper::create(info->mapper_number);
+    const bool supported = mapper && info->prg_rom_count >= 1 && info->prg_rom_count <= 2;
+    delete mapper;
+    if (!supported) {
+      sfc_rom_free(rom);
+      return NULL;
+    }
+    return rom;
+  }
+
+  void sfc_rom_free(sfc_rom* rom) {
+    if (!rom) return;
+    rom->handler.unload_image();
+    delete rom;
+  }
+
+  sfc_env* sfc_env_create(sfc_rom* rom, uint32_t flags) {
+    if (!rom) return NULL;
+    sfc_env* env = new sfc_env();
+    env->flags = flags;
+    env->fc.load_rom(&rom->handler);
+    env->fc.set_headless(true, 0);
+    // 先分配画面，sfc_env_frame 返回的指针之后一直有效
+    if (flags & SFC_ENV_RENDER) env->fc.get_ppu().set_output(true);
+    return env;
+  }
+
+  void sfc_env_destroy(sfc_env* env) {
+    delete env;
+  }
+
+  void sfc_env_step(sfc_env* env, const uint16_t* actions, uint32_t frames) {
+    fc::env_step(env, actions, frames);
+  }
+
+  void sfc_env_step_many(sfc_env* const* envs, uint32_t count, const uint16_t* actions, uint32_t frames,
+    uint8_t* ram, uint8_t* frames_out) {
+    fc::nes_env_batch b;
+    b.envs = envs;
+    b.count = count;
+    b.actions = actions;
+    b.frames = frames;
+    b.ram = ram;
+    b.frames_out = frames_out;
+    b.next = 0;
+    fc::nes_env_workers::shared().execute(b);
+  }
+
+  void sfc_env_set_threads(uint32_t threads) {
+    fc::nes_env_workers::shared().resize(threads);
+  }
+
+  void sfc_env_read_ram(sfc_env* env, uint8_t* out) {
+    memcpy(out, env->fc.get_memory_pool().get_main_memory(), SFC_ENV_RAM_BYTES);
+  }
+
+  void sfc_env_read_frame(sfc_env* env, uint8_t* out) {
+    memcpy(out, env->fc.get_framebuffer(), SFC_ENV_FRAME_BYTES);
+  }
+
+  const uint8_t* sfc_env_ram(sfc_env* env) {
+    return env->fc.get_memory_pool().get_main_memory();
+  }
+
+  const uint8_t* sfc_env_frame(sfc_env* env) {
+    return env->fc.get_framebuffer();
+  }
+
+  uint8_t sfc_env_peek(sfc_env* env, uint16_t addr) {
+    return env->fc.get_memory_pool().peek(addr);
+  }
+
+  uint64_t sfc_env_frame_count(sfc_env* env) {
+    return env->fc.get_ppu().get_frame_count();
+  }
+
+  size_t sfc_env_snapshot_size(sfc_env* env) {
+    return env->fc.snapshot_size();
+  }
+
+  void sfc_env_save(sfc_env* env, void* buf) {
+    env->fc.save_state(buf);
+  }
+
+  void sfc_env_reset(sfc_env* env, const void* snapshot) {
+    env->fc.load_state(snapshot);
+  }
+}
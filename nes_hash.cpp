@@ -0,0 +1,303 @@
+#include <cstring>
+#include <cassert>
+#include "include/nes_hash.h"
+
+// 仅在 x86 + GCC/Clang 下编译 SIMD 版本，其它平台只有标量实现
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SFC_X86_KERNELS 1
+#include <immintrin.h>
+#define SFC_TARGET_SSE2 __attribute__((target("sse2")))
+#define SFC_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace fc
+{
+  static const uint64_t PRIME32_1 = 0x9e3779b1u;
+  static const uint64_t PRIME32_2 = 0x85ebca77u;
+  static const uint64_t PRIME32_3 = 0xc2b2ae3du;
+  static const uint64_t PRIME64_1 = 0x9e3779b185ebca87ull;
+  static const uint64_t PRIME64_2 = 0xc2b2ae3d27d4eb4full;
+  static const uint64_t PRIME64_3 = 0x165667b19e3779f9ull;
+  static const uint64_t PRIME64_4 = 0x85ebca77c2b2ae63ull;
+  static const uint64_t PRIME64_5 = 0x27d4eb2f165667c5ull;
+
+  // 每搅乱一次之间的条带数
+  static const size_t STRIPES_PER_BLOCK = (SFC_HASH_SECRET_SIZE - SFC_HASH_STRIPE) / 8;
+
+  static inline uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+  }
+
+  // 由 splitmix64 生成的密钥
+  struct hash_secret {
+    uint8_t bytes[SFC_HASH_SECRET_SIZE];
+
+    hash_secret() {
+      uint64_t x = 0x6502c0de6502c0deull;
+      for (int i=0; i<SFC_HASH_SECRET_SIZE; i += 8) {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        z ^= z >> 31;
+        memcpy(bytes + i, &z, 8);
+      }
+    }
+  };
+
+  static const uint8_t* secret() {
+    static const hash_secret s;
+    return s.bytes;
+  }
+
+  // ---------------------------------------------------------------- 标量实现
+
+  static void accumulate_scalar(uint64_t* acc, const uint8_t* data, size_t stripes, const uint8_t* key) {
+    for (size_t s=0; s<stripes; s++) {
+      const uint8_t* in = data + s * SFC_HASH_STRIPE;
+      const uint8_t* k = key + s * 8;
+      for (int i=0; i<8; i++) {
+        const uint64_t v = read64(in + i * 8);
+        const uint64_t dk = v ^ read64(k + i * 8);
+        acc[i ^ 1] += v;
+        acc[i] += (dk & 0xffffffffu) * (dk >> 32);
+      }
+    }
+  }
+
+  static void scramble_scalar(uint64_t* acc, const uint8_t* key) {
+    for (int i=0; i<8; i++) {
+      uint64_t a = acc[i];
+      a ^= a >> 47;
+      a ^= read64(key + i * 8);
+      acc[i] = a * PRIME32_1;
+    }
+  }
+
+  static const nes_hash_kernels kernels_scalar = {
+    "scalar",
+    accumulate_scalar,
+    scramble_scalar,
+  };
+
+#ifdef SFC_X86_KERNELS
+  // ---------------------------------------------------------------- SSE2 实现
+
+  SFC_TARGET_SSE2
+  static void accumulate_sse2(uint64_t* acc, const uint8_t* data, size_t stripes, const uint8_t* key) {
+    __m128i a[4];
+    for (int i=0; i<4; i++) a[i] = _mm_loadu_si128((const __m128i*)acc + i);
+    for (size_t s=0; s<stripes; s++) {
+      const __m128i* in = (const __m128i*)(data + s * SFC_HASH_STRIPE);
+      const __m128i* k = (const __m128i*)(key + s * 8);
+      for (int i=0; i<4; i++) {
+        const __m128i v = _mm_loadu_si128(in + i);
+        const __m128i dk = _mm_xor_si128(v, _mm_loadu_si128(k + i));
+        // 低 32 位乘高 32 位
+        const __m128i product = _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+        // 原值交换相邻通道后累加
+        const __m128i swapped = _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+        a[i] = _mm_add_epi64(a[i], _mm_add_epi64(product, swapped));
+      }
+    }
+    for (int i=0; i<4; i++) _mm_storeu_si128((__m128i*)acc + i, a[i]);
+  }
+
+  SFC_TARGET_SSE2
+  static void scramble_sse2(uint64_t* acc, const uint8_t* key) {
+    const __m128i prime = _mm_set1_epi32((int)PRIME32_1);
+    for (int i=0; i<4; i++) {
+      __m128i a = _mm_loadu_si128((const __m128i*)acc + i);
+      a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+      a = _mm_xor_si128(a, _mm_loadu_si128((const __m128i*)key + i));
+      // 64 位乘 32 位：低半与高半分别相乘，高半的积左移 32 位
+      const __m128i lo = _mm_mul_epu32(a, prime);
+      const __m128i hi = _mm_mul_epu32(_mm_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+      _mm_storeu_si128((__m128i*)acc + i, _mm_add_epi64(lo, _mm_slli_epi64(hi, 32)));
+    }
+  }
+
+  static const nes_hash_kernels kernels_sse2 = {
+    "sse2",
+    accumulate_sse2,
+    scramble_sse2,
+  };
+
+  // ---------------------------------------------------------------- AVX2 实现
+
+  SFC_TARGET_AVX2
+  static void accumulate_avx2(uint64_t* acc, const uint8_t* data, size_t stripes, const uint8_t* key) {
+    __m256i a0 = _mm256_loadu_si256((const __m256i*)acc);
+    __m256i a1 = _mm256_loadu_si256((const __m256i*)acc + 1);
+    for (size_t s=0; s<stripes; s++) {
+      const __m256i* in = (const __m256i*)(data + s * SFC_HASH_STRIPE);
+      const __m256i* k = (const __m256i*)(key + s * 8);
+      const __m256i v0 = _mm256_loadu_si256(in);
+      const __m256i v1 = _mm256_loadu_si256(in + 1);
+      const __m256i dk0 = _mm256_xor_si256(v0, _mm256_loadu_si256(k));
+      const __m256i dk1 = _mm256_xor_si256(v1, _mm256_loadu_si256(k + 1));
+      a0 = _mm256_add_epi64(a0, _mm256_add_epi64(
+        _mm256_mul_epu32(dk0, _mm256_shuffle_epi32(dk0, _MM_SHUFFLE(0, 3, 0, 1))),
+        _mm256_shuffle_epi32(v0, _MM_SHUFFLE(1, 0, 3, 2))));
+      a1 = _mm256_add_epi64(a1, _mm256_add_epi64(
+        _mm256_mul_epu32(dk1, _mm256_shuffle_epi32(dk1, _MM_SHUFFLE(0, 3, 0, 1))),
+        _mm256_shuffle_epi32(v1, _MM_SHUFFLE(1, 0, 3, 2))));
+    }
+    _mm256_storeu_si256((__m256i*)acc, a0);
+    _mm256_storeu_si256((__m256i*)acc + 1, a1);
+  }
+
+  SFC_TARGET_AVX2
+  static void scramble_avx2(uint64_t* acc, const uint8_t* key) {
+    const __m256i prime = _mm256_set1_epi32((int)PRIME32_1);
+    for (int i=0; i<2; i++) {
+      __m256i a = _mm256_loadu_si256((const __m256i*)acc + i);
+      a = _mm256_xor_si256(a, _mm256_srli_epi64(a, 47));
+      a = _mm256_xor_si256(a, _mm256_loadu_si256((const __m256i*)key + i));
+      const __m256i lo = _mm256_mul_epu32(a, prime);
+      const __m256i hi = _mm256_mul_epu32(_mm256_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+      _mm256_storeu_si256((__m256i*)acc + i, _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32)));
+    }
+  }
+
+  static const nes_hash_kernels kernels_avx2 = {
+    "avx2",
+    accumulate_avx2,
+    scramble_avx2,
+  };
+#endif
+
+  const nes_hash_kernels& nes_hash_kernels_scalar() {
+    return kernels_scalar;
+  }
+
+  const nes_hash_kernels& nes_hash_kernels_best() {
+#ifdef SFC_X86_KERNELS
+    if (__builtin_cpu_supports("avx2")) return kernels_avx2;
+    if (__builtin_cpu_supports("sse2")) return kernels_sse2;
+#endif
+    return kernels_scalar;
+  }
+
+  int nes_hash_kernels_available(const nes_hash_kernels* list[], int max) {
+    int count = 0;
+    if (count < max) list[count++] = &kernels_scalar;
+#ifdef SFC_X86_KERNELS
+    if (count < max && __builtin_cpu_supports("sse2")) list[count++] = &kernels_sse2;
+    if (count < max && __builtin_cpu_supports("avx2")) list[count++] = &kernels_avx2;
+#endif
+    return count;
+  }
+
+  // 128 位乘积的高低两半异或
+  static inline uint64_t mul128_fold64(uint64_t a, uint64_t b) {
+    const __uint128_t p = (__uint128_t)a * b;
+    return (uint64_t)p ^ (uint64_t)(p >> 64);
+  }
+
+  static inline uint64_t avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= 0x165667919e3779f9ull;
+    return h ^ (h >> 32);
+  }
+
+  uint64_t nes_hash64(const void* data, size_t size, uint64_t seed, const nes_hash_kernels* kernels) {
+    static const nes_hash_kernels& best = nes_hash_kernels_best();
+    const nes_hash_kernels& k = kernels? *kernels: best;
+    const uint8_t* key = secret();
+    const uint8_t* in = (const uint8_t*)data;
+
+    uint64_t acc[8] = {
+      PRIME32_3 + seed, PRIME64_1 - seed, PRIME64_2 + seed, PRIME64_3 - seed,
+      PRIME64_4 + seed, PRIME32_2 - seed, PRIME64_5 + seed, PRIME32_1 - seed,
+    };
+
+    size_t stripes = size / SFC_HASH_STRIPE;
+    while (stripes) {
+      const size_t n = stripes < STRIPES_PER_BLOCK? stripes: STRIPES_PER_BLOCK;
+      k.accumulate(acc, in, n, key);
+      in += n * SFC_HASH_STRIPE;
+      stripes -= n;
+      if (n == STRIPES_PER_BLOCK) k.scramble(acc, key + SFC_HASH_SECRET_SIZE - SFC_HASH_STRIPE);
+    }
+    // 不足一个条带的尾部补零后单独累加
+    const size_t tail = size % SFC_HASH_STRIPE;
+    if (tail) {
+      uint8_t last[SFC_HASH_STRIPE] = {0};
+      memcpy(last, in, tail);
+      k.accumulate(acc, last, 1, key + 7);
+    }
+
+    uint64_t h = size * PRIME64_1 ^ seed;
+    for (int i=0; i<4; i++) {
+      h += mul128_fold64(
+        acc[2 * i] ^ read64(key + 11 + 16 * i),
+        acc[2 * i + 1] ^ read64(key + 19 + 16 * i));
+    }
+    return avalanche(h);
+  }
+
+  // ---------------------------------------------------------------- 日志
+
+  static const char LOG_MAGIC[8] = { 'S', 'F', 'C', 'H', 'A', 'S', 'H', '1' };
+
+  bool nes_state_digest::same_state(const nes_state_digest& o) const {
+    return cycle == o.cycle && cpu == o.cpu && ram == o.ram && sram == o.sram && video == o.video;
+  }
+
+  uint64_t nes_state_digest::checksum(bool with_video) const {
+    const uint64_t fields[5] = { cycle, cpu, ram, sram, video };
+    return nes_hash64(fields, with_video? sizeof(fields): sizeof(fields) - 8);
+  }
+
+  bool nes_hash_log::create(const char* path) {
+    close();
+    fp = fopen(path, "wb");
+    if (!fp) return false;
+    fwrite(LOG_MAGIC, 1, sizeof(LOG_MAGIC), fp);
+    return true;
+  }
+
+  bool nes_hash_log::open(const char* path) {
+    close();
+    fp = fopen(path, "rb");
+    if (!fp) return false;
+    char magic[8];
+    if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, LOG_MAGIC, 8)) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void nes_hash_log::append(const nes_state_digest& d) {
+    const uint64_t fields[6] = { d.frame, d.cycle, d.cpu, d.ram, d.sram, d.video };
+    uint8_t record[48];
+    for (int i=0; i<6; i++) {
+      for (int b=0; b<8; b++) record[i * 8 + b] = (fields[i] >> (b * 8)) & 0xff;
+    }
+    fwrite(record, 1, sizeof(record), fp);
+  }
+
+  bool nes_hash_log::next(nes_state_digest& d) {
+    uint8_t record[48];
+    if (fread(record, 1, sizeof(record), fp) != sizeof(record)) return false;
+    uint64_t fields[6] = {0};
+    for (int i=0; i<6; i++) {
+      for (int b=0; b<8; b++) fields[i] |= (uint64_t)record[i * 8 + b] << (b * 8);
+    }
+    d.frame = fields[0];
+    d.cycle = fields[1];
+    d.cpu = fields[2];
+    d.ram = fields[3];
+    d.sram = fields[4];
+    d.video = fields[5];
+    return true;
+  }
+
+  void nes_hash_log::close() {
+    if (fp) fclose(fp);
+    fp = NULL;
+  }
+}
@@ -0,0 +1,29 @@
+#include "include/nes_joypad.h"
+
+namespace fc
+{
+  // 读取时高位为开放总线，通常是地址的高字节 $40
+  static const uint8_t OPEN_BUS = 0x40;
+
+  void nes_joypad::init() {
+    buttons[0] = buttons[1] = 0;
+    shift[0] = shift[1] = 0;
+    strobe = false;
+  }
+
+  void nes_joypad::write(uint8_t data) {
+    strobe = data & 1;
+    if (strobe) {
+      shift[0] = buttons[0];
+      shift[1] = buttons[1];
+    }
+  }
+
+  uint8_t nes_joypad::read(int port) {
+    if (strobe) return OPEN_BUS | (buttons[port] & 1);
+    const uint8_t bit = shift[port] & 1;
+    // 移出后补 1，8 次之后一直读到 1
+    shift[port] = (shift[port] >> 1) | 0x80;
+    return OPEN_BUS | bit;
+  }
+}
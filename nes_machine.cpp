@@ -0,0 +1,141 @@
+#include <cassert>
+#include <cstring>
+#include <new>
+#include "include/nes_machine.h"
+
+namespace fc
+{
+  static_assert(sizeof(nes_machine) % SFC_CACHE_LINE == 0, "nes_machine 须占整数个缓存行");
+  static_assert(offsetof(nes_machine, cpu) == 0, "CPU 寄存器须在最前");
+
+  // 宿主程序设置的工具状态与 machine 之外的缓冲区，它们属于实例而不属于模拟的机器
+  struct nes_machine::host_fields
+  {
+    uint8_t* sram;
+    nes_ppu_output* output;
+    nes_blip_buffer* blip;
+    nes_aot* aot;
+    uint8_t trace_mode;
+    bool idioms;
+    FILE* trace_file;
+    uint64_t* profile_hits;
+    uint64_t* profile_cycles;
+    uint8_t* coverage;
+    uint32_t coverage_mask;
+    nes_debugger* cpu_debugger;
+    nes_idiom_stats idiom_stats;
+    nes_aot_stats aot_stats;
+    nes_debugger* memory_debugger;
+
+    explicit host_fields(const nes_machine& m) {
+      sram = m.memory_pool.sram_memory;
+      output = m.ppu.output;
+      blip = m.apu.blip;
+      aot = m.cpu.aot;
+      trace_mode = m.cpu.trace_mode;
+      idioms = m.cpu.idioms;
+      trace_file = m.cpu.trace_file;
+      profile_hits = m.cpu.profile_hits;
+      profile_cycles = m.cpu.profile_cycles;
+      coverage = m.cpu.coverage;
+      coverage_mask = m.cpu.coverage_mask;
+      cpu_debugger = m.cpu.debugger;
+      idiom_stats = m.cpu.idiom_stats;
+      aot_stats = m.cpu.aot_stats;
+      memory_debugger = m.memory_pool.debugger;
+    }
+
+    void put(nes_machine& m) const {
+      m.memory_pool.sram_memory = m.memory_pool.banks[3] = sram;
+      m.ppu.output = output;
+      m.apu.blip = blip;
+      m.cpu.aot = aot;
+      m.cpu.trace_mode = trace_mode;
+      m.cpu.idioms = idioms;
+      m.cpu.trace_file = trace_file;
+      m.cpu.profile_hits = profile_hits;
+      m.cpu.profile_cycles = profile_cycles;
+      m.cpu.coverage = coverage;
+      m.cpu.coverage_mask = coverage_mask;
+      m.cpu.debugger = cpu_debugger;
+      m.cpu.idiom_stats = idiom_stats;
+      m.cpu.aot_stats = aot_stats;
+      m.memory_pool.debugger = memory_debugger;
+    }
+  };
+
+  void nes_machine::save(void* buf) {
+    uint8_t* p = (uint8_t*)buf;
+    memcpy(p, (void*)this, sizeof(nes_machine));
+    p += sizeof(nes_machine);
+    memcpy(p, memory_pool.get_sram_memory(), 8 * 1024);
+    p += 8 * 1024;
+    if (ppu.cart_vram_size) memcpy(p, ppu.cart_vram, ppu.cart_vram_size);
+  }
+
+  void nes_machine::restore(const void* buf) {
+    const nes_machine* image = (const nes_machine*)buf;
+    const uint8_t* p = (const uint8_t*)buf + sizeof(nes_machine);
+    // 快照中已经分配了 SRAM 时，本实例也要有
+    if (image->memory_pool.sram_memory && !memory_pool.sram_memory) memory_pool.allocate_sram();
+    const host_fields host(*this);
+    memcpy((void*)this, buf, sizeof(nes_machine));
+    host.put(*this);
+    // 画面与采样输出开启时缓冲区必定存在
+    ppu.output_enabled = ppu.output_enabled && host.output;
+    apu.output_enabled = apu.output_enabled && host.blip;
+
+    if (host.sram) memcpy(host.sram, p, 8 * 1024);
+    p += 8 * 1024;
+    if (ppu.cart_vram_size) memcpy(ppu.cart_vram, p, ppu.cart_vram_size);
+  }
+
+  nes_machine_pool::nes_machine_pool(size_t per_chunk) {
+    this->per_chunk = per_chunk? per_chunk: 1;
+    free_list = NULL;
+    in_use = 0;
+  }
+
+  nes_machine_pool::~nes_machine_pool() {
+    assert(!in_use && "还有实例没有归还");
+    for (size_t i=0; i<chunks.size(); i++) free(chunks[i]);
+  }
+
+  nes_machine* nes_machine_pool::create() {
+    void* slot = NULL;
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (!free_list) {
+        void* chunk = NULL;
+        if (posix_memalign(&chunk, SFC_CACHE_LINE, per_chunk * sizeof(nes_machine))) chunk = NULL;
+        assert(chunk && "无法分配实例");
+        chunks.push_back(chunk);
+        // 把新块中的实例串成空闲链表，第一个实例在链表头
+        for (size_t i=per_chunk; i>0; i--) {
+          void* s = (uint8_t*)chunk + (i - 1) * sizeof(nes_machine);
+          *(void**)s = free_list;
+          free_list = s;
+        }
+      }
+      slot = free_list;
+      free_list = *(void**)slot;
+      ++in_use;
+    }
+    return new (slot) nes_machine();
+  }
+
+  void nes_machine_pool::destroy(nes_machine* machine) {
+    if (!machine) return;
+    machine->~nes_machine();
+    std::lock_guard<std::mutex> guard(lock);
+    *(void**)machine = free_list;
+    free_list = machine;
+    --in_use;
+  }
+
+  nes_machine_pool& nes_machine_pool::shared() {
+    // 永不析构：进程退出时仍存活的实例（包括其他静态对象中的实例）可以照常退出或稍后归还
+    static nes_machine_pool* pool = new nes_machine_pool();
+    return *pool;
+  }
+}
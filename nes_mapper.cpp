@@ -0,0 +1,13 @@
+#include "include/nes_mapper.h"
+#include "include/nes_nrom_mapper.h"
+
+namespace fc
+{
+  nes_mapper* nes_mapper::create(uint8_t number) {
+    switch (number) {
+    case 0:
+      return new nes_nrom_mapper();
+    }
+    return NULL;
+  }
+}
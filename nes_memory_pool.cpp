@@ -1,19 +1,38 @@
 #include <cassert>
 #include "include/nes_memory_pool.h"
 #include "include/nes_mapper.h"
+#include "include/nes_debugger.h"
 
 namespace fc
 {
-  void nes_memory_pool::init(nes_rom_info* rom_info, nes_mapper* mapper) {
+  const uint8_t nes_memory_pool::empty_sram[8 * 1024] = {0};
+
+  nes_memory_pool::~nes_memory_pool() {
+    free(sram_memory);
+  }
+
+  void nes_memory_pool::allocate_sram() {
+    sram_memory = (uint8_t*)calloc(1, 8 * 1024);
+    assert(sram_memory && "无法分配 SRAM");
+    banks[3] = sram_memory;
+  }
+
+  void nes_memory_pool::init(nes_rom_info* rom_info, nes_mapper* mapper, nes_ppu* ppu, nes_apu* apu, nes_joypad* joypad) {
     // puts("Banks (before mapper reset):");
     // for (int i=0; i<8; i++) {
     //   printf(" idx(%d): %p\n", i, banks[i]);
     // }
 
     banks[0] = main_memory;
+    if (rom_info->have_sram && !sram_memory) allocate_sram();
     banks[3] = sram_memory;
+    this->ppu = ppu;
+    this->apu = apu;
+    this->joypad = joypad;
+    prg_rom = rom_info->prg_rom_ptr;
 
     if (mapper) mapper->reset(rom_info, banks);
+    refresh_pages();
 
     // puts("Banks (after mapper reset):");
     // for (int i=0; i<8; i++) {
@@ -21,40 +40,131 @@ namespace fc
     // }
   }
 
+  void nes_memory_pool::refresh_pages() {
+    watched = false;
+    for (int page=0; page<256; page++) {
+      const bool watching = debugger && debugger->watching(page);
+      pages[page] = watching? NULL: page_pointer(page);
+      watched = watched || watching;
+    }
+  }
+
   uint8_t nes_memory_pool::read(uint16_t addr) {
+    const uint8_t* page = pages[addr >> 8];
+    if (page) return page[addr & 0xff];
+    return read_slow(addr);
+  }
+
+  void nes_memory_pool::write(uint16_t addr, uint8_t data) {
+    uint8_t* page = pages[addr >> 8];
+    // PRG-ROM 的页只用于读取
+    if (page && addr < 0x8000) {
+      page[addr & 0xff] = data;
+      return;
+    }
+    write_slow(addr, data);
+  }
+
+  uint8_t nes_memory_pool::read_slow(uint16_t addr) {
+    const uint8_t data = read_bank(addr);
+    if (debugger && debugger->watching(addr >> 8)) debugger->check_access(addr, data, SFC_WATCH_READ);
+    return data;
+  }
+
+  void nes_memory_pool::write_slow(uint16_t addr, uint8_t data) {
+    if (debugger && debugger->watching(addr >> 8)) debugger->check_access(addr, data, SFC_WATCH_WRITE);
+    write_bank(addr, data);
+  }
+
+  uint8_t nes_memory_pool::read_bank(uint16_t addr) {
     switch (addr >> 13) {
     case 0:
       // TODO: 这里是否需要地址的映射？
       return main_memory[addr & (uint16_t)0x07ff];
     case 1:
-      assert(!"未实现");
+      ppu->catch_up(clock->cycle);
+      return ppu->read_register(addr & (uint16_t)0x0007);
     case 2:
+      if (addr == 0x4015) {
+        apu->catch_up(clock->cycle);
+        return apu->read_register(addr);
+      }
+      if (addr == 0x4016 || addr == 0x4017) return joypad->read(addr & 1);
       assert(!"未实现");
     case 3:
-      return sram_memory[addr & (uint16_t)0x1fff];
+      return sram_memory? sram_memory[addr & (uint16_t)0x1fff]: 0;
     case 4: case 5: case 6: case 7:
       return banks[addr >> 13][addr & (uint16_t)0x1fff];
     }
     assert(!"无效的地址");
   }
 
-  void nes_memory_pool::write(uint16_t addr, uint8_t data) {
+  void nes_memory_pool::write_bank(uint16_t addr, uint8_t data) {
     switch (addr >> 13) {
     case 0:
       // TODO: 这里是否需要地址的映射？
       main_memory[addr & (uint16_t)0x07ff] = data;
       return;
     case 1:
-      assert(!"未实现");
+      ppu->catch_up(clock->cycle);
+      ppu->write_register(addr & (uint16_t)0x0007, data);
+      return;
     case 2:
+      if (addr == 0x4014) {
+        oam_dma(data);
+        return;
+      }
+      if (addr == 0x4016) {
+        joypad->write(data);
+        return;
+      }
+      if (addr < 0x4014 || addr == 0x4015 || addr == 0x4017) {
+        apu->catch_up(clock->cycle);
+        apu->write_register(addr, data);
+        return;
+      }
       assert(!"未实现");
     case 3:
+      if (!sram_memory) {
+        // 第一次写入时分配，之后这些页走页表
+        allocate_sram();
+        refresh_pages();
+      }
       sram_memory[addr & (uint16_t)0x1fff] = data;
       return;
     case 4: case 5: case 6: case 7:
-      banks[addr >> 13][addr & (uint16_t)0x1fff] = data;
+      // NROM 的 PRG-ROM 不可写
       return;
     }
     assert(!"无效的地址");
   }
-}
\ No newline at end of file
+
+  uint8_t* nes_memory_pool::page_pointer(uint8_t page) {
+    switch (page >> 5) {
+    case 0:
+      return main_memory + ((page << 8) & 0x07ff);
+    case 1: case 2:
+      return NULL;
+    case 3:
+      return sram_memory? sram_memory + ((page << 8) & 0x1fff): NULL;
+    default:
+      return banks[page >> 5] + ((page << 8) & 0x1fff);
+    }
+  }
+
+  void nes_memory_pool::oam_dma(uint8_t page) {
+    ppu->catch_up(clock->cycle);
+    // 有观察点的页同样逐字节读取，以便观察点看到 DMA 的读取
+    const uint8_t* src = pages[page];
+    if (src) {
+      // 普通内存整页直接复制
+      ppu->write_oam(src);
+    } else {
+      // I/O 区域的读取有副作用，逐字节读取
+      uint8_t data[256];
+      for (int i=0; i<256; i++) data[i] = read((page << 8) | i);
+      ppu->write_oam(data);
+    }
+    stall(SFC_OAM_DMA_CYCLES + (clock->cycle & 1));
+  }
+}
@@ -0,0 +1,87 @@
+#include <cstdio>
+#include <cstring>
+#include "include/nes_movie.h"
+
+namespace fc
+{
+  static const char MOVIE_MAGIC[8] = { 'S', 'F', 'C', 'M', 'O', 'V', 'I', '1' };
+
+  // 解析 .fm2 中一个手柄的 8 个字符，顺序为 RLDUTSBA，'.' 或空格表示未按下
+  static uint8_t parse_fm2_port(const char* p, const char* end) {
+    uint8_t mask = 0;
+    for (int i=0; i<8 && p + i < end; i++) {
+      if (p[i] != '.' && p[i] != ' ') mask |= 0x80 >> i;
+    }
+    return mask;
+  }
+
+  bool nes_movie::load_fm2(const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) return false;
+    clear();
+
+    char line[512];
+    bool ok = true;
+    while (fgets(line, sizeof(line), fp)) {
+      if (line[0] != '|') {
+        // 文件头的键值对，只需要检查是否为二进制形式
+        if (!strncmp(line, "binary 1", 8)) ok = false;
+        continue;
+      }
+      // |命令|手柄 1|手柄 2|扩展口|
+      const char* fields[4] = { NULL, NULL, NULL, NULL };
+      const char* ends[4] = { NULL, NULL, NULL, NULL };
+      const char* p = line + 1;
+      for (int i=0; i<4; i++) {
+        const char* bar = strchr(p, '|');
+        if (!bar) break;
+        fields[i] = p;
+        ends[i] = bar;
+        p = bar + 1;
+      }
+      if (!fields[1]) continue;
+      if (atoi(fields[0]) & 3) ++ignored_resets;
+      append(
+        parse_fm2_port(fields[1], ends[1]),
+        fields[2]? parse_fm2_port(fields[2], ends[2]): 0);
+    }
+    fclose(fp);
+    return ok;
+  }
+
+  bool nes_movie::load(const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return false;
+    clear();
+    char magic[8];
+    uint8_t count[8];
+    bool ok = fread(magic, 1, 8, fp) == 8 && !memcmp(magic, MOVIE_MAGIC, 8)
+      && fread(count, 1, 8, fp) == 8;
+    if (ok) {
+      uint64_t n = 0;
+      for (int i=0; i<8; i++) n |= (uint64_t)count[i] << (i * 8);
+      uint8_t buttons[2];
+      for (uint64_t i=0; i<n && ok; i++) {
+        ok = fread(buttons, 1, 2, fp) == 2;
+        if (ok) append(buttons[0], buttons[1]);
+      }
+    }
+    fclose(fp);
+    return ok;
+  }
+
+  bool nes_movie::save(const char* path) const {
+    FILE* fp = fopen(path, "wb");
+    if (!fp) return false;
+    fwrite(MOVIE_MAGIC, 1, 8, fp);
+    uint8_t count[8];
+    for (int i=0; i<8; i++) count[i] = (uint64_t)frames.size() >> (i * 8);
+    fwrite(count, 1, 8, fp);
+    for (size_t i=0; i<frames.size(); i++) {
+      const uint8_t buttons[2] = { (uint8_t)frames[i], (uint8_t)(frames[i] >> 8) };
+      fwrite(buttons, 1, 2, fp);
+    }
+    fclose(fp);
+    return true;
+  }
+}
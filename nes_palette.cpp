@@ -0,0 +1,544 @@
+#include <cmath>
+#include <cstring>
+#include <cassert>
+#include "include/nes_palette.h"
+
+// 仅在 x86 + GCC/Clang 下编译 SIMD 版本，其它平台只有标量实现
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SFC_X86_KERNELS 1
+#include <immintrin.h>
+#define SFC_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define SFC_TARGET_AVX2  __attribute__((target("avx2")))
+#endif
+
+namespace fc
+{
+  // 内置调色板（2C02），64 种颜色的 RGB
+  static const uint8_t nes_default_rgb[64 * 3] = {
+    0x62,0x62,0x62, 0x00,0x1f,0xb2, 0x24,0x04,0xc8, 0x52,0x00,0xb2,
+    0x73,0x00,0x76, 0x80,0x00,0x24, 0x73,0x0b,0x00, 0x52,0x28,0x00,
+    0x24,0x44,0x00, 0x00,0x57,0x00, 0x00,0x5c,0x00, 0x00,0x53,0x24,
+    0x00,0x3c,0x76, 0x00,0x00,0x00, 0x00,0x00,0x00, 0x00,0x00,0x00,
+    0xab,0xab,0xab, 0x0d,0x57,0xff, 0x4b,0x30,0xff, 0x8a,0x13,0xff,
+    0xbc,0x08,0xd6, 0xd2,0x12,0x69, 0xc7,0x2e,0x00, 0x9d,0x54,0x00,
+    0x60,0x7b,0x00, 0x20,0x98,0x00, 0x00,0xa3,0x00, 0x00,0x99,0x42,
+    0x00,0x7d,0xb4, 0x00,0x00,0x00, 0x00,0x00,0x00, 0x00,0x00,0x00,
+    0xff,0xff,0xff, 0x53,0xae,0xff, 0x90,0x85,0xff, 0xd3,0x65,0xff,
+    0xff,0x57,0xff, 0xff,0x5d,0xcf, 0xff,0x77,0x57, 0xfa,0x9e,0x00,
+    0xbd,0xc7,0x00, 0x7a,0xe7,0x00, 0x43,0xf6,0x11, 0x26,0xef,0x7e,
+    0x2c,0xd5,0xf6, 0x4e,0x4e,0x4e, 0x00,0x00,0x00, 0x00,0x00,0x00,
+    0xff,0xff,0xff, 0xb6,0xe1,0xff, 0xce,0xd1,0xff, 0xe9,0xc3,0xff,
+    0xff,0xbc,0xff, 0xff,0xbd,0xf4, 0xff,0xc6,0xc3, 0xff,0xd5,0x9a,
+    0xe9,0xe6,0x81, 0xce,0xf4,0x81, 0xb6,0xfb,0x9a, 0xa9,0xfa,0xc3,
+    0xa9,0xf0,0xf4, 0xb8,0xb8,0xb8, 0x00,0x00,0x00, 0x00,0x00,0x00,
+  };
+
+  // 色彩强调时未被强调分量的衰减系数
+  static const double EMPHASIS_ATTENUATION = 0.816328;
+
+  static inline uint8_t avg_u8(uint8_t a, uint8_t b) { return (a + b + 1) >> 1; }
+
+  // ---------------------------------------------------------------- 标量实现
+
+  static void line_rgba_scalar(
+    const uint8_t* r, const uint8_t* g, const uint8_t* b,
+    const uint8_t* src, int scale, uint8_t* out
+  ) {
+    for (int x=0; x<256; x++) {
+      const uint8_t c = src[x];
+      for (int s=0; s<scale; s++) {
+        out[0] = r[c];
+        out[1] = g[c];
+        out[2] = b[c];
+        out[3] = 0xff;
+        out += 4;
+      }
+    }
+  }
+
+  static void line_rgb565_scalar(
+    const uint8_t* lo, const uint8_t* hi,
+    const uint8_t* src, int scale, uint16_t* out
+  ) {
+    for (int x=0; x<256; x++) {
+      const uint8_t c = src[x];
+      const uint16_t px = lo[c] | (hi[c] << 8);
+      for (int s=0; s<scale; s++) *out++ = px;
+    }
+  }
+
+  static void line_luma_scalar(const uint8_t* y, const uint8_t* src, int scale, uint8_t* out) {
+    for (int x=0; x<256; x++) {
+      const uint8_t c = y[src[x]];
+      for (int s=0; s<scale; s++) *out++ = c;
+    }
+  }
+
+  static void line_chroma_scalar(
+    const uint8_t* u0, const uint8_t* v0, const uint8_t* src0,
+    const uint8_t* u1, const uint8_t* v1, const uint8_t* src1,
+    int scale, uint8_t* out_u, uint8_t* out_v
+  ) {
+    for (int cx=0; cx<128*scale; cx++) {
+      // 放大后画面中的第 2cx、2cx+1 列对应的源像素
+      const uint8_t a0 = src0[2 * cx / scale], b0 = src0[(2 * cx + 1) / scale];
+      const uint8_t a1 = src1[2 * cx / scale], b1 = src1[(2 * cx + 1) / scale];
+      out_u[cx] = avg_u8(avg_u8(u0[a0], u0[b0]), avg_u8(u1[a1], u1[b1]));
+      out_v[cx] = avg_u8(avg_u8(v0[a0], v0[b0]), avg_u8(v1[a1], v1[b1]));
+    }
+  }
+
+  static const nes_color_kernels kernels_scalar = {
+    "scalar",
+    line_rgba_scalar,
+    line_rgb565_scalar,
+    line_luma_scalar,
+    line_chroma_scalar,
+  };
+
+#ifdef SFC_X86_KERNELS
+  // ---------------------------------------------------------------- SSE4.1 实现
+
+  // 64 项字节表的 4 段
+  struct table64_sse41 { __m128i part[4]; };
+
+  SFC_TARGET_SSE41 __attribute__((always_inline))
+  static inline table64_sse41 load_table_sse41(const uint8_t* t) {
+    table64_sse41 r;
+    for (int i=0; i<4; i++) r.part[i] = _mm_loadu_si128((const __m128i*)(t + i * 16));
+    return r;
+  }
+
+  // 16 个 6 位索引查 64 项字节表
+  SFC_TARGET_SSE41 __attribute__((always_inline))
+  static inline __m128i lookup_sse41(const table64_sse41& t, __m128i idx) {
+    // 把索引的第 4 位、第 5 位分别移到每个字节的最高位，作为选择掩码
+    const __m128i bit4 = _mm_slli_epi16(idx, 3);
+    const __m128i bit5 = _mm_slli_epi16(idx, 2);
+    const __m128i lo = _mm_blendv_epi8(
+      _mm_shuffle_epi8(t.part[0], idx), _mm_shuffle_epi8(t.part[1], idx), bit4);
+    const __m128i hi = _mm_blendv_epi8(
+      _mm_shuffle_epi8(t.part[2], idx), _mm_shuffle_epi8(t.part[3], idx), bit4);
+    return _mm_blendv_epi8(lo, hi, bit5);
+  }
+
+  // 写出 4 个 32 位像素，水平重复 scale 次，返回写出的像素数
+  SFC_TARGET_SSE41 __attribute__((always_inline))
+  static inline int store32_sse41(uint8_t* out, __m128i p, int scale) {
+    __m128i* o = (__m128i*)out;
+    switch (scale) {
+    case 1:
+      _mm_storeu_si128(o, p);
+      return 4;
+    case 2:
+      _mm_storeu_si128(o, _mm_unpacklo_epi32(p, p));
+      _mm_storeu_si128(o + 1, _mm_unpackhi_epi32(p, p));
+      return 8;
+    default:
+      _mm_storeu_si128(o, _mm_shuffle_epi32(p, _MM_SHUFFLE(1, 0, 0, 0)));
+      _mm_storeu_si128(o + 1, _mm_shuffle_epi32(p, _MM_SHUFFLE(2, 2, 1, 1)));
+      _mm_storeu_si128(o + 2, _mm_shuffle_epi32(p, _MM_SHUFFLE(3, 3, 3, 2)));
+      return 12;
+    }
+  }
+
+  // 写出 8 个 16 位像素，水平重复 scale 次，返回写出的像素数
+  SFC_TARGET_SSE41 __attribute__((always_inline))
+  static inline int store16_sse41(uint16_t* out, __m128i p, int scale) {
+    __m128i* o = (__m128i*)out;
+    switch (scale) {
+    case 1:
+      _mm_storeu_si128(o, p);
+      return 8;
+    case 2:
+      _mm_storeu_si128(o, _mm_unpacklo_epi16(p, p));
+      _mm_storeu_si128(o + 1, _mm_unpackhi_epi16(p, p));
+      return 16;
+    default:
+      // 第 i 个输出取第 i/3 个输入
+      _mm_storeu_si128(o, _mm_shuffle_epi8(p, _mm_setr_epi8(
+        0, 1, 0, 1, 0, 1, 2, 3, 2, 3, 2, 3, 4, 5, 4, 5)));
+      _mm_storeu_si128(o + 1, _mm_shuffle_epi8(p, _mm_setr_epi8(
+        4, 5, 6, 7, 6, 7, 6, 7, 8, 9, 8, 9, 8, 9, 10, 11)));
+      _mm_storeu_si128(o + 2, _mm_shuffle_epi8(p, _mm_setr_epi8(
+        10, 11, 10, 11, 12, 13, 12, 13, 12, 13, 14, 15, 14, 15, 14, 15)));
+      return 24;
+    }
+  }
+
+  // 写出 16 个 8 位采样，水平重复 scale 次，返回写出的采样数
+  SFC_TARGET_SSE41 __attribute__((always_inline))
+  static inline int store8_sse41(uint8_t* out, __m128i p, int scale) {
+    __m128i* o = (__m128i*)out;
+    switch (scale) {
+    case 1:
+      _mm_storeu_si128(o, p);
+      return 16;
+    case 2:
+      _mm_storeu_si128(o, _mm_unpacklo_epi8(p, p));
+      _mm_storeu_si128(o + 1, _mm_unpackhi_epi8(p, p));
+      return 32;
+    default:
+      _mm_storeu_si128(o, _mm_shuffle_epi8(p, _mm_setr_epi8(
+        0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5)));
+      _mm_storeu_si128(o + 1, _mm_shuffle_epi8(p, _mm_setr_epi8(
+        5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10)));
+      _mm_storeu_si128(o + 2, _mm_shuffle_epi8(p, _mm_setr_epi8(
+        10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15)));
+      return 48;
+    }
+  }
+
+  // 把 16 个像素的 R/G/B 交错为 RGBA 并写出，返回写出的像素数
+  SFC_TARGET_SSE41 __attribute__((always_inline))
+  static inline int store_rgba_sse41(uint8_t* out, __m128i r, __m128i g, __m128i b, int scale) {
+    const __m128i a = _mm_set1_epi8((char)0xff);
+    const __m128i rg_lo = _mm_unpacklo_epi8(r, g), rg_hi = _mm_unpackhi_epi8(r, g);
+    const __m128i ba_lo = _mm_unpacklo_epi8(b, a), ba_hi = _mm_unpackhi_epi8(b, a);
+    int n = 0;
+    n += store32_sse41(out + n * 4, _mm_unpacklo_epi16(rg_lo, ba_lo), scale);
+    n += store32_sse41(out + n * 4, _mm_unpackhi_epi16(rg_lo, ba_lo), scale);
+    n += store32_sse41(out + n * 4, _mm_unpacklo_epi16(rg_hi, ba_hi), scale);
+    n += store32_sse41(out + n * 4, _mm_unpackhi_epi16(rg_hi, ba_hi), scale);
+    return n;
+  }
+
+  // 把 16 个像素的低/高字节交错为 RGB565 并写出，返回写出的像素数
+  SFC_TARGET_SSE41 __attribute__((always_inline))
+  static inline int store_rgb565_sse41(uint16_t* out, __m128i lo, __m128i hi, int scale) {
+    const int n = store16_sse41(out, _mm_unpacklo_epi8(lo, hi), scale);
+    return n + store16_sse41(out + n, _mm_unpackhi_epi8(lo, hi), scale);
+  }
+
+  // 32 个相邻采样两两取平均，得到 16 个
+  SFC_TARGET_SSE41 __attribute__((always_inline))
+  static inline __m128i halve_sse41(__m128i a, __m128i b) {
+    const __m128i low = _mm_set1_epi16(0x00ff);
+    const __m128i even = _mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low));
+    const __m128i odd = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+    return _mm_avg_epu8(even, odd);
+  }
+
+  SFC_TARGET_SSE41
+  static void line_rgba_sse41(
+    const uint8_t* r, const uint8_t* g, const uint8_t* b,
+    const uint8_t* src, int scale, uint8_t* out
+  ) {
+    const table64_sse41 tr = load_table_sse41(r);
+    const table64_sse41 tg = load_table_sse41(g);
+    const table64_sse41 tb = load_table_sse41(b);
+    for (int x=0; x<256; x += 16) {
+      const __m128i idx = _mm_loadu_si128((const __m128i*)(src + x));
+      out += 4 * store_rgba_sse41(out,
+        lookup_sse41(tr, idx), lookup_sse41(tg, idx), lookup_sse41(tb, idx), scale);
+    }
+  }
+
+  SFC_TARGET_SSE41
+  static void line_rgb565_sse41(
+    const uint8_t* lo, const uint8_t* hi,
+    const uint8_t* src, int scale, uint16_t* out
+  ) {
+    const table64_sse41 tl = load_table_sse41(lo);
+    const table64_sse41 th = load_table_sse41(hi);
+    for (int x=0; x<256; x += 16) {
+      const __m128i idx = _mm_loadu_si128((const __m128i*)(src + x));
+      out += store_rgb565_sse41(out, lookup_sse41(tl, idx), lookup_sse41(th, idx), scale);
+    }
+  }
+
+  SFC_TARGET_SSE41
+  static void line_luma_sse41(const uint8_t* y, const uint8_t* src, int scale, uint8_t* out) {
+    const table64_sse41 ty = load_table_sse41(y);
+    for (int x=0; x<256; x += 16) {
+      const __m128i idx = _mm_loadu_si128((const __m128i*)(src + x));
+      out += store8_sse41(out, lookup_sse41(ty, idx), scale);
+    }
+  }
+
+  // width 个源像素两两平均为 width/2 个色度采样
+  SFC_TARGET_SSE41 __attribute__((always_inline))
+  static inline void chroma_halve_sse41(
+    const table64_sse41& tu0, const table64_sse41& tv0, const uint8_t* src0,
+    const table64_sse41& tu1, const table64_sse41& tv1, const uint8_t* src1,
+    int width, uint8_t* out_u, uint8_t* out_v
+  ) {
+    for (int x=0; x<width; x += 32) {
+      const __m128i a0 = _mm_loadu_si128((const __m128i*)(src0 + x));
+      const __m128i b0 = _mm_loadu_si128((const __m128i*)(src0 + x + 16));
+      const __m128i a1 = _mm_loadu_si128((const __m128i*)(src1 + x));
+      const __m128i b1 = _mm_loadu_si128((const __m128i*)(src1 + x + 16));
+      _mm_storeu_si128((__m128i*)(out_u + x / 2), _mm_avg_epu8(
+        halve_sse41(lookup_sse41(tu0, a0), lookup_sse41(tu0, b0)),
+        halve_sse41(lookup_sse41(tu1, a1), lookup_sse41(tu1, b1))));
+      _mm_storeu_si128((__m128i*)(out_v + x / 2), _mm_avg_epu8(
+        halve_sse41(lookup_sse41(tv0, a0), lookup_sse41(tv0, b0)),
+        halve_sse41(lookup_sse41(tv1, a1), lookup_sse41(tv1, b1))));
+    }
+  }
+
+  SFC_TARGET_SSE41 __attribute__((always_inline))
+  static inline void chroma_body_sse41(
+    const uint8_t* u0, const uint8_t* v0, const uint8_t* src0,
+    const uint8_t* u1, const uint8_t* v1, const uint8_t* src1,
+    int scale, uint8_t* out_u, uint8_t* out_v
+  ) {
+    const table64_sse41 tu0 = load_table_sse41(u0), tv0 = load_table_sse41(v0);
+    const table64_sse41 tu1 = load_table_sse41(u1), tv1 = load_table_sse41(v1);
+    switch (scale) {
+    case 1:
+      chroma_halve_sse41(tu0, tv0, src0, tu1, tv1, src1, 256, out_u, out_v);
+      return;
+    case 2:
+      // 每个色度采样恰好对应一个源像素
+      for (int x=0; x<256; x += 16) {
+        const __m128i a0 = _mm_loadu_si128((const __m128i*)(src0 + x));
+        const __m128i a1 = _mm_loadu_si128((const __m128i*)(src1 + x));
+        _mm_storeu_si128((__m128i*)(out_u + x),
+          _mm_avg_epu8(lookup_sse41(tu0, a0), lookup_sse41(tu1, a1)));
+        _mm_storeu_si128((__m128i*)(out_v + x),
+          _mm_avg_epu8(lookup_sse41(tv0, a0), lookup_sse41(tv1, a1)));
+      }
+      return;
+    default: {
+      // 先把索引水平放大，放大后的第 i 个即为第 i/scale 个源像素，再按 1 倍处理
+      uint8_t wide0[256 * SFC_PALETTE_MAX_SCALE], wide1[256 * SFC_PALETTE_MAX_SCALE];
+      uint8_t* w0 = wide0;
+      uint8_t* w1 = wide1;
+      for (int x=0; x<256; x += 16) {
+        w0 += store8_sse41(w0, _mm_loadu_si128((const __m128i*)(src0 + x)), scale);
+        w1 += store8_sse41(w1, _mm_loadu_si128((const __m128i*)(src1 + x)), scale);
+      }
+      chroma_halve_sse41(tu0, tv0, wide0, tu1, tv1, wide1, 256 * scale, out_u, out_v);
+    }
+    }
+  }
+
+  SFC_TARGET_SSE41
+  static void line_chroma_sse41(
+    const uint8_t* u0, const uint8_t* v0, const uint8_t* src0,
+    const uint8_t* u1, const uint8_t* v1, const uint8_t* src1,
+    int scale, uint8_t* out_u, uint8_t* out_v
+  ) {
+    chroma_body_sse41(u0, v0, src0, u1, v1, src1, scale, out_u, out_v);
+  }
+
+  static const nes_color_kernels kernels_sse41 = {
+    "sse4.1",
+    line_rgba_sse41,
+    line_rgb565_sse41,
+    line_luma_sse41,
+    line_chroma_sse41,
+  };
+
+  // ---------------------------------------------------------------- AVX2 实现
+  // 查表一次处理 32 个像素，交错与水平放大在两个 128 位半边上分别进行
+
+  struct table64_avx2 { __m256i part[4]; };
+
+  SFC_TARGET_AVX2 __attribute__((always_inline))
+  static inline table64_avx2 load_table_avx2(const uint8_t* t) {
+    table64_avx2 r;
+    for (int i=0; i<4; i++) {
+      r.part[i] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(t + i * 16)));
+    }
+    return r;
+  }
+
+  SFC_TARGET_AVX2 __attribute__((always_inline))
+  static inline __m256i lookup_avx2(const table64_avx2& t, __m256i idx) {
+    const __m256i bit4 = _mm256_slli_epi16(idx, 3);
+    const __m256i bit5 = _mm256_slli_epi16(idx, 2);
+    const __m256i lo = _mm256_blendv_epi8(
+      _mm256_shuffle_epi8(t.part[0], idx), _mm256_shuffle_epi8(t.part[1], idx), bit4);
+    const __m256i hi = _mm256_blendv_epi8(
+      _mm256_shuffle_epi8(t.part[2], idx), _mm256_shuffle_epi8(t.part[3], idx), bit4);
+    return _mm256_blendv_epi8(lo, hi, bit5);
+  }
+
+  SFC_TARGET_AVX2
+  static void line_rgba_avx2(
+    const uint8_t* r, const uint8_t* g, const uint8_t* b,
+    const uint8_t* src, int scale, uint8_t* out
+  ) {
+    const table64_avx2 tr = load_table_avx2(r);
+    const table64_avx2 tg = load_table_avx2(g);
+    const table64_avx2 tb = load_table_avx2(b);
+    for (int x=0; x<256; x += 32) {
+      const __m256i idx = _mm256_loadu_si256((const __m256i*)(src + x));
+      const __m256i vr = lookup_avx2(tr, idx);
+      const __m256i vg = lookup_avx2(tg, idx);
+      const __m256i vb = lookup_avx2(tb, idx);
+      out += 4 * store_rgba_sse41(out, _mm256_castsi256_si128(vr),
+        _mm256_castsi256_si128(vg), _mm256_castsi256_si128(vb), scale);
+      out += 4 * store_rgba_sse41(out, _mm256_extracti128_si256(vr, 1),
+        _mm256_extracti128_si256(vg, 1), _mm256_extracti128_si256(vb, 1), scale);
+    }
+  }
+
+  SFC_TARGET_AVX2
+  static void line_rgb565_avx2(
+    const uint8_t* lo, const uint8_t* hi,
+    const uint8_t* src, int scale, uint16_t* out
+  ) {
+    const table64_avx2 tl = load_table_avx2(lo);
+    const table64_avx2 th = load_table_avx2(hi);
+    for (int x=0; x<256; x += 32) {
+      const __m256i idx = _mm256_loadu_si256((const __m256i*)(src + x));
+      const __m256i vl = lookup_avx2(tl, idx);
+      const __m256i vh = lookup_avx2(th, idx);
+      out += store_rgb565_sse41(out,
+        _mm256_castsi256_si128(vl), _mm256_castsi256_si128(vh), scale);
+      out += store_rgb565_sse41(out,
+        _mm256_extracti128_si256(vl, 1), _mm256_extracti128_si256(vh, 1), scale);
+    }
+  }
+
+  SFC_TARGET_AVX2
+  static void line_luma_avx2(const uint8_t* y, const uint8_t* src, int scale, uint8_t* out) {
+    const table64_avx2 ty = load_table_avx2(y);
+    for (int x=0; x<256; x += 32) {
+      const __m256i v = lookup_avx2(ty, _mm256_loadu_si256((const __m256i*)(src + x)));
+      if (scale == 1) {
+        _mm256_storeu_si256((__m256i*)out, v);
+        out += 32;
+        continue;
+      }
+      out += store8_sse41(out, _mm256_castsi256_si128(v), scale);
+      out += store8_sse41(out, _mm256_extracti128_si256(v, 1), scale);
+    }
+  }
+
+  SFC_TARGET_AVX2
+  static void line_chroma_avx2(
+    const uint8_t* u0, const uint8_t* v0, const uint8_t* src0,
+    const uint8_t* u1, const uint8_t* v1, const uint8_t* src1,
+    int scale, uint8_t* out_u, uint8_t* out_v
+  ) {
+    if (scale != 2) {
+      // 两两平均需要跨半边的打包，沿用 128 位实现
+      chroma_body_sse41(u0, v0, src0, u1, v1, src1, scale, out_u, out_v);
+      return;
+    }
+    const table64_avx2 tu0 = load_table_avx2(u0), tv0 = load_table_avx2(v0);
+    const table64_avx2 tu1 = load_table_avx2(u1), tv1 = load_table_avx2(v1);
+    for (int x=0; x<256; x += 32) {
+      const __m256i a0 = _mm256_loadu_si256((const __m256i*)(src0 + x));
+      const __m256i a1 = _mm256_loadu_si256((const __m256i*)(src1 + x));
+      _mm256_storeu_si256((__m256i*)(out_u + x),
+        _mm256_avg_epu8(lookup_avx2(tu0, a0), lookup_avx2(tu1, a1)));
+      _mm256_storeu_si256((__m256i*)(out_v + x),
+        _mm256_avg_epu8(lookup_avx2(tv0, a0), lookup_avx2(tv1, a1)));
+    }
+  }
+
+  static const nes_color_kernels kernels_avx2 = {
+    "avx2",
+    line_rgba_avx2,
+    line_rgb565_avx2,
+    line_luma_avx2,
+    line_chroma_avx2,
+  };
+#endif
+
+  const nes_color_kernels& nes_color_kernels_scalar() {
+    return kernels_scalar;
+  }
+
+  const nes_color_kernels& nes_color_kernels_best() {
+#ifdef SFC_X86_KERNELS
+    if (__builtin_cpu_supports("avx2")) return kernels_avx2;
+    if (__builtin_cpu_supports("sse4.1")) return kernels_sse41;
+#endif
+    return kernels_scalar;
+  }
+
+  int nes_color_kernels_available(const nes_color_kernels* list[], int max) {
+    int count = 0;
+    if (count < max) list[count++] = &kernels_scalar;
+#ifdef SFC_X86_KERNELS
+    if (count < max && __builtin_cpu_supports("sse4.1")) list[count++] = &kernels_sse41;
+    if (count < max && __builtin_cpu_supports("avx2")) list[count++] = &kernels_avx2;
+#endif
+    return count;
+  }
+
+  // ---------------------------------------------------------------- 转换器
+
+  static uint8_t clamp_u8(double v) {
+    return v < 0? 0: v > 255? 255: (uint8_t)lround(v);
+  }
+
+  void nes_color_converter::init(const uint8_t* rgb, const nes_color_kernels* kernels) {
+    this->kernels = kernels? kernels: &nes_color_kernels_best();
+    if (!rgb) rgb = nes_default_rgb;
+
+    for (int e=0; e<8; e++) {
+      // 红、绿、蓝各自在其它分量被强调时衰减
+      const double kr = (e & 6)? EMPHASIS_ATTENUATION: 1;
+      const double kg = (e & 5)? EMPHASIS_ATTENUATION: 1;
+      const double kb = (e & 3)? EMPHASIS_ATTENUATION: 1;
+      for (int c=0; c<64; c++) {
+        const uint8_t r = clamp_u8(rgb[c * 3] * kr);
+        const uint8_t g = clamp_u8(rgb[c * 3 + 1] * kg);
+        const uint8_t b = clamp_u8(rgb[c * 3 + 2] * kb);
+        tables.r[e][c] = r;
+        tables.g[e][c] = g;
+        tables.b[e][c] = b;
+        const uint16_t px = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+        tables.rgb565_lo[e][c] = px & 0xff;
+        tables.rgb565_hi[e][c] = px >> 8;
+        tables.y[e][c] = clamp_u8(16 + (65.481 * r + 128.553 * g + 24.966 * b) / 255);
+        tables.u[e][c] = clamp_u8(128 + (-37.797 * r - 74.203 * g + 112.0 * b) / 255);
+        tables.v[e][c] = clamp_u8(128 + (112.0 * r - 93.786 * g - 18.214 * b) / 255);
+      }
+    }
+  }
+
+  void nes_color_converter::convert(
+    const uint8_t* pixels, const uint8_t* emphasis, const nes_video_target& target
+  ) {
+    const int scale = target.scale;
+    assert(scale >= 1 && scale <= SFC_PALETTE_MAX_SCALE && "不支持的放大倍数");
+    const nes_color_tables& t = tables;
+
+    switch (target.format) {
+    case SFC_PIXEL_RGBA8888:
+    case SFC_PIXEL_RGB565: {
+      const size_t bytes = 256 * scale * (target.format == SFC_PIXEL_RGBA8888? 4: 2);
+      for (int line=0; line<240; line++) {
+        const uint8_t e = emphasis[line] & 7;
+        const uint8_t* src = pixels + line * 256;
+        uint8_t* row = target.planes[0] + line * scale * target.pitch[0];
+        if (target.format == SFC_PIXEL_RGBA8888) {
+          kernels->line_rgba(t.r[e], t.g[e], t.b[e], src, scale, row);
+        } else {
+          kernels->line_rgb565(t.rgb565_lo[e], t.rgb565_hi[e], src, scale, (uint16_t*)row);
+        }
+        // 垂直方向的放大直接复制整行
+        for (int s=1; s<scale; s++) memcpy(row + s * target.pitch[0], row, bytes);
+      }
+      return;
+    }
+    case SFC_PIXEL_YUV420:
+      for (int line=0; line<240; line++) {
+        const uint8_t e = emphasis[line] & 7;
+        uint8_t* row = target.planes[0] + line * scale * target.pitch[0];
+        kernels->line_luma(t.y[e], pixels + line * 256, scale, row);
+        for (int s=1; s<scale; s++) memcpy(row + s * target.pitch[0], row, 256 * scale);
+      }
+      for (int cy=0; cy<120*scale; cy++) {
+        // 色度的一行覆盖放大后画面的第 2cy、2cy+1 行
+        const int l0 = 2 * cy / scale, l1 = (2 * cy + 1) / scale;
+        const uint8_t e0 = emphasis[l0] & 7, e1 = emphasis[l1] & 7;
+        kernels->line_chroma(
+          t.u[e0], t.v[e0], pixels + l0 * 256,
+          t.u[e1], t.v[e1], pixels + l1 * 256, scale,
+          target.planes[1] + cy * target.pitch[1],
+          target.planes[2] + cy * target.pitch[2]);
+      }
+      return;
+    }
+    assert(!"不支持的像素格式");
+  }
+}
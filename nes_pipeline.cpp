@@ -0,0 +1,187 @@
+#include <cstring>
+#include <cassert>
+#include <chrono>
+#include "include/nes_pipeline.h"
+
+namespace fc
+{
+  // 单调时钟的纳秒数
+  static inline uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // 更新累计值与最大值
+  static inline void record(std::atomic<uint64_t>& total, std::atomic<uint64_t>& max, uint64_t v) {
+    total.fetch_add(v, std::memory_order_relaxed);
+    if (v > max.load(std::memory_order_relaxed)) max.store(v, std::memory_order_relaxed);
+  }
+
+  int nes_av_pipeline::add_frame_stage(
+    const char* name, nes_frame_consumer fn, void* ctx,
+    uint32_t capacity, sfc_backpressure policy
+  ) {
+    assert(!started && stage_count < SFC_PIPELINE_MAX_STAGES && "无法再添加阶段");
+    stage& s = stages[stage_count];
+    s.name = name;
+    s.video = true;
+    s.capacity = capacity;
+    s.policy = policy;
+    s.on_frame = fn;
+    s.on_audio = NULL;
+    s.ctx = ctx;
+    return stage_count++;
+  }
+
+  int nes_av_pipeline::add_audio_stage(
+    const char* name, nes_audio_consumer fn, void* ctx,
+    uint32_t capacity, sfc_backpressure policy
+  ) {
+    assert(!started && stage_count < SFC_PIPELINE_MAX_STAGES && "无法再添加阶段");
+    stage& s = stages[stage_count];
+    s.name = name;
+    s.video = false;
+    s.capacity = capacity;
+    s.policy = policy;
+    s.on_frame = NULL;
+    s.on_audio = fn;
+    s.ctx = ctx;
+    return stage_count++;
+  }
+
+  void nes_av_pipeline::start() {
+    if (started) return;
+    running.store(true);
+    for (int i=0; i<stage_count; i++) {
+      stage& s = stages[i];
+      if (s.video) {
+        s.frames.init(s.capacity, s.policy);
+      } else {
+        s.audio.init(s.capacity, s.policy);
+      }
+      s.stats.items.store(0);
+      s.stats.wait_total.store(0);
+      s.stats.wait_max.store(0);
+      s.stats.work_total.store(0);
+      s.stats.work_max.store(0);
+    }
+    for (int i=0; i<stage_count; i++) {
+      stages[i].worker = std::thread(&nes_av_pipeline::consume, this, stages + i);
+    }
+    started = true;
+  }
+
+  void nes_av_pipeline::stop() {
+    if (!started) return;
+    running.store(false);
+    for (int i=0; i<stage_count; i++) {
+      stage& s = stages[i];
+      if (s.video) s.frames.close(); else s.audio.close();
+      s.worker.join();
+      if (s.video) s.frames.destroy(); else s.audio.destroy();
+    }
+    started = false;
+  }
+
+  void nes_av_pipeline::consume(stage* s) {
+    uint32_t idle = 0;
+    for (;;) {
+      const nes_video_frame* frame = NULL;
+      const nes_audio_block* block = NULL;
+      if (s->video) {
+        frame = s->frames.begin_read();
+      } else {
+        block = s->audio.begin_read();
+      }
+
+      if (!frame && !block) {
+        // 停止后把剩余的数据处理完再退出
+        if (!running.load()) break;
+        // 先让出时间片，长时间空闲再睡眠，避免占满一个核心
+        if (++idle < 64) {
+          std::this_thread::yield();
+        } else {
+          std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        continue;
+      }
+      idle = 0;
+
+      const uint64_t begin = now_ns();
+      const uint64_t queued = frame? frame->timestamp: block->timestamp;
+      if (frame) {
+        s->on_frame(s->ctx, *frame);
+        s->frames.end_read();
+      } else {
+        s->on_audio(s->ctx, *block);
+        s->audio.end_read();
+      }
+      const uint64_t end = now_ns();
+
+      s->stats.items.fetch_add(1, std::memory_order_relaxed);
+      record(s->stats.wait_total, s->stats.wait_max, begin - queued);
+      record(s->stats.work_total, s->stats.work_max, end - begin);
+    }
+  }
+
+  void nes_av_pipeline::push_frame(uint64_t frame, const uint8_t* pixels, const uint8_t* emphasis) {
+    if (!started) return;
+    const uint64_t stamp = now_ns();
+    for (int i=0; i<stage_count; i++) {
+      stage& s = stages[i];
+      if (!s.video) continue;
+      nes_video_frame* slot = s.frames.begin_write();
+      if (!slot) continue;
+      slot->frame = frame;
+      slot->timestamp = stamp;
+      memcpy(slot->pixels, pixels, sizeof(slot->pixels));
+      memcpy(slot->emphasis, emphasis, sizeof(slot->emphasis));
+      s.frames.end_write();
+    }
+  }
+
+  void nes_av_pipeline::push_audio(
+    uint64_t first_sample, uint32_t sample_rate,
+    const int16_t* samples, uint32_t count
+  ) {
+    if (!started) return;
+    const uint64_t stamp = now_ns();
+    while (count) {
+      const uint32_t n = count < SFC_AUDIO_BLOCK_MAX? count: SFC_AUDIO_BLOCK_MAX;
+      for (int i=0; i<stage_count; i++) {
+        stage& s = stages[i];
+        if (s.video) continue;
+        nes_audio_block* slot = s.audio.begin_write();
+        if (!slot) continue;
+        slot->first_sample = first_sample;
+        slot->timestamp = stamp;
+        slot->sample_rate = sample_rate;
+        slot->count = n;
+        memcpy(slot->samples, samples, n * sizeof(int16_t));
+        s.audio.end_write();
+      }
+      first_sample += n;
+      samples += n;
+      count -= n;
+    }
+  }
+
+  void nes_av_pipeline::print_stats(FILE* fp) {
+    fprintf(fp, "%-12s %10s %10s %12s %12s %12s %12s\n",
+      "stage", "items", "dropped", "wait_avg_us", "wait_max_us", "work_avg_us", "work_max_us");
+    for (int i=0; i<stage_count; i++) {
+      stage& s = stages[i];
+      const uint64_t items = s.stats.items.load();
+      const uint64_t dropped = s.video? s.frames.get_dropped(): s.audio.get_dropped();
+      const double div = items? items * 1000.0: 1;
+      fprintf(fp, "%-12s %10llu %10llu %12.1f %12.1f %12.1f %12.1f\n",
+        s.name,
+        (unsigned long long)items,
+        (unsigned long long)dropped,
+        s.stats.wait_total.load() / div,
+        s.stats.wait_max.load() / 1000.0,
+        s.stats.work_total.load() / div,
+        s.stats.work_max.load() / 1000.0);
+    }
+  }
+}
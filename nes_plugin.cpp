@@ -0,0 +1,100 @@
+#include <cstring>
+#include "include/nes_plugin.h"
+#include "include/simulator.h"
+
+namespace fc
+{
+  static void* plugin_create(const char* config) {
+    simulator* fc = new simulator();
+    // 逐个解析逗号分隔的选项
+    bool headless = false;
+    uint32_t interval = 0;
+    for (const char* p = config; p && *p; ) {
+      const char* end = strchr(p, ',');
+      const size_t len = end? (size_t)(end - p): strlen(p);
+      if (len == 8 && !strncmp(p, "headless", 8)) headless = true;
+      if (len > 9 && !strncmp(p, "interval=", 9)) interval = atoi(p + 9);
+      p = end? end + 1: p + len;
+    }
+    fc->set_headless(headless, interval);
+    return fc;
+  }
+
+  static void plugin_destroy(void* instance) {
+    simulator* fc = (simulator*)instance;
+    fc->free_rom();
+    delete fc;
+  }
+
+  static int plugin_load_rom(void* instance, const char* path) {
+    ((simulator*)instance)->load_rom(path);
+    return 0;
+  }
+
+  static void plugin_run_frame(void* instance) {
+    ((simulator*)instance)->run_frame();
+  }
+
+  static void plugin_step(void* instance, uint64_t count) {
+    ((simulator*)instance)->step(count);
+  }
+
+  static size_t plugin_snapshot_size(void* instance) {
+    return ((simulator*)instance)->snapshot_size();
+  }
+
+  static void plugin_save_state(void* instance, void* buf) {
+    ((simulator*)instance)->save_state(buf);
+  }
+
+  static void plugin_load_state(void* instance, const void* buf) {
+    ((simulator*)instance)->load_state(buf);
+  }
+
+  static void plugin_digest(void* instance, uint64_t out[6]) {
+    const nes_state_digest d = ((simulator*)instance)->digest();
+    out[0] = d.frame;
+    out[1] = d.cycle;
+    out[2] = d.cpu;
+    out[3] = d.ram;
+    out[4] = d.sram;
+    out[5] = d.video;
+  }
+
+  static void plugin_get_cpu(void* instance, sfc_plugin_cpu* out) {
+    nes_cpu& cpu = ((simulator*)instance)->get_cpu();
+    const nes_registers& r = cpu.get_registers();
+    out->cycle = cpu.get_cycle();
+    out->pc = r.program_counter;
+    out->a = r.accumulator;
+    out->x = r.x_index;
+    out->y = r.y_index;
+    out->p = r.status;
+    out->sp = r.stack_pointer;
+  }
+
+  static uint8_t plugin_peek(void* instance, uint16_t addr) {
+    if (addr >= 0x2000 && addr < 0x6000) return 0;
+    return ((simulator*)instance)->get_memory_pool().read(addr);
+  }
+
+  static const sfc_plugin_api plugin_api = {
+    SFC_PLUGIN_ABI_VERSION,
+    "SimpleFCsimulator " __DATE__ " " __TIME__,
+    plugin_create,
+    plugin_destroy,
+    plugin_load_rom,
+    plugin_run_frame,
+    plugin_step,
+    plugin_snapshot_size,
+    plugin_save_state,
+    plugin_load_state,
+    plugin_digest,
+    plugin_get_cpu,
+    plugin_peek,
+  };
+}
+
+extern "C" const sfc_plugin_api* sfc_plugin_entry() {
+  return &fc::plugin_api;
+}
@@ -0,0 +1,441 @@
+#include <cstring>
+#include <cassert>
+#include "include/nes_ppu.h"
+
+namespace fc
+{
+  // 调色板地址 $3F10/$3F14/$3F18/$3F1C 是 $3F00/$3F04/$3F08/$3F0C 的镜像
+  static inline uint8_t palette_index(uint16_t addr) {
+    uint8_t idx = addr & 0x1f;
+    if ((idx & 0x13) == 0x10) idx &= 0x0f;
+    return idx;
+  }
+
+  // 翻转一个字节的位序，用于水平翻转的精灵
+  static inline uint8_t reverse_bits(uint8_t b) {
+    b = (b & 0xf0) >> 4 | (b & 0x0f) << 4;
+    b = (b & 0xcc) >> 2 | (b & 0x33) << 2;
+    b = (b & 0xaa) >> 1 | (b & 0x55) << 1;
+    return b;
+  }
+
+  const nes_ppu_output nes_ppu::blank = {};
+
+  nes_ppu::~nes_ppu() {
+    delete output;
+    delete[] cart_vram;
+  }
+
+  void nes_ppu::set_output(bool enabled) {
+    if (enabled && !output) output = new nes_ppu_output();
+    output_enabled = enabled;
+  }
+
+  void nes_ppu::init(nes_rom_info* rom_info, nes_scheduler* scheduler) {
+    this->scheduler = scheduler;
+    ctrl = mask = status = oam_addr = 0;
+    vram_addr = temp_addr = 0;
+    fine_x = write_toggle = read_buffer = open_bus = 0;
+    nmi_pending = false;
+    output_enabled = false;
+    dot_clock = 0;
+    scanline = dot = hit_dot = 0;
+    frame_count = 0;
+    memset(oam, 0, sizeof(oam));
+    memset(palette, 0, sizeof(palette));
+    memset(nametables, 0, sizeof(nametables));
+    if (output) memset(output, 0, sizeof(nes_ppu_output));
+    kernels = &nes_ppu_kernels_best();
+
+    // 没有 CHR-ROM 的卡带使用 8KB 的 CHR-RAM，四屏幕的卡带另有 2KB 名称表
+    pattern_writable = !rom_info->chr_rom_count;
+    delete[] cart_vram;
+    cart_vram_size = (pattern_writable? 0x2000: 0) + (rom_info->is_four_sreen? 0x800: 0);
+    cart_vram = cart_vram_size? new uint8_t[cart_vram_size](): NULL;
+    pattern = pattern_writable? cart_vram: rom_info->chr_rom_ptr;
+
+    // 按镜像方式映射四个名称表
+    if (rom_info->is_four_sreen) {
+      uint8_t* extra = cart_vram + cart_vram_size - 0x800;
+      nametable_banks[0] = nametables;
+      nametable_banks[1] = nametables + 0x400;
+      nametable_banks[2] = extra;
+      nametable_banks[3] = extra + 0x400;
+    } else if (rom_info->is_vertical) {
+      nametable_banks[0] = nametable_banks[2] = nametables;
+      nametable_banks[1] = nametable_banks[3] = nametables + 0x400;
+    } else {
+      nametable_banks[0] = nametable_banks[1] = nametables;
+      nametable_banks[2] = nametable_banks[3] = nametables + 0x400;
+    }
+  }
+
+  uint8_t nes_ppu::vram_read(uint16_t addr) {
+    addr &= 0x3fff;
+    if (addr < 0x2000) return pattern[addr];
+    if (addr < 0x3f00) return nametable_banks[(addr >> 10) & 3][addr & 0x3ff];
+    return palette[palette_index(addr)];
+  }
+
+  void nes_ppu::vram_write(uint16_t addr, uint8_t data) {
+    addr &= 0x3fff;
+    if (addr < 0x2000) {
+      if (pattern_writable) pattern[addr] = data;
+    } else if (addr < 0x3f00) {
+      nametable_banks[(addr >> 10) & 3][addr & 0x3ff] = data;
+    } else {
+      palette[palette_index(addr)] = data & 0x3f;
+    }
+  }
+
+  uint8_t nes_ppu::read_register(uint8_t addr) {
+    switch (addr) {
+    case 2:
+    {
+      const uint8_t data = (status & 0xe0) | (open_bus & 0x1f);
+      status &= ~SFC_STATUS_VBLANK;
+      write_toggle = 0;
+      return data;
+    }
+    case 4:
+      return oam[oam_addr];
+    case 7:
+    {
+      const uint16_t addr = vram_addr & 0x3fff;
+      uint8_t data;
+      if (addr < 0x3f00) {
+        // 非调色板区域的读取会延迟一次
+        data = read_buffer;
+        read_buffer = vram_read(addr);
+      } else {
+        // 调色板直接返回，但缓冲中放入下面的名称表
+        data = vram_read(addr);
+        read_buffer = vram_read(addr - 0x1000);
+      }
+      vram_addr += (ctrl & SFC_CTRL_INC32)? 32: 1;
+      return data;
+    }
+    }
+    // 其余为只写寄存器
+    return open_bus;
+  }
+
+  void nes_ppu::write_register(uint8_t addr, uint8_t data) {
+    open_bus = data;
+    switch (addr) {
+    case 0:
+      // 在 VBlank 期间开启 NMI 会立即产生一次 NMI
+      if (!(ctrl & SFC_CTRL_NMI) && (data & SFC_CTRL_NMI) && (status & SFC_STATUS_VBLANK)) {
+        raise_nmi();
+      }
+      ctrl = data;
+      temp_addr = (temp_addr & 0xf3ff) | ((uint16_t)(data & 3) << 10);
+      reschedule();
+      return;
+    case 1:
+      mask = data;
+      // 渲染开关会影响奇数帧的长度
+      reschedule();
+      return;
+    case 3:
+      oam_addr = data;
+      return;
+    case 4:
+      oam[oam_addr++] = data;
+      return;
+    case 5:
+      if (!write_toggle) {
+        temp_addr = (temp_addr & 0xffe0) | (data >> 3);
+        fine_x = data & 7;
+      } else {
+        temp_addr
+          = (temp_addr & 0x8c1f)
+          | ((uint16_t)(data & 0x07) << 12)
+          | ((uint16_t)(data & 0xf8) << 2);
+      }
+      write_toggle ^= 1;
+      return;
+    case 6:
+      if (!write_toggle) {
+        temp_addr = (temp_addr & 0x00ff) | ((uint16_t)(data & 0x3f) << 8);
+      } else {
+        temp_addr = (temp_addr & 0xff00) | data;
+        vram_addr = temp_addr;
+      }
+      write_toggle ^= 1;
+      return;
+    case 7:
+      vram_write(vram_addr, data);
+      vram_addr += (ctrl & SFC_CTRL_INC32)? 32: 1;
+      return;
+    }
+  }
+
+  uint16_t nes_ppu::line_length() {
+    if (scanline == SFC_PPU_PRERENDER_LINE && (frame_count & 1) && rendering()) {
+      return SFC_PPU_DOTS_PER_LINE - 1;
+    }
+    return SFC_PPU_DOTS_PER_LINE;
+  }
+
+  uint16_t nes_ppu::next_dot() {
+    uint16_t next = line_length();
+    const bool visible = scanline < 240;
+    if (dot < 1 && (visible || scanline == SFC_PPU_VBLANK_LINE || scanline == SFC_PPU_PRERENDER_LINE)) {
+      return 1;
+    }
+    if (visible && hit_dot > dot && hit_dot < next) next = hit_dot;
+    if (visible || scanline == SFC_PPU_PRERENDER_LINE) {
+      if (dot < 256) return next < 256? next: 256;
+      if (dot < 257) return next < 257? next: 257;
+      if (scanline == SFC_PPU_PRERENDER_LINE && dot < 304) return next < 304? next: 304;
+    }
+    return next;
+  }
+
+  void nes_ppu::run_dot() {
+    if (dot == line_length()) {
+      dot = 0;
+      if (++scanline == SFC_PPU_LINES_PER_FRAME) {
+        scanline = 0;
+        ++frame_count;
+      }
+      return;
+    }
+
+    const bool visible = scanline < 240;
+    if (dot == 1) {
+      if (visible) {
+        render_line();
+      } else if (scanline == SFC_PPU_VBLANK_LINE) {
+        status |= SFC_STATUS_VBLANK;
+        if (ctrl & SFC_CTRL_NMI) raise_nmi();
+      } else if (scanline == SFC_PPU_PRERENDER_LINE) {
+        status &= ~(SFC_STATUS_VBLANK | SFC_STATUS_SPR0HIT | SFC_STATUS_OVERFLOW);
+      }
+    }
+    if (visible && hit_dot && dot == hit_dot) {
+      status |= SFC_STATUS_SPR0HIT;
+      hit_dot = 0;
+    }
+    if ((visible || scanline == SFC_PPU_PRERENDER_LINE) && rendering()) {
+      if (dot == 256) increment_y();
+      // 复制水平滚动
+      if (dot == 257) vram_addr = (vram_addr & ~0x041f) | (temp_addr & 0x041f);
+      // 复制垂直滚动
+      if (dot == 304 && scanline == SFC_PPU_PRERENDER_LINE) {
+        vram_addr = (vram_addr & ~0x7be0) | (temp_addr & 0x7be0);
+      }
+    }
+  }
+
+  void nes_ppu::catch_up(uint64_t cpu_cycle) {
+    const uint64_t target = cpu_cycle * 3;
+    if (dot_clock >= target) return;
+    while (dot_clock < target) {
+      const uint16_t next = next_dot();
+      const uint64_t step = next - dot;
+      if (dot_clock + step > target) {
+        // 停在两个事件之间
+        dot += target - dot_clock;
+        dot_clock = target;
+        break;
+      }
+      dot_clock += step;
+      dot = next;
+      run_dot();
+    }
+    reschedule();
+  }
+
+  void nes_ppu::raise_nmi() {
+    nmi_pending = true;
+    scheduler->poll_now();
+  }
+
+  void nes_ppu::reschedule() {
+    if (ctrl & SFC_CTRL_NMI) {
+      scheduler->schedule(SFC_EVENT_VBLANK, next_vblank_cycle());
+    } else {
+      scheduler->cancel(SFC_EVENT_VBLANK);
+    }
+  }
+
+  void nes_ppu::increment_y() {
+    if ((vram_addr & 0x7000) != 0x7000) {
+      vram_addr += 0x1000;
+      return;
+    }
+    vram_addr &= ~0x7000;
+    uint16_t y = (vram_addr & 0x03e0) >> 5;
+    if (y == 29) {
+      y = 0;
+      vram_addr ^= 0x0800;
+    } else if (y == 31) {
+      y = 0;
+    } else {
+      ++y;
+    }
+    vram_addr = (vram_addr & ~0x03e0) | (y << 5);
+  }
+
+  void nes_ppu::fetch_bg_tiles(
+    int skip, int count, uint8_t* plane0, uint8_t* plane1, uint8_t* attr
+  ) {
+    // 使用 v 的副本，真正的 v 在第 257 周期从 t 复制
+    uint16_t v = vram_addr;
+    const uint8_t* table = pattern + ((ctrl & SFC_CTRL_BG_TBL)? 0x1000: 0) + ((v >> 12) & 7);
+    for (int i=0; i<skip+count; i++) {
+      if (i >= skip) {
+        const uint8_t* nt = nametable_banks[(v >> 10) & 3];
+        const uint8_t tile = nt[v & 0x3ff];
+        const uint8_t at = nt[0x3c0 | ((v >> 4) & 0x38) | ((v >> 2) & 0x07)];
+        attr[i - skip] = (at >> (((v >> 4) & 4) | (v & 2))) & 3;
+        plane0[i - skip] = table[tile * 16];
+        plane1[i - skip] = table[tile * 16 + 8];
+      }
+      if ((v & 0x1f) == 31) {
+        v &= ~0x1f;
+        v ^= 0x0400;
+      } else {
+        ++v;
+      }
+    }
+  }
+
+  void nes_ppu::fetch_sprite_row(const uint8_t* s, int row, uint8_t& plane0, uint8_t& plane1) {
+    const int height = (ctrl & SFC_CTRL_SPR_16)? 16: 8;
+    const uint8_t tile = s[1];
+    const uint8_t at = s[2];
+    if (at & 0x80) row = height - 1 - row;
+    uint16_t addr;
+    if (height == 16) {
+      addr = ((tile & 1) << 12) | ((tile & 0xfe) << 4);
+      if (row >= 8) {
+        addr += 16;
+        row -= 8;
+      }
+    } else {
+      addr = ((ctrl & SFC_CTRL_SPR_TBL)? 0x1000: 0) | (tile << 4);
+    }
+    plane0 = pattern[addr + row];
+    plane1 = pattern[addr + row + 8];
+    if (at & 0x40) {
+      plane0 = reverse_bits(plane0);
+      plane1 = reverse_bits(plane1);
+    }
+  }
+
+  void nes_ppu::render_line() {
+    hit_dot = 0;
+    if (!output_enabled) {
+      render_line_timing();
+      return;
+    }
+
+    uint8_t* out = output->framebuffer + scanline * 256;
+    output->emphasis[scanline] = mask >> 5;
+    if (!rendering()) {
+      memset(out, palette[0], 256);
+      return;
+    }
+
+    uint8_t plane0[SFC_BG_TILES_PER_LINE];
+    uint8_t plane1[SFC_BG_TILES_PER_LINE];
+    uint8_t attr[SFC_BG_TILES_PER_LINE];
+    fetch_bg_tiles(0, SFC_BG_TILES_PER_LINE, plane0, plane1, attr);
+
+    uint8_t bg[256];
+    uint8_t spr[SFC_SPRITE_LINE_LEN] = {0};
+    kernels->render_bg(plane0, plane1, attr, fine_x, bg);
+    evaluate_sprites(spr);
+    const int hit = kernels->compose(bg, spr, palette, mask, out);
+    // 命中标记在对应像素输出后才可见，+2 保证落在第 1 周期之后
+    if (hit >= 0 && !(status & SFC_STATUS_SPR0HIT)) hit_dot = hit + 2;
+  }
+
+  void nes_ppu::render_line_timing() {
+    if (!rendering()) return;
+    const int row = evaluate_sprites(NULL);
+    if (row < 0 || (status & SFC_STATUS_SPR0HIT)) return;
+    if ((mask & (SFC_MASK_BG | SFC_MASK_SPR)) != (SFC_MASK_BG | SFC_MASK_SPR)) return;
+
+    // 只抓取 0 号精灵覆盖到的两个背景 tile
+    uint8_t sp0, sp1;
+    fetch_sprite_row(oam, row, sp0, sp1);
+    const int x0 = oam[3];
+    const int first = (fine_x + x0) >> 3;
+    uint8_t plane0[2], plane1[2], attr[2];
+    fetch_bg_tiles(first, first + 1 < SFC_BG_TILES_PER_LINE? 2: 1, plane0, plane1, attr);
+
+    const bool clip = !(mask & SFC_MASK_BG_L8) || !(mask & SFC_MASK_SPR_L8);
+    for (int k=0; k<8; k++) {
+      const int x = x0 + k;
+      if (x >= 255) break;
+      if (x < 8 && clip) continue;
+      if (!(((sp0 | sp1) >> (7 - k)) & 1)) continue;
+      const int pos = fine_x + x;
+      const int t = (pos >> 3) - first;
+      const int bit = 7 - (pos & 7);
+      if (((plane0[t] | plane1[t]) >> bit) & 1) {
+        hit_dot = x + 2;
+        return;
+      }
+    }
+  }
+
+  int nes_ppu::evaluate_sprites(uint8_t* line) {
+    const int height = (ctrl & SFC_CTRL_SPR_16)? 16: 8;
+    int count = 0;
+    int zero_row = -1;
+    for (int i=0; i<64; i++) {
+      const uint8_t* s = oam + i * 4;
+      // 精灵的 Y 坐标会延迟一条扫描线
+      const int row = (int)scanline - (int)s[0] - 1;
+      if (row < 0 || row >= height) continue;
+      if (count == 8) {
+        status |= SFC_STATUS_OVERFLOW;
+        break;
+      }
+      ++count;
+      if (i == 0) zero_row = row;
+      if (!line) continue;
+
+      uint8_t p0, p1;
+      fetch_sprite_row(s, row, p0, p1);
+      const uint8_t at = s[2];
+      const uint8_t flags
+        = (at & 3)
+        | ((at & 0x20)? SFC_SPR_BEHIND: 0)
+        | (i == 0? SFC_SPR_ZERO: 0);
+      kernels->overlay_sprite(line, p0, p1, flags, s[3]);
+    }
+    return zero_row;
+  }
+
+  uint64_t nes_ppu::dots_until(uint16_t line, uint16_t pos) {
+    const uint64_t frame_dots = SFC_PPU_LINES_PER_FRAME * SFC_PPU_DOTS_PER_LINE;
+    const uint64_t cur = scanline * SFC_PPU_DOTS_PER_LINE + dot;
+    const uint64_t tgt = line * SFC_PPU_DOTS_PER_LINE + pos;
+    if (tgt > cur) return tgt - cur;
+    // 需要跨过帧尾，奇数帧开启渲染时会少一个周期
+    uint64_t dots = frame_dots - cur + tgt;
+    if ((frame_count & 1) && rendering()) --dots;
+    return dots;
+  }
+
+  void nes_ppu::write_oam(const uint8_t* data) {
+    // OAMADDR 不为 0 时写入会绕回开头，拆成两段复制
+    const int head = 256 - oam_addr;
+    memcpy(oam + oam_addr, data, head);
+    memcpy(oam, data + head, oam_addr);
+  }
+
+  uint64_t nes_ppu::next_vblank_cycle() {
+    return (dot_clock + dots_until(SFC_PPU_VBLANK_LINE, 1) + 2) / 3;
+  }
+
+  uint64_t nes_ppu::next_frame_cycle() {
+    return (dot_clock + dots_until(0, 0) + 2) / 3;
+  }
+}
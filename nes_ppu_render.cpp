@@ -0,0 +1,383 @@
+#include <cstring>
+#include "include/nes_ppu_render.h"
+
+// 仅在 x86 + GCC/Clang 下编译 SIMD 版本，其它平台只有标量实现
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SFC_X86_KERNELS 1
+#include <immintrin.h>
+#define SFC_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define SFC_TARGET_AVX2  __attribute__((target("avx2")))
+#endif
+
+namespace fc
+{
+  // ---------------------------------------------------------------- 标量实现
+
+  static void decode_tiles_scalar(
+    const uint8_t* plane0, const uint8_t* plane1,
+    const uint8_t* attr, int count, uint8_t* out
+  ) {
+    for (int i=0; i<count; i++) {
+      const uint8_t lo = plane0[i];
+      const uint8_t hi = plane1[i];
+      const uint8_t pal = attr[i] << 2;
+      for (int b=0; b<8; b++) {
+        const uint8_t px
+          = ((lo >> (7 - b)) & 1)
+          | (((hi >> (7 - b)) & 1) << 1);
+        out[i * 8 + b] = px? (pal | px): 0;
+      }
+    }
+  }
+
+  static void render_bg_scalar(
+    const uint8_t* plane0, const uint8_t* plane1,
+    const uint8_t* attr, uint8_t fine_x, uint8_t* out
+  ) {
+    uint8_t buf[SFC_BG_TILES_PER_LINE * 8];
+    decode_tiles_scalar(plane0, plane1, attr, SFC_BG_TILES_PER_LINE, buf);
+    memcpy(out, buf + (fine_x & 7), 256);
+  }
+
+  static void overlay_sprite_scalar(
+    uint8_t* line, uint8_t plane0, uint8_t plane1, uint8_t flags, uint8_t x
+  ) {
+    const uint8_t pal
+      = 0x10 | ((flags & 3) << 2)
+      | (flags & (SFC_SPR_BEHIND | SFC_SPR_ZERO));
+    for (int b=0; b<8; b++) {
+      const uint8_t px
+        = ((plane0 >> (7 - b)) & 1)
+        | (((plane1 >> (7 - b)) & 1) << 1);
+      if (px && !line[x + b]) line[x + b] = pal | px;
+    }
+  }
+
+  static int compose_scalar(
+    const uint8_t* bg, const uint8_t* spr,
+    const uint8_t* palette, uint8_t mask, uint8_t* out
+  ) {
+    const uint8_t gray = (mask & SFC_MASK_GRAY)? 0x30: 0x3f;
+    int hit = -1;
+    for (int x=0; x<256; x++) {
+      uint8_t b = bg[x];
+      uint8_t s = spr[x];
+      if (!(mask & SFC_MASK_BG)  || (x < 8 && !(mask & SFC_MASK_BG_L8)))  b = 0;
+      if (!(mask & SFC_MASK_SPR) || (x < 8 && !(mask & SFC_MASK_SPR_L8))) s = 0;
+
+      uint8_t idx = 0;
+      if ((s & 3) && (!(s & SFC_SPR_BEHIND) || !(b & 3))) {
+        idx = s & 0x1f;
+      } else if (b & 3) {
+        idx = b & 0x0f;
+      }
+      // 0 号精灵命中：两者都不透明，且 x=255 处永远不会命中
+      if (hit < 0 && (s & SFC_SPR_ZERO) && (s & 3) && (b & 3) && x != 255) {
+        hit = x;
+      }
+      out[x] = palette[idx] & gray;
+    }
+    return hit;
+  }
+
+  static const nes_ppu_kernels kernels_scalar = {
+    "scalar",
+    decode_tiles_scalar,
+    render_bg_scalar,
+    overlay_sprite_scalar,
+    compose_scalar,
+  };
+
+#ifdef SFC_X86_KERNELS
+  // ---------------------------------------------------------------- SSE4.1 实现
+
+  // 强制内联，使 AVX2 版本中展开为 VEX 编码，避免 SSE/AVX 切换的开销
+  SFC_TARGET_SSE41 __attribute__((always_inline))
+  static inline __m128i decode_pair_sse41(
+    uint8_t lo0, uint8_t lo1, uint8_t hi0, uint8_t hi1, uint8_t pal0, uint8_t pal1
+  ) {
+    const __m128i bits = _mm_setr_epi8(
+      (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1,
+      (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1);
+    const __m128i dup = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+    const __m128i p0 = _mm_shuffle_epi8(_mm_cvtsi32_si128(lo0 | (lo1 << 8)), dup);
+    const __m128i p1 = _mm_shuffle_epi8(_mm_cvtsi32_si128(hi0 | (hi1 << 8)), dup);
+    const __m128i pal = _mm_shuffle_epi8(_mm_cvtsi32_si128(pal0 | (pal1 << 8)), dup);
+    const __m128i b0 = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(p0, bits), bits), _mm_set1_epi8(1));
+    const __m128i b1 = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(p1, bits), bits), _mm_set1_epi8(2));
+    const __m128i px = _mm_or_si128(b0, b1);
+    const __m128i transparent = _mm_cmpeq_epi8(px, _mm_setzero_si128());
+    return _mm_or_si128(px, _mm_andnot_si128(transparent, pal));
+  }
+
+  SFC_TARGET_SSE41
+  static void decode_tiles_sse41(
+    const uint8_t* plane0, const uint8_t* plane1,
+    const uint8_t* attr, int count, uint8_t* out
+  ) {
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+      const __m128i v = decode_pair_sse41(
+        plane0[i], plane0[i + 1], plane1[i], plane1[i + 1],
+        attr[i] << 2, attr[i + 1] << 2);
+      _mm_storeu_si128((__m128i*)(out + i * 8), v);
+    }
+    if (i < count) {
+      decode_tiles_scalar(plane0 + i, plane1 + i, attr + i, count - i, out + i * 8);
+    }
+  }
+
+  SFC_TARGET_SSE41
+  static void render_bg_sse41(
+    const uint8_t* plane0, const uint8_t* plane1,
+    const uint8_t* attr, uint8_t fine_x, uint8_t* out
+  ) {
+    uint8_t buf[SFC_BG_TILES_PER_LINE * 8];
+    decode_tiles_sse41(plane0, plane1, attr, SFC_BG_TILES_PER_LINE, buf);
+    // 精细滚动即按 fine_x 偏移做一次非对齐的整行拷贝
+    const uint8_t* src = buf + (fine_x & 7);
+    for (int x=0; x<256; x += 16) {
+      _mm_storeu_si128((__m128i*)(out + x), _mm_loadu_si128((const __m128i*)(src + x)));
+    }
+  }
+
+  SFC_TARGET_SSE41 __attribute__((always_inline))
+  static inline void overlay_sprite_body(
+    uint8_t* line, uint8_t plane0, uint8_t plane1, uint8_t flags, uint8_t x
+  ) {
+    const uint8_t pal
+      = 0x10 | ((flags & 3) << 2)
+      | (flags & (SFC_SPR_BEHIND | SFC_SPR_ZERO));
+    const __m128i px = decode_pair_sse41(plane0, 0, plane1, 0, pal, 0);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i cur = _mm_loadl_epi64((const __m128i*)(line + x));
+    // 只写入当前透明且新像素不透明的位置
+    const __m128i take = _mm_andnot_si128(
+      _mm_cmpeq_epi8(px, zero), _mm_cmpeq_epi8(cur, zero));
+    _mm_storel_epi64((__m128i*)(line + x), _mm_blendv_epi8(cur, px, take));
+  }
+
+  SFC_TARGET_SSE41
+  static void overlay_sprite_sse41(
+    uint8_t* line, uint8_t plane0, uint8_t plane1, uint8_t flags, uint8_t x
+  ) {
+    overlay_sprite_body(line, plane0, plane1, flags, x);
+  }
+
+  SFC_TARGET_SSE41
+  static int compose_sse41(
+    const uint8_t* bg, const uint8_t* spr,
+    const uint8_t* palette, uint8_t mask, uint8_t* out
+  ) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i three = _mm_set1_epi8(3);
+    const __m128i behind = _mm_set1_epi8(SFC_SPR_BEHIND);
+    const __m128i sprite0 = _mm_set1_epi8(SFC_SPR_ZERO);
+    const __m128i hi_bit = _mm_set1_epi8(0x10);
+    const __m128i spr_idx = _mm_set1_epi8(0x1f);
+    const __m128i gray = _mm_set1_epi8((mask & SFC_MASK_GRAY)? 0x30: 0x3f);
+    const __m128i pal_lo = _mm_loadu_si128((const __m128i*)palette);
+    const __m128i pal_hi = _mm_loadu_si128((const __m128i*)(palette + 16));
+    const __m128i left8 = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i bg_on = _mm_set1_epi8((mask & SFC_MASK_BG)? -1: 0);
+    const __m128i spr_on = _mm_set1_epi8((mask & SFC_MASK_SPR)? -1: 0);
+
+    int hit = -1;
+    for (int x=0; x<256; x += 16) {
+      __m128i bg_keep = bg_on;
+      __m128i spr_keep = spr_on;
+      if (x == 0) {
+        if (!(mask & SFC_MASK_BG_L8))  bg_keep  = _mm_and_si128(bg_keep, left8);
+        if (!(mask & SFC_MASK_SPR_L8)) spr_keep = _mm_and_si128(spr_keep, left8);
+      }
+      const __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i*)(bg + x)), bg_keep);
+      const __m128i s = _mm_and_si128(_mm_loadu_si128((const __m128i*)(spr + x)), spr_keep);
+      const __m128i b_clear = _mm_cmpeq_epi8(_mm_and_si128(b, three), zero);
+      const __m128i s_clear = _mm_cmpeq_epi8(_mm_and_si128(s, three), zero);
+      const __m128i s_front = _mm_cmpeq_epi8(_mm_and_si128(s, behind), zero);
+      const __m128i s_wins = _mm_andnot_si128(s_clear, _mm_or_si128(s_front, b_clear));
+      const __m128i idx = _mm_blendv_epi8(b, _mm_and_si128(s, spr_idx), s_wins);
+
+      const __m128i lo = _mm_shuffle_epi8(pal_lo, idx);
+      const __m128i hi = _mm_shuffle_epi8(pal_hi, idx);
+      const __m128i use_hi = _mm_cmpeq_epi8(_mm_and_si128(idx, hi_bit), hi_bit);
+      _mm_storeu_si128((__m128i*)(out + x),
+        _mm_and_si128(_mm_blendv_epi8(lo, hi, use_hi), gray));
+
+      if (hit < 0) {
+        const __m128i s0 = _mm_cmpeq_epi8(_mm_and_si128(s, sprite0), sprite0);
+        int bits = _mm_movemask_epi8(
+          _mm_andnot_si128(_mm_or_si128(b_clear, s_clear), s0));
+        if (x == 240) bits &= 0x7fff;
+        if (bits) hit = x + __builtin_ctz(bits);
+      }
+    }
+    return hit;
+  }
+
+  static const nes_ppu_kernels kernels_sse41 = {
+    "sse4.1",
+    decode_tiles_sse41,
+    render_bg_sse41,
+    overlay_sprite_sse41,
+    compose_sse41,
+  };
+
+  // ---------------------------------------------------------------- AVX2 实现
+
+  SFC_TARGET_AVX2
+  static void decode_tiles_avx2(
+    const uint8_t* plane0, const uint8_t* plane1,
+    const uint8_t* attr, int count, uint8_t* out
+  ) {
+    const __m256i bits = _mm256_setr_epi8(
+      (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1, (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1,
+      (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1, (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1);
+    // 每个 128 位通道各展开两个 tile：低通道 tile 0/1，高通道 tile 2/3
+    const __m256i dup = _mm256_setr_epi8(
+      0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+      2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i two = _mm256_set1_epi8(2);
+    const __m256i zero = _mm256_setzero_si256();
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+      uint32_t lo, hi;
+      memcpy(&lo, plane0 + i, 4);
+      memcpy(&hi, plane1 + i, 4);
+      const uint32_t pal
+        = (uint32_t)(attr[i] << 2)
+        | (uint32_t)(attr[i + 1] << 2) << 8
+        | (uint32_t)(attr[i + 2] << 2) << 16
+        | (uint32_t)(attr[i + 3] << 2) << 24;
+      const __m256i p0 = _mm256_shuffle_epi8(_mm256_set1_epi32((int)lo), dup);
+      const __m256i p1 = _mm256_shuffle_epi8(_mm256_set1_epi32((int)hi), dup);
+      const __m256i pv = _mm256_shuffle_epi8(_mm256_set1_epi32((int)pal), dup);
+      const __m256i b0 = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(p0, bits), bits), one);
+      const __m256i b1 = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(p1, bits), bits), two);
+      const __m256i px = _mm256_or_si256(b0, b1);
+      const __m256i transparent = _mm256_cmpeq_epi8(px, zero);
+      _mm256_storeu_si256((__m256i*)(out + i * 8),
+        _mm256_or_si256(px, _mm256_andnot_si256(transparent, pv)));
+    }
+    for (; i < count; i += 2) {
+      // 剩余的 1-3 个 tile 按两个一组处理，最后不足两个时只写回 8 字节
+      const bool pair = i + 1 < count;
+      const __m128i v = decode_pair_sse41(
+        plane0[i], pair? plane0[i + 1]: 0, plane1[i], pair? plane1[i + 1]: 0,
+        attr[i] << 2, pair? attr[i + 1] << 2: 0);
+      if (pair) {
+        _mm_storeu_si128((__m128i*)(out + i * 8), v);
+      } else {
+        _mm_storel_epi64((__m128i*)(out + i * 8), v);
+      }
+    }
+  }
+
+  SFC_TARGET_AVX2
+  static void render_bg_avx2(
+    const uint8_t* plane0, const uint8_t* plane1,
+    const uint8_t* attr, uint8_t fine_x, uint8_t* out
+  ) {
+    uint8_t buf[SFC_BG_TILES_PER_LINE * 8];
+    decode_tiles_avx2(plane0, plane1, attr, SFC_BG_TILES_PER_LINE, buf);
+    const uint8_t* src = buf + (fine_x & 7);
+    for (int x=0; x<256; x += 32) {
+      _mm256_storeu_si256((__m256i*)(out + x), _mm256_loadu_si256((const __m256i*)(src + x)));
+    }
+  }
+
+  SFC_TARGET_AVX2
+  static int compose_avx2(
+    const uint8_t* bg, const uint8_t* spr,
+    const uint8_t* palette, uint8_t mask, uint8_t* out
+  ) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i three = _mm256_set1_epi8(3);
+    const __m256i behind = _mm256_set1_epi8(SFC_SPR_BEHIND);
+    const __m256i sprite0 = _mm256_set1_epi8(SFC_SPR_ZERO);
+    const __m256i hi_bit = _mm256_set1_epi8(0x10);
+    const __m256i spr_idx = _mm256_set1_epi8(0x1f);
+    const __m256i gray = _mm256_set1_epi8((mask & SFC_MASK_GRAY)? 0x30: 0x3f);
+    // vpshufb 只在 128 位通道内查表，因此把 16 项的表复制到两个通道
+    const __m256i pal_lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)palette));
+    const __m256i pal_hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(palette + 16)));
+    const __m256i left8 = _mm256_setr_epi8(
+      0, 0, 0, 0, 0, 0, 0, 0, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i bg_on = _mm256_set1_epi8((mask & SFC_MASK_BG)? -1: 0);
+    const __m256i spr_on = _mm256_set1_epi8((mask & SFC_MASK_SPR)? -1: 0);
+
+    int hit = -1;
+    for (int x=0; x<256; x += 32) {
+      __m256i bg_keep = bg_on;
+      __m256i spr_keep = spr_on;
+      if (x == 0) {
+        if (!(mask & SFC_MASK_BG_L8))  bg_keep  = _mm256_and_si256(bg_keep, left8);
+        if (!(mask & SFC_MASK_SPR_L8)) spr_keep = _mm256_and_si256(spr_keep, left8);
+      }
+      const __m256i b = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(bg + x)), bg_keep);
+      const __m256i s = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(spr + x)), spr_keep);
+      const __m256i b_clear = _mm256_cmpeq_epi8(_mm256_and_si256(b, three), zero);
+      const __m256i s_clear = _mm256_cmpeq_epi8(_mm256_and_si256(s, three), zero);
+      const __m256i s_front = _mm256_cmpeq_epi8(_mm256_and_si256(s, behind), zero);
+      const __m256i s_wins = _mm256_andnot_si256(s_clear, _mm256_or_si256(s_front, b_clear));
+      const __m256i idx = _mm256_blendv_epi8(b, _mm256_and_si256(s, spr_idx), s_wins);
+
+      const __m256i lo = _mm256_shuffle_epi8(pal_lo, idx);
+      const __m256i hi = _mm256_shuffle_epi8(pal_hi, idx);
+      const __m256i use_hi = _mm256_cmpeq_epi8(_mm256_and_si256(idx, hi_bit), hi_bit);
+      _mm256_storeu_si256((__m256i*)(out + x),
+        _mm256_and_si256(_mm256_blendv_epi8(lo, hi, use_hi), gray));
+
+      if (hit < 0) {
+        const __m256i s0 = _mm256_cmpeq_epi8(_mm256_and_si256(s, sprite0), sprite0);
+        uint32_t bits = (uint32_t)_mm256_movemask_epi8(
+          _mm256_andnot_si256(_mm256_or_si256(b_clear, s_clear), s0));
+        if (x == 224) bits &= 0x7fffffff;
+        if (bits) hit = x + __builtin_ctz(bits);
+      }
+    }
+    return hit;
+  }
+
+  // 单个精灵只有 8 像素，AVX2 没有更宽的收益，只是以 VEX 编码重新编译 SSE4.1 的版本
+  SFC_TARGET_AVX2
+  static void overlay_sprite_avx2(
+    uint8_t* line, uint8_t plane0, uint8_t plane1, uint8_t flags, uint8_t x
+  ) {
+    overlay_sprite_body(line, plane0, plane1, flags, x);
+  }
+
+  static const nes_ppu_kernels kernels_avx2 = {
+    "avx2",
+    decode_tiles_avx2,
+    render_bg_avx2,
+    overlay_sprite_avx2,
+    compose_avx2,
+  };
+#endif
+
+  const nes_ppu_kernels& nes_ppu_kernels_scalar() {
+    return kernels_scalar;
+  }
+
+  const nes_ppu_kernels& nes_ppu_kernels_best() {
+#ifdef SFC_X86_KERNELS
+    if (__builtin_cpu_supports("avx2")) return kernels_avx2;
+    if (__builtin_cpu_supports("sse4.1")) return kernels_sse41;
+#endif
+    return kernels_scalar;
+  }
+
+  int nes_ppu_kernels_available(const nes_ppu_kernels* list[], int max) {
+    int n = 0;
+    if (n < max) list[n++] = &kernels_scalar;
+#ifdef SFC_X86_KERNELS
+    if (n < max && __builtin_cpu_supports("sse4.1")) list[n++] = &kernels_sse41;
+    if (n < max && __builtin_cpu_supports("avx2")) list[n++] = &kernels_avx2;
+#endif
+    return n;
+  }
+}
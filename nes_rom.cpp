@@ -1,6 +1,7 @@
 #include "include/nes_rom.h"
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <cassert>
 
 namespace fc {
@@ -27,12 +28,23 @@ namespace fc {
   }
 
   void nes_rom_handler::load_image(const char* path) {
+    source = NULL;
     fp = fopen(path, "rb");
     if (fp == NULL) assert(!"文件打开失败");
 
     fread(&this->buffer, sizeof(nes_header_info_buffer), 1, fp);
   }
 
+  bool nes_rom_handler::load_memory(const uint8_t* data, size_t size) {
+    if (!data || size < sizeof(nes_header_info_buffer)) return false;
+    memcpy(&this->buffer, data, sizeof(nes_header_info_buffer));
+    source = data + sizeof(nes_header_info_buffer);
+    source_size = size - sizeof(nes_header_info_buffer);
+    // 与 parse_to_info 相同的检查，这里返回 false 而不是断言
+    const size_t need = (buffer.flags6 & 0x04? 512: 0) + buffer.prg_rom_count * 0x4000 + buffer.chr_rom_count * 0x2000;
+    return buffer.id == 0x1a53454e && source_size >= need;
+  }
+
   void nes_rom_handler::parse_to_info() {
     // "NES<EOF>"
     uint32_t magic_number = 0x1a53454e;
@@ -44,7 +56,7 @@ namespace fc {
     // 将 buffer 中的两个 count 赋值给 info，同时申请相应大小的空间并设置指针
     size_t prg_rom_size = (info.prg_rom_count = buffer.prg_rom_count) * 0x4000;
     size_t chr_rom_size = (info.chr_rom_count = buffer.chr_rom_count) * 0x2000;
-    uint8_t* memory = new uint8_t(prg_rom_size + chr_rom_size);
+    uint8_t* memory = new uint8_t[prg_rom_size + chr_rom_size];
     if (memory == NULL) assert(!"内存不足");
     info.prg_rom_ptr = memory;
     info.chr_rom_ptr = memory + prg_rom_size;
@@ -60,8 +72,18 @@ namespace fc {
 
     // 继续读取 ROM 镜像文件
     // TODO: 暂时跳过 Trainer
+    if (source) {
+      const size_t skip = info.have_trainer? 512: 0;
+      assert(source_size >= skip + prg_rom_size + chr_rom_size && "镜像不完整");
+      memcpy(memory, source + skip, prg_rom_size + chr_rom_size);
+      source = NULL;
+      source_size = 0;
+      return;
+    }
     if (info.have_trainer) fseek(fp, 512, SEEK_CUR);
     fread(memory, prg_rom_size + chr_rom_size, 1, fp);
+    fclose(fp);
+    fp = NULL;
   }
 
   nes_rom_info* nes_rom_handler::get_info() {
@@ -75,7 +97,7 @@ namespace fc {
     }
 
     if (info.prg_rom_ptr != NULL) {
-      delete info.prg_rom_ptr;
+      delete[] info.prg_rom_ptr;
       info.prg_rom_ptr = NULL;
     }
   }
@@ -0,0 +1,76 @@
+#include <cstdint>
+#include "include/nes_scheduler.h"
+
+namespace fc
+{
+  void nes_scheduler::init(nes_clock* clock) {
+    this->clock = clock;
+    size = 0;
+    for (int i=0; i<SFC_EVENT_COUNT; i++) due[i] = UINT64_MAX;
+  }
+
+  void nes_scheduler::push(uint64_t cycle, uint8_t type) {
+    if (size == SFC_EVENT_HEAP_SIZE) rebuild();
+    int i = size++;
+    // 上滤
+    while (i > 0) {
+      const int parent = (i - 1) / 2;
+      if (heap[parent].cycle <= cycle) break;
+      heap[i] = heap[parent];
+      i = parent;
+    }
+    heap[i].cycle = cycle;
+    heap[i].type = type;
+  }
+
+  void nes_scheduler::pop() {
+    const nes_event last = heap[--size];
+    int i = 0;
+    // 下滤
+    for (;;) {
+      int child = i * 2 + 1;
+      if (child >= size) break;
+      if (child + 1 < size && heap[child + 1].cycle < heap[child].cycle) ++child;
+      if (last.cycle <= heap[child].cycle) break;
+      heap[i] = heap[child];
+      i = child;
+    }
+    heap[i] = last;
+  }
+
+  void nes_scheduler::rebuild() {
+    size = 0;
+    for (int i=0; i<SFC_EVENT_COUNT; i++) {
+      if (due[i] != UINT64_MAX) push(due[i], i);
+    }
+  }
+
+  bool nes_scheduler::stale_top() {
+    return heap[0].cycle != due[heap[0].type];
+  }
+
+  void nes_scheduler::schedule(uint8_t type, uint64_t cycle) {
+    if (due[type] == cycle) return;
+    due[type] = cycle;
+    push(cycle, type);
+    if (cycle < clock->stop) clock->stop = cycle;
+  }
+
+  void nes_scheduler::cancel(uint8_t type) {
+    due[type] = UINT64_MAX;
+  }
+
+  uint64_t nes_scheduler::next_cycle() {
+    while (size && stale_top()) pop();
+    return size? heap[0].cycle: UINT64_MAX;
+  }
+
+  int nes_scheduler::pop_due(uint64_t now) {
+    while (size && stale_top()) pop();
+    if (!size || heap[0].cycle > now) return -1;
+    const uint8_t type = heap[0].type;
+    due[type] = UINT64_MAX;
+    pop();
+    return type;
+  }
+}
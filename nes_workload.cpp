@@ -0,0 +1,308 @@
+#include "include/nes_workload.h"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+
+namespace fc {
+
+  static const char* nes_workload_names[SFC_WORKLOAD_COUNT] = {
+    "memset", "memcpy", "adc", "branchy", "recursion", "table_walk", "smc",
+  };
+
+  // 每种负载 size 的默认值与上限
+  static const uint16_t nes_workload_sizes[SFC_WORKLOAD_COUNT][2] = {
+    { 4, 5 }, { 2, 2 }, { 64, 255 }, { 64, 255 }, { 64, 80 }, { 16, 16 }, { 64, 255 },
+  };
+
+  // 递归子程序、自修改代码模板与数据表的固定位置
+  static const uint16_t REC_ROUTINE = 0xCE00;
+  static const uint16_t SMC_TEMPLATE = 0xCF00;
+  static const uint16_t SMC_RAM = 0x0600;
+  static const uint16_t TABLE_BASE = 0xD000;
+  static const uint16_t IRQ_HANDLER = SFC_WORKLOAD_HALT_PC + 3;
+  // 外层循环计数器所在的零页地址
+  static const uint8_t COUNTER = 0xF0;
+
+  // 只支持生成器用到的那几种写法的汇编器
+  struct nes_workload_asm {
+    uint8_t* prg;
+    uint16_t pc;
+
+    void org(uint16_t addr) { pc = addr; }
+    void byte(uint8_t b) { assert(pc >= 0x8000); prg[pc - 0x8000] = b; pc++; }
+    void word(uint16_t w) { byte(w & 0xff); byte(w >> 8); }
+    void op(uint8_t opcode) { byte(opcode); }
+    void op8(uint8_t opcode, uint8_t operand) { byte(opcode); byte(operand); }
+    void op16(uint8_t opcode, uint16_t operand) { byte(opcode); word(operand); }
+    // 向回跳转到 target 的分支
+    void branch(uint8_t opcode, uint16_t target) {
+      const int offset = (int)target - (int)(pc + 2);
+      assert(offset >= -128 && offset <= 127);
+      op8(opcode, (uint8_t)offset);
+    }
+    // 向前跳转的分支，返回待回填的偏移位置
+    uint16_t forward(uint8_t opcode) { op8(opcode, 0); return pc - 1; }
+    // 让 forward 返回的分支跳到当前位置
+    void land(uint16_t at) {
+      const int offset = (int)pc - (int)(at + 1);
+      assert(offset >= 0 && offset <= 127);
+      prg[at - 0x8000] = (uint8_t)offset;
+    }
+  };
+
+  const char* nes_workload_name(int kind) {
+    return (kind >= 0 && kind < SFC_WORKLOAD_COUNT)? nes_workload_names[kind]: "unknown";
+  }
+
+  int nes_workload_find(const char* name) {
+    for (int i=0; i<SFC_WORKLOAD_COUNT; i++) {
+      if (!strcmp(name, nes_workload_names[i])) return i;
+    }
+    return -1;
+  }
+
+  nes_workload_params nes_workload_normalize(const nes_workload_params& params) {
+    nes_workload_params p = params;
+    assert(p.kind >= 0 && p.kind < SFC_WORKLOAD_COUNT);
+    if (p.iterations == 0) p.iterations = 1;
+    if (p.size == 0) p.size = nes_workload_sizes[p.kind][0];
+    if (p.size > nes_workload_sizes[p.kind][1]) p.size = nes_workload_sizes[p.kind][1];
+    return p;
+  }
+
+  // 各负载的循环体，X/Y/A 都可以随意使用，但不能碰 $F0-$F1 与栈
+  static void emit_body(nes_workload_asm& a, const nes_workload_params& p) {
+    switch (p.kind) {
+    case SFC_WORKLOAD_MEMSET:
+      // 用计数器低字节填充，每页一个 STA abs,X / INX / BNE 循环
+      a.op8(0xA5, COUNTER);                         // LDA $F0
+      for (int page=0; page<p.size; page++) {
+        a.op8(0xA2, 0x00);                          // LDX #0
+        const uint16_t loop = a.pc;
+        a.op16(0x9D, 0x0200 + page * 0x100);        // STA $xx00,X
+        a.op(0xE8);                                 // INX
+        a.branch(0xD0, loop);                       // BNE loop
+      }
+      break;
+
+    case SFC_WORKLOAD_MEMCPY:
+      // 先改写源数据的首字节，避免每轮复制的内容都相同
+      a.op8(0xA5, COUNTER);                         // LDA $F0
+      a.op16(0x8D, 0x0200);                         // STA $0200
+      for (int page=0; page<p.size; page++) {
+        a.op8(0xA2, 0x00);                          // LDX #0
+        const uint16_t loop = a.pc;
+        a.op16(0xBD, 0x0200 + page * 0x100);        // LDA $02xx,X
+        a.op16(0x9D, 0x0400 + page * 0x100);        // STA $04xx,X
+        a.op(0xE8);                                 // INX
+        a.branch(0xD0, loop);                       // BNE loop
+      }
+      break;
+
+    case SFC_WORKLOAD_ADC: {
+      // $00-$03 += $04-$07，然后 $04-$07 -= $00-$03，均为 32 位小端
+      a.op8(0xA2, (uint8_t)p.size);                 // LDX #size
+      const uint16_t loop = a.pc;
+      a.op(0x18);                                   // CLC
+      for (int i=0; i<4; i++) {
+        a.op8(0xA5, i);                             // LDA $0i
+        a.op8(0x65, 4 + i);                         // ADC $0(4+i)
+        a.op8(0x85, i);                             // STA $0i
+      }
+      a.op(0x38);                                   // SEC
+      for (int i=0; i<4; i++) {
+        a.op8(0xA5, 4 + i);                         // LDA $0(4+i)
+        a.op8(0xE5, i);                             // SBC $0i
+        a.op8(0x85, 4 + i);                         // STA $0(4+i)
+      }
+      a.op(0xCA);                                   // DEX
+      a.branch(0xD0, loop);                         // BNE loop
+      break;
+    }
+
+    case SFC_WORKLOAD_BRANCHY: {
+      // $10 为 LFSR，$11 为当前状态，$18-$1F 统计各状态走到次要分支的次数
+      a.op8(0xA2, (uint8_t)p.size);                 // LDX #size
+      const uint16_t step = a.pc;
+      a.op8(0xA5, 0x10);                            // LDA $10
+      a.op(0x4A);                                   // LSR A
+      const uint16_t no_tap = a.forward(0x90);      // BCC +2
+      a.op8(0x49, 0xB8);                            // EOR #$B8
+      a.land(no_tap);
+      a.op8(0x85, 0x10);                            // STA $10
+      a.op8(0xA5, 0x11);                            // LDA $11
+      std::vector<uint16_t> to_end;
+      for (int k=0; k<8; k++) {
+        a.op8(0xC9, k);                             // CMP #k
+        const uint16_t next = a.forward(0xD0);      // BNE next
+        a.op8(0xA5, 0x10);                          // LDA $10
+        a.op8(0x29, 1 << k);                        // AND #(1<<k)
+        const uint16_t alt = a.forward(0xF0);       // BEQ alt
+        a.op8(0xA9, (k * 3 + 1) & 7);               // LDA #next_state
+        a.op8(0x85, 0x11);                          // STA $11
+        a.op16(0x4C, 0); to_end.push_back(a.pc - 2);// JMP end
+        a.land(alt);
+        a.op8(0xA9, (k + 5) & 7);                   // LDA #alt_state
+        a.op8(0x85, 0x11);                          // STA $11
+        a.op8(0xE6, 0x18 + k);                      // INC $18+k
+        a.op16(0x4C, 0); to_end.push_back(a.pc - 2);// JMP end
+        a.land(next);
+      }
+      for (size_t i=0; i<to_end.size(); i++) {
+        a.prg[to_end[i] - 0x8000] = a.pc & 0xff;
+        a.prg[to_end[i] - 0x8000 + 1] = a.pc >> 8;
+      }
+      a.op(0xCA);                                   // DEX
+      const uint16_t done = a.forward(0xF0);        // BEQ done
+      a.op16(0x4C, step);                           // JMP step
+      a.land(done);
+      break;
+    }
+
+    case SFC_WORKLOAD_RECURSION:
+      a.op8(0xA2, (uint8_t)p.size);                 // LDX #depth
+      a.op16(0x20, REC_ROUTINE);                    // JSR rec
+      break;
+
+    case SFC_WORKLOAD_TABLE_WALK: {
+      // 以 $00/$01 为指针逐页累加数据表，16 位和存于 $02/$03
+      a.op8(0xA9, TABLE_BASE & 0xff);               // LDA #<table
+      a.op8(0x85, 0x00);                            // STA $00
+      a.op8(0xA9, TABLE_BASE >> 8);                 // LDA #>table
+      a.op8(0x85, 0x01);                            // STA $01
+      a.op8(0xA2, (uint8_t)p.size);                 // LDX #pages
+      a.op8(0xA0, 0x00);                            // LDY #0
+      const uint16_t loop = a.pc;
+      a.op8(0xB1, 0x00);                            // LDA ($00),Y
+      a.op(0x18);                                   // CLC
+      a.op8(0x65, 0x02);                            // ADC $02
+      a.op8(0x85, 0x02);                            // STA $02
+      const uint16_t no_carry = a.forward(0x90);    // BCC +2
+      a.op8(0xE6, 0x03);                            // INC $03
+      a.land(no_carry);
+      a.op(0xC8);                                   // INY
+      a.branch(0xD0, loop);                         // BNE loop
+      a.op8(0xE6, 0x01);                            // INC $01
+      a.op(0xCA);                                   // DEX
+      a.branch(0xD0, loop);                         // BNE loop
+      break;
+    }
+
+    case SFC_WORKLOAD_SMC: {
+      // 每次调用前改写 LDA 的立即数，调用后在 $10/$11 之间切换 STA 的目标
+      a.op8(0xA2, (uint8_t)p.size);                 // LDX #size
+      const uint16_t loop = a.pc;
+      a.op16(0xEE, SMC_RAM + 1);                    // INC $0601
+      a.op16(0x20, SMC_RAM);                        // JSR $0600
+      a.op16(0xAD, SMC_RAM + 6);                    // LDA $0606
+      a.op8(0x49, 0x01);                            // EOR #$01
+      a.op16(0x8D, SMC_RAM + 6);                    // STA $0606
+      a.op(0xCA);                                   // DEX
+      a.branch(0xD0, loop);                         // BNE loop
+      break;
+    }
+    }
+  }
+
+  std::vector<uint8_t> nes_workload_build(const nes_workload_params& params) {
+    const nes_workload_params p = nes_workload_normalize(params);
+    std::vector<uint8_t> image(16 + 0x8000 + 0x2000, 0);
+    // "NES<EOF>"，2 * 16K PRG，1 * 8K CHR，mapper 0，水平镜像
+    memcpy(&image[0], "NES\x1a", 4);
+    image[4] = 2;
+    image[5] = 1;
+
+    nes_workload_asm a;
+    a.prg = &image[16];
+    // 未使用的 PRG 填充为 KIL，跑飞时会立即暴露
+    memset(a.prg, 0x02, 0x8000);
+
+    // 数据表：固定种子的线性同余序列
+    uint32_t seed = 0x2545F491;
+    for (int i=0; i<0x1000; i++) {
+      seed = seed * 1103515245 + 12345;
+      a.prg[TABLE_BASE - 0x8000 + i] = seed >> 16;
+    }
+
+    // 递归子程序：X 为剩余深度，每层压入 3 字节
+    a.org(REC_ROUTINE);
+    a.op8(0xE6, 0x30);                              // INC $30
+    a.op8(0xE0, 0x00);                              // CPX #0
+    const uint16_t base = a.forward(0xF0);          // BEQ ret
+    a.op(0xCA);                                     // DEX
+    a.op(0x48);                                     // PHA
+    a.op16(0x20, REC_ROUTINE);                      // JSR rec
+    a.op(0x68);                                     // PLA
+    a.op(0xE8);                                     // INX
+    a.land(base);
+    a.op(0x60);                                     // RTS
+
+    // 自修改代码的模板：LDA #imm / CLC / ADC $10 / STA $10 / RTS
+    const uint8_t smc[8] = { 0xA9, 0x00, 0x18, 0x65, 0x10, 0x85, 0x10, 0x60 };
+    memcpy(a.prg + SMC_TEMPLATE - 0x8000, smc, sizeof(smc));
+
+    // 结束处的死循环、中断处理与向量
+    a.org(SFC_WORKLOAD_HALT_PC);
+    a.op16(0x4C, SFC_WORKLOAD_HALT_PC);             // halt: JMP halt
+    a.op(0x40);                                     // RTI
+    a.org(0xFFFA);
+    a.word(IRQ_HANDLER);                            // NMI
+    a.word(SFC_WORKLOAD_ENTRY);                     // RESET
+    a.word(IRQ_HANDLER);                            // IRQ/BRK
+
+    // 序言：屏蔽中断、初始化栈、计数器与各负载用到的零页
+    a.org(SFC_WORKLOAD_ENTRY);
+    a.op(0x78);                                     // SEI
+    a.op(0xD8);                                     // CLD
+    a.op8(0xA2, 0xFF);                              // LDX #$FF
+    a.op(0x9A);                                     // TXS
+    a.op8(0xA9, p.iterations & 0xff);               // LDA #<iterations
+    a.op8(0x85, COUNTER);                           // STA $F0
+    a.op8(0xA9, p.iterations >> 8);                 // LDA #>iterations
+    a.op8(0x85, COUNTER + 1);                       // STA $F1
+    for (int i=0; i<8; i++) {
+      a.op8(0xA9, 0x11 * (i + 1));                  // LDA #..
+      a.op8(0x85, i);                               // STA $0i
+    }
+    a.op8(0xA9, 0xA7);                              // LDA #$A7
+    a.op8(0x85, 0x10);                              // STA $10
+    if (p.kind == SFC_WORKLOAD_SMC) {
+      a.op8(0xA2, sizeof(smc) - 1);                 // LDX #7
+      const uint16_t copy = a.pc;
+      a.op16(0xBD, SMC_TEMPLATE);                   // LDA template,X
+      a.op16(0x9D, SMC_RAM);                        // STA $0600,X
+      a.op(0xCA);                                   // DEX
+      a.branch(0x10, copy);                         // BPL copy
+    }
+
+    // 外层循环
+    const uint16_t body = a.pc;
+    emit_body(a, p);
+    // 16 位计数器减一，非零时回到 body
+    a.op8(0xA5, COUNTER);                           // LDA $F0
+    const uint16_t no_borrow = a.forward(0xD0);     // BNE +2
+    a.op8(0xC6, COUNTER + 1);                       // DEC $F1
+    a.land(no_borrow);
+    a.op8(0xC6, COUNTER);                           // DEC $F0
+    a.op8(0xA5, COUNTER);                           // LDA $F0
+    a.op8(0x05, COUNTER + 1);                       // ORA $F1
+    const uint16_t finished = a.forward(0xF0);      // BEQ finished
+    a.op16(0x4C, body);                             // JMP body
+    a.land(finished);
+
+    // 尾声：写入完成标记后进入死循环
+    a.op8(0xA9, SFC_WORKLOAD_DONE_VALUE);           // LDA #$A5
+    a.op16(0x8D, SFC_WORKLOAD_DONE_ADDR);           // STA $07FF
+    a.op16(0x4C, SFC_WORKLOAD_HALT_PC);             // JMP halt
+    assert(a.pc <= REC_ROUTINE);
+    return image;
+  }
+
+  bool nes_workload_write(const nes_workload_params& params, const char* path) {
+    const std::vector<uint8_t> image = nes_workload_build(params);
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) return false;
+    const bool ok = fwrite(&image[0], image.size(), 1, fp) == 1;
+    return fclose(fp) == 0 && ok;
+  }
+}
@@ -1,22 +1,318 @@
+#include <chrono>
+#include <cstring>
+#include <cassert>
 #include "include/simulator.h"
 
 namespace fc
 {
-  simulator::simulator() {}
+  simulator::simulator(nes_machine_pool* pool):
+    pool(pool? pool: &nes_machine_pool::shared()),
+    machine(this->pool->create()),
+    memory_pool(machine->memory_pool),
+    cpu(machine->cpu),
+    ppu(machine->ppu),
+    apu(machine->apu),
+    scheduler(machine->scheduler),
+    joypad(machine->joypad) {
+    rom_info = NULL;
+    rom_handler = NULL;
+    owns_rom = false;
+    mapper = NULL;
+    headless = false;
+    render_interval = 0;
+    render_requested = false;
+    frame_pending = false;
+    frame_render = false;
+    pipeline = NULL;
+    audio_samples = NULL;
+    audio_position = 0;
+    hash_log = NULL;
+    hash_interval = 0;
+    hash_countdown = 0;
+    movie = NULL;
+    movie_frame = 0;
+    run_ahead_frames = 0;
+    run_ahead_buffer = NULL;
+    memset(&frame_stats, 0, sizeof(frame_stats));
+  }
+
+  simulator::~simulator() {
+    free_rom();
+    free(run_ahead_buffer);
+    delete[] audio_samples;
+    pool->destroy(machine);
+  }
 
   void simulator::load_rom(const char* path) {
-    rom_handler.load_image(path);
-    rom_handler.parse_to_info();
-    rom_info = rom_handler.get_info();
-    // TODO: 暂时传递 NULL，后面会根据 mapper_number 来传递具体的 mapper 实例
-    memory_pool.init(rom_info, mappers[rom_info->mapper_number]);
+    free_rom();
+    rom_handler = new nes_rom_handler();
+    owns_rom = true;
+    rom_handler->load_image(path);
+    rom_handler->parse_to_info();
+    attach_rom();
+  }
+
+  void simulator::load_rom(nes_rom_handler* rom) {
+    free_rom();
+    rom_handler = rom;
+    owns_rom = false;
+    attach_rom();
+  }
+
+  void simulator::attach_rom() {
+    rom_info = rom_handler->get_info();
+    mapper = nes_mapper::create(rom_info->mapper_number);
+    assert(mapper && "不支持的 mapper");
+    joypad.init();
+    memory_pool.init(rom_info, mapper, &ppu, &apu, &joypad);
     cpu.init(&memory_pool);
+    debugger.init(&memory_pool, &cpu);
+    frame_pending = false;
+    scheduler.init(&cpu.get_clock());
+    ppu.init(rom_info, &scheduler);
+    apu.init(&scheduler, &memory_pool);
 
     // rom_info->show_info();
   }
 
+  void simulator::sync_devices() {
+    const uint64_t cycle = cpu.get_cycle();
+    ppu.catch_up(cycle);
+    apu.catch_up(cycle);
+  }
+
+  void simulator::dispatch_event(int type) {
+    const uint64_t cycle = cpu.get_cycle();
+    switch (type) {
+    case SFC_EVENT_VBLANK:
+      ppu.catch_up(cycle);
+      return;
+    case SFC_EVENT_APU_FRAME_IRQ:
+    case SFC_EVENT_DMC:
+      apu.catch_up(cycle);
+      return;
+    case SFC_EVENT_MAPPER_IRQ:
+      // NROM 没有 IRQ 计数器
+      return;
+    }
+  }
+
+  void simulator::service_interrupts() {
+    if (ppu.take_nmi()) cpu.nmi();
+    const bool irq = apu.irq();
+    cpu.set_irq_line(irq);
+    if (irq) cpu.irq();
+  }
+
+  void simulator::run_until(uint64_t cycle) {
+    debugger.clear_hit();
+    while (cpu.get_cycle() < cycle) {
+      const uint64_t event = scheduler.next_cycle();
+      // 只在批次开始前检查一次是否有断点，没有断点时执行路径与不调试时相同
+      cpu.set_breakpoints(debugger.has_breakpoints()? &debugger: NULL);
+      if (hash_log && hash_interval) run_hashed(event < cycle? event: cycle);
+      else cpu.run(event < cycle? event: cycle);
+
+      int type;
+      while ((type = scheduler.pop_due(cpu.get_cycle())) >= 0) {
+        dispatch_event(type);
+      }
+      service_interrupts();
+      if (debugger.has_hit()) {
+        debugger.settle();
+        return;
+      }
+    }
+  }
+
+  void simulator::run_hashed(uint64_t until) {
+    while (cpu.get_cycle() < until && !debugger.has_hit()) {
+      const uint64_t cycle = cpu.get_cycle();
+      // 周期上限只比当前多 1，因此恰好执行一条指令，停在断点上时不执行
+      cpu.run(cycle + 1);
+      if (cpu.get_cycle() != cycle) count_hashed_instruction();
+    }
+  }
+
+  void simulator::step(uint64_t count) {
+    debugger.clear_hit();
+    // 单步不检查断点
+    cpu.set_breakpoints(NULL);
+    // 单步不生成声音：先结束之前未完成的一帧音频，单步期间关闭输出，
+    // 否则重采样缓冲中的位置会随单步的周期数无限增长
+    apu.end_frame(cpu.get_cycle());
+    apu.set_output(false);
+    for (; count && !debugger.has_hit(); --count) {
+      // 周期上限只比当前多 1，因此恰好执行一条指令
+      cpu.run(cpu.get_cycle() + 1);
+      if (hash_log && hash_interval) count_hashed_instruction();
+      int type;
+      while ((type = scheduler.pop_due(cpu.get_cycle())) >= 0) {
+        dispatch_event(type);
+      }
+      service_interrupts();
+    }
+    apu.end_frame(cpu.get_cycle());
+    debugger.settle();
+  }
+
+  bool simulator::emulate_frame(bool render, bool audio) {
+    const uint64_t frame = ppu.get_frame_count();
+    ppu.set_output(render);
+    apu.set_output(audio);
+    while (ppu.get_frame_count() == frame) {
+      run_until(ppu.next_frame_cycle());
+      if (debugger.has_hit()) return false;
+      sync_devices();
+    }
+    apu.end_frame(cpu.get_cycle());
+    return true;
+  }
+
+  void simulator::run_frame() {
+    const uint64_t frame = ppu.get_frame_count();
+    if (!frame_pending) {
+      frame_render
+        = !headless
+        || render_requested
+        || (render_interval && frame % render_interval == 0);
+      render_requested = false;
+      if (!movie_finished()) {
+        joypad.set_buttons(0, movie->get(movie_frame, 0));
+        joypad.set_buttons(1, movie->get(movie_frame, 1));
+        ++movie_frame;
+      }
+    }
+    const bool render = frame_render;
+
+    const auto start = std::chrono::steady_clock::now();
+    // 提前运行时真实帧的像素不会被显示
+    frame_pending = !emulate_frame(render && !run_ahead_frames, !headless);
+    if (frame_pending) return;
+    if (apu.samples_avail() && !audio_samples) audio_samples = new int16_t[SFC_AUDIO_BLOCK_MAX];
+    uint32_t count;
+    while ((count = apu.read_samples(audio_samples, SFC_AUDIO_BLOCK_MAX))) {
+      if (pipeline) pipeline->push_audio(audio_position, apu.get_sample_rate(), audio_samples, count);
+      audio_position += count;
+    }
+    if (hash_log && !hash_interval) hash_log->append(digest());
+
+    const uint8_t* pixels = ppu.get_framebuffer();
+    const uint8_t* emphasis = ppu.get_emphasis();
+    if (run_ahead_frames) {
+      auto mark = std::chrono::steady_clock::now();
+      save_state(run_ahead_buffer);
+      double snapshot = std::chrono::duration<double>(std::chrono::steady_clock::now() - mark).count();
+      debugger.set_enabled(false);
+      nes_hash_log* log = hash_log;
+      hash_log = NULL;
+      for (uint32_t i=1; i<=run_ahead_frames; i++) {
+        emulate_frame(render && i == run_ahead_frames, false);
+      }
+      hash_log = log;
+      debugger.set_enabled(true);
+      if (render) {
+        memcpy(presented_pixels(), ppu.get_framebuffer(), 240 * 256);
+        memcpy(presented_pixels() + 240 * 256, ppu.get_emphasis(), 240);
+      }
+      pixels = get_framebuffer();
+      emphasis = get_emphasis();
+      mark = std::chrono::steady_clock::now();
+      load_state(run_ahead_buffer);
+      snapshot += std::chrono::duration<double>(std::chrono::steady_clock::now() - mark).count();
+      frame_stats.snapshot_seconds += snapshot;
+    }
+
+    const double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+    if (seconds > frame_stats.max_seconds) frame_stats.max_seconds = seconds;
+    if (render) {
+      if (pipeline) pipeline->push_frame(frame, pixels, emphasis);
+      ++frame_stats.rendered_frames;
+      frame_stats.rendered_seconds += seconds;
+    } else {
+      ++frame_stats.skipped_frames;
+      frame_stats.skipped_seconds += seconds;
+    }
+  }
+
+  void simulator::set_run_ahead(uint32_t frames) {
+    free(run_ahead_buffer);
+    run_ahead_buffer = NULL;
+    run_ahead_frames = frames;
+    if (frames) {
+      run_ahead_buffer = (uint8_t*)calloc(1, snapshot_size() + 240 * 256 + 240);
+      assert(run_ahead_buffer && "无法分配提前运行的快照");
+    }
+  }
+
+  nes_state_digest simulator::digest() {
+    nes_state_digest d;
+    d.frame = ppu.get_frame_count();
+    d.cycle = cpu.get_cycle();
+    const nes_registers& r = cpu.get_registers();
+    const uint8_t regs[7] = {
+      (uint8_t)r.program_counter, (uint8_t)(r.program_counter >> 8),
+      r.status, r.accumulator, r.x_index, r.y_index, r.stack_pointer,
+    };
+    d.cpu = nes_hash64(regs, sizeof(regs));
+    d.ram = nes_hash64(memory_pool.get_main_memory(), 2 * 1024);
+    d.sram = nes_hash64(memory_pool.get_sram_memory(), 8 * 1024);
+    d.video = nes_hash64(ppu.get_emphasis(), 240, nes_hash64(ppu.get_framebuffer(), 240 * 256));
+    return d;
+  }
+
+  size_t simulator::snapshot_size() {
+    return machine->snapshot_size();
+  }
+
+  void simulator::save_state(void* buf) {
+    machine->save(buf);
+  }
+
+  void simulator::load_state(const void* buf) {
+    machine->restore(buf);
+    // 快照中的页表可能与当前的观察点或 SRAM 不一致
+    memory_pool.refresh_pages();
+  }
+
+  size_t simulator::instance_bytes() {
+    size_t bytes = sizeof(simulator) + sizeof(nes_machine) + machine->allocated_bytes();
+    if (mapper) bytes += sizeof(*mapper);
+    if (audio_samples) bytes += SFC_AUDIO_BLOCK_MAX * sizeof(int16_t);
+    if (run_ahead_buffer) bytes += snapshot_size() + 240 * 256 + 240;
+    return bytes;
+  }
+
+  void simulator::set_headless(bool enabled, uint32_t interval) {
+    headless = enabled;
+    render_interval = interval;
+  }
+
+  bool simulator::load_aot(const char* path, const char** error) {
+    const size_t prg_size = rom_info->prg_rom_count * 0x4000;
+    if (!aot.load(path, rom_info->prg_rom_ptr, prg_size, error)) return false;
+    cpu.set_aot(&aot);
+    return true;
+  }
+
+  bool simulator::load_aot_cache(const char* dir, const char** error) {
+    const size_t prg_size = rom_info->prg_rom_count * 0x4000;
+    if (!aot.load_cache(dir, rom_info->prg_rom_ptr, prg_size, error)) return false;
+    cpu.set_aot(&aot);
+    return true;
+  }
+
   void simulator::free_rom() {
-    rom_handler.unload_image();
+    unload_aot();
+    delete mapper;
+    mapper = NULL;
+    if (owns_rom) {
+      rom_handler->unload_image();
+      delete rom_handler;
+    }
+    rom_handler = NULL;
+    owns_rom = false;
     rom_info = NULL;
   }
 }
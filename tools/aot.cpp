@@ -0,0 +1,501 @@
+// NROM 的 AOT 静态重编译：把 PRG-ROM 中可达的代码翻译成 C++，每个基本块一个函数
+// 编译：g++ -O2 -o aot tools/aot.cpp $(ls *.cpp | grep -v main.cpp) -ldl -lpthread
+// 用法：
+//   aot translate <rom> <输出.cpp>
+//   aot build [-I 头文件目录] <rom> <输出.so>   翻译后用 $CXX（默认 g++）编译为共享库，头文件目录默认为 include
+//   aot check <rom> <模块.so> [帧数] [录像]     与解释器逐帧比较状态哈希，并报告两者的速度，
+//     最后卸载预编译块并恢复之前的快照，确认之后由解释器继续运行
+//   aot cache [-I 头文件目录] <rom> <缓存目录>   从块缓存启动并报告第一帧的用时，缓存中没有时先 build 并写入缓存
+//     缓存以 PRG-ROM 哈希与模拟器的构建标识为键（见 nes_aot.h），换了 ROM 或重新编译模拟器后自动失效
+// 控制流分析从 RESET/NMI/IRQ 向量与 $C000 出发，沿顺序执行、条件分支、JMP 与 JSR 的目标及返回地址遍历。
+// 间接跳转、RTS/RTI 的目标与 RAM 中的代码不做静态解析，运行时查不到块即交给解释器；
+// BRK/RTI/CLI/PLP（涉及中断的时机）、JMP ($xxxx) 与非法指令同样交给解释器，其后的地址作为新块的入口。
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "../include/simulator.h"
+#include "../include/nes_6502.h"
+
+// 翻译为 C++ 的指令
+static const char* TRANSLATED[] = {
+  "ADC", "AND", "ASL", "BCC", "BCS", "BEQ", "BIT", "BMI", "BNE", "BPL", "BVC", "BVS",
+  "CLC", "CLD", "CLV", "CMP", "CPX", "CPY", "DEC", "DEX", "DEY", "EOR", "INC", "INX",
+  "INY", "JMP", "JSR", "LDA", "LDX", "LDY", "LSR", "NOP", "ORA", "PHA", "PHP", "PLA",
+  "ROL", "ROR", "RTS", "SBC", "SEC", "SED", "SEI", "STA", "STX", "STY", "TAX", "TAY",
+  "TSX", "TXA", "TXS", "TYA",
+};
+
+// 一条指令的解码结果
+struct instruction {
+  uint16_t addr;
+  uint8_t opcode, a1, a2;
+  uint8_t mode, length;
+  std::string name;
+  // 反汇编文本
+  std::string text;
+  uint16_t operand() const { return a1 | a2 << 8; }
+  uint16_t next() const { return addr + length; }
+  // 相对寻址的目标
+  uint16_t target() const { return next() + (int8_t)a1; }
+};
+
+struct translator {
+  std::vector<uint8_t> prg;
+  // $8000-$FFFF 中已解码的地址与块的入口
+  std::vector<bool> reached, leader;
+  std::vector<uint16_t> work;
+
+  uint8_t byte(uint16_t addr) const { return prg[(addr - 0x8000) % prg.size()]; }
+
+  instruction decode(uint16_t addr) const {
+    instruction in;
+    in.addr = addr;
+    in.opcode = byte(addr);
+    in.a1 = byte(addr + 1);
+    in.a2 = byte(addr + 2);
+    in.mode = fc::addressing_mode(in.opcode);
+    fc::nes_code code;
+    code.data = 0;
+    code.op = in.opcode;
+    code.a1 = in.a1;
+    code.a2 = in.a2;
+    char buf[32];
+    memset(buf, ' ', sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = 0;
+    in.length = fc::disassemble(code, buf);
+    in.name = std::string(buf, 3);
+    in.text = buf;
+    in.text.erase(in.text.find_last_not_of(' ') + 1);
+    // 相对寻址的反汇编带有 (+PC)，换成目标地址
+    if (in.mode == fc::SFC_AM_REL) {
+      char target[8];
+      snprintf(target, sizeof(target), "$%04X", in.target());
+      in.text = in.name + " " + target;
+    }
+    return in;
+  }
+
+  static bool translatable(const instruction& in) {
+    if (!fc::nes_cpu::implemented(in.opcode) || in.opcode == 0x6C) return false;
+    for (size_t i=0; i<sizeof(TRANSLATED)/sizeof(TRANSLATED[0]); i++) {
+      if (in.name == TRANSLATED[i]) return true;
+    }
+    return false;
+  }
+
+  // 是否结束基本块（之后的指令不按顺序执行）
+  static bool ends_block(const instruction& in) {
+    return in.mode == fc::SFC_AM_REL || in.name == "JMP" || in.name == "JSR" || in.name == "RTS";
+  }
+
+  void add_leader(uint32_t addr) {
+    if (addr < 0x8000 || addr > 0xffff) return;
+    if (!leader[addr & 0x7fff]) {
+      leader[addr & 0x7fff] = true;
+      work.push_back(addr);
+    }
+  }
+
+  // 从各个入口出发，找出可达的指令与基本块的入口
+  void analyze(const std::vector<uint16_t>& roots) {
+    reached.assign(0x8000, false);
+    leader.assign(0x8000, false);
+    for (size_t i=0; i<roots.size(); i++) add_leader(roots[i]);
+    while (!work.empty()) {
+      uint32_t addr = work.back();
+      work.pop_back();
+      while (addr <= 0xffff && !reached[addr & 0x7fff]) {
+        reached[addr & 0x7fff] = true;
+        const instruction in = decode(addr);
+        if (in.next() < in.addr) break;
+        if (!translatable(in)) {
+          // 交给解释器，RTI/JMP ($xxxx) 之后没有静态可知的后继
+          if (in.name == "BRK") add_leader(in.addr + 2);
+          else if (in.name != "RTI" && in.opcode != 0x6C && fc::nes_cpu::implemented(in.opcode)) add_leader(in.next());
+          break;
+        }
+        if (in.mode == fc::SFC_AM_REL) {
+          add_leader(in.target());
+          add_leader(in.next());
+          break;
+        }
+        if (in.name == "JMP") {
+          add_leader(in.operand());
+          break;
+        }
+        if (in.name == "JSR") {
+          add_leader(in.operand());
+          add_leader(in.next());
+          break;
+        }
+        if (in.name == "RTS") break;
+        addr = in.next();
+        // 落到另一个块的入口上时由那个块继续
+        if (addr <= 0xffff && leader[addr & 0x7fff]) break;
+      }
+    }
+  }
+};
+
+// 读取操作数的表达式
+static std::string source(const instruction& in) {
+  char buf[32];
+  if (in.mode == fc::SFC_AM_IMM) snprintf(buf, sizeof(buf), "0x%02X", in.a1);
+  else snprintf(buf, sizeof(buf), "sfc_aot_read(c, cyc, a)");
+  return buf;
+}
+
+// 生成一条指令，返回是否已经离开块
+static bool emit(FILE* out, const instruction& in) {
+  fprintf(out, "  // %04X  %s\n", in.addr, in.text.c_str());
+  fprintf(out, "  cyc += %d;\n", fc::nes_cpu::base_cycles(in.opcode));
+
+  // 有效地址，base 为变址前的地址，用来判断是否跨页
+  bool indexed = false;
+  switch (in.mode) {
+  case fc::SFC_AM_ZPG:
+    fprintf(out, "  a = 0x%02X;\n", in.a1);
+    break;
+  case fc::SFC_AM_ZPX:
+    fprintf(out, "  a = (uint8_t)(0x%02X + r->x);\n", in.a1);
+    break;
+  case fc::SFC_AM_ZPY:
+    fprintf(out, "  a = (uint8_t)(0x%02X + r->y);\n", in.a1);
+    break;
+  case fc::SFC_AM_ABS:
+    fprintf(out, "  a = 0x%04X;\n", in.operand());
+    break;
+  case fc::SFC_AM_ABX:
+  case fc::SFC_AM_ABY:
+    fprintf(out, "  base = 0x%04X;\n  a = (uint16_t)(base + r->%c);\n", in.operand(), in.mode == fc::SFC_AM_ABX? 'x': 'y');
+    indexed = true;
+    break;
+  case fc::SFC_AM_INX:
+    fprintf(out, "  t = (uint8_t)(0x%02X + r->x);\n", in.a1);
+    fprintf(out, "  lo = sfc_aot_read(c, cyc, t);\n  hi = sfc_aot_read(c, cyc, (uint8_t)(t + 1));\n");
+    fprintf(out, "  a = lo | hi << 8;\n");
+    break;
+  case fc::SFC_AM_INY:
+    fprintf(out, "  lo = sfc_aot_read(c, cyc, 0x%02X);\n  hi = sfc_aot_read(c, cyc, 0x%02X);\n", in.a1, (uint8_t)(in.a1 + 1));
+    fprintf(out, "  base = lo | hi << 8;\n  a = (uint16_t)(base + r->y);\n");
+    indexed = true;
+    break;
+  default:
+    break;
+  }
+
+  const std::string& n = in.name;
+  const std::string src = source(in);
+  const char* reg = n == "LDX" || n == "STX" || n == "CPX"? "x": n == "LDY" || n == "STY" || n == "CPY"? "y": "a";
+  if (n == "LDA" || n == "LDX" || n == "LDY") {
+    fprintf(out, "  r->%s = %s;\n  sfc_aot_zn(r, r->%s);\n", reg, src.c_str(), reg);
+  } else if (n == "STA" || n == "STX" || n == "STY") {
+    fprintf(out, "  sfc_aot_write(c, cyc, a, r->%s);\n", reg);
+  } else if (n == "AND" || n == "ORA" || n == "EOR") {
+    fprintf(out, "  r->a %s= %s;\n  sfc_aot_zn(r, r->a);\n", n == "AND"? "&": n == "ORA"? "|": "^", src.c_str());
+  } else if (n == "ADC") {
+    fprintf(out, "  v = %s;\n  s = r->a + v + (r->p & 0x01);\n", src.c_str());
+    fprintf(out, "  r->p = (r->p & 0xbe) | (s >> 8) | ((~(r->a ^ v) & (r->a ^ s) & 0x80) >> 1);\n");
+    fprintf(out, "  r->a = (uint8_t)s;\n  sfc_aot_zn(r, r->a);\n");
+  } else if (n == "SBC") {
+    fprintf(out, "  v = %s;\n  s = (uint16_t)(r->a - v - ((r->p & 0x01)? 0: 1));\n", src.c_str());
+    fprintf(out, "  r->p = (r->p & 0xbe) | ((s >> 8)? 0: 0x01) | (((r->a ^ v) & (r->a ^ s) & 0x80) >> 1);\n");
+    fprintf(out, "  r->a = (uint8_t)s;\n  sfc_aot_zn(r, r->a);\n");
+  } else if (n == "CMP" || n == "CPX" || n == "CPY") {
+    fprintf(out, "  s = (uint16_t)(r->%s - %s);\n", reg, src.c_str());
+    fprintf(out, "  r->p = (r->p & 0xfe) | (s < 0x100);\n  sfc_aot_zn(r, (uint8_t)s);\n");
+  } else if (n == "BIT") {
+    fprintf(out, "  v = %s;\n  r->p = (r->p & 0x3d) | (v & 0xc0) | ((r->a & v)? 0: 0x02);\n", src.c_str());
+  } else if (n == "ASL" || n == "LSR" || n == "ROL" || n == "ROR") {
+    const bool acc = in.mode == fc::SFC_AM_ACC;
+    fprintf(out, "  v = %s;\n", acc? "r->a": "sfc_aot_read(c, cyc, a)");
+    if (n == "ASL") fprintf(out, "  r->p = (r->p & 0xfe) | (v >> 7);\n  v <<= 1;\n");
+    if (n == "LSR") fprintf(out, "  r->p = (r->p & 0xfe) | (v & 0x01);\n  v >>= 1;\n");
+    if (n == "ROL") fprintf(out, "  s = v << 1 | (r->p & 0x01);\n  r->p = (r->p & 0xfe) | (s >> 8);\n  v = (uint8_t)s;\n");
+    if (n == "ROR") fprintf(out, "  s = v | (r->p & 0x01) << 8;\n  r->p = (r->p & 0xfe) | (s & 0x01);\n  v = (uint8_t)(s >> 1);\n");
+    // 与解释器一致：ROL 的内存形式同样把结果写入 A
+    if (acc || n == "ROL") fprintf(out, "  r->a = v;\n");
+    if (!acc) fprintf(out, "  sfc_aot_write(c, cyc, a, v);\n");
+    fprintf(out, "  sfc_aot_zn(r, v);\n");
+  } else if (n == "INC" || n == "DEC") {
+    fprintf(out, "  v = sfc_aot_read(c, cyc, a) %s 1;\n  sfc_aot_write(c, cyc, a, v);\n  sfc_aot_zn(r, v);\n", n == "INC"? "+": "-");
+  } else if (n == "INX" || n == "INY" || n == "DEX" || n == "DEY") {
+    const char r = n[2] == 'X'? 'x': 'y';
+    fprintf(out, "  %sr->%c;\n  sfc_aot_zn(r, r->%c);\n", n[0] == 'I'? "++": "--", r, r);
+  } else if (n == "TAX" || n == "TAY" || n == "TXA" || n == "TYA" || n == "TSX") {
+    const char* from = n[1] == 'A'? "a": n[1] == 'X'? "x": n[1] == 'Y'? "y": "sp";
+    const char* to = n[2] == 'A'? "a": n[2] == 'X'? "x": "y";
+    fprintf(out, "  r->%s = r->%s;\n  sfc_aot_zn(r, r->%s);\n", to, from, to);
+  } else if (n == "TXS") {
+    fprintf(out, "  r->sp = r->x;\n");
+  } else if (n == "CLC" || n == "SEC" || n == "CLD" || n == "SED" || n == "SEI" || n == "CLV") {
+    const int flag = n[2] == 'C'? 0x01: n[2] == 'D'? 0x08: n[2] == 'I'? 0x04: 0x40;
+    if (n[0] == 'S') fprintf(out, "  r->p |= 0x%02X;\n", flag);
+    else fprintf(out, "  r->p &= 0x%02X;\n", (uint8_t)~flag);
+  } else if (n == "PHA") {
+    fprintf(out, "  c->stack[r->sp--] = r->a;\n");
+  } else if (n == "PHP") {
+    fprintf(out, "  c->stack[r->sp--] = r->p | 0x30;\n");
+  } else if (n == "PLA") {
+    fprintf(out, "  r->a = c->stack[++r->sp];\n  sfc_aot_zn(r, r->a);\n");
+  } else if (n == "NOP") {
+  } else if (in.mode == fc::SFC_AM_REL) {
+    static const char* conditions[8] = {
+      "!(r->p & 0x80)", "r->p & 0x80", "!(r->p & 0x40)", "r->p & 0x40",
+      "!(r->p & 0x01)", "r->p & 0x01", "!(r->p & 0x02)", "r->p & 0x02",
+    };
+    const int extra = ((in.next() ^ in.target()) & 0xff00)? 2: 1;
+    // 足够短的向回 BNE 可能是填充或复制循环，交给 CPU 判断（与解释器的 operate_bne 相同）
+    const bool loop = in.name == "BNE" && in.target() < in.next() && in.next() - in.target() <= 9;
+    fprintf(out, "  if (%s) {\n    cyc += %d;\n", conditions[in.opcode >> 5], extra);
+    if (loop) fprintf(out, "    SFC_AOT_LOOP(0x%04X, 0x%04X);\n  }\n", in.target(), in.next());
+    else fprintf(out, "    SFC_AOT_EXIT(0x%04X);\n  }\n", in.target());
+    fprintf(out, "  SFC_AOT_EXIT(0x%04X);\n", in.next());
+    return true;
+  } else if (n == "JMP") {
+    fprintf(out, "  SFC_AOT_EXIT(0x%04X);\n", in.operand());
+    return true;
+  } else if (n == "JSR") {
+    fprintf(out, "  c->stack[r->sp--] = 0x%02X;\n  c->stack[r->sp--] = 0x%02X;\n", (in.addr + 2) >> 8, (in.addr + 2) & 0xff);
+    fprintf(out, "  SFC_AOT_EXIT(0x%04X);\n", in.operand());
+    return true;
+  } else if (n == "RTS") {
+    fprintf(out, "  lo = c->stack[++r->sp];\n  hi = c->stack[++r->sp];\n");
+    fprintf(out, "  SFC_AOT_EXIT((uint16_t)((lo | hi << 8) + 1));\n");
+    return true;
+  }
+  if (indexed && fc::nes_cpu::page_penalty(in.opcode)) {
+    fprintf(out, "  if ((a ^ base) & 0xff00) cyc += 1;\n");
+  }
+  return false;
+}
+
+static bool load_prg(const char* path, std::vector<uint8_t>& prg) {
+  FILE* fp = fopen(path, "rb");
+  if (!fp) {
+    fprintf(stderr, "无法打开 %s\n", path);
+    return false;
+  }
+  fclose(fp);
+  fc::nes_rom_handler rom;
+  rom.load_image(path);
+  rom.parse_to_info();
+  fc::nes_rom_info* info = rom.get_info();
+  const bool ok = info->mapper_number == 0 && (info->prg_rom_count == 1 || info->prg_rom_count == 2);
+  if (ok) prg.assign(info->prg_rom_ptr, info->prg_rom_ptr + info->prg_rom_count * 0x4000);
+  else fprintf(stderr, "只支持 NROM（mapper 0，16K/32K PRG-ROM）\n");
+  rom.unload_image();
+  return ok;
+}
+
+static bool translate(const char* rom_path, const char* out_path) {
+  translator t;
+  if (!load_prg(rom_path, t.prg)) return false;
+  std::vector<uint16_t> roots;
+  roots.push_back(t.byte(fc::nes_cpu::RESET_VECTOR) | t.byte(fc::nes_cpu::RESET_VECTOR + 1) << 8);
+  roots.push_back(t.byte(fc::nes_cpu::NMI_VECTOR) | t.byte(fc::nes_cpu::NMI_VECTOR + 1) << 8);
+  roots.push_back(t.byte(fc::nes_cpu::IRQBRK_VECTOR) | t.byte(fc::nes_cpu::IRQBRK_VECTOR + 1) << 8);
+  // nes_cpu::init 固定从 $C000 开始
+  roots.push_back(0xC000);
+  t.analyze(roots);
+
+  FILE* out = fopen(out_path, "w");
+  if (!out) {
+    fprintf(stderr, "无法创建 %s\n", out_path);
+    return false;
+  }
+  const char* name = strrchr(rom_path, '/')? strrchr(rom_path, '/') + 1: rom_path;
+  fprintf(out, "// 由 tools/aot.cpp 从 %s 生成，不要手工修改\n", name);
+  fprintf(out, "#include <cstdint>\n#include \"nes_aot.h\"\n\n");
+
+  // 每个块的入口与翻译的字节数
+  std::vector<uint16_t> blocks, lengths;
+  uint32_t instructions = 0;
+  for (uint32_t pc=0x8000; pc<=0xffff; pc++) {
+    if (!t.leader[pc & 0x7fff]) continue;
+    const instruction first = t.decode(pc);
+    // 入口就是交给解释器的指令时不生成块
+    if (!translator::translatable(first)) continue;
+    blocks.push_back(pc);
+    fprintf(out, "static void block_%04X(sfc_aot_context* c) {\n", pc);
+    fprintf(out, "  sfc_aot_registers* const r = c->regs;\n  uint64_t cyc = *c->cycle;\n");
+    fprintf(out, "  uint16_t a = 0, base = 0, s = 0;\n  uint8_t v = 0, t = 0, lo = 0, hi = 0;\n");
+    fprintf(out, "  (void)a; (void)base; (void)s; (void)v; (void)t; (void)lo; (void)hi;\n");
+    uint32_t addr = pc;
+    while (true) {
+      const instruction in = t.decode(addr);
+      instructions++;
+      if (emit(out, in)) {
+        addr = in.addr + in.length;
+        break;
+      }
+      addr = in.addr + in.length;
+      // 到达另一个块的入口、交给解释器的指令或地址空间的末尾时离开
+      if (addr > 0xffff || t.leader[addr & 0x7fff] || !translator::translatable(t.decode(addr))) {
+        fprintf(out, "  SFC_AOT_EXIT(0x%04X);\n", addr & 0xffff);
+        break;
+      }
+      fprintf(out, "  SFC_AOT_CHECK(0x%04X);\n", addr);
+    }
+    lengths.push_back(addr - pc);
+    fprintf(out, "}\n\n");
+  }
+
+  fprintf(out, "static const sfc_aot_entry_point blocks[] = {\n");
+  for (size_t i=0; i<blocks.size(); i++) fprintf(out, "  { 0x%04X, %u, block_%04X },\n", blocks[i], (unsigned)lengths[i], blocks[i]);
+  fprintf(out, "};\n\n");
+  fprintf(out, "static const sfc_aot_module module = {\n");
+  fprintf(out, "  %d, 0x%016llxull, %u, %u, blocks,\n", SFC_AOT_ABI_VERSION,
+    (unsigned long long)fc::nes_hash64(&t.prg[0], t.prg.size()), (unsigned)t.prg.size(), (unsigned)blocks.size());
+  fprintf(out, "};\n\n");
+  fprintf(out, "extern \"C\" const sfc_aot_module* sfc_aot_entry() {\n  return &module;\n}\n");
+  fclose(out);
+
+  uint32_t reached = 0;
+  for (size_t i=0; i<t.reached.size(); i++) reached += t.reached[i];
+  printf("%s：可达指令 %u 条，生成 %zu 个块共 %u 条指令\n", out_path, reached, blocks.size(), instructions);
+  return true;
+}
+
+static bool build(const char* include_dir, const char* rom_path, const char* so_path) {
+  const std::string cpp_path = std::string(so_path) + ".cpp";
+  if (!translate(rom_path, cpp_path.c_str())) return false;
+  const char* cxx = getenv("CXX");
+  const std::string command = std::string(cxx && *cxx? cxx: "g++") + " -std=c++11 -O2 -shared -fPIC -I'"
+    + include_dir + "' -o '" + so_path + "' '" + cpp_path + "'";
+  printf("%s\n", command.c_str());
+  const auto start = std::chrono::steady_clock::now();
+  if (system(command.c_str()) != 0) {
+    fprintf(stderr, "编译失败\n");
+    return false;
+  }
+  printf("编译用时 %.2f 秒\n", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  return true;
+}
+
+static bool check(const char* rom_path, const char* so_path, uint64_t frames, const char* movie_path) {
+  fc::nes_movie movie;
+  if (movie_path) {
+    const size_t n = strlen(movie_path);
+    const bool fm2 = n > 4 && !strcmp(movie_path + n - 4, ".fm2");
+    if (!(fm2? movie.load_fm2(movie_path): movie.load(movie_path))) {
+      fprintf(stderr, "无法读取录像 %s\n", movie_path);
+      return false;
+    }
+  }
+  fc::simulator interpreted, compiled;
+  interpreted.load_rom(rom_path);
+  compiled.load_rom(rom_path);
+  const char* error = NULL;
+  if (!compiled.load_aot(so_path, &error)) {
+    fprintf(stderr, "无法加载 %s：%s\n", so_path, error);
+    return false;
+  }
+  fc::simulator* sims[2] = { &interpreted, &compiled };
+  double seconds[2] = { 0, 0 };
+  for (int i=0; i<2; i++) {
+    sims[i]->set_headless(true, 0);
+    if (movie_path) sims[i]->play_movie(&movie);
+  }
+
+  bool same = true;
+  for (uint64_t f=0; f<frames && same; f++) {
+    for (int i=0; i<2; i++) {
+      const auto start = std::chrono::steady_clock::now();
+      sims[i]->run_frame();
+      seconds[i] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    const fc::nes_state_digest a = interpreted.digest(), b = compiled.digest();
+    if (!a.same_state(b)) {
+      printf("第 %llu 帧的状态不一致：解释器 %016llx，预编译 %016llx\n", (unsigned long long)f,
+        (unsigned long long)a.checksum(), (unsigned long long)b.checksum());
+      same = false;
+    }
+  }
+
+  // 快照不带预编译块：保存后卸载再恢复，之后应由解释器继续运行且状态不变
+  if (same) {
+    std::vector<uint8_t> state(compiled.snapshot_size());
+    compiled.save_state(state.data());
+    compiled.unload_aot();
+    compiled.load_state(state.data());
+    const uint64_t blocks = compiled.get_cpu().get_aot_stats().blocks;
+    for (int f=0; f<10; f++) {
+      interpreted.run_frame();
+      compiled.run_frame();
+    }
+    const bool unloaded = compiled.get_cpu().get_aot_stats().blocks == blocks;
+    const bool kept = interpreted.digest().same_state(compiled.digest());
+    printf("卸载预编译块后恢复快照：%s\n", unloaded && kept? "由解释器继续运行，状态一致": "失败");
+    same = unloaded && kept;
+  }
+
+  const fc::nes_aot_stats& stats = compiled.get_cpu().get_aot_stats();
+  printf("解释器：%.1f 帧/秒  预编译：%.1f 帧/秒  (%.2f 倍)\n", frames / seconds[0], frames / seconds[1], seconds[0] / seconds[1]);
+  printf("执行块 %llu 次，交给解释器的指令 %llu 条\n", (unsigned long long)stats.blocks, (unsigned long long)stats.interpreted);
+  printf("%s\n", same? "状态哈希一致": "状态哈希不一致");
+  interpreted.free_rom();
+  compiled.free_rom();
+  return same;
+}
+
+// 从块缓存启动并运行第一帧，缓存中没有时先翻译、编译并写入缓存
+static bool cache(const char* include_dir, const char* rom_path, const char* dir) {
+  const auto start = std::chrono::steady_clock::now();
+  fc::simulator fc;
+  fc.load_rom(rom_path);
+  fc.set_headless(true, 0);
+  const char* error = NULL;
+  const bool warm = fc.load_aot_cache(dir, &error);
+  if (!warm) {
+    printf("缓存未命中：%s\n", error);
+    std::vector<uint8_t> prg;
+    if (!load_prg(rom_path, prg)) return false;
+    const std::string so_path = fc::nes_aot::cache_path(dir, &prg[0], prg.size(), ".so");
+    if (!build(include_dir, rom_path, so_path.c_str())) return false;
+    remove((so_path + ".cpp").c_str());
+    if (!fc.load_aot(so_path.c_str(), &error)) {
+      fprintf(stderr, "无法加载 %s：%s\n", so_path.c_str(), error);
+      return false;
+    }
+    if (!fc.get_aot().save_cache(dir)) {
+      fprintf(stderr, "无法写入块索引\n");
+      return false;
+    }
+  }
+  fc.run_frame();
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("首帧用时 %.2f 毫秒（%s）\n", seconds * 1000, warm? "命中缓存": "冷启动");
+  if (warm) {
+    fc::nes_aot& aot = fc.get_aot();
+    printf("块 %u 个，首帧核对 %u 个，核对失败 %u 个\n", aot.get_count(), aot.get_validated(), aot.get_rejected());
+  }
+  fc.free_rom();
+  return true;
+}
+
+int main(int argc, char** argv) {
+  const char* usage =
+    "用法：%s translate <rom> <输出.cpp>\n"
+    "      %s build [-I 头文件目录] <rom> <输出.so>\n"
+    "      %s check <rom> <模块.so> [帧数] [录像]\n"
+    "      %s cache [-I 头文件目录] <rom> <缓存目录>\n";
+  if (argc >= 4 && !strcmp(argv[1], "translate")) return translate(argv[2], argv[3])? 0: 1;
+  if (argc >= 4 && !strcmp(argv[1], "build")) {
+    const bool custom = !strcmp(argv[2], "-I") && argc >= 6;
+    return build(custom? argv[3]: "include", argv[custom? 4: 2], argv[custom? 5: 3])? 0: 1;
+  }
+  if (argc >= 4 && !strcmp(argv[1], "check")) {
+    const uint64_t frames = argc > 4? strtoull(argv[4], NULL, 10): 600;
+    return check(argv[2], argv[3], frames, argc > 5? argv[5]: NULL)? 0: 1;
+  }
+  if (argc >= 4 && !strcmp(argv[1], "cache")) {
+    const bool custom = !strcmp(argv[2], "-I") && argc >= 6;
+    return cache(custom? argv[3]: "include", argv[custom? 4: 2], argv[custom? 5: 3])? 0: 1;
+  }
+  fprintf(stderr, usage, argv[0], argv[0], argv[0], argv[0]);
+  return 2;
+}
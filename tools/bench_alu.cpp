@@ -0,0 +1,334 @@
+// 查表 ALU（include/nes_alu.h）的校验与基准
+//  - 先对每种 ALU 运算穷举全部 (P, A, 操作数) 组合，与原来按数据分支的实现逐项比对结果与状态寄存器
+//  - 再用随机输入分别统计两种实现每次运算的用时与分支预测失败次数（perf_event，不可用时只报告用时）
+// 编译：g++ -O2 -o bench_alu tools/bench_alu.cpp nes_alu.cpp
+// 用法：bench_alu [每种运算的次数（百万）]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "../include/nes_alu.h"
+
+using namespace fc;
+
+// 原来按数据分支的实现，作为比对的基准
+namespace reference
+{
+  static uint8_t zn(uint8_t p, uint8_t data) {
+    if (!data) p |= SFC_FLAG_Z;
+    else p &= ~SFC_FLAG_Z;
+    if (data & 0x80) p |= SFC_FLAG_S;
+    else p &= ~SFC_FLAG_S;
+    return p;
+  }
+
+  static uint8_t adc(uint8_t& p, uint8_t a, uint8_t data) {
+    const uint16_t result16 = (uint16_t)a + (uint16_t)data + (p & SFC_FLAG_C? 1: 0);
+    const uint8_t result8 = (uint8_t)result16;
+    if (result16 >> 8) p |= SFC_FLAG_C;
+    else p &= ~SFC_FLAG_C;
+    if (!((a ^ data) & 0x80) && ((a ^ result8) & 0x80)) p |= SFC_FLAG_V;
+    else p &= ~SFC_FLAG_V;
+    p = zn(p, result8);
+    return result8;
+  }
+
+  static uint8_t sbc(uint8_t& p, uint8_t a, uint8_t data) {
+    const uint16_t result16 = (uint16_t)a - (uint16_t)data - (p & SFC_FLAG_C? 0: 1);
+    const uint8_t result8 = (uint8_t)result16;
+    if (!(result16 >> 8)) p |= SFC_FLAG_C;
+    else p &= ~SFC_FLAG_C;
+    if (((a ^ data) & 0x80) && ((a ^ result8) & 0x80)) p |= SFC_FLAG_V;
+    else p &= ~SFC_FLAG_V;
+    p = zn(p, result8);
+    return result8;
+  }
+
+  static void cmp(uint8_t& p, uint8_t r, uint8_t data) {
+    const uint16_t result = (uint16_t)r - (uint16_t)data;
+    if (result < 0x100) p |= SFC_FLAG_C;
+    else p &= ~SFC_FLAG_C;
+    p = zn(p, (uint8_t)result);
+  }
+
+  static uint8_t asl(uint8_t& p, uint8_t data) {
+    if (data & 0x80) p |= SFC_FLAG_C;
+    else p &= ~SFC_FLAG_C;
+    data <<= 1;
+    p = zn(p, data);
+    return data;
+  }
+
+  static uint8_t lsr(uint8_t& p, uint8_t data) {
+    if (data & 1) p |= SFC_FLAG_C;
+    else p &= ~SFC_FLAG_C;
+    data >>= 1;
+    p = zn(p, data);
+    return data;
+  }
+
+  static uint8_t rol(uint8_t& p, uint8_t v) {
+    uint16_t data = v;
+    data <<= 1;
+    data |= (p & SFC_FLAG_C);
+    if (data & 0x100) p |= SFC_FLAG_C;
+    else p &= ~SFC_FLAG_C;
+    p = zn(p, (uint8_t)data);
+    return (uint8_t)data;
+  }
+
+  static uint8_t ror(uint8_t& p, uint8_t v) {
+    uint16_t data = v;
+    data |= uint16_t(p & SFC_FLAG_C) << 8;
+    if (data & 1) p |= SFC_FLAG_C;
+    else p &= ~SFC_FLAG_C;
+    data >>= 1;
+    p = zn(p, (uint8_t)data);
+    return (uint8_t)data;
+  }
+
+  static uint8_t rra(uint8_t& p, uint8_t a, uint8_t v) {
+    uint16_t result16 = v;
+    result16 |= (p & SFC_FLAG_C) << 8;
+    const uint8_t carry = result16 & 1;
+    result16 >>= 1;
+    const uint8_t src = (uint8_t)result16;
+    result16 = (uint16_t)a + (uint16_t)src + carry;
+    if (result16 >> 8) p |= SFC_FLAG_C;
+    else p &= ~SFC_FLAG_C;
+    const uint8_t result8 = (uint8_t)result16;
+    if (!((a ^ src) & 0x80) && ((a ^ result8) & 0x80)) p |= SFC_FLAG_V;
+    else p &= ~SFC_FLAG_V;
+    p = zn(p, result8);
+    return result8;
+  }
+
+  static void dcp(uint8_t& p, uint8_t a, uint8_t v) {
+    const uint8_t data = v - 1;
+    const uint16_t result16 = (uint16_t)a - (uint16_t)data;
+    if (!(result16 & 0x8000)) p |= SFC_FLAG_C;
+    else p &= ~SFC_FLAG_C;
+    p = zn(p, (uint8_t)result16);
+  }
+
+  static uint8_t isb(uint8_t& p, uint8_t a, uint8_t v) {
+    const uint8_t data = v + 1;
+    const uint16_t result16 = (uint16_t)a - (uint16_t)data - (p & SFC_FLAG_C? 0: 1);
+    if (!(result16 >> 8)) p |= SFC_FLAG_C;
+    else p &= ~SFC_FLAG_C;
+    const uint8_t result8 = (uint8_t)result16;
+    if (((a ^ data) & 0x80) && ((a ^ result8) & 0x80)) p |= SFC_FLAG_V;
+    else p &= ~SFC_FLAG_V;
+    p = zn(p, result8);
+    return result8;
+  }
+
+  static uint8_t slo(uint8_t& p, uint8_t a, uint8_t v) {
+    if (v & 0x80) p |= SFC_FLAG_C;
+    else p &= ~SFC_FLAG_C;
+    a |= (uint8_t)(v << 1);
+    p = zn(p, a);
+    return a;
+  }
+
+  static uint8_t rla(uint8_t& p, uint8_t a, uint8_t v) {
+    uint16_t result16 = v;
+    result16 <<= 1;
+    result16 |= p & SFC_FLAG_C;
+    if (result16 & 0x100) p |= SFC_FLAG_C;
+    else p &= ~SFC_FLAG_C;
+    a &= (uint8_t)result16;
+    p = zn(p, a);
+    return a;
+  }
+
+  static uint8_t sre(uint8_t& p, uint8_t a, uint8_t v) {
+    if (v & 1) p |= SFC_FLAG_C;
+    else p &= ~SFC_FLAG_C;
+    a ^= v >> 1;
+    p = zn(p, a);
+    return a;
+  }
+}
+
+// 查表实现，与 nes_cpu 中各指令的组合方式相同
+namespace table
+{
+  static uint8_t rra(uint8_t& p, uint8_t a, uint8_t v) {
+    const uint8_t data = nes_alu_ror(p, v);
+    return nes_alu_adc(p, a, data);
+  }
+
+  static void dcp(uint8_t& p, uint8_t a, uint8_t v) {
+    nes_alu_cmp(p, a, v - 1);
+  }
+
+  static uint8_t isb(uint8_t& p, uint8_t a, uint8_t v) {
+    return nes_alu_sbc(p, a, v + 1);
+  }
+
+  static uint8_t slo(uint8_t& p, uint8_t a, uint8_t v) {
+    a |= nes_alu_asl(p, v);
+    p = nes_alu_zn(p, a);
+    return a;
+  }
+
+  static uint8_t rla(uint8_t& p, uint8_t a, uint8_t v) {
+    a &= nes_alu_rol(p, v);
+    p = nes_alu_zn(p, a);
+    return a;
+  }
+
+  static uint8_t sre(uint8_t& p, uint8_t a, uint8_t v) {
+    a ^= nes_alu_lsr(p, v);
+    p = nes_alu_zn(p, a);
+    return a;
+  }
+}
+
+// 一种运算：输入 P、A 与操作数，输出结果，P 原地更新
+typedef uint8_t (*alu_op)(uint8_t& p, uint8_t a, uint8_t v);
+
+struct alu_case {
+  const char* name;
+  alu_op branchy;
+  alu_op tabled;
+};
+
+#define BINARY(f) [](uint8_t& p, uint8_t a, uint8_t v) -> uint8_t { return f(p, a, v); }
+#define COMPARE(f) [](uint8_t& p, uint8_t a, uint8_t v) -> uint8_t { f(p, a, v); return 0; }
+#define UNARY(f) [](uint8_t& p, uint8_t, uint8_t v) -> uint8_t { return f(p, v); }
+
+static const alu_case cases[] = {
+  { "adc", BINARY(reference::adc), BINARY(nes_alu_adc) },
+  { "sbc", BINARY(reference::sbc), BINARY(nes_alu_sbc) },
+  { "cmp", COMPARE(reference::cmp), COMPARE(nes_alu_cmp) },
+  { "asl", UNARY(reference::asl), UNARY(nes_alu_asl) },
+  { "lsr", UNARY(reference::lsr), UNARY(nes_alu_lsr) },
+  { "rol", UNARY(reference::rol), UNARY(nes_alu_rol) },
+  { "ror", UNARY(reference::ror), UNARY(nes_alu_ror) },
+  { "rra", BINARY(reference::rra), BINARY(table::rra) },
+  { "dcp", COMPARE(reference::dcp), COMPARE(table::dcp) },
+  { "isb", BINARY(reference::isb), BINARY(table::isb) },
+  { "slo", BINARY(reference::slo), BINARY(table::slo) },
+  { "rla", BINARY(reference::rla), BINARY(table::rla) },
+  { "sre", BINARY(reference::sre), BINARY(table::sre) },
+};
+static const int CASES = sizeof(cases) / sizeof(cases[0]);
+
+// 穷举全部 2^24 种输入
+static bool verify(const alu_case& c) {
+  for (int p=0; p<256; p++) {
+    for (int a=0; a<256; a++) {
+      for (int v=0; v<256; v++) {
+        uint8_t p1 = p, p2 = p;
+        const uint8_t r1 = c.branchy(p1, a, v);
+        const uint8_t r2 = c.tabled(p2, a, v);
+        if (r1 != r2 || p1 != p2) {
+          printf("%s 不一致：P=%02X A=%02X v=%02X  分支 %02X/%02X  查表 %02X/%02X\n", c.name, p, a, v, r1, p1, r2, p2);
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// 本线程用户态的分支预测失败计数
+struct branch_counter {
+  int fd;
+
+  branch_counter() {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+  ~branch_counter() { if (fd >= 0) close(fd); }
+  bool available() { return fd >= 0; }
+  void start() {
+    if (fd < 0) return;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  uint64_t stop() {
+    uint64_t count = 0;
+    if (fd < 0) return 0;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) return 0;
+    return count;
+  }
+};
+
+// 一次测量的结果
+struct measurement {
+  double ns;
+  double misses;
+};
+
+// 每次测量的 P 与结果累加到这里，写入 volatile 变量，不会被优化掉
+static volatile uint64_t sink;
+
+// 对随机输入连续运算，P 与结果串联起来，防止被优化掉
+static measurement measure(alu_op op, const std::vector<uint8_t>& input, uint64_t count, branch_counter& counter) {
+  const size_t n = input.size() / 2;
+  uint8_t p = 0x24, acc = 0;
+  counter.start();
+  const auto start = std::chrono::steady_clock::now();
+  for (uint64_t i=0; i<count; i++) {
+    const size_t k = i % n;
+    // 进位取自随机输入，让 ADC/SBC 与循环移位的两种进位都出现
+    p = (p & ~SFC_FLAG_C) | (input[2 * k] & SFC_FLAG_C);
+    acc ^= op(p, input[2 * k], input[2 * k + 1]);
+  }
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  const uint64_t misses = counter.stop();
+  sink = sink + acc + p;
+  measurement m;
+  m.ns = seconds * 1e9 / count;
+  m.misses = (double)misses / count;
+  return m;
+}
+
+int main(int argc, char const *argv[])
+{
+  const uint64_t count = (argc > 1? atoi(argv[1]): 50) * 1000000ull;
+
+  bool ok = true;
+  for (int i=0; i<CASES; i++) {
+    const auto start = std::chrono::steady_clock::now();
+    const bool same = verify(cases[i]);
+    printf("%s：穷举 16777216 种输入%s（%.2f 秒）\n", cases[i].name, same? "一致": "不一致",
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    ok = ok && same;
+  }
+  if (!ok) return 1;
+
+  srand(0x6502);
+  std::vector<uint8_t> input(1 << 16);
+  for (size_t i=0; i<input.size(); i++) input[i] = rand() & 0xff;
+  branch_counter counter;
+  if (!counter.available()) printf("无法打开 perf_event，只报告用时\n");
+
+  printf("%-6s %12s %12s %14s %14s\n", "运算", "分支 ns", "查表 ns", "分支 失败/次", "查表 失败/次");
+  for (int i=0; i<CASES; i++) {
+    const measurement b = measure(cases[i].branchy, input, count, counter);
+    const measurement t = measure(cases[i].tabled, input, count, counter);
+    if (counter.available()) {
+      printf("%-6s %12.3f %12.3f %14.4f %14.4f\n", cases[i].name, b.ns, t.ns, b.misses, t.misses);
+    } else {
+      printf("%-6s %12.3f %12.3f %14s %14s\n", cases[i].name, b.ns, t.ns, "-", "-");
+    }
+  }
+  return 0;
+}
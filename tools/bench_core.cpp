@@ -0,0 +1,360 @@
+// CPU、内存总线与反汇编器的微基准，以及整个 ROM 的运行速度
+// 编译：g++ -O2 -o bench_core tools/bench_core.cpp $(ls *.cpp | grep -v main.cpp) -lpthread
+// 用法：bench_core [--format csv|json] [--out 文件] [--label 标签] [--quick] [--synthetic [次数]] [--no-idioms] [rom[:帧数]]...
+//   每个 rom 以无画面模式运行（默认 600 帧），例如 nestest.nes
+//   --synthetic 逐一生成 include/nes_workload.h 中的合成负载（外层循环默认 1000 次），
+//   运行到程序写入完成标记为止，报告运行速度与所用周期数（suite 为 workload）
+//   rom 与 workload 另外报告每种循环惯用法整块执行的指令数（metric 为 idiom_<种类>），
+//   --no-idioms 关闭循环惯用法的整块执行以便比较
+// 输出格式（schema sfc-bench-1，字段与含义保持稳定，便于跨提交比较）：
+//   CSV：schema,label,suite,name,metric,value,unit，每行一个结果
+//   JSON：{"schema":"sfc-bench-1","label":...,"results":[{"suite":...,"name":...,"metric":...,"value":...,"unit":...}]}
+//   suite 为 opcode / mode / memory / disasm / rom / workload
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+#include "../include/simulator.h"
+#include "../include/nes_nrom_mapper.h"
+#include "../include/nes_6502.h"
+#include "../include/nes_workload.h"
+#include <unistd.h>
+
+#define SFC_BENCH_SCHEMA "sfc-bench-1"
+
+struct bench_result {
+  std::string suite, name, metric;
+  double value;
+  const char* unit;
+};
+
+static std::vector<bench_result> results;
+// 是否整块执行循环惯用法
+static bool idioms = true;
+// 每项测量的次数
+static uint64_t iterations = 1 << 20;
+
+static void add_result(const char* suite, const std::string& name, const char* metric, double value, const char* unit) {
+  bench_result r = { suite, name, metric, value, unit };
+  results.push_back(r);
+  fprintf(stderr, "%-8s %-20s %-14s %12.2f %s\n", suite, name.c_str(), metric, value, unit);
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 不经过 simulator 直接搭起 CPU 与内存总线，32KB 的 PRG 位于可写的宿主内存中
+struct bench_machine {
+  uint8_t prg[32 * 1024];
+  fc::nes_rom_info info;
+  fc::nes_nrom_mapper mapper;
+  fc::nes_memory_pool memory;
+  fc::nes_cpu cpu;
+  fc::nes_ppu ppu;
+  fc::nes_apu apu;
+  fc::nes_scheduler scheduler;
+  fc::nes_joypad joypad;
+
+  void init() {
+    memset(&info, 0, sizeof(info));
+    info.prg_rom_ptr = prg;
+    info.prg_rom_count = 2;
+    joypad.init();
+    memory.init(&info, &mapper, &ppu, &apu, &joypad);
+    cpu.init(&memory);
+    scheduler.init(&cpu.get_clock());
+    ppu.init(&info, &scheduler);
+    apu.init(&scheduler, &memory);
+  }
+
+  // 写入 PRG 中的 CPU 地址 addr
+  uint8_t* at(uint16_t addr) { return prg + (addr & 0x7fff); }
+};
+
+// 为 opcode 生成一段可以无限循环执行的程序，不能构造时返回 false
+/*
+  程序从 $C000 开始（nes_cpu::init 会把 PC 设为 $C000），由同一条指令重复 256 次后跟 JMP $C000 组成。
+  操作数只指向主内存：零页与绝对地址分别为 $10 与 $0200，零页交替填入 $00/$03 使 (zp,X) 与 (zp),Y 指向 $0300 或 $0003。
+  分支偏移为 0，JMP/JSR 跳到下一条；RTS/RTI/BRK/JMP (ind) 借助栈内容、向量或指针回到同一条指令。
+*/
+static bool build_stream(bench_machine& m, uint8_t opcode) {
+  if (!fc::nes_cpu::implemented(opcode)) return false;
+  memset(m.prg, 0xEA, sizeof(m.prg));
+  uint8_t* ram = m.memory.get_main_memory();
+  for (int i=0; i<256; i++) ram[i] = i & 1? 0x03: 0x00;
+  memset(ram + 0x100, 0, 0x700);
+
+  const uint8_t mode = fc::addressing_mode(opcode);
+  uint16_t pc = 0xC000;
+  switch (opcode) {
+  case 0x00:
+    // BRK：向量指向 $8080，整个 PRG 都是 BRK
+    memset(m.prg, 0x00, sizeof(m.prg));
+    *m.at(0xFFFE) = 0x80;
+    *m.at(0xFFFF) = 0x80;
+    return true;
+  case 0x40:
+    // RTI：栈中全是 $80，弹出 P=$80、PC=$8080，整个 PRG 都是 RTI
+    memset(m.prg, 0x40, sizeof(m.prg));
+    memset(ram + 0x100, 0x80, 0x100);
+    return true;
+  case 0x60:
+    // RTS：栈中交替为 $FF/$BF，返回 $BFFF+1=$C000
+    for (int i=0; i<256; i++) ram[0x100 + i] = i & 1? 0xBF: 0xFF;
+    *m.at(pc) = 0x60;
+    return true;
+  case 0x6C:
+    // JMP ($0200)，指针指向自己
+    ram[0x200] = 0x00;
+    ram[0x201] = 0xC0;
+    *m.at(pc) = 0x6C; *m.at(pc + 1) = 0x00; *m.at(pc + 2) = 0x02;
+    return true;
+  }
+
+  for (int i=0; i<256; i++) {
+    *m.at(pc) = opcode;
+    switch (mode) {
+    case fc::SFC_AM_IMM: case fc::SFC_AM_ZPG: case fc::SFC_AM_ZPX: case fc::SFC_AM_ZPY:
+    case fc::SFC_AM_INX: case fc::SFC_AM_INY:
+      *m.at(pc + 1) = 0x10;
+      pc += 2;
+      break;
+    case fc::SFC_AM_REL:
+      *m.at(pc + 1) = 0x00;
+      pc += 2;
+      break;
+    case fc::SFC_AM_ABS: case fc::SFC_AM_ABX: case fc::SFC_AM_ABY: {
+      // JMP/JSR 跳到下一条
+      const bool jump = opcode == 0x4C || opcode == 0x20;
+      const uint16_t target = jump? pc + 3: 0x0200;
+      *m.at(pc + 1) = target & 0xff;
+      *m.at(pc + 2) = target >> 8;
+      pc += 3;
+      break;
+    }
+    default:
+      pc += 1;
+    }
+  }
+  *m.at(pc) = 0x4C; *m.at(pc + 1) = 0x00; *m.at(pc + 2) = 0xC0;
+  return true;
+}
+
+static void bench_opcodes(bench_machine& m) {
+  double mode_seconds[fc::SFC_AM_REL + 1] = {0};
+  uint64_t mode_count[fc::SFC_AM_REL + 1] = {0};
+  for (int op=0; op<256; op++) {
+    if (!build_stream(m, op)) continue;
+    m.cpu.init(&m.memory);
+    // 预热
+    for (int i=0; i<4096; i++) m.cpu.execute();
+    const uint64_t cycle = m.cpu.get_cycle();
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i=0; i<iterations; i++) m.cpu.execute();
+    const double seconds = seconds_since(start);
+
+    char name[OP_BUF_LEN];
+    memset(name, ' ', sizeof(name));
+    fc::nes_code code;
+    code.op = op;
+    fc::disassemble(code, name);
+    const uint8_t mode = fc::addressing_mode(op);
+    char label[32];
+    snprintf(label, sizeof(label), "%02X %.3s %s", op, name, fc::addressing_mode_name(mode));
+    add_result("opcode", label, "throughput", iterations / seconds / 1e6, "Minstr/s");
+    add_result("opcode", label, "cycles", (double)(m.cpu.get_cycle() - cycle) / iterations, "cycles/instr");
+    mode_seconds[mode] += seconds;
+    mode_count[mode] += iterations;
+  }
+  for (int mode=fc::SFC_AM_ACC; mode<=fc::SFC_AM_REL; mode++) {
+    if (!mode_count[mode]) continue;
+    add_result("mode", fc::addressing_mode_name(mode), "throughput", mode_count[mode] / mode_seconds[mode] / 1e6, "Minstr/s");
+  }
+}
+
+static void bench_memory(bench_machine& m) {
+  m.cpu.init(&m.memory);
+  struct region { const char* name; uint16_t base; uint16_t size; bool writable; };
+  // I/O 区域只测试没有副作用的寄存器
+  static const region regions[] = {
+    { "ram",        0x0000, 0x0800, true },
+    { "ram_mirror", 0x0800, 0x1800, true },
+    { "ppu_2002",   0x2002, 1,      false },
+    { "apu_4015",   0x4015, 1,      false },
+    { "sram",       0x6000, 0x2000, true },
+    { "prg_rom",    0x8000, 0x8000, false },
+  };
+  uint16_t addrs[4096];
+  for (size_t r=0; r<sizeof(regions)/sizeof(regions[0]); r++) {
+    for (int i=0; i<4096; i++) addrs[i] = regions[r].base + rand() % regions[r].size;
+    uint32_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i=0; i<iterations; i++) sum += m.memory.read(addrs[i & 4095]);
+    add_result("memory", regions[r].name, "read", iterations / seconds_since(start) / 1e6, "Maccess/s");
+    if (sum == 1) fprintf(stderr, " ");
+    if (!regions[r].writable) continue;
+    start = std::chrono::steady_clock::now();
+    for (uint64_t i=0; i<iterations; i++) m.memory.write(addrs[i & 4095], (uint8_t)i);
+    add_result("memory", regions[r].name, "write", iterations / seconds_since(start) / 1e6, "Maccess/s");
+  }
+}
+
+static void bench_disasm(bench_machine& m) {
+  for (size_t i=0; i<sizeof(m.prg); i++) m.prg[i] = rand();
+  m.cpu.init(&m.memory);
+  char buf[OP_BUF_LEN];
+  uint32_t sum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i=0; i<iterations; i++) {
+    fc::nes_code code;
+    code.data = (uint32_t)(i * 2654435761u);
+    sum += fc::disassemble(code, buf);
+  }
+  add_result("disasm", "disassemble", "throughput", iterations / seconds_since(start) / 1e6, "Mlines/s");
+
+  uint8_t bytes[3];
+  start = std::chrono::steady_clock::now();
+  for (uint64_t i=0; i<iterations; i++) sum += m.cpu.disassemble_op(0x8000 | (i & 0x7fff), buf, bytes);
+  add_result("disasm", "disassemble_op", "throughput", iterations / seconds_since(start) / 1e6, "Mlines/s");
+  if (sum == 1) fprintf(stderr, " ");
+}
+
+static void add_idiom_results(const char* suite, const std::string& name, fc::nes_cpu& cpu) {
+  static const char* metrics[fc::SFC_IDIOM_COUNT] = { "idiom_clear", "idiom_memset", "idiom_memcpy" };
+  for (int k=0; k<fc::SFC_IDIOM_COUNT; k++) {
+    add_result(suite, name, metrics[k], cpu.get_idiom_stats().instructions[k], "instr");
+  }
+}
+
+static bool bench_rom(const char* arg) {
+  std::string path = arg;
+  uint64_t frames = 600;
+  const size_t colon = path.rfind(':');
+  if (colon != std::string::npos && colon + 1 < path.size()) {
+    frames = strtoull(path.c_str() + colon + 1, NULL, 10);
+    path.resize(colon);
+  }
+  FILE* fp = fopen(path.c_str(), "rb");
+  if (!fp) {
+    fprintf(stderr, "无法打开 %s\n", path.c_str());
+    return false;
+  }
+  fclose(fp);
+  std::string name = path.substr(path.find_last_of('/') == std::string::npos? 0: path.find_last_of('/') + 1);
+
+  fc::simulator fc;
+  fc.load_rom(path.c_str());
+  fc.set_headless(true, 0);
+  fc.get_cpu().set_idioms(idioms);
+  const uint64_t cycle = fc.get_cpu().get_cycle();
+  const auto start = std::chrono::steady_clock::now();
+  for (uint64_t i=0; i<frames; i++) fc.run_frame();
+  const double seconds = seconds_since(start);
+  add_result("rom", name, "fps", frames / seconds, "frames/s");
+  add_result("rom", name, "speed", (fc.get_cpu().get_cycle() - cycle) / seconds / 1e6, "MHz");
+  add_idiom_results("rom", name, fc.get_cpu());
+  fc.free_rom();
+  return true;
+}
+
+static bool bench_workload(int kind, uint16_t iterations) {
+  const fc::nes_workload_params params = { kind, iterations, 0 };
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/sfc_workload_%d_%s.nes", (int)getpid(), fc::nes_workload_name(kind));
+  if (!fc::nes_workload_write(params, path)) {
+    fprintf(stderr, "无法写入 %s\n", path);
+    return false;
+  }
+
+  fc::simulator fc;
+  fc.load_rom(path);
+  unlink(path);
+  fc.set_headless(true, 0);
+  fc.get_cpu().set_idioms(idioms);
+  // 只有 $0700 页走慢速路径，对其余负载的速度没有影响
+  fc.get_debugger().add_watchpoint(SFC_WORKLOAD_DONE_ADDR, 1, fc::SFC_WATCH_WRITE, "VALUE == $A5");
+  const auto start = std::chrono::steady_clock::now();
+  while (!fc.stopped()) fc.run_frame();
+  const double seconds = seconds_since(start);
+  const uint64_t cycles = fc.get_cpu().get_cycle();
+  add_result("workload", fc::nes_workload_name(kind), "speed", cycles / seconds / 1e6, "MHz");
+  add_result("workload", fc::nes_workload_name(kind), "cycles", cycles, "cycles");
+  add_idiom_results("workload", fc::nes_workload_name(kind), fc.get_cpu());
+  fc.free_rom();
+  return true;
+}
+
+static void write_csv(FILE* out, const char* label) {
+  fprintf(out, "schema,label,suite,name,metric,value,unit\n");
+  for (size_t i=0; i<results.size(); i++) {
+    const bench_result& r = results[i];
+    fprintf(out, "%s,%s,%s,%s,%s,%.6g,%s\n", SFC_BENCH_SCHEMA, label,
+      r.suite.c_str(), r.name.c_str(), r.metric.c_str(), r.value, r.unit);
+  }
+}
+
+static void write_json(FILE* out, const char* label) {
+  fprintf(out, "{\"schema\":\"%s\",\"label\":\"%s\",\"results\":[\n", SFC_BENCH_SCHEMA, label);
+  for (size_t i=0; i<results.size(); i++) {
+    const bench_result& r = results[i];
+    fprintf(out, "  {\"suite\":\"%s\",\"name\":\"%s\",\"metric\":\"%s\",\"value\":%.6g,\"unit\":\"%s\"}%s\n",
+      r.suite.c_str(), r.name.c_str(), r.metric.c_str(), r.value, r.unit, i + 1 < results.size()? ",": "");
+  }
+  fprintf(out, "]}\n");
+}
+
+int main(int argc, char** argv) {
+  const char* format = "csv";
+  const char* out_path = NULL;
+  const char* label = "";
+  std::vector<const char*> roms;
+  int synthetic = 0;
+  for (int i=1; i<argc; i++) {
+    if (!strcmp(argv[i], "--format") && i + 1 < argc) format = argv[++i];
+    else if (!strcmp(argv[i], "--out") && i + 1 < argc) out_path = argv[++i];
+    else if (!strcmp(argv[i], "--label") && i + 1 < argc) label = argv[++i];
+    else if (!strcmp(argv[i], "--quick")) iterations = 1 << 16;
+    else if (!strcmp(argv[i], "--no-idioms")) idioms = false;
+    else if (!strcmp(argv[i], "--synthetic")) {
+      synthetic = 1000;
+      if (i + 1 < argc && atoi(argv[i + 1]) > 0) synthetic = atoi(argv[++i]);
+    }
+    else roms.push_back(argv[i]);
+  }
+  if (strcmp(format, "csv") && strcmp(format, "json")) {
+    fprintf(stderr, "用法：%s [--format csv|json] [--out 文件] [--label 标签] [--quick] [--synthetic [次数]] [--no-idioms] [rom[:帧数]]...\n", argv[0]);
+    return 2;
+  }
+
+  srand(1);
+  // 内存池按缓存行对齐，普通的 new 不保证这一点
+  void* slot = NULL;
+  if (posix_memalign(&slot, alignof(bench_machine), sizeof(bench_machine))) {
+    fprintf(stderr, "无法分配 %zu 字节\n", sizeof(bench_machine));
+    return 1;
+  }
+  bench_machine* m = new (slot) bench_machine();
+  m->init();
+  bench_opcodes(*m);
+  bench_memory(*m);
+  bench_disasm(*m);
+  m->~bench_machine();
+  free(slot);
+  bool ok = true;
+  for (int k=0; synthetic && k<fc::SFC_WORKLOAD_COUNT; k++) ok = bench_workload(k, synthetic) && ok;
+  for (size_t i=0; i<roms.size(); i++) ok = bench_rom(roms[i]) && ok;
+
+  FILE* out = out_path? fopen(out_path, "w"): stdout;
+  if (!out) {
+    fprintf(stderr, "无法创建 %s\n", out_path);
+    return 2;
+  }
+  if (!strcmp(format, "csv")) write_csv(out, label);
+  else write_json(out, label);
+  if (out != stdout) fclose(out);
+  return ok? 0: 1;
+}
@@ -0,0 +1,109 @@
+// 调色板转换的基准测试
+//  - 先用随机画面逐字节比对各实现与标量实现在每种格式、每种放大倍数下的输出
+//  - 再分别统计单核每秒能转换的帧数
+// 编译：g++ -O2 -o bench_palette tools/bench_palette.cpp nes_palette.cpp
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include "../include/nes_palette.h"
+
+static const char* format_names[] = { "rgba8888", "rgb565", "yuv420" };
+
+// 按格式与放大倍数分配的输出缓冲区
+struct output_buffer {
+  uint8_t* data;
+  size_t size;
+  fc::nes_video_target target;
+
+  void init(fc::sfc_pixel_format format, int scale) {
+    const size_t w = 256 * scale, h = 240 * scale;
+    target.format = format;
+    target.scale = scale;
+    switch (format) {
+    case fc::SFC_PIXEL_RGBA8888:
+      size = w * h * 4;
+      target.pitch[0] = w * 4;
+      break;
+    case fc::SFC_PIXEL_RGB565:
+      size = w * h * 2;
+      target.pitch[0] = w * 2;
+      break;
+    case fc::SFC_PIXEL_YUV420:
+      size = w * h + w * h / 2;
+      target.pitch[0] = w;
+      target.pitch[1] = target.pitch[2] = w / 2;
+      break;
+    }
+    data = (uint8_t*)calloc(1, size);
+    target.planes[0] = data;
+    target.planes[1] = data + w * h;
+    target.planes[2] = data + w * h + w * h / 4;
+  }
+};
+
+static void random_frame(uint8_t* pixels, uint8_t* emphasis) {
+  for (int i=0; i<240*256; i++) pixels[i] = rand() & 0x3f;
+  for (int i=0; i<240; i++) emphasis[i] = rand() % 4? 0: rand() & 7;
+}
+
+int main(int argc, char const *argv[])
+{
+  const int frames = argc > 1? atoi(argv[1]): 2000;
+  srand(0x6502);
+
+  const fc::nes_color_kernels* list[4];
+  const int count = fc::nes_color_kernels_available(list, 4);
+
+  static uint8_t pixels[240 * 256];
+  static uint8_t emphasis[240];
+  static fc::nes_color_converter ref, conv;
+  ref.init(NULL, &fc::nes_color_kernels_scalar());
+
+  bool ok = true;
+  for (int k=1; k<count; k++) {
+    conv.init(NULL, list[k]);
+    for (int f=0; f<3; f++) {
+      for (int scale=1; scale<=SFC_PALETTE_MAX_SCALE; scale++) {
+        output_buffer a, b;
+        a.init((fc::sfc_pixel_format)f, scale);
+        b.init((fc::sfc_pixel_format)f, scale);
+        for (int r=0; r<20; r++) {
+          random_frame(pixels, emphasis);
+          ref.convert(pixels, emphasis, a.target);
+          conv.convert(pixels, emphasis, b.target);
+          if (memcmp(a.data, b.data, a.size)) {
+            printf("%s: %s %dx 与标量实现不一致\n", list[k]->name, format_names[f], scale);
+            ok = false;
+            break;
+          }
+        }
+        free(a.data);
+        free(b.data);
+      }
+    }
+  }
+  if (!ok) return 1;
+
+  random_frame(pixels, emphasis);
+  printf("%-8s %-9s %5s %12s %10s\n", "kernel", "format", "scale", "frames/s", "speedup");
+  for (int f=0; f<3; f++) {
+    for (int scale=1; scale<=SFC_PALETTE_MAX_SCALE; scale++) {
+      output_buffer out;
+      out.init((fc::sfc_pixel_format)f, scale);
+      double base = 0;
+      for (int k=0; k<count; k++) {
+        conv.init(NULL, list[k]);
+        const auto start = std::chrono::steady_clock::now();
+        for (int i=0; i<frames; i++) conv.convert(pixels, emphasis, out.target);
+        const double seconds = std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count();
+        const double fps = frames / seconds;
+        if (k == 0) base = fps;
+        printf("%-8s %-9s %4dx %12.0f %9.2fx\n", list[k]->name, format_names[f], scale, fps, fps / base);
+      }
+      free(out.data);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,123 @@
+// PPU 合成内核的微基准测试
+//  - 先用随机扫描线逐位比对各实现与标量实现的输出
+//  - 再分别统计每条扫描线（背景解码 + 8 个精灵叠加 + 合成）的耗时
+// 编译：g++ -O2 -o bench_ppu_render tools/bench_ppu_render.cpp nes_ppu_render.cpp
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include "../include/nes_ppu_render.h"
+
+// 一条随机生成的扫描线输入
+struct scanline_case {
+  uint8_t plane0[SFC_BG_TILES_PER_LINE];
+  uint8_t plane1[SFC_BG_TILES_PER_LINE];
+  uint8_t attr[SFC_BG_TILES_PER_LINE];
+  uint8_t fine_x;
+  uint8_t spr_plane0[8];
+  uint8_t spr_plane1[8];
+  uint8_t spr_flags[8];
+  uint8_t spr_x[8];
+  int spr_count;
+  uint8_t palette[32];
+  uint8_t mask;
+};
+
+static void random_case(scanline_case& c) {
+  for (int i=0; i<SFC_BG_TILES_PER_LINE; i++) {
+    c.plane0[i] = rand();
+    c.plane1[i] = rand();
+    c.attr[i] = rand() & 3;
+  }
+  c.fine_x = rand() & 7;
+  c.spr_count = rand() % 9;
+  for (int i=0; i<8; i++) {
+    c.spr_plane0[i] = rand();
+    c.spr_plane1[i] = rand();
+    c.spr_flags[i] = (rand() & 3) | (rand() & 1? fc::SFC_SPR_BEHIND: 0);
+    c.spr_x[i] = rand();
+  }
+  if (rand() & 1) c.spr_flags[0] |= fc::SFC_SPR_ZERO;
+  for (int i=0; i<32; i++) c.palette[i] = rand() & 0x3f;
+  c.mask = rand() & 0x1f;
+}
+
+// 用指定内核完整渲染一条扫描线，返回 0 号精灵命中位置
+static int run_case(
+  const fc::nes_ppu_kernels& k, const scanline_case& c,
+  uint8_t* bg, uint8_t* spr, uint8_t* out
+) {
+  k.render_bg(c.plane0, c.plane1, c.attr, c.fine_x, bg);
+  memset(spr, 0, SFC_SPRITE_LINE_LEN);
+  for (int i=0; i<c.spr_count; i++) {
+    k.overlay_sprite(spr, c.spr_plane0[i], c.spr_plane1[i], c.spr_flags[i], c.spr_x[i]);
+  }
+  return k.compose(bg, spr, c.palette, c.mask, out);
+}
+
+static bool verify(const fc::nes_ppu_kernels& k, int rounds) {
+  const fc::nes_ppu_kernels& ref = fc::nes_ppu_kernels_scalar();
+  scanline_case c;
+  uint8_t bg0[256], spr0[SFC_SPRITE_LINE_LEN], out0[256];
+  uint8_t bg1[256], spr1[SFC_SPRITE_LINE_LEN], out1[256];
+  uint8_t dec0[SFC_BG_TILES_PER_LINE * 8], dec1[SFC_BG_TILES_PER_LINE * 8];
+
+  for (int r=0; r<rounds; r++) {
+    random_case(c);
+    const int count = 1 + r % SFC_BG_TILES_PER_LINE;
+    ref.decode_tiles(c.plane0, c.plane1, c.attr, count, dec0);
+    k.decode_tiles(c.plane0, c.plane1, c.attr, count, dec1);
+    const int hit0 = run_case(ref, c, bg0, spr0, out0);
+    const int hit1 = run_case(k, c, bg1, spr1, out1);
+    if (memcmp(dec0, dec1, count * 8)
+      || memcmp(bg0, bg1, sizeof(bg0))
+      || memcmp(spr0, spr1, sizeof(spr0))
+      || memcmp(out0, out1, sizeof(out0))
+      || hit0 != hit1) {
+      printf("%s: 第 %d 轮与标量实现不一致 (hit %d / %d)\n", k.name, r, hit0, hit1);
+      return false;
+    }
+  }
+  return true;
+}
+
+static double bench(const fc::nes_ppu_kernels& k, const scanline_case* cases, int n, int lines) {
+  uint8_t bg[256], spr[SFC_SPRITE_LINE_LEN], out[256];
+  int sink = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i=0; i<lines; i++) {
+    sink += run_case(k, cases[i % n], bg, spr, out);
+    sink += out[i & 0xff];
+  }
+  const auto end = std::chrono::steady_clock::now();
+  if (sink == 0x7fffffff) puts("");
+  return std::chrono::duration<double, std::nano>(end - start).count() / lines;
+}
+
+int main(int argc, char const *argv[])
+{
+  const int lines = argc > 1? atoi(argv[1]): 2000000;
+  srand(0x6502);
+
+  const fc::nes_ppu_kernels* list[4];
+  const int count = fc::nes_ppu_kernels_available(list, 4);
+
+  bool ok = true;
+  for (int i=1; i<count; i++) ok = verify(*list[i], 100000) && ok;
+  if (!ok) return 1;
+
+  static scanline_case cases[1024];
+  for (int i=0; i<1024; i++) {
+    random_case(cases[i]);
+    cases[i].spr_count = 8;
+  }
+
+  printf("%-8s %12s %14s %10s\n", "kernel", "ns/line", "frames/s", "speedup");
+  double base = 0;
+  for (int i=0; i<count; i++) {
+    const double ns = bench(*list[i], cases, 1024, lines);
+    if (i == 0) base = ns;
+    printf("%-8s %12.2f %14.0f %9.2fx\n", list[i]->name, ns, 1e9 / (ns * 240), base / ns);
+  }
+  return 0;
+}
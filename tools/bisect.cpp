@@ -0,0 +1,256 @@
+// 找出两个构建（或同一构建的两种配置）第一条产生不同状态的指令
+//  1. 两边逐帧运行，每隔若干帧比较一次状态摘要并保存快照
+//  2. 从最后一个一致的快照开始按指令数倍增步长，找到包含分歧的区间
+//  3. 在区间内二分，每次一致时把快照前移，总共重新执行的指令数不超过区间长度的两倍
+//  4. 从最后一个一致的检查点重新执行，输出分歧之前的若干条指令、分歧指令的反汇编与执行后的状态差异
+// 编译：g++ -O2 -o bisect tools/bisect.cpp $(ls *.cpp | grep -v main.cpp) -ldl -lpthread
+// 用法：bisect <rom> <构建 a> <构建 b> [最大帧数] [检查间隔帧数] [--ignore-video]
+//  - 构建为插件共享库的路径，或 builtin 表示本程序自带的构建，可以追加 :选项（见 nes_plugin.h）
+//  - 例如：bisect game.nes builtin builtin:headless --ignore-video
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <dlfcn.h>
+#include "../include/nes_plugin.h"
+#include "../include/nes_6502.h"
+
+// 报告中分歧指令之前显示的指令数
+static const uint64_t CONTEXT = 16;
+
+// 一个被比较的模拟器实例
+struct engine {
+  const char* spec = NULL;
+  const sfc_plugin_api* api = NULL;
+  void* lib = NULL;
+  void* instance = NULL;
+  // 二分时前移的快照
+  uint8_t* snapshot = NULL;
+  // 最后一个一致的检查点
+  uint8_t* origin = NULL;
+
+  bool open(const char* spec, const char* rom) {
+    this->spec = spec;
+    std::string path = spec;
+    std::string config;
+    const size_t colon = path.find(':');
+    if (colon != std::string::npos) {
+      config = path.substr(colon + 1);
+      path = path.substr(0, colon);
+    }
+
+    if (path == "builtin") {
+      api = sfc_plugin_entry();
+    } else {
+      lib = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+      if (!lib) {
+        fprintf(stderr, "%s\n", dlerror());
+        return false;
+      }
+      typedef const sfc_plugin_api* (*entry_fn)();
+      entry_fn entry = (entry_fn)dlsym(lib, SFC_PLUGIN_ENTRY);
+      api = entry? entry(): NULL;
+    }
+    if (!api || api->abi_version != SFC_PLUGIN_ABI_VERSION) {
+      fprintf(stderr, "%s: 插件接口版本不匹配\n", spec);
+      return false;
+    }
+    instance = api->create(config.c_str());
+    if (api->load_rom(instance, rom)) return false;
+    snapshot = (uint8_t*)malloc(api->snapshot_size(instance));
+    origin = (uint8_t*)malloc(api->snapshot_size(instance));
+    save();
+    return true;
+  }
+
+  // 释放实例、快照与插件
+  void close() {
+    if (instance) api->destroy(instance);
+    free(snapshot);
+    free(origin);
+    if (lib) dlclose(lib);
+    instance = lib = NULL;
+    snapshot = origin = NULL;
+  }
+
+  void save() { api->save_state(instance, snapshot); }
+  void save_origin() { api->save_state(instance, origin); }
+  void restore_origin() { api->load_state(instance, origin); }
+  void restore() { api->load_state(instance, snapshot); }
+  void digest(uint64_t out[6]) { api->digest(instance, out); }
+  void cpu(sfc_plugin_cpu& c) { api->get_cpu(instance, &c); }
+};
+
+static bool ignore_video = false;
+static const char* field_names[6] = { "frame", "cycle", "cpu", "ram", "sram", "video" };
+
+// 比较两边的状态，不比较帧序号
+static bool same(engine& a, engine& b) {
+  uint64_t da[6], db[6];
+  a.digest(da);
+  b.digest(db);
+  for (int i=1; i<(ignore_video? 5: 6); i++) {
+    if (da[i] != db[i]) return false;
+  }
+  return true;
+}
+
+static void print_cpu(const char* name, const sfc_plugin_cpu& c) {
+  printf("  %-7s PC:%04X A:%02X X:%02X Y:%02X P:%02X SP:%02X cycle:%llu\n", name,
+    c.pc, c.a, c.x, c.y, c.p, c.sp, (unsigned long long)c.cycle);
+}
+
+// 输出 e 即将执行的指令的反汇编与执行前的寄存器，mark 为行首的标记
+static void print_instruction(engine& e, const char* mark) {
+  sfc_plugin_cpu c;
+  e.cpu(c);
+  fc::nes_code code;
+  code.op = e.api->peek(e.instance, c.pc);
+  code.a1 = e.api->peek(e.instance, c.pc + 1);
+  code.a2 = e.api->peek(e.instance, c.pc + 2);
+  // 与 nes_cpu::disassemble_op 一样先用空格填充
+  char buf[32];
+  memset(buf, ' ', sizeof(buf));
+  buf[sizeof(buf) - 1] = 0;
+  fc::disassemble(code, buf);
+  printf("%s $%04X  %-14.14s A:%02X X:%02X Y:%02X P:%02X SP:%02X cycle:%llu\n", mark, c.pc, buf,
+    c.a, c.x, c.y, c.p, c.sp, (unsigned long long)c.cycle);
+}
+
+// 输出分歧之前的指令、分歧指令的反汇编与执行前后的状态差异
+/*
+  两边从最后一个一致的检查点重新执行到分歧指令，之前的指令两边的状态相同，只输出 a 的。
+*/
+static void report(engine& a, engine& b, uint64_t frame, uint64_t instruction) {
+  const uint64_t context = instruction < CONTEXT? instruction: CONTEXT;
+  a.restore_origin();
+  b.restore_origin();
+  a.api->step(a.instance, instruction - context);
+  b.api->step(b.instance, instruction - context);
+  printf("first divergent instruction: frame %llu, instruction %llu after the frame start\n",
+    (unsigned long long)frame, (unsigned long long)instruction);
+  for (uint64_t i=0; i<context; i++) {
+    print_instruction(a, "   ");
+    a.api->step(a.instance, 1);
+    b.api->step(b.instance, 1);
+  }
+  print_instruction(a, "  >");
+  sfc_plugin_cpu before;
+  a.cpu(before);
+  print_cpu("before", before);
+
+  uint8_t ram_a[0x800], ram_b[0x800];
+  a.api->step(a.instance, 1);
+  b.api->step(b.instance, 1);
+  sfc_plugin_cpu ca, cb;
+  a.cpu(ca);
+  b.cpu(cb);
+  print_cpu("a after", ca);
+  print_cpu("b after", cb);
+
+  uint64_t da[6], db[6];
+  a.digest(da);
+  b.digest(db);
+  printf("  differs in:");
+  for (int i=1; i<6; i++) if (da[i] != db[i]) printf(" %s", field_names[i]);
+  printf("\n");
+
+  for (int i=0; i<0x800; i++) {
+    ram_a[i] = a.api->peek(a.instance, i);
+    ram_b[i] = b.api->peek(b.instance, i);
+  }
+  int shown = 0;
+  for (int i=0; i<0x800 && shown<16; i++) {
+    if (ram_a[i] == ram_b[i]) continue;
+    printf("  ram $%04X: a=%02X b=%02X\n", i, ram_a[i], ram_b[i]);
+    ++shown;
+  }
+}
+
+// 找出并报告第一条产生不同状态的指令，没有分歧时返回 0，否则返回 1
+static int bisect(engine& a, engine& b, uint64_t max_frames, uint64_t interval) {
+  printf("a: %s (%s)\nb: %s (%s)\n", a.spec, a.api->build, b.spec, b.api->build);
+
+  // 1. 按帧前进，每隔 interval 帧比较一次
+  uint64_t good = 0, frame = 0;
+  bool diverged = false;
+  while (frame < max_frames && !diverged) {
+    for (uint64_t i=0; i<interval && frame<max_frames; i++, frame++) {
+      a.api->run_frame(a.instance);
+      b.api->run_frame(b.instance);
+    }
+    if (same(a, b)) {
+      a.save();
+      b.save();
+      good = frame;
+    } else {
+      diverged = true;
+    }
+  }
+  if (!diverged) {
+    printf("no divergence in %llu frames\n", (unsigned long long)frame);
+    return 0;
+  }
+  printf("state diverges between frame %llu and %llu\n",
+    (unsigned long long)good, (unsigned long long)frame);
+
+  // 2. 从一致的快照开始倍增步长，lo 为快照处相对 good 帧开始的指令数
+  a.restore();
+  b.restore();
+  a.save_origin();
+  b.save_origin();
+  uint64_t lo = 0, span = 1, probes = 0;
+  for (;;) {
+    a.api->step(a.instance, span);
+    b.api->step(b.instance, span);
+    ++probes;
+    if (!same(a, b)) break;
+    a.save();
+    b.save();
+    lo += span;
+    span *= 2;
+  }
+
+  // 3. 在 (lo, lo+span] 内二分，找到执行后第一次不一致的指令
+  while (span > 1) {
+    const uint64_t half = span / 2;
+    a.restore();
+    b.restore();
+    a.api->step(a.instance, half);
+    b.api->step(b.instance, half);
+    ++probes;
+    if (same(a, b)) {
+      a.save();
+      b.save();
+      lo += half;
+      span -= half;
+    } else {
+      span = half;
+    }
+  }
+  printf("%llu probes\n", (unsigned long long)probes);
+  report(a, b, good, lo);
+  return 1;
+}
+
+int main(int argc, char const *argv[])
+{
+  if (argc < 4) {
+    fprintf(stderr, "用法：bisect <rom> <构建 a> <构建 b> [最大帧数] [检查间隔帧数] [--ignore-video]\n");
+    return 2;
+  }
+  int positional = 0;
+  uint64_t max_frames = 3600, interval = 60;
+  for (int i=4; i<argc; i++) {
+    if (!strcmp(argv[i], "--ignore-video")) ignore_video = true;
+    else if (positional++ == 0) max_frames = strtoull(argv[i], NULL, 10);
+    else interval = strtoull(argv[i], NULL, 10);
+  }
+
+  engine a, b;
+  int status = 2;
+  if (a.open(argv[2], argv[1]) && b.open(argv[3], argv[1])) status = bisect(a, b, max_frames, interval);
+  a.close();
+  b.close();
+  return status;
+}
@@ -0,0 +1,161 @@
+// 命令行调试器：PC 断点、内存读写观察点与条件表达式
+// 编译：g++ -O2 -o debug tools/debug.cpp $(ls *.cpp | grep -v main.cpp) -lpthread
+// 用法：
+//   debug <rom>                 从标准输入读取命令
+//   debug <rom> --bench [帧数]   比较无断点、有断点、有观察点时的帧率
+// 命令：
+//   b <pc> [条件]                 PC 断点，例：b $C123 A==0x40 && X>3
+//   w <addr> [长度] r|w|rw [条件]  观察点，例：w $0300 16 w VALUE>=$80
+//   d <编号>                      删除断点或观察点
+//   c [帧数]                      运行，停在断点或观察点上时提前返回
+//   s [条数]                      单步执行并反汇编
+//   r                            显示寄存器
+//   m <addr> [长度]               显示内存（不产生副作用）
+//   q                            退出
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include "../include/simulator.h"
+
+static const char* reason_names[] = { "none", "breakpoint", "read", "write" };
+
+static void report_stop(fc::simulator& fc) {
+  if (!fc.stopped()) return;
+  const fc::nes_break_info& hit = fc.get_debugger().get_hit();
+  if (hit.reason == fc::SFC_BREAK_PC) {
+    printf("#%d %s at $%04X, cycle %llu\n", hit.id, reason_names[hit.reason], hit.pc,
+      (unsigned long long)hit.cycle);
+  } else {
+    printf("#%d %s $%04X = $%02X, pc $%04X, cycle %llu\n", hit.id, reason_names[hit.reason],
+      hit.addr, hit.value, hit.pc, (unsigned long long)hit.cycle);
+  }
+  fc.get_cpu().output_registers_and_flags();
+}
+
+static double measure(fc::simulator& fc, uint64_t frames) {
+  const auto start = std::chrono::steady_clock::now();
+  for (uint64_t i=0; i<frames; i++) fc.run_frame();
+  return frames / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int bench(const char* rom, uint64_t frames) {
+  fc::simulator fc;
+  fc.load_rom(rom);
+  fc.set_headless(true, 0);
+  measure(fc, 60);
+  printf("no breakpoints:          %8.1f fps\n", measure(fc, frames));
+  // 永远不会执行到的 PC，只计入逐条指令检查的开销
+  const int bp = fc.get_debugger().add_breakpoint(0x0000, "A==0x40 && X>3");
+  printf("breakpoint (never hit):  %8.1f fps\n", measure(fc, frames));
+  fc.get_debugger().remove(bp);
+  fc.get_debugger().add_watchpoint(0x07f0, 1, fc::SFC_WATCH_WRITE, "VALUE==0xff");
+  printf("watchpoint on $07xx:     %8.1f fps\n", measure(fc, frames));
+  fc.get_debugger().clear();
+  printf("cleared:                 %8.1f fps\n", measure(fc, frames));
+  fc.free_rom();
+  return 0;
+}
+
+// 跳过空白后解析一个数字，$ 与 0x 开头为十六进制，其余为十进制
+static bool parse_number(char*& p, unsigned long& value) {
+  while (*p == ' ' || *p == '\t') ++p;
+  const bool hex = *p == '$' || (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'));
+  const char* digits = *p == '$'? p + 1: hex? p + 2: p;
+  char* end;
+  const unsigned long v = strtoul(digits, &end, hex? 16: 10);
+  if (end == digits || !isxdigit((unsigned char)*digits)) return false;
+  value = v;
+  p = end;
+  return true;
+}
+
+static char* rest(char* p) {
+  while (*p == ' ' || *p == '\t') ++p;
+  char* end = p + strlen(p);
+  while (end > p && (end[-1] == '\n' || end[-1] == '\r')) *--end = 0;
+  return *p? p: NULL;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "用法：%s <rom> [--bench [帧数]]\n", argv[0]);
+    return 2;
+  }
+  if (argc > 2 && !strcmp(argv[2], "--bench")) return bench(argv[1], argc > 3? strtoull(argv[3], NULL, 10): 600);
+
+  fc::simulator fc;
+  fc.load_rom(argv[1]);
+  fc::nes_debugger& debugger = fc.get_debugger();
+  char line[256];
+  while (printf("> "), fflush(stdout), fgets(line, sizeof(line), stdin)) {
+    char* p = line + 1;
+    unsigned long a, n;
+    const char* error = NULL;
+    switch (line[0]) {
+    case 'b': {
+      if (!parse_number(p, a)) { puts("需要地址"); break; }
+      const int id = debugger.add_breakpoint(a, rest(p), &error);
+      if (id < 0) printf("条件有误：%s\n", error);
+      else printf("breakpoint #%d at $%04lX\n", id, a);
+      break;
+    }
+    case 'w': {
+      if (!parse_number(p, a)) { puts("需要地址"); break; }
+      n = 1;
+      parse_number(p, n);
+      while (*p == ' ') ++p;
+      int kinds = 0;
+      for (; *p == 'r' || *p == 'w'; ++p) kinds |= *p == 'r'? fc::SFC_WATCH_READ: fc::SFC_WATCH_WRITE;
+      const int id = debugger.add_watchpoint(a, n, kinds, rest(p), &error);
+      if (id < 0) printf("观察点有误：%s\n", error? error: "需要 r、w 或 rw");
+      else printf("watchpoint #%d at $%04lX-$%04lX\n", id, a, a + n - 1);
+      break;
+    }
+    case 'd':
+      if (!parse_number(p, a) || !debugger.remove(a)) puts("没有这个编号");
+      break;
+    case 'c':
+      if (!parse_number(p, n)) n = 1;
+      for (unsigned long i=0; i<n; i++) {
+        fc.run_frame();
+        if (fc.stopped()) break;
+      }
+      if (fc.stopped()) report_stop(fc);
+      else printf("frame %llu\n", (unsigned long long)fc.get_ppu().get_frame_count());
+      break;
+    case 's':
+      if (!parse_number(p, n)) n = 1;
+      for (unsigned long i=0; i<n; i++) {
+        char buf[OP_BUF_LEN];
+        fc.get_cpu().output_op(fc.get_cpu().get_pc(), buf);
+        printf("%s\n", buf);
+        fc.step();
+        if (fc.stopped()) { report_stop(fc); break; }
+      }
+      break;
+    case 'r':
+      fc.get_cpu().output_registers_and_flags();
+      break;
+    case 'm':
+      if (!parse_number(p, a)) { puts("需要地址"); break; }
+      if (!parse_number(p, n)) n = 16;
+      for (unsigned long i=0; i<n; i++) {
+        if (i % 16 == 0) printf("%s%04lX:", i? "\n": "", (a + i) & 0xffff);
+        printf(" %02X", fc.get_memory_pool().peek(a + i));
+      }
+      printf("\n");
+      break;
+    case 'q':
+      fc.free_rom();
+      return 0;
+    case '\n':
+      break;
+    default:
+      puts("命令：b w d c s r m q");
+    }
+  }
+  fc.free_rom();
+  return 0;
+}
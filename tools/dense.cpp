@@ -0,0 +1,78 @@
+// 高密度模式：大量 NROM 实例共享同一份只读 ROM，无画面无声音地运行
+// 编译：g++ -O2 -o dense tools/dense.cpp $(ls *.cpp | grep -v main.cpp) -lpthread -ldl
+// 用法：dense [-n 实例数] [-f 帧数] <rom>
+//   ROM 只解析一次，实例数默认 10000，每个实例运行帧数（默认 10）帧，然后报告：
+//     - 每个实例的字节数：simulator::instance_bytes 的平均值，以及创建并运行前后常驻内存的增量除以实例数
+//     - 全部实例合计的帧率
+//   SRAM、画面与音频缓冲按需分配，因此运行之后的字节数才是实际的占用。
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <unistd.h>
+#include "../include/simulator.h"
+
+// 当前进程的常驻内存（字节）
+static size_t resident_bytes() {
+  FILE* fp = fopen("/proc/self/statm", "r");
+  if (!fp) return 0;
+  unsigned long pages = 0, resident = 0;
+  if (fscanf(fp, "%lu %lu", &pages, &resident) != 2) resident = 0;
+  fclose(fp);
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+int main(int argc, char** argv) {
+  size_t count = 10000;
+  uint32_t frames = 10;
+  int i = 1;
+  for (; i<argc && argv[i][0] == '-'; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) count = strtoul(argv[++i], NULL, 10);
+    else if (!strcmp(argv[i], "-f") && i + 1 < argc) frames = atoi(argv[++i]);
+    else break;
+  }
+  if (i + 1 != argc || !count) {
+    fprintf(stderr, "用法：%s [-n 实例数] [-f 帧数] <rom>\n", argv[0]);
+    return 2;
+  }
+
+  fc::nes_rom_handler rom;
+  rom.load_image(argv[i]);
+  rom.parse_to_info();
+  const fc::nes_rom_info* info = rom.get_info();
+  const size_t rom_bytes = info->prg_rom_count * 0x4000 + info->chr_rom_count * 0x2000;
+
+  const size_t rss_before = resident_bytes();
+  fc::nes_machine_pool pool(256);
+  std::vector<fc::simulator*> instances(count);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t k=0; k<count; k++) {
+    instances[k] = new fc::simulator(&pool);
+    instances[k]->load_rom(&rom);
+    instances[k]->set_headless(true, 0);
+  }
+  const double create_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  start = std::chrono::steady_clock::now();
+  for (uint32_t f=0; f<frames; f++) {
+    for (size_t k=0; k<count; k++) instances[k]->run_frame();
+  }
+  const double run_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  const size_t rss_after = resident_bytes();
+
+  size_t bytes = 0;
+  for (size_t k=0; k<count; k++) bytes += instances[k]->instance_bytes();
+  printf("实例数:           %zu（共享 %zu 字节的 ROM 镜像）\n", count, rom_bytes);
+  printf("每个实例:         %.0f 字节（instance_bytes），%.0f 字节（常驻内存增量）\n",
+    (double)bytes / count, (double)(rss_after - rss_before) / count);
+  printf("machine 池:       %zu 字节/实例（sizeof(nes_machine)），共申请 %zu 字节\n",
+    sizeof(fc::nes_machine), pool.reserved());
+  printf("创建与加载:       %.3f 秒\n", create_seconds);
+  printf("运行 %u 帧:       %.3f 秒，合计 %.0f 帧/秒\n", frames, run_seconds,
+    run_seconds > 0? (double)count * frames / run_seconds: 0);
+
+  for (size_t k=0; k<count; k++) delete instances[k];
+  rom.unload_image();
+  return 0;
+}
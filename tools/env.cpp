@@ -0,0 +1,124 @@
+// 嵌入接口（include/nes_env.h）的校验与基准，只通过 C 接口使用模拟器
+// 编译：g++ -O2 -o env tools/env.cpp $(ls *.cpp | grep -v main.cpp) -lpthread -ldl
+//   或先编译 libsfcenv.so（见 nes_env.h），再 g++ -O2 -o env tools/env.cpp -L. -lsfcenv
+// 用法：env [-n 实例数] [-k 每步帧数] [-s 步数] [-t 最大线程数] <rom>
+//   每个实例以各自的伪随机动作序列运行（默认 64 个实例，每步 4 帧，共 100 步）：
+//     1. 逐个实例调用 sfc_env_step，记录每一步之后主内存的哈希作为基准
+//     2. 恢复到起点的快照，以 1、2、4……直到最大线程数（默认全部处理器）调用 sfc_env_step_many，
+//        每一步写入批量缓冲的主内存须与基准一致
+//   并报告每种方式每秒的环境步数与帧数
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../include/nes_env.h"
+#include "../include/nes_hash.h"
+
+static bool read_file(const char* path, std::vector<uint8_t>& data) {
+  FILE* fp = fopen(path, "rb");
+  if (!fp) return false;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), fp))) data.insert(data.end(), chunk, chunk + n);
+  fclose(fp);
+  return true;
+}
+
+// 每个实例第 step 步的动作，只按下方向键与 A/B，避免一直暂停
+static void make_actions(uint32_t env, uint32_t step, uint32_t frames, uint16_t* out) {
+  uint32_t x = (env + 1) * 2654435761u ^ (step + 1) * 40503u;
+  for (uint32_t i=0; i<frames; i++) {
+    x = x * 1664525u + 1013904223u;
+    out[i] = (x >> 24) & 0xf3;
+  }
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+  uint32_t count = 64, frames = 4, steps = 100;
+  uint32_t max_threads = std::thread::hardware_concurrency();
+  int i = 1;
+  for (; i<argc && argv[i][0] == '-'; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) count = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-k") && i + 1 < argc) frames = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) steps = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-t") && i + 1 < argc) max_threads = atoi(argv[++i]);
+    else break;
+  }
+  if (i + 1 != argc || !count || !frames || !steps) {
+    fprintf(stderr, "用法：%s [-n 实例数] [-k 每步帧数] [-s 步数] [-t 最大线程数] <rom>\n", argv[0]);
+    return 2;
+  }
+  if (!max_threads) max_threads = 1;
+  if (sfc_env_abi_version() != SFC_ENV_ABI_VERSION) {
+    fprintf(stderr, "库的接口版本 %u 与头文件的 %u 不符\n", sfc_env_abi_version(), SFC_ENV_ABI_VERSION);
+    return 1;
+  }
+
+  std::vector<uint8_t> image;
+  if (!read_file(argv[i], image)) {
+    fprintf(stderr, "无法读取 %s\n", argv[i]);
+    return 1;
+  }
+  sfc_rom* rom = sfc_rom_load(image.data(), image.size());
+  if (!rom) {
+    fprintf(stderr, "不是合法的镜像或不支持的 mapper：%s\n", argv[i]);
+    return 1;
+  }
+
+  std::vector<sfc_env*> envs(count);
+  for (uint32_t k=0; k<count; k++) envs[k] = sfc_env_create(rom, 0);
+  const size_t snapshot_size = sfc_env_snapshot_size(envs[0]);
+  std::vector<uint8_t> snapshots((size_t)count * snapshot_size);
+  for (uint32_t k=0; k<count; k++) sfc_env_save(envs[k], snapshots.data() + k * snapshot_size);
+
+  // 所有步的动作，按 step_many 的布局排列：[步][实例][帧]
+  std::vector<uint16_t> actions((size_t)steps * count * frames);
+  for (uint32_t s=0; s<steps; s++) {
+    for (uint32_t k=0; k<count; k++) make_actions(k, s, frames, actions.data() + ((size_t)s * count + k) * frames);
+  }
+
+  // 基准：逐个实例单独调用 sfc_env_step
+  std::vector<uint64_t> expected((size_t)steps * count);
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t s=0; s<steps; s++) {
+    for (uint32_t k=0; k<count; k++) {
+      sfc_env_step(envs[k], actions.data() + ((size_t)s * count + k) * frames, frames);
+      expected[(size_t)s * count + k] = fc::nes_hash64(sfc_env_ram(envs[k]), SFC_ENV_RAM_BYTES);
+    }
+  }
+  double seconds = seconds_since(start);
+  const double total = (double)steps * count;
+  printf("%-16s %12s %12s %8s\n", "方式", "步/秒", "帧/秒", "结果");
+  printf("%-16s %12.0f %12.0f %8s\n", "sfc_env_step", total / seconds, total * frames / seconds, "基准");
+
+  bool ok = true;
+  std::vector<uint8_t> ram((size_t)count * SFC_ENV_RAM_BYTES);
+  for (uint32_t threads=1; ; threads = threads * 2 < max_threads? threads * 2: max_threads) {
+    for (uint32_t k=0; k<count; k++) sfc_env_reset(envs[k], snapshots.data() + k * snapshot_size);
+    sfc_env_set_threads(threads);
+    bool same = true;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t s=0; s<steps; s++) {
+      sfc_env_step_many(envs.data(), count, actions.data() + (size_t)s * count * frames, frames, ram.data(), NULL);
+      for (uint32_t k=0; k<count; k++) {
+        same = same && fc::nes_hash64(ram.data() + (size_t)k * SFC_ENV_RAM_BYTES, SFC_ENV_RAM_BYTES) == expected[(size_t)s * count + k];
+      }
+    }
+    seconds = seconds_since(start);
+    char name[32];
+    snprintf(name, sizeof(name), "step_many x%u", threads);
+    printf("%-16s %12.0f %12.0f %8s\n", name, total / seconds, total * frames / seconds, same? "一致": "不一致");
+    ok = ok && same;
+    if (threads >= max_threads) break;
+  }
+
+  for (uint32_t k=0; k<count; k++) sfc_env_destroy(envs[k]);
+  sfc_rom_free(rom);
+  return ok? 0: 1;
+}
@@ -0,0 +1,188 @@
+// 模糊测试驱动：一个常驻的 simulator，每次迭代恢复到基准快照，输入作为手柄按键与内存补丁
+// 编译：
+//   自带的随机变异循环：g++ -O2 -o fuzz tools/fuzz.cpp $(ls *.cpp | grep -v main.cpp) -lpthread
+//   libFuzzer：clang++ -O2 -fsanitize=fuzzer -DSFC_FUZZ_LIBFUZZER -o fuzz tools/fuzz.cpp $(ls *.cpp | grep -v main.cpp) -lpthread
+//   AFL 持久模式：afl-clang-fast++ -O2 -DSFC_FUZZ_AFL -o fuzz tools/fuzz.cpp $(ls *.cpp | grep -v main.cpp) -lpthread
+// 用法：
+//   fuzz <rom> [迭代次数]                      自带循环，报告每秒迭代次数与覆盖的边数
+//   SFC_FUZZ_ROM=<rom> ./fuzz [libFuzzer 参数]  libFuzzer
+//   SFC_FUZZ_ROM=<rom> afl-fuzz -i in -o out -- ./fuzz
+// 环境变量：
+//   SFC_FUZZ_ROM     要测试的 ROM
+//   SFC_FUZZ_WARMUP  保存基准快照前先运行的帧数，默认 30
+//   SFC_FUZZ_FRAMES  每次迭代最多运行的帧数，默认 300
+//   SFC_FUZZ_TARGET  形如 0x0123=0x45，某帧结束后主内存该地址等于该值时 abort，用来寻找到达特定游戏状态的输入
+// 输入格式：
+//   第 0 字节的低 3 位为内存补丁数 n，之后 n 个补丁各 3 字节（地址低 8 位、高 3 位、值），
+//   恢复快照后先写入主内存；剩下的每 2 字节为一帧两个手柄的按键
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include "../include/simulator.h"
+
+// 分支覆盖率计数表的长度
+#define SFC_FUZZ_MAP_SIZE (64 * 1024)
+
+#ifdef SFC_FUZZ_LIBFUZZER
+// libFuzzer 会把这个段中的计数当作额外的覆盖率，并在每次迭代前清零
+__attribute__((section("__libfuzzer_extra_counters")))
+#endif
+static uint8_t coverage_map[SFC_FUZZ_MAP_SIZE];
+
+static fc::simulator* fuzz_fc = NULL;
+static uint8_t* base_state = NULL;
+static uint32_t max_frames = 300;
+static int target_addr = -1;
+static uint8_t target_value = 0;
+
+static uint32_t env_number(const char* name, uint32_t fallback) {
+  const char* v = getenv(name);
+  return v? strtoul(v, NULL, 0): fallback;
+}
+
+// 释放 fuzz_init 创建的实例与快照，可以重复调用
+static void fuzz_cleanup() {
+  if (fuzz_fc) {
+    fuzz_fc->free_rom();
+    delete fuzz_fc;
+    fuzz_fc = NULL;
+  }
+  free(base_state);
+  base_state = NULL;
+}
+
+// 加载 ROM、运行若干帧并保存基准快照，只在进程启动时执行一次
+/*
+  libFuzzer 与 AFL 在结束时直接 exit，因此用 atexit 登记 fuzz_cleanup。
+*/
+static void fuzz_init(const char* rom) {
+  if (!rom) {
+    fprintf(stderr, "请用 SFC_FUZZ_ROM 指定 ROM\n");
+    exit(2);
+  }
+  max_frames = env_number("SFC_FUZZ_FRAMES", 300);
+  const char* target = getenv("SFC_FUZZ_TARGET");
+  if (target) {
+    char* end;
+    target_addr = strtoul(target, &end, 0) & 0x7ff;
+    target_value = *end == '='? strtoul(end + 1, NULL, 0): 0;
+  }
+
+  fuzz_fc = new fc::simulator();
+  fuzz_fc->load_rom(rom);
+  fuzz_fc->set_headless(true, 0);
+  // 计数表属于宿主程序的设置，每次 load_state 恢复快照后仍然有效
+  fuzz_fc->get_cpu().set_coverage(coverage_map, SFC_FUZZ_MAP_SIZE);
+  const uint32_t warmup = env_number("SFC_FUZZ_WARMUP", 30);
+  for (uint32_t i=0; i<warmup; i++) fuzz_fc->run_frame();
+  base_state = (uint8_t*)malloc(fuzz_fc->snapshot_size());
+  fuzz_fc->save_state(base_state);
+  atexit(fuzz_cleanup);
+}
+
+// 运行一次输入
+static void fuzz_one(const uint8_t* data, size_t size) {
+  fuzz_fc->load_state(base_state);
+  if (!size) return;
+
+  uint8_t* ram = fuzz_fc->get_memory_pool().get_main_memory();
+  size_t pos = 1;
+  for (int n = data[0] & 7; n && pos + 3 <= size; --n, pos += 3) {
+    ram[(data[pos] | (data[pos + 1] << 8)) & 0x7ff] = data[pos + 2];
+  }
+
+  fc::nes_joypad& joypad = fuzz_fc->get_joypad();
+  for (uint32_t frame=0; frame < max_frames && pos + 2 <= size; ++frame, pos += 2) {
+    joypad.set_buttons(0, data[pos]);
+    joypad.set_buttons(1, data[pos + 1]);
+    fuzz_fc->run_frame();
+    if (target_addr >= 0 && ram[target_addr] == target_value) {
+      fprintf(stderr, "到达目标状态：$%04X = $%02X（第 %u 帧）\n", target_addr, target_value, frame);
+      abort();
+    }
+  }
+}
+
+extern "C" int LLVMFuzzerInitialize(int*, char***) {
+  fuzz_init(getenv("SFC_FUZZ_ROM"));
+  return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  fuzz_one(data, size);
+  return 0;
+}
+
+#if defined(SFC_FUZZ_AFL)
+
+// AFL 的共享覆盖率表，由 afl-clang-fast 的运行时提供
+extern "C" uint8_t* __afl_area_ptr;
+
+int main() {
+  fuzz_init(getenv("SFC_FUZZ_ROM"));
+  static uint8_t input[1 << 16];
+  while (__AFL_LOOP(10000)) {
+    const ssize_t size = fread(input, 1, sizeof(input), stdin);
+    memset(coverage_map, 0, sizeof(coverage_map));
+    fuzz_one(input, size > 0? size: 0);
+    // 把 6502 程序的分支覆盖率叠加到宿主程序的覆盖率上
+    for (size_t i=0; i<SFC_FUZZ_MAP_SIZE; i++) __afl_area_ptr[i] += coverage_map[i];
+  }
+  fuzz_cleanup();
+  return 0;
+}
+
+#elif !defined(SFC_FUZZ_LIBFUZZER)
+
+// 不依赖外部模糊测试器的简易循环：随机生成或变异语料库中的输入，保留带来新覆盖的输入
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "用法：%s <rom> [迭代次数]\n", argv[0]);
+    return 2;
+  }
+  const uint64_t iterations = argc > 2? strtoull(argv[2], NULL, 10): 2000;
+  fuzz_init(argv[1]);
+
+  std::vector<std::vector<uint8_t> > corpus;
+  static uint8_t seen[SFC_FUZZ_MAP_SIZE];
+  uint64_t edges = 0, frames = 0;
+  srand(1);
+
+  const auto start = std::chrono::steady_clock::now();
+  for (uint64_t i=0; i<iterations; i++) {
+    std::vector<uint8_t> input;
+    if (corpus.empty() || rand() % 4 == 0) {
+      input.resize(1 + 2 * (1 + rand() % max_frames));
+      for (size_t k=0; k<input.size(); k++) input[k] = rand();
+      input[0] &= ~7;
+    } else {
+      input = corpus[rand() % corpus.size()];
+      for (int m = 1 + rand() % 8; m; --m) input[rand() % input.size()] ^= 1 << (rand() % 8);
+    }
+
+    memset(coverage_map, 0, sizeof(coverage_map));
+    fuzz_one(input.data(), input.size());
+    frames += (input.size() - 1) / 2;
+
+    bool fresh = false;
+    for (size_t k=0; k<SFC_FUZZ_MAP_SIZE; k++) {
+      if (coverage_map[k] && !seen[k]) {
+        seen[k] = 1;
+        ++edges;
+        fresh = true;
+      }
+    }
+    if (fresh) corpus.push_back(input);
+  }
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("iterations: %llu  time: %.2fs  %.1f iter/s  (%.0f frames/s)\n",
+    (unsigned long long)iterations, seconds, iterations / seconds, frames / seconds);
+  printf("edges: %llu  corpus: %zu\n", (unsigned long long)edges, corpus.size());
+  fuzz_cleanup();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,108 @@
+// 生成合成 6502 负载的 NROM 镜像，供基准扫描使用
+// 编译：g++ -O2 -o gen_workload tools/gen_workload.cpp $(ls *.cpp | grep -v main.cpp) -lpthread
+// 用法：gen_workload [--iterations 次数] [--size 规模] [--check] <种类|all> <输出>
+//   种类为 memset / memcpy / adc / branchy / recursion / table_walk / smc，
+//   all 时输出为目录，每种负载写为 <目录>/<种类>.nes
+//   程序从 $C000 开始，结束时向 $07FF 写入 $A5 并停在 $FFF0，
+//   --check 用模拟器加载生成的镜像，运行到结束并报告所用的周期数与整块执行的循环惯用法，
+//   同时关闭循环惯用法再运行一次，结束时的周期数与状态哈希须完全一致
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "../include/simulator.h"
+#include "../include/nes_workload.h"
+
+// 最多运行的帧数，防止生成的程序跑飞时不结束
+static const uint64_t MAX_FRAMES = 1000000;
+
+// 一次运行的结果
+struct run_result {
+  bool halted;
+  uint64_t cycles;
+  uint64_t frames;
+  uint64_t checksum;
+  fc::nes_idiom_stats idioms;
+};
+
+// 运行到写入完成标记为止，halted 表示是否正常停在 SFC_WORKLOAD_HALT_PC
+static run_result run(const char* path, bool idioms) {
+  fc::simulator fc;
+  fc.load_rom(path);
+  fc.set_headless(true, 0);
+  fc.get_cpu().set_idioms(idioms);
+  char condition[32];
+  snprintf(condition, sizeof(condition), "VALUE == %d", SFC_WORKLOAD_DONE_VALUE);
+  fc.get_debugger().add_watchpoint(SFC_WORKLOAD_DONE_ADDR, 1, fc::SFC_WATCH_WRITE, condition);
+
+  run_result r;
+  r.frames = 0;
+  while (!fc.stopped() && r.frames < MAX_FRAMES) {
+    fc.run_frame();
+    r.frames++;
+  }
+  r.cycles = fc.get_cpu().get_cycle();
+  r.checksum = fc.digest().checksum();
+  r.idioms = fc.get_cpu().get_idiom_stats();
+  r.halted = fc.stopped();
+  if (r.halted) {
+    // 停在 STA $07FF 之后，再执行尾声的 JMP 与一次死循环
+    fc.get_debugger().clear();
+    fc.step(2);
+    r.halted = fc.get_cpu().get_pc() == SFC_WORKLOAD_HALT_PC;
+  }
+  fc.free_rom();
+  return r;
+}
+
+static bool check(const char* path) {
+  const run_result on = run(path, true);
+  const run_result off = run(path, false);
+  const bool same = on.cycles == off.cycles && on.checksum == off.checksum;
+  uint64_t collapsed = 0;
+  for (int k=0; k<fc::SFC_IDIOM_COUNT; k++) collapsed += on.idioms.instructions[k];
+  printf("%-28s %s  %12llu 周期  %8llu 帧  整块执行 %llu 条指令  %s\n", path, on.halted? "结束": "未结束",
+    (unsigned long long)on.cycles, (unsigned long long)on.frames, (unsigned long long)collapsed,
+    same? "与逐条解释一致": "与逐条解释不一致");
+  return on.halted && same;
+}
+
+static bool generate(const fc::nes_workload_params& params, const std::string& path, bool verify) {
+  if (!fc::nes_workload_write(params, path.c_str())) {
+    fprintf(stderr, "无法写入 %s\n", path.c_str());
+    return false;
+  }
+  return verify? check(path.c_str()): true;
+}
+
+int main(int argc, char** argv) {
+  fc::nes_workload_params params = { 0, 1000, 0 };
+  bool verify = false;
+  int i = 1;
+  for (; i<argc && argv[i][0] == '-'; i++) {
+    if (!strcmp(argv[i], "--iterations") && i + 1 < argc) params.iterations = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--size") && i + 1 < argc) params.size = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--check")) verify = true;
+    else break;
+  }
+  const int kind = i < argc? fc::nes_workload_find(argv[i]): -1;
+  if (i + 2 != argc || (kind < 0 && strcmp(argv[i], "all"))) {
+    fprintf(stderr, "用法：%s [--iterations 次数] [--size 规模] [--check] <种类|all> <输出>\n", argv[0]);
+    fprintf(stderr, "种类：");
+    for (int k=0; k<fc::SFC_WORKLOAD_COUNT; k++) fprintf(stderr, "%s ", fc::nes_workload_name(k));
+    fprintf(stderr, "\n");
+    return 2;
+  }
+
+  bool ok = true;
+  if (kind >= 0) {
+    params.kind = kind;
+    ok = generate(params, argv[i + 1], verify);
+  } else {
+    for (int k=0; k<fc::SFC_WORKLOAD_COUNT; k++) {
+      params.kind = k;
+      ok = generate(params, std::string(argv[i + 1]) + "/" + fc::nes_workload_name(k) + ".nes", verify) && ok;
+    }
+  }
+  return ok? 0: 1;
+}
@@ -0,0 +1,129 @@
+// 逐帧状态哈希日志：记录、比较，以及哈希内核的校验与基准
+// 编译：g++ -O2 -o hashlog tools/hashlog.cpp $(ls *.cpp | grep -v main.cpp) -lpthread
+// 用法：
+//   hashlog record [-i 指令数] <rom> <帧数> <输出日志> [无画面模式渲染间隔]
+//     带 -i 时每执行这么多条指令记录一条，而不是每帧一条，两份日志须用相同的间隔记录
+//   hashlog diff <日志 a> <日志 b>
+//   hashlog bench
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include "../include/simulator.h"
+
+static int record(const char* rom, uint64_t frames, const char* path, int interval, uint64_t instructions) {
+  fc::nes_hash_log log;
+  if (!log.create(path)) {
+    fprintf(stderr, "无法创建 %s\n", path);
+    return 1;
+  }
+  fc::simulator fc;
+  fc.load_rom(rom);
+  if (interval >= 0) fc.set_headless(true, interval);
+  fc.set_hash_log(&log, instructions);
+  for (uint64_t i=0; i<frames; i++) fc.run_frame();
+  fc.free_rom();
+  return 0;
+}
+
+static void print_digest(const char* name, const fc::nes_state_digest& d) {
+  printf("  %s: cycle=%llu cpu=%016llx ram=%016llx sram=%016llx video=%016llx\n", name,
+    (unsigned long long)d.cycle, (unsigned long long)d.cpu, (unsigned long long)d.ram,
+    (unsigned long long)d.sram, (unsigned long long)d.video);
+}
+
+static int diff(const char* path_a, const char* path_b) {
+  fc::nes_hash_log a, b;
+  if (!a.open(path_a) || !b.open(path_b)) {
+    fprintf(stderr, "无法打开日志\n");
+    return 2;
+  }
+  fc::nes_state_digest da, db;
+  uint64_t count = 0;
+  for (;;) {
+    const bool more_a = a.next(da), more_b = b.next(db);
+    if (!more_a || !more_b) {
+      if (more_a != more_b) printf("logs have different lengths, common prefix of %llu records matches\n",
+        (unsigned long long)count);
+      else printf("identical: %llu records\n", (unsigned long long)count);
+      return more_a != more_b;
+    }
+    if (!da.same_state(db)) break;
+    ++count;
+  }
+
+  printf("first divergent record: %llu (frame %llu)\n",
+    (unsigned long long)count, (unsigned long long)da.frame);
+  printf("  differs in:%s%s%s%s%s\n",
+    da.cycle != db.cycle? " cycle": "", da.cpu != db.cpu? " cpu": "",
+    da.ram != db.ram? " ram": "", da.sram != db.sram? " sram": "",
+    da.video != db.video? " video": "");
+  print_digest("a", da);
+  print_digest("b", db);
+  return 1;
+}
+
+static int bench() {
+  const fc::nes_hash_kernels* list[4];
+  const int count = fc::nes_hash_kernels_available(list, 4);
+  // 一帧需要哈希的数据量：主内存 + SRAM + 画面
+  const size_t size = 2 * 1024 + 8 * 1024 + 240 * 256 + 240;
+  uint8_t* data = (uint8_t*)malloc(size);
+  for (size_t i=0; i<size; i++) data[i] = rand();
+
+  // 各种长度与种子下与标量实现逐位比对
+  for (int k=1; k<count; k++) {
+    for (size_t len=0; len<4096; len += 1 + len / 8) {
+      for (uint64_t seed=0; seed<3; seed++) {
+        const uint64_t ref = fc::nes_hash64(data, len, seed, &fc::nes_hash_kernels_scalar());
+        if (fc::nes_hash64(data, len, seed, list[k]) != ref) {
+          printf("%s: 长度 %zu 种子 %llu 与标量实现不一致\n", list[k]->name, len, (unsigned long long)seed);
+          return 1;
+        }
+      }
+    }
+    if (fc::nes_hash64(data, size, 0, list[k]) != fc::nes_hash64(data, size, 0, &fc::nes_hash_kernels_scalar())) {
+      printf("%s: 整帧数据与标量实现不一致\n", list[k]->name);
+      return 1;
+    }
+  }
+
+  printf("%-8s %10s %12s\n", "kernel", "GB/s", "us/frame");
+  const int rounds = 20000;
+  for (int k=0; k<count; k++) {
+    uint64_t sink = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i=0; i<rounds; i++) sink += fc::nes_hash64(data, size, sink, list[k]);
+    const double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+    printf("%-8s %10.2f %12.2f\n", list[k]->name,
+      size * (double)rounds / seconds / 1e9, seconds / rounds * 1e6);
+    if (sink == 42) puts("");
+  }
+  free(data);
+  return 0;
+}
+
+int main(int argc, char const *argv[])
+{
+  if (argc >= 2 && !strcmp(argv[1], "record")) {
+    int i = 2;
+    uint64_t instructions = 0;
+    if (i + 1 < argc && !strcmp(argv[i], "-i")) {
+      instructions = strtoull(argv[i + 1], NULL, 10);
+      i += 2;
+    }
+    if (argc - i >= 3) {
+      return record(argv[i], strtoull(argv[i + 1], NULL, 10), argv[i + 2],
+        argc - i > 3? atoi(argv[i + 3]): -1, instructions);
+    }
+  }
+  if (argc >= 4 && !strcmp(argv[1], "diff")) return diff(argv[2], argv[3]);
+  if (argc >= 2 && !strcmp(argv[1], "bench")) return bench();
+  fprintf(stderr,
+    "用法：\n"
+    "  hashlog record [-i 指令数] <rom> <帧数> <输出日志> [无画面模式渲染间隔]\n"
+    "  hashlog diff <日志 a> <日志 b>\n"
+    "  hashlog bench\n");
+  return 2;
+}
@@ -0,0 +1,56 @@
+// 运行 ROM 并把画面录制为 .y4m、声音录制为 .wav，报告录制带来的减速
+// 编译：g++ -O2 -o record tools/record.cpp $(ls *.cpp | grep -v main.cpp) -lpthread
+// 用法：record <rom> <帧数> <输出.y4m> <输出.wav> [放大倍数]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <chrono>
+#include "../include/simulator.h"
+#include "../include/nes_capture.h"
+
+// 运行 frames 帧，返回每秒帧数
+static double run(const char* rom, uint64_t frames, fc::nes_av_pipeline* pipeline) {
+  fc::simulator fc;
+  fc.load_rom(rom);
+  fc.set_pipeline(pipeline);
+  const auto start = std::chrono::steady_clock::now();
+  for (uint64_t i=0; i<frames; i++) fc.run_frame();
+  if (pipeline) pipeline->stop();
+  const double seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+  fc.free_rom();
+  return frames / seconds;
+}
+
+int main(int argc, char const *argv[])
+{
+  if (argc < 5) {
+    assert(!"用法：record <rom> <帧数> <输出.y4m> <输出.wav> [放大倍数]");
+    return 1;
+  }
+  const uint64_t frames = strtoull(argv[2], NULL, 10);
+  const int scale = argc > 5? atoi(argv[5]): 1;
+
+  const double base = run(argv[1], frames, NULL);
+
+  fc::nes_av_capture capture;
+  if (!capture.open(argv[3], argv[4], SFC_APU_SAMPLE_RATE, scale)) {
+    fprintf(stderr, "无法创建输出文件\n");
+    return 1;
+  }
+  fc::nes_av_pipeline pipeline;
+  capture.attach(pipeline);
+  pipeline.start();
+  const double recorded = run(argv[1], frames, &pipeline);
+
+  printf("without capture: %.1f fps\n", base);
+  printf("with capture:    %.1f fps (%.1f%% slower)\n", recorded, (1 - recorded / base) * 100);
+  pipeline.print_stats(stdout);
+  capture.print_stats(stdout);
+  if (!capture.close()) {
+    fprintf(stderr, "写入输出文件失败：%s\n", strerror(capture.get_error()));
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,60 @@
+// 无画面回放输入录像，比较最终状态哈希
+// 编译：g++ -O2 -o replay tools/replay.cpp $(ls *.cpp | grep -v main.cpp) -lpthread
+// 用法：
+//   replay <rom> <录像> [期望的哈希] [--save <输出录像>]
+//   录像以 .fm2 结尾时按 FCEUX 文本格式导入，否则按自有格式读取
+//   给出期望的哈希（16 位十六进制）时，一致返回 0，不一致返回 1
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include "../include/simulator.h"
+
+static bool ends_with(const char* s, const char* suffix) {
+  const size_t n = strlen(s), m = strlen(suffix);
+  return n >= m && !strcmp(s + n - m, suffix);
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    fprintf(stderr, "用法：%s <rom> <录像> [期望的哈希] [--save <输出录像>]\n", argv[0]);
+    return 2;
+  }
+  const char* expected = NULL;
+  const char* save_path = NULL;
+  for (int i=3; i<argc; i++) {
+    if (!strcmp(argv[i], "--save") && i + 1 < argc) save_path = argv[++i];
+    else expected = argv[i];
+  }
+
+  fc::nes_movie movie;
+  const bool loaded = ends_with(argv[2], ".fm2")? movie.load_fm2(argv[2]): movie.load(argv[2]);
+  if (!loaded) {
+    fprintf(stderr, "无法读取录像 %s\n", argv[2]);
+    return 2;
+  }
+  if (movie.get_ignored_resets())
+    fprintf(stderr, "警告：忽略了 %u 个复位命令，回放可能与录制时不同\n", movie.get_ignored_resets());
+  if (save_path && !movie.save(save_path)) {
+    fprintf(stderr, "无法写入 %s\n", save_path);
+    return 2;
+  }
+
+  fc::simulator fc;
+  fc.load_rom(argv[1]);
+  fc.set_headless(true, 0);
+  fc.play_movie(&movie);
+  const auto start = std::chrono::steady_clock::now();
+  while (!fc.movie_finished()) fc.run_frame();
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  const uint64_t hash = fc.digest().checksum();
+  fc.free_rom();
+
+  printf("frames: %llu  time: %.3fs (%.0f fps)\n",
+    (unsigned long long)movie.size(), seconds, movie.size() / seconds);
+  printf("final hash: %016llx\n", (unsigned long long)hash);
+  if (!expected) return 0;
+  const bool match = strtoull(expected, NULL, 16) == hash;
+  printf("%s\n", match? "match": "MISMATCH");
+  return match? 0: 1;
+}
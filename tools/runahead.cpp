@@ -0,0 +1,119 @@
+// 提前运行（run-ahead）的校验与基准
+// 编译：g++ -O2 -o runahead tools/runahead.cpp $(ls *.cpp | grep -v main.cpp) -lpthread
+// 用法：runahead <rom> <帧数> [最大提前帧数] [录像]
+//   对 0 到最大提前帧数逐一运行：
+//     - 真实状态的最终哈希应与不提前运行时一致
+//     - 输入不变的区间内，第 n 个显示帧应等于不提前运行时的第 n+K 帧
+//   并报告每个显示帧的主机用时与相当于实时的倍数
+//   最后校验快照不带宿主程序的设置：保存快照后开启性能统计与覆盖率，
+//   恢复快照后这些设置应仍然生效，且状态与不做这些更改时一致
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "../include/simulator.h"
+
+// NTSC 每帧的时长（毫秒）
+static const double FRAME_MS = 1000.0 / 60.0988;
+
+// 第 a 到 b 帧的输入是否相同
+static bool same_input(const fc::nes_movie* movie, uint64_t a, uint64_t b) {
+  if (!movie) return true;
+  for (uint64_t i=a; i<=b; i++) {
+    if (i >= movie->size() || a >= movie->size()) return a >= movie->size() && i >= movie->size();
+    if (movie->get(i, 0) != movie->get(a, 0) || movie->get(i, 1) != movie->get(a, 1)) return false;
+  }
+  return true;
+}
+
+// 在保存与恢复快照之间更改宿主程序的设置，返回是否保持了设置且状态不变
+static bool check_host_state(const char* rom, uint64_t frames) {
+  const uint64_t warmup = frames / 2;
+  fc::simulator reference, fc;
+  reference.load_rom(rom);
+  fc.load_rom(rom);
+  for (uint64_t i=0; i<frames; i++) reference.run_frame();
+  for (uint64_t i=0; i<warmup; i++) fc.run_frame();
+  std::vector<uint8_t> state(fc.snapshot_size());
+  fc.save_state(state.data());
+
+  std::vector<uint64_t> hits(65536), cycles(65536);
+  std::vector<uint8_t> map(1 << 16);
+  fc::nes_cpu& cpu = fc.get_cpu();
+  cpu.set_profile(hits.data(), cycles.data());
+  cpu.set_coverage(map.data(), map.size());
+  const int mode = cpu.get_trace_mode();
+  fc.run_frame();
+  fc.load_state(state.data());
+  const bool kept = mode && cpu.get_trace_mode() == mode;
+  // 只统计恢复之后的执行
+  memset(hits.data(), 0, hits.size() * sizeof(uint64_t));
+  for (uint64_t i=warmup; i<frames; i++) fc.run_frame();
+
+  uint64_t executed = 0;
+  for (size_t i=0; i<hits.size(); i++) executed += hits[i];
+  const bool same = fc.digest().same_state(reference.digest());
+  printf("host state after load_state: settings %s, profiled %llu instructions, state %s\n",
+    kept? "kept": "LOST", (unsigned long long)executed, same? "ok": "DIFFERS");
+  fc.free_rom();
+  reference.free_rom();
+  return kept && executed && same;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    fprintf(stderr, "用法：%s <rom> <帧数> [最大提前帧数] [录像]\n", argv[0]);
+    return 2;
+  }
+  const uint64_t frames = strtoull(argv[2], NULL, 10);
+  const uint32_t max_ahead = argc > 3? atoi(argv[3]): 4;
+  fc::nes_movie movie_data;
+  const fc::nes_movie* movie = NULL;
+  if (argc > 4) {
+    const size_t n = strlen(argv[4]);
+    const bool fm2 = n > 4 && !strcmp(argv[4] + n - 4, ".fm2");
+    if (!(fm2? movie_data.load_fm2(argv[4]): movie_data.load(argv[4]))) {
+      fprintf(stderr, "无法读取录像 %s\n", argv[4]);
+      return 2;
+    }
+    movie = &movie_data;
+  }
+
+  std::vector<uint64_t> reference;
+  uint64_t reference_hash = 0;
+  bool ok = true;
+  printf("%3s  %10s  %10s  %10s  %9s  %s\n", "K", "ms/frame", "max ms", "snap ms", "realtime", "check");
+  for (uint32_t k=0; k<=max_ahead; k++) {
+    fc::simulator fc;
+    fc.load_rom(argv[1]);
+    fc.set_run_ahead(k);
+    if (movie) fc.play_movie(movie);
+
+    uint64_t compared = 0, mismatched = 0;
+    for (uint64_t i=0; i<frames; i++) {
+      fc.run_frame();
+      const uint64_t video = fc::nes_hash64(fc.get_framebuffer(), 240 * 256);
+      if (k == 0) reference.push_back(video);
+      else if (i + k < frames && same_input(movie, i, i + k)) {
+        ++compared;
+        mismatched += reference[i + k] != video;
+      }
+    }
+    const uint64_t hash = fc.digest().checksum();
+    if (k == 0) reference_hash = hash;
+
+    fc::nes_frame_stats& stats = fc.get_frame_stats();
+    const double ms = stats.ms_per_frame();
+    char check[96];
+    if (k == 0) snprintf(check, sizeof(check), "reference %016llx", (unsigned long long)hash);
+    else snprintf(check, sizeof(check), "state %s, frames %llu/%llu ahead",
+      hash == reference_hash? "ok": "DIFFERS",
+      (unsigned long long)(compared - mismatched), (unsigned long long)compared);
+    printf("%3u  %10.3f  %10.3f  %10.4f  %8.1fx  %s\n", k, ms, stats.max_seconds * 1000,
+      stats.snapshot_seconds * 1000 / frames, ms > 0? FRAME_MS / ms: 0, check);
+    ok = ok && hash == reference_hash && !mismatched;
+    fc.free_rom();
+  }
+  ok = check_host_state(argv[1], frames) && ok;
+  return ok? 0: 1;
+}
@@ -0,0 +1,108 @@
+// 解释器插桩：指令日志、按地址的性能剖析、分支覆盖率，以及各插桩的开销
+// 编译：g++ -O2 -o trace tools/trace.cpp $(ls *.cpp | grep -v main.cpp) -lpthread
+// 用法：
+//   trace <rom> <帧数> log [输出文件]       输出与 nestest.log 相近格式的指令日志（默认标准输出）
+//   trace <rom> <帧数> profile [条数]       列出执行周期数最多的指令
+//   trace <rom> <帧数> coverage            统计覆盖到的分支（bank, 地址, 是否成立）
+//   trace <rom> <帧数> bench               比较各种插桩组合的帧率
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "../include/simulator.h"
+
+// 覆盖率计数表的长度
+#define SFC_TRACE_MAP_SIZE (64 * 1024)
+
+static double run_frames(fc::simulator& fc, uint64_t frames) {
+  const auto start = std::chrono::steady_clock::now();
+  for (uint64_t i=0; i<frames; i++) fc.run_frame();
+  return frames / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int profile(fc::simulator& fc, uint64_t frames, size_t top) {
+  std::vector<uint64_t> hits(0x10000), cycles(0x10000);
+  fc.get_cpu().set_profile(hits.data(), cycles.data());
+  run_frames(fc, frames);
+  fc.get_cpu().set_profile(NULL, NULL);
+
+  std::vector<uint16_t> order;
+  uint64_t total = 0;
+  for (uint32_t pc=0; pc<0x10000; pc++) {
+    total += cycles[pc];
+    if (hits[pc]) order.push_back(pc);
+  }
+  std::sort(order.begin(), order.end(), [&](uint16_t a, uint16_t b) { return cycles[a] > cycles[b]; });
+  printf("%-22s %12s %12s %7s\n", "instruction", "count", "cycles", "share");
+  for (size_t i=0; i<order.size() && i<top; i++) {
+    char buf[OP_BUF_LEN];
+    uint8_t bytes[3];
+    fc.get_cpu().disassemble_op(order[i], buf, bytes);
+    buf[OP_BUF_LEN - 2] = 0;
+    printf("%-22s %12llu %12llu %6.2f%%\n", buf, (unsigned long long)hits[order[i]],
+      (unsigned long long)cycles[order[i]], total? 100.0 * cycles[order[i]] / total: 0);
+  }
+  return 0;
+}
+
+static int coverage(fc::simulator& fc, uint64_t frames) {
+  static uint8_t map[SFC_TRACE_MAP_SIZE];
+  fc.get_cpu().set_coverage(map, SFC_TRACE_MAP_SIZE);
+  run_frames(fc, frames);
+  fc.get_cpu().set_coverage(NULL, 0);
+  uint32_t edges = 0;
+  for (size_t i=0; i<SFC_TRACE_MAP_SIZE; i++) edges += map[i] != 0;
+  printf("branch edges covered: %u\n", edges);
+  return 0;
+}
+
+static int bench(fc::simulator& fc, uint64_t frames) {
+  static uint8_t map[SFC_TRACE_MAP_SIZE];
+  std::vector<uint64_t> hits(0x10000), cycles(0x10000);
+  FILE* null = fopen("/dev/null", "w");
+  fc::nes_cpu& cpu = fc.get_cpu();
+  static const char* names[] = { "none", "log", "profile", "coverage", "profile+coverage", "none" };
+  for (int mode=0; mode<6; mode++) {
+    cpu.set_trace_log(mode == 1? null: NULL);
+    cpu.set_profile(mode == 2 || mode == 4? hits.data(): NULL, cycles.data());
+    cpu.set_coverage(mode == 3 || mode == 4? map: NULL, SFC_TRACE_MAP_SIZE);
+    const double fps = run_frames(fc, mode == 1? frames / 10 + 1: frames);
+    printf("%-18s %10.1f fps\n", names[mode], fps);
+  }
+  fclose(null);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 4) {
+    fprintf(stderr, "用法：%s <rom> <帧数> log [输出文件] | profile [条数] | coverage | bench\n", argv[0]);
+    return 2;
+  }
+  const uint64_t frames = strtoull(argv[2], NULL, 10);
+  const char* mode = argv[3];
+
+  fc::simulator fc;
+  fc.load_rom(argv[1]);
+  fc.set_headless(true, 0);
+  int result = 2;
+  if (!strcmp(mode, "log")) {
+    FILE* out = argc > 4? fopen(argv[4], "w"): stdout;
+    if (!out) {
+      fprintf(stderr, "无法创建 %s\n", argv[4]);
+    } else {
+      fc.get_cpu().set_trace_log(out);
+      run_frames(fc, frames);
+      fc.get_cpu().set_trace_log(NULL);
+      if (out != stdout) fclose(out);
+      result = 0;
+    }
+  }
+  else if (!strcmp(mode, "profile")) result = profile(fc, frames, argc > 4? atoi(argv[4]): 20);
+  else if (!strcmp(mode, "coverage")) result = coverage(fc, frames);
+  else if (!strcmp(mode, "bench")) result = bench(fc, frames);
+  else fprintf(stderr, "未知的模式 %s\n", mode);
+  fc.free_rom();
+  return result;
+}
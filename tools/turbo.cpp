@@ -0,0 +1,48 @@
+// 无画面加速运行 ROM，分别报告完整渲染帧与跳过像素输出帧的帧率
+// 编译：g++ -O2 -o turbo tools/turbo.cpp $(ls *.cpp | grep -v main.cpp)
+// 用法：turbo <rom> <帧数> [每隔多少帧完整渲染一次]
+//   之后每帧都完整渲染，分别在生成与不生成声音时再运行一遍，报告声音输出占每帧用时的比例
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include "../include/simulator.h"
+
+// 每帧都完整渲染地运行 frames 帧，audio 为 true 时同时生成声音，返回每帧的毫秒数
+static double frame_ms(const char* rom, uint64_t frames, bool audio) {
+  fc::simulator fc;
+  fc.load_rom(rom);
+  // 无画面模式不生成声音，渲染间隔为 1 时每帧都输出像素，与正常模式只差声音
+  if (!audio) fc.set_headless(true, 1);
+  for (uint64_t i=0; i<frames; i++) fc.run_frame();
+  const double ms = fc.get_frame_stats().ms_per_frame();
+  fc.free_rom();
+  return ms;
+}
+
+int main(int argc, char const *argv[])
+{
+  if (argc < 3) {
+    assert(!"用法：turbo <rom> <帧数> [渲染间隔]");
+    return 1;
+  }
+  const uint64_t frames = strtoull(argv[2], NULL, 10);
+  const uint32_t interval = argc > 3? atoi(argv[3]): 0;
+
+  fc::simulator fc;
+  fc.load_rom(argv[1]);
+  fc.set_headless(true, interval);
+  for (uint64_t i=0; i<frames; i++) fc.run_frame();
+
+  fc::nes_frame_stats& stats = fc.get_frame_stats();
+  printf("rendered: %llu frames, %.1f fps\n",
+    (unsigned long long)stats.rendered_frames, stats.rendered_fps());
+  printf("skipped:  %llu frames, %.1f fps\n",
+    (unsigned long long)stats.skipped_frames, stats.skipped_fps());
+  fc.free_rom();
+
+  const double quiet = frame_ms(argv[1], frames, false);
+  const double audible = frame_ms(argv[1], frames, true);
+  printf("audio:    %.4f ms/frame with sound, %.4f without, sound output %.1f%% of frame time\n",
+    audible, quiet, audible > 0? (audible - quiet) / audible * 100: 0);
+  return 0;
+}